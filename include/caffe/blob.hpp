@@ -90,7 +90,9 @@ class Blob {
   Dtype* mutable_cpu_acum_diff();
   void Update();
   void FromProto(const BlobProto& proto);
-  void ToProto(BlobProto* proto, bool write_diff = false) const;
+  /// @brief Writes the blob to proto, the data at the precision data_type.
+  void ToProto(BlobProto* proto, bool write_diff = false,
+      BlobProto_DataType data_type = BlobProto_DataType_FP32) const;
 
   /// @brief Compute the sum of absolute values (L1 norm) of the data.
   Dtype asum_data() const;
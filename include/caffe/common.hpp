@@ -4,6 +4,7 @@
 #include <boost/shared_ptr.hpp>
 #include <gflags/gflags.h>
 #include <glog/logging.h>
+#include <stdint.h>
 
 #include <cmath>
 #include <fstream>  // NOLINT(readability/streams)
@@ -89,6 +90,10 @@ class Caffe {
     explicit RNG(const RNG&);
     RNG& operator=(const RNG&);
     void* generator();
+    // The counter-based stream of util/philox.hpp behind the bulk
+    // caffe_rng_* fills, keyed by the same seed as the boost generator.
+    // Copies the key and returns the first of blocks fresh counters.
+    uint64_t ReserveBlocks(const uint64_t blocks, uint32_t key[2]);
    private:
     class Generator;
     shared_ptr<Generator> generator_;
@@ -130,6 +135,11 @@ class Caffe {
   // added for allowing bigger batch size
   inline static void set_accumulate(bool acum) { Get().accumulate_ = acum; }
   inline static bool accumulate() { return Get().accumulate_; }
+  // While set, GetFiller hands out fillers that leave their blobs as they
+  // are; Net sets it around the setup of layers whose weights it is about to
+  // load.
+  inline static void set_skip_fill(bool skip) { Get().skip_fill_ = skip; }
+  inline static bool skip_fill() { return Get().skip_fill_; }
 
  protected:
 #ifndef CPU_ONLY
@@ -139,6 +149,7 @@ class Caffe {
   shared_ptr<RNG> random_generator_;
   // added for allowing bigger batch size
   bool accumulate_;
+  bool skip_fill_;
   Brew mode_;
   Phase phase_;
   static shared_ptr<Caffe> singleton_;
@@ -12,6 +12,7 @@
 #include "caffe/loss_layers.hpp"
 #include "caffe/neuron_layers.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/quantization.hpp"
 
 namespace caffe {
 
@@ -106,8 +107,10 @@ namespace caffe {
 		Blob<Dtype> buffer_blob_;
 		// x_norm and x_std
 		Blob<Dtype> x_norm_, x_std_;
-		// Due to buffer_blob_ and x_norm, this implementation is memory-consuming
-		// May use for-loop instead
+		// Due to buffer_blob_ and x_norm, the GPU implementation is
+		// memory-consuming. The CPU one uses fused per-channel loops, keeps only
+		// x_mean_ and x_std_ for backward, and touches x_norm_ only in place.
+		Blob<Dtype> x_mean_;
 
 		// x_sum_multiplier is used to carry out sum using BLAS
 		Blob<Dtype> spatial_sum_multiplier_, batch_sum_multiplier_;
@@ -298,21 +301,48 @@ namespace caffe {
 	* @brief Also known as a "fully-connected" layer, computes an inner product
 	*        with a set of learned weights, and (optionally) adds biases.
 	*
+	* In the TEST phase, weights that are mostly zero (at most
+	* inner_product_param.sparse_density of them nonzero) are multiplied in
+	* CSR form on the CPU.
+	*
+	* With three bottoms the input is a sparse batch in CSR form: the nonzero
+	* values, their feature indices, and the M + 1 row pointers, as the tops
+	* of HDF5DataLayer and MemoryDataLayer (the indices and pointers are
+	* stored as Dtype). The K = inner_product_param.sparse_input_dim features
+	* then own the rows of the @f$ (K \times 1 \times 1 \times N) @f$
+	* weights, the transpose of the dense layout; Forward adds the rows of
+	* the active features, and Backward writes only those rows of the weight
+	* diff (see Layer::sparse_param_rows). There is no gradient for the
+	* inputs, and the layer runs on the CPU in either mode.
+	*
 	* TODO(dox): thorough documentation for Forward, Backward, and proto params.
 	*/
 	template <typename Dtype>
 	class InnerProductLayer : public Layer<Dtype> {
 	public:
 		explicit InnerProductLayer(const LayerParameter& param)
-			: Layer<Dtype>(param) {}
+			: Layer<Dtype>(param), sparse_input_(false),
+			weight_diff_sparse_(false) {}
 		virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
 			vector<Blob<Dtype>*>* top);
 
 		virtual inline LayerParameter_LayerType type() const {
 			return LayerParameter_LayerType_INNER_PRODUCT;
 		}
-		virtual inline int ExactNumBottomBlobs() const { return 1; }
+		virtual inline int MinBottomBlobs() const { return 1; }
+		virtual inline int MaxBottomBlobs() const { return 3; }
 		virtual inline int ExactNumTopBlobs() const { return 1; }
+		virtual inline bool AllowForceBackward(const int bottom_index) const {
+			return !sparse_input_;
+		}
+
+		virtual const vector<int>* sparse_param_rows(const int param_id) const;
+		virtual void DensifyParamDiff(const int param_id);
+
+		// Rebuilds the CSR copy of the weights if blobs_[0] may have been
+		// written since last time, and returns whether the forward pass
+		// should multiply with it.
+		bool UseSparseWeights();
 
 	protected:
 		virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
@@ -324,11 +354,63 @@ namespace caffe {
 		virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
 			const vector<bool>& propagate_down, vector<Blob<Dtype>*>* bottom);
 
+		// The passes over a sparse input batch.
+		void ForwardSparseInput(const vector<Blob<Dtype>*>& bottom,
+			vector<Blob<Dtype>*>* top);
+		void BackwardSparseInput(const vector<Blob<Dtype>*>& top,
+			const vector<bool>& propagate_down, vector<Blob<Dtype>*>* bottom);
+
 		int M_;
 		int K_;
 		int N_;
 		bool bias_term_;
 		Blob<Dtype> bias_multiplier_;
+		shared_ptr<SyncedMemory> sparse_from_;
+		unsigned int sparse_version_;
+		bool use_sparse_;
+		vector<int> sparse_row_ptr_;
+		vector<int> sparse_col_index_;
+		vector<Dtype> sparse_values_;
+		bool sparse_input_;
+		// The features of the last sparse input batch, increasing, and
+		// whether the weight diff holds only their rows.
+		vector<int> active_features_;
+		bool weight_diff_sparse_;
+	};
+
+	/**
+	* @brief InnerProductLayer computing its CPU forward pass with 8-bit
+	*        inputs and weights (see Int8Engine), for inference. The weights
+	*        get one scale per output, the input the calibrated scale of the
+	*        quantization_param. The backward pass and GPU mode run the float
+	*        InnerProductLayer, and refuse a fused ReLU.
+	*/
+	template <typename Dtype>
+	class Int8InnerProductLayer : public InnerProductLayer<Dtype> {
+	public:
+		explicit Int8InnerProductLayer(const LayerParameter& param)
+			: InnerProductLayer<Dtype>(param) {}
+		virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+			vector<Blob<Dtype>*>* top);
+
+		virtual inline int ExactNumBottomBlobs() const { return 1; }
+
+	protected:
+		virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+			vector<Blob<Dtype>*>* top);
+		virtual void Forward_gpu(const vector<Blob<Dtype>*>& bottom,
+			vector<Blob<Dtype>*>* top);
+		virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
+			const vector<bool>& propagate_down, vector<Blob<Dtype>*>* bottom);
+
+		// Requantizes the weights of engine_ if blobs_[0] may have been written
+		// since last time.
+		void QuantizeWeights();
+
+		shared_ptr<Int8Engine<Dtype> > engine_;
+		// The weights engine_ was quantized from, and their version then.
+		shared_ptr<SyncedMemory> quantized_from_;
+		unsigned int quantized_version_;
 	};
 
 
@@ -363,7 +445,7 @@ namespace caffe {
 
 		Blob<Dtype> mean_, variance_, temp_;
 
-		/// sum_multiplier is used to carry out sum using BLAS
+		/// sum_multiplier is used to carry out sum using BLAS on the GPU
 		Blob<Dtype> sum_multiplier_;
 	};
 
@@ -427,8 +509,6 @@ namespace caffe {
 		virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
 			const vector<bool>& propagate_down, vector<Blob<Dtype>*>* bottom);
 
-		/// sum_multiplier is used to carry out sum using BLAS
-		Blob<Dtype> sum_multiplier_;
 		/// scale is an intermediate Blob to hold temporary results.
 		Blob<Dtype> scale_;
 	};
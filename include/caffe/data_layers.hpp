@@ -156,6 +156,13 @@ class DummyDataLayer : public Layer<Dtype> {
 /**
  * @brief Provides data to the Net from HDF5 files.
  *
+ * With four tops the data is sparse: each file holds the compressed sparse
+ * row datasets "data" (the nonzero values), "indices" (their feature
+ * indices) and "indptr" (the rows + 1 offsets of the rows into them), as
+ * written from a scipy.sparse.csr_matrix, next to "label". Each batch is
+ * then output as its values, indices and batch_size + 1 row pointers, for
+ * InnerProductLayer; the value and index tops grow to the largest batch.
+ *
  * TODO(dox): thorough documentation for Forward and proto params.
  */
 template <typename Dtype>
@@ -171,7 +178,8 @@ class HDF5DataLayer : public Layer<Dtype> {
     return LayerParameter_LayerType_HDF5_DATA;
   }
   virtual inline int ExactNumBottomBlobs() const { return 0; }
-  virtual inline int ExactNumTopBlobs() const { return 2; }
+  virtual inline int MinTopBlobs() const { return 2; }
+  virtual inline int MaxTopBlobs() const { return 4; }
 
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
@@ -183,6 +191,8 @@ class HDF5DataLayer : public Layer<Dtype> {
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, vector<Blob<Dtype>*>* bottom) {}
   virtual void LoadHDF5FileData(const char* filename);
+  // Gathers the next batch of sparse rows; see the class description.
+  void ForwardSparse(vector<Blob<Dtype>*>* top);
 
   std::vector<std::string> hdf_filenames_;
   unsigned int num_files_;
@@ -190,6 +200,10 @@ class HDF5DataLayer : public Layer<Dtype> {
   hsize_t current_row_;
   Blob<Dtype> data_blob_;
   Blob<Dtype> label_blob_;
+  bool sparse_;
+  // The feature indices and row offsets of the current sparse file.
+  vector<int> indices_;
+  vector<int> indptr_;
 };
 
 /**
@@ -263,6 +277,11 @@ class ImageDataLayer : public BasePrefetchingDataLayer<Dtype> {
 /**
  * @brief Provides data to the Net from memory.
  *
+ * With four tops the data is sparse, given by ResetSparse in compressed
+ * sparse row form over channels * height * width features, and each batch
+ * is output as its values, indices and batch_size + 1 row pointers, for
+ * InnerProductLayer.
+ *
  * TODO(dox): thorough documentation for Forward and proto params.
  */
 template <typename Dtype>
@@ -277,13 +296,20 @@ class MemoryDataLayer : public BaseDataLayer<Dtype> {
     return LayerParameter_LayerType_MEMORY_DATA;
   }
   virtual inline int ExactNumBottomBlobs() const { return 0; }
-  virtual inline int ExactNumTopBlobs() const { return 2; }
+  virtual inline int MinTopBlobs() const { return 2; }
+  virtual inline int MaxTopBlobs() const { return 4; }
 
   virtual void AddDatumVector(const vector<Datum>& datum_vector);
 
   // Reset should accept const pointers, but can't, because the memory
   //  will be given to Blob, which is mutable
   void Reset(Dtype* data, Dtype* label, int n);
+  // Sets n sparse rows: row i has the values values[indptr[i]] up to
+  // values[indptr[i + 1]] at the features indices[indptr[i]] and on. The
+  // values and indices are copied batch by batch; like Reset, the arrays
+  // must outlive their use.
+  void ResetSparse(const Dtype* values, const int* indices,
+      const int* indptr, Dtype* label, int n);
 
   int batch_size() { return batch_size_; }
 
@@ -299,6 +325,10 @@ class MemoryDataLayer : public BaseDataLayer<Dtype> {
   Blob<Dtype> added_data_;
   Blob<Dtype> added_label_;
   bool has_new_data_;
+  bool sparse_;
+  const Dtype* values_;
+  const int* indices_;
+  const int* indptr_;
 };
 
 template <typename Dtype>
@@ -239,6 +239,15 @@ public:
 	}
 };
 
+/// @brief Leaves the Blob untouched, for weights that are about to be loaded.
+template <typename Dtype>
+class SkipFiller : public Filler<Dtype> {
+ public:
+  explicit SkipFiller(const FillerParameter& param)
+      : Filler<Dtype>(param) {}
+  virtual void Fill(Blob<Dtype>* blob) {}
+};
+
 /**
  * @brief Get a specific filler from the specification given in FillerParameter.
  *
@@ -248,7 +257,9 @@ public:
 template <typename Dtype>
 Filler<Dtype>* GetFiller(const FillerParameter& param) {
   const std::string& type = param.type();
-  if (type == "constant") {
+  if (Caffe::skip_fill()) {
+    return new SkipFiller<Dtype>(param);
+  } else if (type == "constant") {
     return new ConstantFiller<Dtype>(param);
   } else if (type == "gaussian") {
     return new GaussianFiller<Dtype>(param);
@@ -138,7 +138,8 @@ class Layer {
   /**
    * @brief Writes the layer parameter to a protocol buffer
    */
-  virtual void ToProto(LayerParameter* param, bool write_diff = false);
+  virtual void ToProto(LayerParameter* param, bool write_diff = false,
+      BlobProto_DataType data_type = BlobProto_DataType_FP32);
 
   /**
    * @brief Returns the scalar loss associated with a top blob at a given index.
@@ -272,6 +273,26 @@ class Layer {
     param_propagate_down_[param_id] = value;
   }
 
+  /**
+   * @brief Returns the rows (indices along num) of the diff of parameter
+   *        param_id that the last Backward wrote, or NULL if it wrote all
+   *        of them.
+   *
+   * Layers whose parameter gradients touch a few rows of a large blob, such
+   * as an output layer over 100k classes, leave the other rows of the diff
+   * stale instead of zeroing them. The Net and SGDSolver then update only
+   * the listed rows; anything else must call DensifyParamDiff first.
+   */
+  virtual const vector<int>* sparse_param_rows(const int param_id) const {
+    return NULL;
+  }
+  /**
+   * @brief Zeroes the stale rows of the diff of parameter param_id, making
+   *        it the full gradient; sparse_param_rows then returns NULL until
+   *        the next Backward.
+   */
+  virtual void DensifyParamDiff(const int param_id) {}
+
 
  protected:
   /** The protobuf that stores the layer parameters */
@@ -440,12 +461,13 @@ inline void Layer<Dtype>::Backward(const vector<Blob<Dtype>*>& top,
 
 // Serialize LayerParameter to protocol buffer
 template <typename Dtype>
-void Layer<Dtype>::ToProto(LayerParameter* param, bool write_diff) {
+void Layer<Dtype>::ToProto(LayerParameter* param, bool write_diff,
+    BlobProto_DataType data_type) {
   param->Clear();
   param->CopyFrom(layer_param_);
   param->clear_blobs();
   for (int i = 0; i < blobs_.size(); ++i) {
-    blobs_[i]->ToProto(param->add_blobs(), write_diff);
+    blobs_[i]->ToProto(param->add_blobs(), write_diff, data_type);
   }
 }
 
@@ -211,6 +211,95 @@ class EuclideanLossLayer : public LossLayer<Dtype> {
   Blob<Dtype> diff_;
 };
 
+/**
+ * @brief A two-level softmax loss over many classes, owning its output
+ *        weights: @f$ p(l|x) = p(c(l)|x) \, p(l|c(l),x) @f$, where the
+ *        clusters @f$ c(.) @f$ come from cluster_file.
+ *
+ * Each example pays for a softmax over the K clusters and one over the
+ * classes of its label's cluster, about @f$ K + V / K @f$ dot products
+ * instead of the @f$ V @f$ of InnerProductLayer + SoftmaxWithLossLayer.
+ * Backward writes only the class rows of the clusters in the batch; see
+ * Layer::sparse_param_rows.
+ *
+ * The parameters are the cluster weights @f$ (K \times 1 \times 1 \times D)
+ * @f$, the class weights @f$ (V \times 1 \times 1 \times D) @f$ and, with
+ * bias_term, the matching @f$ (K \times 1 \times 1 \times 1) @f$ and
+ * @f$ (V \times 1 \times 1 \times 1) @f$ biases.
+ *
+ * @param bottom input Blob vector (length 2)
+ *   -# @f$ (N \times C \times H \times W) @f$
+ *      the features @f$ x @f$, with @f$ D = CHW @f$
+ *   -# @f$ (N \times 1 \times 1 \times 1) @f$
+ *      the labels @f$ l_n \in [0, 1, ..., V - 1] @f$
+ * @param top output Blob vector (length 1 or 2)
+ *   -# @f$ (1 \times 1 \times 1 \times 1) @f$
+ *      the loss @f$ E = \frac{-1}{N} \sum_n \log p(l_n|x_n) @f$
+ *   -# @f$ (N \times V \times 1 \times 1) @f$ (optional)
+ *      @f$ p(.|x_n) @f$ over all classes, which costs as much as a full
+ *      softmax
+ */
+template <typename Dtype>
+class HierarchicalSoftmaxLossLayer : public LossLayer<Dtype> {
+ public:
+  explicit HierarchicalSoftmaxLossLayer(const LayerParameter& param)
+      : LossLayer<Dtype>(param) {}
+  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      vector<Blob<Dtype>*>* top);
+
+  virtual inline LayerParameter_LayerType type() const {
+    return LayerParameter_LayerType_HIERARCHICAL_SOFTMAX_LOSS;
+  }
+  virtual inline int ExactNumTopBlobs() const { return -1; }
+  virtual inline int MinTopBlobs() const { return 1; }
+  virtual inline int MaxTopBlobs() const { return 2; }
+
+  virtual const vector<int>* sparse_param_rows(const int param_id) const;
+  virtual void DensifyParamDiff(const int param_id);
+
+ protected:
+  /// @copydoc HierarchicalSoftmaxLossLayer
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      vector<Blob<Dtype>*>* top);
+  virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, vector<Blob<Dtype>*>* bottom);
+
+  /// Copies the weight (and bias) rows of cluster c's classes into
+  /// class_weight_ (and class_bias_).
+  void GatherClassRows(const int c);
+  /// Writes p(.|x) for all classes to prob.
+  void FullProbabilities(const Dtype* bottom_data, const int num, Dtype* prob);
+
+  int num_output_;
+  int num_clusters_;
+  int dim_;
+  bool bias_term_;
+  /// The classes grouped by cluster: cluster c owns
+  /// members_[cluster_begin_[c], cluster_begin_[c + 1]).
+  vector<int> members_;
+  vector<int> cluster_begin_;
+  vector<int> cluster_of_;
+  /// Each class's index within its cluster.
+  vector<int> slot_of_;
+  /// The batch reordered by cluster, in groups of one cluster each.
+  vector<int> order_;
+  vector<int> group_begin_;
+  vector<int> group_cluster_;
+  /// The cluster softmax (N x K) and, group after group, the class softmax.
+  vector<Dtype> cluster_prob_;
+  vector<Dtype> class_prob_;
+  /// Scratch for the gathered rows of one group and their gradients.
+  vector<Dtype> class_weight_;
+  vector<Dtype> class_bias_;
+  vector<Dtype> group_data_;
+  vector<Dtype> group_diff_;
+  /// Sorted class rows written by the last Backward.
+  vector<int> class_rows_;
+  /// Whether the class weight and class bias diffs have stale rows.
+  bool class_weight_sparse_;
+  bool class_bias_sparse_;
+};
+
 /**
  * @brief Computes the hinge loss for a one-of-many classification task.
  *
@@ -472,6 +561,91 @@ class MultinomialLogisticLossLayer : public LossLayer<Dtype> {
       const vector<bool>& propagate_down, vector<Blob<Dtype>*>* bottom);
 };
 
+/**
+ * @brief A softmax loss over many classes, owning its output weights, that
+ *        trains against the true class and a few sampled ones.
+ *
+ * Each training batch draws num_sampled classes @f$ s_j @f$ from the
+ * proposal @f$ Q @f$ and every example takes its softmax over its label and
+ * the samples, with logits @f$ w_k^\top x + b_k - \log(S Q(k)) @f$
+ * (Jean et al., 2015). Only the rows of the labels and samples are computed,
+ * and Backward writes only those rows; see Layer::sparse_param_rows. In the
+ * TEST phase the loss is the exact full softmax loss.
+ *
+ * The parameters are the weights @f$ (V \times 1 \times 1 \times D) @f$
+ * and, with bias_term, the biases @f$ (V \times 1 \times 1 \times 1) @f$.
+ *
+ * @param bottom input Blob vector (length 2)
+ *   -# @f$ (N \times C \times H \times W) @f$
+ *      the features @f$ x @f$, with @f$ D = CHW @f$
+ *   -# @f$ (N \times 1 \times 1 \times 1) @f$
+ *      the labels @f$ l_n \in [0, 1, ..., V - 1] @f$
+ * @param top output Blob vector (length 1 or 2)
+ *   -# @f$ (1 \times 1 \times 1 \times 1) @f$
+ *      the sampled loss when training, the full softmax loss when testing
+ *   -# @f$ (N \times V \times 1 \times 1) @f$ (optional)
+ *      the full softmax probabilities, computed in either phase
+ */
+template <typename Dtype>
+class SampledSoftmaxLossLayer : public LossLayer<Dtype> {
+ public:
+  explicit SampledSoftmaxLossLayer(const LayerParameter& param)
+      : LossLayer<Dtype>(param) {}
+  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      vector<Blob<Dtype>*>* top);
+
+  virtual inline LayerParameter_LayerType type() const {
+    return LayerParameter_LayerType_SAMPLED_SOFTMAX_LOSS;
+  }
+  virtual inline int ExactNumTopBlobs() const { return -1; }
+  virtual inline int MinTopBlobs() const { return 1; }
+  virtual inline int MaxTopBlobs() const { return 2; }
+
+  virtual const vector<int>* sparse_param_rows(const int param_id) const;
+  virtual void DensifyParamDiff(const int param_id);
+
+  /// @brief The proposal probability of class k.
+  double ProposalProbability(const int k) const;
+  /// @brief The class whose proposal quantile holds u in [0, 1].
+  int ProposalClass(const double u) const;
+
+ protected:
+  /// @copydoc SampledSoftmaxLossLayer
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      vector<Blob<Dtype>*>* top);
+  /// Backpropagates the sampled loss; only valid after a TRAIN Forward.
+  virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, vector<Blob<Dtype>*>* bottom);
+
+  /// Writes the full softmax to prob and returns the summed loss.
+  Dtype FullSoftmax(const Dtype* bottom_data, const Dtype* label,
+      const int num, Dtype* prob);
+
+  int num_output_;
+  int dim_;
+  int num_sampled_;
+  bool bias_term_;
+  /// The UNIGRAM proposal and its running sum.
+  vector<double> proposal_;
+  vector<double> proposal_cdf_;
+  /// The sorted distinct labels and samples of the last TRAIN batch, whose
+  /// weight rows are gathered into candidate_weight_ (M x D).
+  vector<int> candidates_;
+  vector<Dtype> candidate_weight_;
+  vector<Dtype> candidate_bias_;
+  /// The candidate logits (N x M) and the unscaled loss gradient w.r.t.
+  /// them.
+  vector<Dtype> scores_;
+  vector<Dtype> candidate_diff_;
+  /// Full softmax scratch when there is no probability top.
+  vector<Dtype> prob_;
+  /// Whether the last Forward was a sampled one.
+  bool sampled_;
+  /// Whether the weight and bias diffs have stale rows.
+  bool weight_sparse_;
+  bool bias_sparse_;
+};
+
 /**
  * @brief Computes the cross-entropy (logistic) loss @f$
  *          E = \frac{-1}{n} \sum\limits_{n=1}^N \left[
@@ -567,9 +741,6 @@ class SigmoidCrossEntropyLossLayer : public LossLayer<Dtype> {
   vector<Blob<Dtype>*> sigmoid_top_vec_;
 };
 
-// Forward declare SoftmaxLayer for use in SoftmaxWithLossLayer.
-template <typename Dtype> class SoftmaxLayer;
-
 /**
  * @brief Computes the multinomial logistic loss for a one-of-many
  *        classification task, passing real-valued predictions through a
@@ -602,8 +773,7 @@ template <typename Dtype>
 class SoftmaxWithLossLayer : public LossLayer<Dtype> {
  public:
   explicit SoftmaxWithLossLayer(const LayerParameter& param)
-      : LossLayer<Dtype>(param),
-        softmax_layer_(new SoftmaxLayer<Dtype>(param)) {}
+      : LossLayer<Dtype>(param) {}
   virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       vector<Blob<Dtype>*>* top);
 
@@ -656,14 +826,8 @@ class SoftmaxWithLossLayer : public LossLayer<Dtype> {
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, vector<Blob<Dtype>*>* bottom);
 
-  /// The internal SoftmaxLayer used to map predictions to a distribution.
-  shared_ptr<SoftmaxLayer<Dtype> > softmax_layer_;
-  /// prob stores the output probability predictions from the SoftmaxLayer.
-  Blob<Dtype> prob_;
-  /// bottom vector holder used in call to the underlying SoftmaxLayer::Forward
-  vector<Blob<Dtype>*> softmax_bottom_vec_;
-  /// top vector holder used in call to the underlying SoftmaxLayer::Forward
-  vector<Blob<Dtype>*> softmax_top_vec_;
+  /// The log of the softmax denominator for each (image, position).
+  Blob<Dtype> log_sum_exp_;
 };
 
 }  // namespace caffe
@@ -11,6 +11,7 @@
 #include "caffe/common.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/mapped_weights.hpp"
 
 namespace caffe {
 
@@ -25,10 +26,24 @@ class Net {
  public:
   explicit Net(const NetParameter& param);
   explicit Net(const string& param_file);
+  /**
+   * @brief Initializes from param and copies the layers of the trained net,
+   *        whose fillers are skipped as their values would be overwritten.
+   *        A trained_file in the mapped weights format is mapped instead of
+   *        parsed; see MapTrainedLayersFrom.
+   */
+  Net(const NetParameter& param, const NetParameter& trained);
+  Net(const NetParameter& param, const MappedWeights& trained);
+  Net(const string& param_file, const string& trained_file);
   virtual ~Net() {}
 
-  /// @brief Initialize a network with a NetParameter.
-  void Init(const NetParameter& param);
+  /**
+   * @brief Initialize a network with a NetParameter. The layers named in
+   *        skip_fill are set up without running their fillers; the caller
+   *        copies their trained blobs in with CopyTrainedLayersFrom.
+   */
+  void Init(const NetParameter& param,
+      const set<string>& skip_fill = set<string>());
 
   /**
    * @brief Run Forward with the input Blob%s already fed separately.
@@ -36,6 +51,13 @@ class Net {
    * You can get the input blobs using input_blobs().
    */
   const vector<Blob<Dtype>*>& ForwardPrefilled(Dtype* loss = NULL);
+  /**
+   * @brief Runs ForwardPrefilled iterations times and returns the mean
+   *        forward time in ms. means gets the mean of every output value and
+   *        names the name of its blob, as the tools compare nets with them.
+   */
+  double MeanOutputs(const int iterations, vector<string>* names,
+      vector<double>* means);
 
   /**
    * The From and To variants of Forward and Backward operate on the
@@ -75,7 +97,18 @@ class Net {
   }
 
   /// @brief Updates the network weights based on the diff values computed.
+  ///        Parameters with sparse rows (see Layer::sparse_param_rows) are
+  ///        updated in those rows only.
   void Update();
+  /// @brief Zeroes the stale rows of every sparse parameter diff.
+  void DensifyParamDiffs();
+  /**
+   * @brief Zeroes the smallest-magnitude sparsity fraction of the weights
+   *        (the first parameter) of layer layer_name, and keeps them at zero
+   *        from then on: Update masks the parameter after every step.
+   *        Pruning again recomputes the mask from the current weights.
+   */
+  void PruneLayer(const string& layer_name, const float sparsity);
 
   // added for allowing large batch size
   void AccumulateDiff();
@@ -92,9 +125,22 @@ class Net {
    *        another Net.
    */
   void CopyTrainedLayersFrom(const NetParameter& param);
+  void CopyTrainedLayersFrom(const MappedWeights& weights);
+  /// Reads either a binary NetParameter or a mapped weights file.
   void CopyTrainedLayersFrom(const string trained_filename);
-  /// @brief Writes the net to a proto.
-  void ToProto(NetParameter* param, bool write_diff = false);
+  /**
+   * @brief Maps a mapped weights file and points the parameter blobs at its
+   *        pages, so that loading reads and copies nothing up front. The net
+   *        keeps the mappings alive. Only float blobs can share the pages;
+   *        double nets copy.
+   */
+  void MapTrainedLayersFrom(const string& trained_filename);
+  /// @brief Writes the net to a proto, the weights at the precision
+  ///        data_type.
+  void ToProto(NetParameter* param, bool write_diff = false,
+      BlobProto_DataType data_type = BlobProto_DataType_FP32);
+  /// @brief Writes the parameter blobs to a mapped weights file.
+  void ToMappedWeights(const string& filename);
 
   /// @brief returns the network name.
   inline const string& name() { return name_; }
@@ -127,6 +173,18 @@ class Net {
   /// @brief returns the parameter learning rate multipliers
   inline vector<float>& params_lr() { return params_lr_; }
   inline vector<float>& params_weight_decay() { return params_weight_decay_; }
+  /// @brief returns the rows the last Backward wrote of parameter param_id's
+  ///        diff, or NULL if they all hold the gradient
+  inline const vector<int>* param_sparse_rows(const int param_id) const {
+    const pair<int, int>& index = param_layer_indices_[param_id];
+    return layers_[index.first]->sparse_param_rows(index.second);
+  }
+  /// @brief returns the pruning mask of parameter param_id (1 where the
+  ///        weight is kept), or NULL if it was never pruned
+  inline const Blob<Dtype>* param_mask(const int param_id) const {
+    return param_id < param_masks_.size() ?
+        param_masks_[param_id].get() : NULL;
+  }
   const map<string, int>& param_names_index() { return param_names_index_; }
   /// @brief Input and output blob numbers
   inline int num_inputs() { return net_input_blobs_.size(); }
@@ -154,6 +212,8 @@ class Net {
       const string& layer_name);
 
  protected:
+  // Copies, or with share maps, the layers weights has blobs for.
+  void LoadMappedLayers(const MappedWeights& weights, const bool share);
   // Helpers for Init.
   /// @brief Append a new input or top blob to the net.
   void AppendTop(const NetParameter& param, const int layer_id,
@@ -173,6 +233,8 @@ class Net {
   void BackwardDebugInfo(const int layer_id);
   /// @brief Helper for displaying debug info in Update.
   void UpdateDebugInfo(const int param_id);
+  /// @brief Zeroes the pruned weights of parameter param_id again.
+  void ApplyParamMask(const int param_id);
 
   /// @brief Get misc parameters, e.g. the LR multiplier and weight decay.
   void GetLearningRateAndWeightDecay();
@@ -215,10 +277,14 @@ class Net {
   vector<float> params_lr_;
   /// the weight decay multipliers
   vector<float> params_weight_decay_;
+  /// the masks of the pruned parameters, NULL for the others
+  vector<shared_ptr<Blob<Dtype> > > param_masks_;
   /// The bytes of memory used by this net
   size_t memory_used_;
   /// Whether to compute and display debug info for the net.
   bool debug_info_;
+  /// The mapped weights files the parameters may point into.
+  vector<shared_ptr<MappedWeights> > mapped_weights_;
 
   DISABLE_COPY_AND_ASSIGN(Net);
 };
@@ -203,6 +203,8 @@ class DropoutLayer : public NeuronLayer<Dtype> {
 
   /// when divided by UINT_MAX, the randomly generated values @f$u\sim U(0,1)@f$
   Blob<unsigned int> rand_vec_;
+  /// the CPU keep mask, packed one bit per input
+  Blob<unsigned int> mask_bits_;
   /// the probability @f$ p @f$ of dropping any input
   Dtype threshold_;
   /// the scale for undropped inputs at train time @f$ 1 / (1 - p) @f$
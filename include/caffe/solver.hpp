@@ -38,6 +38,9 @@ class Solver {
   virtual void PreSolve() {}
   // Get the update value for the current iteration.
   virtual void ComputeUpdateValue() = 0;
+  // Whether ComputeUpdateValue honors Net::param_sparse_rows. If not, the
+  // sparse parameter diffs are densified before it runs.
+  virtual bool SparseUpdates() const { return false; }
   // The Solver::Snapshot function implements the basic snapshotting utility
   // that stores the learned net. You should implement the SnapshotSolverState()
   // function that produces a SolverState protocol buffer that needs to be
@@ -53,6 +56,11 @@ class Solver {
   void Restore(const char* resume_file);
   virtual void RestoreSolverState(const SolverState& state) = 0;
   void DisplayOutputBlobs(const int net_id);
+  // The sparsity the pruning_param schedule asks for at iteration iter.
+  float PruningSparsity(const int iter) const;
+  // Prunes the layers of the pruning_param at the iterations it schedules,
+  // and at start_iter to rebuild the masks after a restore.
+  void Prune(const int start_iter);
 
   SolverParameter param_;
   int iter_;
@@ -81,6 +89,11 @@ class SGDSolver : public Solver<Dtype> {
   virtual void PreSolve();
   Dtype GetLearningRate();
   virtual void ComputeUpdateValue();
+  virtual bool SparseUpdates() const { return true; }
+  // Applies weight decay and momentum to the given rows of a parameter only,
+  // leaving the history of the other rows as it was (lazy momentum).
+  void ComputeSparseUpdateValue(const int param_id, const vector<int>& rows,
+      const Dtype local_rate, const Dtype local_decay, const Dtype momentum);
   virtual void SnapshotSolverState(SolverState * state);
   virtual void RestoreSolverState(const SolverState& state);
   // history maintains the historical momentum data.
@@ -102,6 +115,7 @@ class NesterovSolver : public SGDSolver<Dtype> {
 
  protected:
   virtual void ComputeUpdateValue();
+  virtual bool SparseUpdates() const { return false; }
 
   DISABLE_COPY_AND_ASSIGN(NesterovSolver);
 };
@@ -116,6 +130,7 @@ class AdaGradSolver : public SGDSolver<Dtype> {
 
  protected:
   virtual void ComputeUpdateValue();
+  virtual bool SparseUpdates() const { return false; }
   void constructor_sanity_check() {
     CHECK_EQ(0, this->param_.momentum())
         << "Momentum cannot be used with AdaGrad.";
@@ -135,6 +150,7 @@ class AdaDeltaSolver : public SGDSolver<Dtype> {
  protected:
   virtual void PreSolve();
   virtual void ComputeUpdateValue();
+  virtual bool SparseUpdates() const { return false; }
   void constructor_sanity_check() {
 	// comment out by Denny for allowing learning rate
     //CHECK_EQ(0, this->param_.base_lr())
@@ -156,6 +172,7 @@ public:
 
 protected:
 	virtual void ComputeUpdateValue();
+	virtual bool SparseUpdates() const { return false; }
 
 	DISABLE_COPY_AND_ASSIGN(RMSpropSolver);
 };
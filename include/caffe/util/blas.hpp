@@ -0,0 +1,82 @@
+#ifndef CAFFE_UTIL_BLAS_H_
+#define CAFFE_UTIL_BLAS_H_
+
+#include <stdint.h>
+#include <string>
+
+#include "glog/logging.h"
+
+#include "caffe/util/mkl_alternate.hpp"
+
+namespace caffe {
+
+// Where caffe_cpu_gemm and caffe_cpu_gemv send the calls that are not
+// rerouted by shape (see caffe_cpu_gemm).
+enum BlasBackend {
+  // The CBLAS library Caffe is linked against (MKL, OpenBLAS, ATLAS, ...).
+  BLAS_CBLAS,
+  // Caffe's own cache-blocked kernels, for machines or shapes where the
+  // linked library does poorly.
+  BLAS_BUILTIN
+};
+
+// The backend starts as the one named by the CAFFE_BLAS environment
+// variable, or cblas if that is unset.
+void caffe_set_blas_backend(const BlasBackend backend);
+BlasBackend caffe_blas_backend();
+// Parses "cblas" or "builtin"; the name of the linked library ("mkl",
+// "atlas" or "openblas") is accepted for cblas.
+BlasBackend caffe_blas_backend_from_name(const std::string& name);
+// Human readable name, naming the linked library for cblas.
+const char* caffe_blas_backend_name(const BlasBackend backend);
+
+// GEMMs with at most this many multiply-adds run caffe_cpu_gemm_small
+// rather than paying a library call's setup cost. Above it, OpenBLAS's own
+// small-matrix paths win.
+const int kSmallGemmVolume = 8 * 8 * 8;
+
+// Per-routine call counters, collected only while profiling is on.
+enum BlasRoutine {
+  BLAS_GEMM,          // GEMMs handed to the backend
+  BLAS_GEMM_AS_GEMV,  // GEMMs with M or N equal to 1
+  BLAS_GEMM_SMALL,    // GEMMs run by caffe_cpu_gemm_small
+  BLAS_GEMV,          // direct caffe_cpu_gemv calls
+  BLAS_NUM_ROUTINES
+};
+
+struct BlasStats {
+  uint64_t calls;
+  double flops;
+  double seconds;
+};
+
+void caffe_blas_set_profiling(const bool profiling);
+bool caffe_blas_profiling();
+BlasStats caffe_blas_stats(const BlasRoutine routine);
+void caffe_blas_reset_stats();
+// Logs calls, time and GFlop/s per routine.
+void caffe_blas_log_stats();
+
+// The kernels behind the builtin backend, with the caffe_cpu_gemm and
+// caffe_cpu_gemv interfaces.
+template <typename Dtype>
+void caffe_cpu_gemm_builtin(const CBLAS_TRANSPOSE TransA,
+    const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
+    const Dtype alpha, const Dtype* A, const Dtype* B, const Dtype beta,
+    Dtype* C);
+
+template <typename Dtype>
+void caffe_cpu_gemv_builtin(const CBLAS_TRANSPOSE TransA, const int M,
+    const int N, const Dtype alpha, const Dtype* A, const Dtype* x,
+    const Dtype beta, Dtype* y);
+
+// Unpacked, register-blocked GEMM for tiny shapes.
+template <typename Dtype>
+void caffe_cpu_gemm_small(const CBLAS_TRANSPOSE TransA,
+    const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
+    const Dtype alpha, const Dtype* A, const Dtype* B, const Dtype beta,
+    Dtype* C);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_BLAS_H_
@@ -0,0 +1,67 @@
+#ifndef CAFFE_UTIL_FAST_MATH_H_
+#define CAFFE_UTIL_FAST_MATH_H_
+
+#include <stdint.h>
+
+namespace caffe {
+
+// Single precision kernels behind caffe_exp, caffe_log, caffe_tanh,
+// caffe_sigmoid and caffe_log1p_exp unless strict math is on (see
+// math_functions.hpp). Each element is a branch-free run of polynomial and
+// bit operations, four lanes at a time with SSE2 where the target has it.
+// Maximum errors against double precision libm, measured over every third
+// float:
+//
+//   fast_exp        1 ulp for normal results; +inf above 88.72
+//   fast_log        1 ulp; -inf at 0, NaN below
+//   fast_tanh       1.5 ulp
+//   fast_sigmoid    2.5 ulp
+//   fast_log1p_exp  2 ulp
+//
+// NaN inputs give NaN.
+void fast_exp(const int n, const float* a, float* y);
+void fast_log(const int n, const float* a, float* y);
+void fast_tanh(const int n, const float* a, float* y);
+void fast_sigmoid(const int n, const float* a, float* y);
+// log(1 + exp(x)), the softplus / BNLL function.
+void fast_log1p_exp(const int n, const float* a, float* y);
+
+// Bit-packed masks, bit i of a mask being bit i % 32 of word i / 32.
+//
+// fast_threshold_bits sets bit i when random lane i is below threshold. The
+// lanes are the lane_bits (8 or 16) wide slices of words, lowest first, so
+// each mask word reads lane_bits words; the bits past n in the last mask
+// word are cleared.
+void fast_threshold_bits(const int n, const unsigned int* words,
+    const int lane_bits, const unsigned int threshold, unsigned int* bits);
+// y[i] = scale * x[i] where bit i of the mask is set and 0 elsewhere.
+void fast_mask_scale(const int n, const unsigned int* bits, const float scale,
+    const float* x, float* y);
+void fast_mask_scale(const int n, const unsigned int* bits,
+    const double scale, const double* x, double* y);
+
+// Conversions to and from the 16-bit storage formats, IEEE half precision
+// and bfloat16 (the top half of a float). Narrowing rounds to nearest even;
+// past the half range it gives inf, and NaN stays a quiet NaN. Widening is
+// exact.
+void fast_float_to_half(const int n, const float* x, uint16_t* y);
+void fast_half_to_float(const int n, const uint16_t* x, float* y);
+void fast_float_to_bfloat16(const int n, const float* x, uint16_t* y);
+void fast_bfloat16_to_float(const int n, const uint16_t* x, float* y);
+
+// 8-bit quantized inference. fast_quantize_u8 sets
+// q[i] = round(x[i] * inv_scale) + zero_point, saturated to [0, 255], ties to
+// even (NaN gives 0). fast_gemm_u8s8s32 computes
+// C[m * ldc + n] = sum_k A[m * K + k] * B[n * K + k] for the M x K unsigned
+// and N x K signed matrices, both rows along K; the int32 sums cannot
+// overflow for K up to 2^31 / (255 * 128), about 65000.
+void fast_quantize_u8(const int n, const float* x, const float inv_scale,
+    const int zero_point, uint8_t* q);
+void fast_quantize_u8(const int n, const double* x, const double inv_scale,
+    const int zero_point, uint8_t* q);
+void fast_gemm_u8s8s32(const int M, const int N, const int K,
+    const uint8_t* A, const int8_t* B, int32_t* C, const int ldc);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_FAST_MATH_H_
@@ -0,0 +1,36 @@
+#ifndef CAFFE_UTIL_FFT_H_
+#define CAFFE_UTIL_FFT_H_
+
+#include <complex>
+#include <vector>
+
+namespace caffe {
+
+/**
+ * @brief Radix-2 complex FFT of a fixed power-of-two size, with the bit
+ *        reversal permutation and twiddle factors computed once.
+ *
+ * Transforms are unnormalized in both directions, so an inverse following a
+ * forward transform scales by n (or n * n in 2-D).
+ */
+template <typename Dtype>
+class FFTPlan {
+ public:
+  explicit FFTPlan(const int n);
+
+  inline int size() const { return n_; }
+  // In-place transform of the n elements x[0], x[stride], x[2 * stride], ...
+  void Transform(std::complex<Dtype>* x, const int stride,
+      const bool inverse) const;
+  // In-place transform of a row-major n x n array.
+  void Transform2D(std::complex<Dtype>* x, const bool inverse) const;
+
+ private:
+  int n_;
+  std::vector<int> bit_reverse_;
+  std::vector<std::complex<Dtype> > twiddles_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_FFT_H_
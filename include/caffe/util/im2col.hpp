@@ -1,8 +1,23 @@
 #ifndef _CAFFE_UTIL_IM2COL_HPP_
 #define _CAFFE_UTIL_IM2COL_HPP_
 
+#include <stdint.h>
+
+#include <algorithm>
+
 namespace caffe {
 
+// Range [*begin, *end) of outputs o, along one spatial axis, whose input
+// o * stride - pad + offset lies inside [0, size).
+inline void im2col_valid_range(const int size, const int size_out,
+    const int pad, const int stride, const int offset, int* begin, int* end) {
+  const int lead = pad - offset;
+  *begin = lead > 0 ? (lead + stride - 1) / stride : 0;
+  const int last = size - 1 + lead;
+  *end = last < 0 ? 0 : std::min(size_out, last / stride + 1);
+  *begin = std::min(*begin, *end);
+}
+
 template <typename Dtype>
 void im2col_cpu(const Dtype* data_im, const int channels,
     const int height, const int width, const int kernel_h, const int kernel_w,
@@ -15,6 +30,29 @@ void col2im_cpu(const Dtype* data_col, const int channels,
     const int pad_h, const int pad_w, const int stride_h,
     const int stride_w, Dtype* data_im);
 
+// Variants of im2col_cpu/col2im_cpu for a column matrix whose rows are
+// col_ld elements apart rather than height_col * width_col. This lets the
+// columns of several images sit side by side in one wide matrix.
+template <typename Dtype>
+void im2col_cpu_ld(const Dtype* data_im, const int channels,
+    const int height, const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h,
+    const int stride_w, Dtype* data_col, const int col_ld);
+
+template <typename Dtype>
+void col2im_cpu_ld(const Dtype* data_col, const int col_ld,
+    const int channels, const int height, const int width, const int patch_h,
+    const int patch_w, const int pad_h, const int pad_w, const int stride_h,
+    const int stride_w, Dtype* data_im);
+
+// Unrolls the patches of a quantized image into the rows of a
+// (height_col * width_col) x (channels * kernel_h * kernel_w) matrix, the
+// transpose of the im2col_cpu matrix, with pad_value outside the image.
+void im2row_cpu(const uint8_t* data_im, const int channels,
+    const int height, const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h,
+    const int stride_w, const uint8_t pad_value, uint8_t* data_row);
+
 template <typename Dtype>
 void im2col_gpu(const Dtype* data_im, const int channels,
     const int height, const int width, const int kernel_h, const int kernel_w,
@@ -5,8 +5,10 @@
 #include <io.h>
 #include <process.h>
 
+#include <fstream>  // NOLINT(readability/streams)
 #include <string>
 
+#include "boost/filesystem.hpp"
 #include "google/protobuf/message.h"
 #include "hdf5/hdf5.h"
 #include "hdf5/hdf5_hl.h"
@@ -25,30 +27,23 @@ namespace caffe {
 
 using ::google::protobuf::Message;
 
+// A fresh path in the system temporary directory, for test scratch files.
+inline string MakeTempPath() {
+  return (boost::filesystem::temp_directory_path() /
+      boost::filesystem::unique_path("caffe_test.%%%%-%%%%-%%%%-%%%%"))
+      .string();
+}
+
 inline void MakeTempFilename(string* temp_filename) {
-  //temp_filename->clear();
-  //*temp_filename = "/tmp/caffe_test.XXXXXX";
-  //char* temp_filename_cstr = new char[temp_filename->size()];
-  //// NOLINT_NEXT_LINE(runtime/printf)
-  //strcpy(temp_filename_cstr, temp_filename->c_str());
-  //int fd = mkstemp(temp_filename_cstr);
-  //CHECK_GE(fd, 0) << "Failed to open a temporary file at: " << *temp_filename;
-  //close(fd);
-  //*temp_filename = temp_filename_cstr;
-  //delete temp_filename_cstr;
+  *temp_filename = MakeTempPath();
+  std::ofstream file(temp_filename->c_str());
+  CHECK(file) << "Failed to open a temporary file at: " << *temp_filename;
 }
 
 inline void MakeTempDir(string* temp_dirname) {
-  //temp_dirname->clear();
-  //*temp_dirname = "/tmp/caffe_test.XXXXXX";
-  //char* temp_dirname_cstr = new char[temp_dirname->size()];
-  //// NOLINT_NEXT_LINE(runtime/printf)
-  //strcpy(temp_dirname_cstr, temp_dirname->c_str());
-  //char* mkdtemp_result = mkdtemp(temp_dirname_cstr);
-  //CHECK(mkdtemp_result != NULL)
-  //    << "Failed to create a temporary directory at: " << *temp_dirname;
-  //*temp_dirname = temp_dirname_cstr;
-  //delete temp_dirname_cstr;
+  *temp_dirname = MakeTempPath();
+  CHECK(boost::filesystem::create_directory(*temp_dirname))
+      << "Failed to create a temporary directory at: " << *temp_dirname;
 }
 
 bool ReadProtoFromTextFile(const char* filename, Message* proto);
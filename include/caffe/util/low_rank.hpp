@@ -0,0 +1,24 @@
+#ifndef CAFFE_UTIL_LOW_RANK_H_
+#define CAFFE_UTIL_LOW_RANK_H_
+
+#include <vector>
+
+namespace caffe {
+
+// Approximates the M x N row-major matrix A by U * V, U being M x rank and V
+// rank x N, from the leading rank singular triplets of A: U = U_r S^1/2 and
+// V = S^1/2 V_r', so that both factors carry the same scale. The triplets
+// come from a randomized range finder with power iterations (Halko et al.,
+// "Finding Structure with Randomness", 2011), which only needs products with
+// A and the decomposition of a small (rank + oversampling)^2 matrix; it is
+// exact when A has rank at most that. The random test matrix is drawn from
+// the Caffe RNG. If singular_values is not NULL, it receives the rank
+// leading singular values, largest first.
+template <typename Dtype>
+void caffe_cpu_low_rank(const int M, const int N, const Dtype* A,
+    const int rank, Dtype* U, Dtype* V,
+    std::vector<Dtype>* singular_values = NULL);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_LOW_RANK_H_
@@ -0,0 +1,81 @@
+#ifndef CAFFE_UTIL_MAPPED_WEIGHTS_H_
+#define CAFFE_UTIL_MAPPED_WEIGHTS_H_
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+// A weights container that is memory-mapped instead of parsed. The file is
+//
+//   char     magic[8]      "CAFFEMAP"
+//   uint32   version       1
+//   uint32   num_entries
+//   num_entries index entries, each
+//     uint32   name_size, followed by name_size bytes of layer name
+//     uint32   blob_id
+//     int32    num, channels, height, width
+//     uint64   offset of the data from the start of the file
+//   the float data of every entry, each at a multiple of kAlignment
+//
+// in little-endian byte order. Nothing is read until a blob asks for it, and
+// the pages are mapped copy-on-write, so float blobs may point straight at
+// them with set_cpu_data: any write goes to a private copy of the page.
+class MappedWeights {
+ public:
+  struct Entry {
+    string layer;
+    int blob_id;
+    int num;
+    int channels;
+    int height;
+    int width;
+    const float* data;
+    int count() const { return num * channels * height * width; }
+  };
+
+  static const int kAlignment = 64;
+
+  explicit MappedWeights(const string& filename);
+  ~MappedWeights();
+
+  // Whether filename starts with the magic of this format.
+  static bool IsMappedWeightsFile(const string& filename);
+
+  const vector<Entry>& entries() const { return entries_; }
+  // The entries of layer by blob id, empty if the file does not have it.
+  vector<const Entry*> layer_entries(const string& layer) const;
+
+  // Rebuilds a NetParameter holding only the layer names and blobs, which is
+  // all CopyTrainedLayersFrom reads.
+  void ToProto(NetParameter* param) const;
+
+ private:
+  void* addr_;
+  size_t size_;
+#ifdef _WIN32
+  void* file_;
+  void* mapping_;
+#endif
+  vector<Entry> entries_;
+
+  DISABLE_COPY_AND_ASSIGN(MappedWeights);
+};
+
+// Writes the blobs of the layers of param in the mapped weights format.
+void WriteMappedWeights(const NetParameter& param, const string& filename);
+// Writes blobs[i], the parameter blobs of layer_names[i], in the mapped
+// weights format; double data is rounded to float as in Blob::ToProto.
+template <typename Dtype>
+void WriteMappedWeights(const vector<string>& layer_names,
+    const vector<vector<Blob<Dtype>*> >& blobs, const string& filename);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_MAPPED_WEIGHTS_H_
@@ -3,17 +3,42 @@
 
 #include <stdint.h>
 #include <cmath>  // for std::fabs and std::signbit
+#include <cstring>  // for memset
 
 #include "glog/logging.h"
 
 #include "caffe/common.hpp"
+#include "caffe/util/blas.hpp"
 #include "caffe/util/device_alternate.hpp"
 #include "caffe/util/mkl_alternate.hpp"
 
 namespace caffe {
 
+// The elementwise and reduction primitives below split ranges of more than
+// this many elements across the OpenMP threads.
+const int kDefaultParallelGrain = 16384;
+
+void caffe_set_parallel_grain(const int grain);
+int caffe_parallel_grain();
+// With deterministic reductions, caffe_cpu_dot, caffe_cpu_strided_dot and
+// caffe_cpu_asum sum fixed chunks of parallel_grain elements in a fixed
+// order, so their results do not depend on the thread count or the BLAS
+// library. Off by default.
+void caffe_set_deterministic_reductions(const bool deterministic);
+bool caffe_deterministic_reductions();
+// With strict math, caffe_exp, caffe_log, caffe_tanh, caffe_sigmoid and
+// caffe_log1p_exp call libm per element, and the TanH, BNLL and
+// SigmoidCrossEntropyLoss layers run their original formulas, so that these
+// elementwise results match earlier builds bit for bit (reordered sums, as in
+// softmax, still differ in the last bits). Off by default, when float inputs
+// take the polynomial kernels of fast_math.hpp. Double always uses libm.
+void caffe_set_strict_math(const bool strict);
+bool caffe_strict_math();
+
 // Decaf gemm provides a simpler interface to the gemm functions, with the
-// limitation that the data has to be contiguous in memory.
+// limitation that the data has to be contiguous in memory. GEMMs with M or N
+// equal to 1 run as GEMVs and tiny ones as caffe_cpu_gemm_small; the rest go
+// to the selected BLAS backend (see blas.hpp).
 template <typename Dtype>
 void caffe_cpu_gemm(const CBLAS_TRANSPOSE TransA,
     const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
@@ -25,6 +50,24 @@ void caffe_cpu_gemv(const CBLAS_TRANSPOSE TransA, const int M, const int N,
     const Dtype alpha, const Dtype* A, const Dtype* x, const Dtype beta,
     Dtype* y);
 
+// C = A * B' for quantized inference, A being M x K unsigned bytes and B
+// N x K signed ones (see fast_gemm_u8s8s32).
+void caffe_cpu_gemm_u8s8s32(const int M, const int N, const int K,
+    const uint8_t* A, const int8_t* B, int32_t* C);
+
+// C = A * B' for a dense M x K matrix A and an N x K matrix B in compressed
+// sparse row form: the nonzeros of row n of B are values[row_ptr[n]] to
+// values[row_ptr[n + 1] - 1], in the columns col_index[...].
+template <typename Dtype>
+void caffe_cpu_csr_gemm(const int M, const int N, const int K,
+    const Dtype* A, const int* row_ptr, const int* col_index,
+    const Dtype* values, Dtype* C);
+
+// q = round(x / scale) + zero_point, saturated to [0, 255].
+template <typename Dtype>
+void caffe_cpu_quantize_u8(const int n, const Dtype* x, const Dtype scale,
+    const int zero_point, uint8_t* q);
+
 template <typename Dtype>
 void caffe_axpy(const int N, const Dtype alpha, const Dtype* X,
     Dtype* Y);
@@ -67,8 +110,15 @@ void caffe_div(const int N, const Dtype* a, const Dtype* b, Dtype* y);
 template <typename Dtype>
 void caffe_powx(const int n, const Dtype* a, const Dtype b, Dtype* y);
 
+// A single draw from the boost generator of Caffe::RNG, which also drives
+// shuffle(). The bulk caffe_rng_* fills below draw from its counter-based
+// stream instead (see util/philox.hpp), in parallel for large n, with
+// values that depend only on the seed and the sequence of calls.
 unsigned int caffe_rng_rand();
 
+// n raw 32-bit words of the counter-based stream.
+void caffe_rng_bits(const int n, unsigned int* r);
+
 template <typename Dtype>
 Dtype caffe_nextafter(const Dtype b);
 
@@ -85,9 +135,36 @@ void caffe_rng_bernoulli(const int n, const Dtype p, int* r);
 template <typename Dtype>
 void caffe_rng_bernoulli(const int n, const Dtype p, unsigned int* r);
 
+// Draws n Bernoulli(p) bits packed 32 to a word into r, which holds
+// (n + 31) / 32 words (see fast_math.hpp for the layout). Each bit compares
+// one 8-bit slice of a random word with p when p is a multiple of 1/256, and
+// a 16-bit slice otherwise, so p is rounded to the nearest 1/65536.
+template <typename Dtype>
+void caffe_rng_bernoulli_bits(const int n, const Dtype p, unsigned int* r);
+
+// y[i] = alpha * x[i] where bit i of the packed mask is set and 0 elsewhere;
+// y may be x.
+template <typename Dtype>
+void caffe_cpu_mask_scale(const int n, const unsigned int* mask,
+    const Dtype alpha, const Dtype* x, Dtype* y);
+
 template <typename Dtype>
 void caffe_exp(const int n, const Dtype* a, Dtype* y);
 
+template <typename Dtype>
+void caffe_log(const int n, const Dtype* a, Dtype* y);
+
+template <typename Dtype>
+void caffe_tanh(const int n, const Dtype* a, Dtype* y);
+
+// y = 1 / (1 + exp(-a))
+template <typename Dtype>
+void caffe_sigmoid(const int n, const Dtype* a, Dtype* y);
+
+// y = log(1 + exp(a)), computed without overflow for large a.
+template <typename Dtype>
+void caffe_log1p_exp(const int n, const Dtype* a, Dtype* y);
+
 template <typename Dtype>
 void caffe_abs(const int n, const Dtype* a, Dtype* y);
 
@@ -147,6 +224,62 @@ DEFINE_CAFFE_CPU_UNARY_FUNC(fabs, y[i] = std::fabs(x[i]));
 template <typename Dtype>
 void caffe_cpu_scale(const int n, const Dtype alpha, const Dtype *x, Dtype* y);
 
+// Strided reductions and broadcasts along the middle axis of x viewed as an
+// outer x dim x inner array, x[(o * dim + d) * inner + i]; the reduced
+// arrays are outer x inner. E.g. for an N x C x H x W blob, (N, C, H * W)
+// reduces over channels and (N * C, H * W, 1) over space; a per-channel
+// bias is added to one image with (C, H * W, 1). These replace GEMVs and
+// GEMMs against all-ones multiplier blobs, and run in parallel over the
+// outer and inner indices.
+
+// y = alpha * sum_d x + beta * y
+template <typename Dtype>
+void caffe_cpu_axis_sum(const int outer, const int dim, const int inner,
+    const Dtype alpha, const Dtype* x, const Dtype beta, Dtype* y);
+
+// y = max_d x
+template <typename Dtype>
+void caffe_cpu_axis_max(const int outer, const int dim, const int inner,
+    const Dtype* x, Dtype* y);
+
+// y = sum_d a * b
+template <typename Dtype>
+void caffe_cpu_axis_dot(const int outer, const int dim, const int inner,
+    const Dtype* a, const Dtype* b, Dtype* y);
+
+// The mean and the biased variance along d, in one pass.
+template <typename Dtype>
+void caffe_cpu_axis_mean_var(const int outer, const int dim, const int inner,
+    const Dtype* x, Dtype* mean, Dtype* variance);
+
+// x += alpha * v, broadcast along d.
+template <typename Dtype>
+void caffe_cpu_axis_add(const int outer, const int dim, const int inner,
+    const Dtype alpha, const Dtype* v, Dtype* x);
+
+// x *= v, broadcast along d.
+template <typename Dtype>
+void caffe_cpu_axis_mul(const int outer, const int dim, const int inner,
+    const Dtype* v, Dtype* x);
+
+// y = (x - mean) * scale, broadcast along d. A NULL scale only subtracts.
+// y may be x.
+template <typename Dtype>
+void caffe_cpu_axis_normalize(const int outer, const int dim,
+    const int inner, const Dtype* x, const Dtype* mean, const Dtype* scale,
+    Dtype* y);
+
+// Zeroes the rows of the num x dim matrix x that are not listed in rows,
+// which must be increasing.
+template <typename Dtype>
+void caffe_cpu_zero_other_rows(const int num, const int dim,
+    const vector<int>& rows, Dtype* x);
+
+// Replaces the n values of x with their softmax and returns the log of its
+// denominator, log(sum(exp(x))).
+template <typename Dtype>
+Dtype caffe_cpu_softmax(const int n, Dtype* x);
+
 #ifndef CPU_ONLY  // GPU
 
 // Decaf gpu gemm provides an interface that is almost the same as the cpu
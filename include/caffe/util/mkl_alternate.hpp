@@ -8,7 +8,11 @@
 #else  // If use MKL, simply include the MKL header
 
 extern "C" {
+#ifdef USE_ATLAS
+#include <cblas.h>
+#else
 #include <openblas/cblas.h>
+#endif
 }
 #include <math.h>
 
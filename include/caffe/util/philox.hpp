@@ -0,0 +1,21 @@
+#ifndef CAFFE_UTIL_PHILOX_H_
+#define CAFFE_UTIL_PHILOX_H_
+
+#include <stdint.h>
+
+namespace caffe {
+
+// Philox4x32-10, the counter-based generator of Salmon et al., "Parallel
+// Random Numbers: As Easy as 1, 2, 3" (SC 2011). Block i of the stream of a
+// key is ten rounds of multiply and xor applied to the counter (i, 0), so
+// any range of the stream can be generated on its own, on any thread, and
+// the result does not depend on how the range was split.
+//
+// Writes the 4 * blocks words of blocks first, first + 1, ... of the stream
+// of key to out, four blocks at a time with SSE2 where the target has it.
+void philox4x32(const uint64_t first, const int blocks, const uint32_t key[2],
+    uint32_t* out);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_PHILOX_H_
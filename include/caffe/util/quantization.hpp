@@ -0,0 +1,61 @@
+#ifndef CAFFE_UTIL_QUANTIZATION_H_
+#define CAFFE_UTIL_QUANTIZATION_H_
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/**
+ * @brief The 8-bit inference path shared by the INT8 engines of
+ *        InnerProduct and Convolution: y = x * W' + b with unsigned 8-bit
+ *        inputs, signed 8-bit weights and int32 sums.
+ *
+ * Each row of W gets its own symmetric scale, max |w| / 127. The input scale
+ * and zero point come from the QuantizationParameter, or from the range of
+ * each batch when input_scale is 0. The int32 sums are turned back into
+ * Dtype together with the bias and the optional ReLU, in one pass over the
+ * output.
+ */
+template <typename Dtype>
+class Int8Engine {
+ public:
+  explicit Int8Engine(const QuantizationParameter& param);
+
+  // Quantizes the num_output x dim weights.
+  void SetWeights(const int num_output, const int dim, const Dtype* weights);
+  inline bool has_weights() const { return !weights_.empty(); }
+  inline Dtype weight_scale(const int i) const { return weight_scales_[i]; }
+  // Bytes held by the quantized weights and the buffers of the last Forward.
+  uint64_t workspace_bytes() const;
+
+  // The scale and zero point of the n inputs x: the calibrated ones of the
+  // QuantizationParameter, or ones covering the range of x.
+  void InputQuantization(const int n, const Dtype* x, Dtype* scale,
+      int* zero_point) const;
+  // Computes the num_output values of rows inputs of dim values each, given
+  // as the rows x dim bytes q quantized with scale and zero_point. y is
+  // rows x num_output, or num_output x rows when y_trans. bias may be NULL.
+  void Forward(const int rows, const uint8_t* q, const Dtype scale,
+      const int zero_point, const Dtype* bias, const bool y_trans, Dtype* y);
+  // Quantizes the rows x dim inputs x and computes y, rows x num_output.
+  void Forward(const int rows, const Dtype* x, const Dtype* bias, Dtype* y);
+
+ private:
+  QuantizationParameter param_;
+  int num_output_;
+  int dim_;
+  std::vector<int8_t> weights_;
+  std::vector<Dtype> weight_scales_;
+  // The sum of each row of weights_, to take out the input zero point.
+  std::vector<int32_t> weight_sums_;
+  std::vector<uint8_t> input_;
+  std::vector<int32_t> sums_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_QUANTIZATION_H_
@@ -1,6 +1,7 @@
 #ifndef CAFFE_VISION_LAYERS_HPP_
 #define CAFFE_VISION_LAYERS_HPP_
 
+#include <complex>
 #include <string>
 #include <utility>
 #include <vector>
@@ -13,6 +14,7 @@
 #include "caffe/loss_layers.hpp"
 #include "caffe/neuron_layers.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/fft.hpp"
 
 namespace caffe {
 
@@ -37,6 +39,9 @@ class ConvolutionLayer : public Layer<Dtype> {
   virtual inline int MinTopBlobs() const { return 1; }
   virtual inline bool EqualNumBottomTopBlobs() const { return true; }
 
+  // Bytes of scratch memory the layer holds besides its blobs and tops.
+  virtual uint64_t workspace_bytes() const;
+
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       vector<Blob<Dtype>*>* top);
@@ -47,6 +52,20 @@ class ConvolutionLayer : public Layer<Dtype> {
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, vector<Blob<Dtype>*>* bottom);
 
+  // Sizes the column buffers for images_per_gemm images per CPU GEMM, and
+  // the GPU bias multiplier.
+  void ReshapeWorkspace(const int images_per_gemm);
+  // CPU paths that convolve images_per_gemm_ images per GEMM.
+  virtual void BatchedForward_cpu(const vector<Blob<Dtype>*>& bottom,
+      vector<Blob<Dtype>*>* top);
+  virtual void BatchedBackward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, vector<Blob<Dtype>*>* bottom);
+  // CPU sliding-window paths for depthwise and small-group convolution.
+  virtual void DirectForward_cpu(const vector<Blob<Dtype>*>& bottom,
+      vector<Blob<Dtype>*>* top);
+  virtual void DirectBackward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, vector<Blob<Dtype>*>* bottom);
+
   int kernel_h_, kernel_w_;
   int stride_h_, stride_w_;
   int num_;
@@ -57,9 +76,19 @@ class ConvolutionLayer : public Layer<Dtype> {
   int num_output_;
   int height_out_, width_out_;
   bool bias_term_;
+  // True for 1x1 kernels with unit stride and no padding, where the im2col
+  // matrix is the input itself and col_buffer_ is bypassed.
+  bool is_1x1_;
+  // True for grouped convolutions with so few channels per group that the
+  // CPU direct kernels beat per-group GEMMs.
+  bool use_direct_;
   // For the Caffe matrix multiplication convolution.
   int M_, K_, N_;
   Blob<Dtype> col_buffer_;
+  // Number of images unrolled into one wide column matrix on CPU, and the
+  // num_output_ x (images_per_gemm_ * N_) product of that matrix.
+  int images_per_gemm_;
+  Blob<Dtype> gemm_buffer_;
   Blob<Dtype> bias_multiplier_;
 };
 
@@ -93,6 +122,170 @@ class CuDNNConvolutionLayer : public ConvolutionLayer<Dtype> {
 };
 #endif
 
+/**
+ * @brief Winograd minimal-filtering implementation of ConvolutionLayer for
+ *        3x3, stride 1 kernels on CPU, using F(2x2,3x3) or F(4x4,3x3) tiles.
+ *        Other shapes, the backward pass and GPU mode fall back to the im2col
+ *        ConvolutionLayer.
+ */
+template <typename Dtype>
+class WinogradConvolutionLayer : public ConvolutionLayer<Dtype> {
+ public:
+  explicit WinogradConvolutionLayer(const LayerParameter& param)
+      : ConvolutionLayer<Dtype>(param) {}
+  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      vector<Blob<Dtype>*>* top);
+  virtual uint64_t workspace_bytes() const;
+
+ protected:
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      vector<Blob<Dtype>*>* top);
+
+  // Recomputes transformed_weights_ if blobs_[0] may have been written
+  // since last time.
+  void TransformWeights();
+
+  bool use_winograd_;
+  // Output tile size m and input tile size alpha = m + 2.
+  int tile_, alpha_;
+  int tiles_h_, tiles_w_;
+  // Per-position (alpha * alpha) GEMM operands: filters, input tiles of one
+  // image, and their products.
+  Blob<Dtype> transformed_weights_;
+  Blob<Dtype> transformed_input_;
+  Blob<Dtype> transformed_output_;
+  // The weights transformed_weights_ was computed from, and their version then.
+  shared_ptr<SyncedMemory> transformed_from_;
+  unsigned int transformed_version_;
+};
+
+/**
+ * @brief FFT implementation of ConvolutionLayer for large kernels on CPU.
+ *        The image is cut into tiles that are convolved in the frequency
+ *        domain and overlap-added. With the DEFAULT engine it runs only when
+ *        its cost model beats im2col; otherwise, and in GPU mode, it falls
+ *        back to ConvolutionLayer.
+ */
+template <typename Dtype>
+class FFTConvolutionLayer : public ConvolutionLayer<Dtype> {
+ public:
+  explicit FFTConvolutionLayer(const LayerParameter& param)
+      : ConvolutionLayer<Dtype>(param) {}
+  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      vector<Blob<Dtype>*>* top);
+  virtual uint64_t workspace_bytes() const;
+
+ protected:
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      vector<Blob<Dtype>*>* top);
+  virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, vector<Blob<Dtype>*>* bottom);
+
+  // Recomputes weight_spectra_ if blobs_[0] may have been written since
+  // last time.
+  void TransformWeights();
+
+  bool use_fft_;
+  // FFT size and the input (forward) or output (backward) tile it covers.
+  int fft_size_, tile_h_, tile_w_;
+  // Size of the stride 1 output the transforms produce before subsampling.
+  int height_full_, width_full_;
+  shared_ptr<FFTPlan<Dtype> > plan_;
+  // fft_size_ x fft_size_ spectra: per (output, input channel) filter, and
+  // per-tile workspaces for the input channels and outputs of one group.
+  vector<std::complex<Dtype> > weight_spectra_;
+  vector<std::complex<Dtype> > weight_diff_spectra_;
+  vector<std::complex<Dtype> > input_spectra_;
+  vector<std::complex<Dtype> > output_spectra_;
+  // Stride 1 output (data) and upsampled top diff (diff) of one image.
+  Blob<Dtype> full_buffer_;
+  // The weights weight_spectra_ was computed from, and their version then.
+  shared_ptr<SyncedMemory> transformed_from_;
+  unsigned int transformed_version_;
+};
+
+/**
+ * @brief ConvolutionLayer that benchmarks the applicable CPU algorithms for
+ *        its exact shape at setup (per-image or batched im2col, direct,
+ *        Winograd and FFT) and runs the fastest whose workspace fits in the
+ *        limit. Choices are cached on disk, keyed by shape and CPU model, so
+ *        later runs skip the benchmark. GPU mode runs ConvolutionLayer.
+ */
+template <typename Dtype>
+class AutotunedConvolutionLayer : public ConvolutionLayer<Dtype> {
+ public:
+  explicit AutotunedConvolutionLayer(const LayerParameter& param)
+      : ConvolutionLayer<Dtype>(param) {}
+  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      vector<Blob<Dtype>*>* top);
+  virtual uint64_t workspace_bytes() const;
+
+  // The algorithm chosen at setup: "im2col", "batched", "direct",
+  // "winograd2", "winograd4" or "fft".
+  inline const string& algorithm() const { return algorithm_; }
+
+ protected:
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      vector<Blob<Dtype>*>* top);
+  virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, vector<Blob<Dtype>*>* bottom);
+
+  // Configures this layer, or engine_layer_, to run the given algorithm.
+  // Returns false if the algorithm does not apply to this shape.
+  bool UseAlgorithm(const string& algorithm,
+      const vector<Blob<Dtype>*>& bottom, vector<Blob<Dtype>*>* top);
+  // Best time in ms of a forward (and, in TRAIN, backward) pass on scratch
+  // data with the current algorithm.
+  float TimeAlgorithm(const vector<Blob<Dtype>*>& bottom,
+      vector<Blob<Dtype>*>* top);
+  // Identifies the shape, precision, phase and machine in the cache.
+  string CacheKey() const;
+
+  string algorithm_;
+  uint64_t workspace_limit_;
+  // The WINOGRAD or FFT layer running a chosen algorithm of that engine. It
+  // shares blobs_ with this layer.
+  shared_ptr<ConvolutionLayer<Dtype> > engine_layer_;
+};
+
+/**
+ * @brief ConvolutionLayer computing its CPU forward pass with 8-bit inputs
+ *        and weights (see Int8Engine), for inference: each image is
+ *        quantized, unrolled by im2row and multiplied by the 8-bit filters
+ *        of each group. The backward pass and GPU mode run the float
+ *        ConvolutionLayer, and refuse a fused ReLU.
+ */
+template <typename Dtype>
+class Int8ConvolutionLayer : public ConvolutionLayer<Dtype> {
+ public:
+  explicit Int8ConvolutionLayer(const LayerParameter& param)
+      : ConvolutionLayer<Dtype>(param) {}
+  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      vector<Blob<Dtype>*>* top);
+  virtual uint64_t workspace_bytes() const;
+
+ protected:
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      vector<Blob<Dtype>*>* top);
+  virtual void Forward_gpu(const vector<Blob<Dtype>*>& bottom,
+      vector<Blob<Dtype>*>* top);
+  virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, vector<Blob<Dtype>*>* bottom);
+
+  // Requantizes the weights of engines_ if blobs_[0] may have been written
+  // since last time.
+  void QuantizeWeights();
+
+  // One engine per group.
+  vector<shared_ptr<Int8Engine<Dtype> > > engines_;
+  // One image quantized, and its patches as the rows of one group.
+  vector<uint8_t> quantized_image_;
+  vector<uint8_t> quantized_rows_;
+  // The weights engines_ were quantized from, and their version then.
+  shared_ptr<SyncedMemory> quantized_from_;
+  unsigned int quantized_version_;
+};
+
 /**
  * @brief A helper for image operations that rearranges image regions into
  *        column vectors.  Used by ConvolutionLayer to perform convolution
@@ -168,12 +361,16 @@ class LRNLayer : public Layer<Dtype> {
       vector<Blob<Dtype>*>* top);
   virtual void CrossChannelForward_gpu(const vector<Blob<Dtype>*>& bottom,
       vector<Blob<Dtype>*>* top);
+  virtual void WithinChannelForward_cpu(const vector<Blob<Dtype>*>& bottom,
+      vector<Blob<Dtype>*>* top);
   virtual void WithinChannelForward(const vector<Blob<Dtype>*>& bottom,
       vector<Blob<Dtype>*>* top);
   virtual void CrossChannelBackward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, vector<Blob<Dtype>*>* bottom);
   virtual void CrossChannelBackward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, vector<Blob<Dtype>*>* bottom);
+  virtual void WithinChannelBackward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, vector<Blob<Dtype>*>* bottom);
   virtual void WithinChannelBackward(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, vector<Blob<Dtype>*>* bottom);
 
@@ -186,11 +383,11 @@ class LRNLayer : public Layer<Dtype> {
   int height_;
   int width_;
 
-  // Fields used for normalization ACROSS_CHANNELS
-  // scale_ stores the intermediate summing results
+  // scale_ stores 1 + alpha / size * the windowed sum of squares (alpha /
+  // size^2 within a channel), the only state backward needs on the CPU.
   Blob<Dtype> scale_;
 
-  // Fields used for normalization WITHIN_CHANNEL
+  // The WITHIN_CHANNEL subnet, used by the GPU
   shared_ptr<SplitLayer<Dtype> > split_layer_;
   vector<Blob<Dtype>*> split_top_vec_;
   shared_ptr<PowerLayer<Dtype> > square_layer_;
@@ -245,6 +442,20 @@ class PoolingLayer : public Layer<Dtype> {
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, vector<Blob<Dtype>*>* bottom);
 
+  // Pool one height_ x width_ plane. MAX pooling also writes the offset of
+  // each maximum within its (unclipped) kernel window.
+  void MaxPoolPlane_cpu(const Dtype* bottom_data, Dtype* top_data,
+      int* offset);
+  void AvePoolPlane_cpu(const Dtype* bottom_data, Dtype* top_data);
+  // The index in its bottom plane of the window offset of pooled output
+  // pool_index.
+  inline int WindowIndex(const int pool_index, const int offset) const {
+    const int hstart = (pool_index / pooled_width_) * stride_h_ - pad_h_;
+    const int wstart = (pool_index % pooled_width_) * stride_w_ - pad_w_;
+    return (hstart + offset / kernel_w_) * width_ + wstart
+        + offset % kernel_w_;
+  }
+
   int kernel_h_, kernel_w_;
   int stride_h_, stride_w_;
   int pad_h_, pad_w_;
@@ -252,7 +463,10 @@ class PoolingLayer : public Layer<Dtype> {
   int height_, width_;
   int pooled_height_, pooled_width_;
   Blob<Dtype> rand_idx_;
+  // The GPU argmax mask, and the CPU one for windows over 256 elements.
   Blob<int> max_idx_;
+  // The CPU argmax mask as one uint8_t window offset per pooled output.
+  shared_ptr<SyncedMemory> max_offset_;
 };
 
 #ifdef USE_CUDNN
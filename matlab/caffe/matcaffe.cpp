@@ -266,8 +266,7 @@ static void init(MEX_ARGS) {
   char* param_file = mxArrayToString(prhs[0]);
   char* model_file = mxArrayToString(prhs[1]);
 
-  net_.reset(new Net<float>(string(param_file)));
-  net_->CopyTrainedLayersFrom(string(model_file));
+  net_.reset(new Net<float>(string(param_file), string(model_file)));
 
   mxFree(param_file);
   mxFree(model_file);
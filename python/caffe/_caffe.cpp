@@ -142,9 +142,9 @@ struct CaffeNet {
   }
 
   CaffeNet(string param_file, string pretrained_param_file) {
-    Init(param_file);
+    CheckFile(param_file);
     CheckFile(pretrained_param_file);
-    net_->CopyTrainedLayersFrom(pretrained_param_file);
+    net_.reset(new Net<float>(param_file, pretrained_param_file));
   }
 
   explicit CaffeNet(shared_ptr<Net<float> > net)
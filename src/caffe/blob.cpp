@@ -1,10 +1,54 @@
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/syncedmem.hpp"
+#include "caffe/util/fast_math.hpp"
 #include "caffe/util/math_functions.hpp"
 
 namespace caffe {
 
+// Converts n values between float and the 16-bit storage type.
+static void widen_half(const BlobProto_DataType type, const int n,
+    const uint16_t* x, float* y) {
+  if (type == BlobProto_DataType_FP16) {
+    fast_half_to_float(n, x, y);
+  } else {
+    CHECK_EQ(type, BlobProto_DataType_BF16) << "Unknown blob data type";
+    fast_bfloat16_to_float(n, x, y);
+  }
+}
+
+template <typename Dtype>
+static void widen_half(const BlobProto_DataType type, const int n,
+    const uint16_t* x, Dtype* y) {
+  vector<float> buffer(n);
+  widen_half(type, n, x, &buffer[0]);
+  for (int i = 0; i < n; ++i) {
+    y[i] = static_cast<Dtype>(buffer[i]);
+  }
+}
+
+static void narrow_half(const BlobProto_DataType type, const int n,
+    const float* x, uint16_t* y) {
+  if (type == BlobProto_DataType_FP16) {
+    fast_float_to_half(n, x, y);
+  } else {
+    CHECK_EQ(type, BlobProto_DataType_BF16) << "Unknown blob data type";
+    fast_float_to_bfloat16(n, x, y);
+  }
+}
+
+template <typename Dtype>
+static void narrow_half(const BlobProto_DataType type, const int n,
+    const Dtype* x, uint16_t* y) {
+  const vector<float> buffer(x, x + n);
+  narrow_half(type, n, &buffer[0], y);
+}
+
 template <typename Dtype>
 void Blob<Dtype>::Reshape(const int num, const int channels, const int height,
     const int width) {
@@ -345,8 +389,16 @@ void Blob<Dtype>::FromProto(const BlobProto& proto) {
   Reshape(proto.num(), proto.channels(), proto.height(), proto.width());
   // copy data
   Dtype* data_vec = mutable_cpu_data();
-  for (int i = 0; i < count_; ++i) {
-    data_vec[i] = proto.data(i);
+  if (proto.data_type() == BlobProto_DataType_FP32) {
+    for (int i = 0; i < count_; ++i) {
+      data_vec[i] = proto.data(i);
+    }
+  } else if (count_) {
+    CHECK_EQ(proto.half_data().size(), count_ * sizeof(uint16_t))
+        << "half_data does not match the blob shape";
+    widen_half(proto.data_type(), count_,
+        reinterpret_cast<const uint16_t*>(proto.half_data().data()),
+        data_vec);
   }
   if (proto.diff_size() > 0) {
     Dtype* diff_vec = mutable_cpu_diff();
@@ -357,16 +409,29 @@ void Blob<Dtype>::FromProto(const BlobProto& proto) {
 }
 
 template <typename Dtype>
-void Blob<Dtype>::ToProto(BlobProto* proto, bool write_diff) const {
+void Blob<Dtype>::ToProto(BlobProto* proto, bool write_diff,
+    BlobProto_DataType data_type) const {
   proto->set_num(num_);
   proto->set_channels(channels_);
   proto->set_height(height_);
   proto->set_width(width_);
   proto->clear_data();
   proto->clear_diff();
+  proto->clear_data_type();
+  proto->clear_half_data();
   const Dtype* data_vec = cpu_data();
-  for (int i = 0; i < count_; ++i) {
-    proto->add_data(data_vec[i]);
+  if (data_type == BlobProto_DataType_FP32) {
+    for (int i = 0; i < count_; ++i) {
+      proto->add_data(data_vec[i]);
+    }
+  } else {
+    proto->set_data_type(data_type);
+    string* half_data = proto->mutable_half_data();
+    half_data->resize(count_ * sizeof(uint16_t));
+    if (count_) {
+      narrow_half(data_type, count_, data_vec,
+          reinterpret_cast<uint16_t*>(&(*half_data)[0]));
+    }
   }
   if (write_diff) {
     const Dtype* diff_vec = cpu_diff();
@@ -41,7 +41,8 @@ void GlobalInit(int* pargc, char*** pargv) {
 #ifdef CPU_ONLY  // CPU-only Caffe.
 
 Caffe::Caffe()
-    : random_generator_(), mode_(Caffe::CPU), phase_(Caffe::TRAIN) { }
+    : random_generator_(), skip_fill_(false), mode_(Caffe::CPU),
+      phase_(Caffe::TRAIN) { }
 
 Caffe::~Caffe() { }
 
@@ -61,11 +62,32 @@ void Caffe::DeviceQuery() {
 
 class Caffe::RNG::Generator {
  public:
-  Generator() : rng_(new caffe::rng_t(cluster_seedgen())) {}
-  explicit Generator(unsigned int seed) : rng_(new caffe::rng_t(seed)) {}
+  Generator() : counter_(0) { Seed(cluster_seedgen()); }
+  explicit Generator(unsigned int seed) : counter_(0) { Seed(seed); }
   caffe::rng_t* rng() { return rng_.get(); }
+  uint64_t ReserveBlocks(const uint64_t blocks, uint32_t key[2]) {
+    key[0] = key_[0];
+    key[1] = key_[1];
+    const uint64_t first = counter_;
+    counter_ += blocks;
+    return first;
+  }
  private:
+  // The key is the seed through the 64-bit finalizer of MurmurHash3, so
+  // that nearby seeds give unrelated keys.
+  void Seed(const int64_t seed) {
+    rng_.reset(new caffe::rng_t(static_cast<unsigned int>(seed)));
+    uint64_t z = static_cast<uint64_t>(seed);
+    z = (z ^ (z >> 33)) * 0xFF51AFD7ED558CCDull;
+    z = (z ^ (z >> 33)) * 0xC4CEB9FE1A85EC53ull;
+    z ^= z >> 33;
+    key_[0] = static_cast<uint32_t>(z);
+    key_[1] = static_cast<uint32_t>(z >> 32);
+  }
+
   shared_ptr<caffe::rng_t> rng_;
+  uint32_t key_[2];
+  uint64_t counter_;
 };
 
 Caffe::RNG::RNG() : generator_(new Generator()) { }
@@ -81,11 +103,15 @@ void* Caffe::RNG::generator() {
   return static_cast<void*>(generator_->rng());
 }
 
+uint64_t Caffe::RNG::ReserveBlocks(const uint64_t blocks, uint32_t key[2]) {
+  return generator_->ReserveBlocks(blocks, key);
+}
+
 #else  // Normal GPU + CPU Caffe.
 
 Caffe::Caffe()
     : cublas_handle_(NULL), curand_generator_(NULL), random_generator_(),
-    mode_(Caffe::CPU), phase_(Caffe::TRAIN) {
+    skip_fill_(false), mode_(Caffe::CPU), phase_(Caffe::TRAIN) {
   // Try to create a cublas handler, and report an error if failed (but we will
   // keep the program running as one might just want to run CPU code).
   if (cublasCreate(&cublas_handle_) != CUBLAS_STATUS_SUCCESS) {
@@ -183,11 +209,32 @@ void Caffe::DeviceQuery() {
 
 class Caffe::RNG::Generator {
  public:
-  Generator() : rng_(new caffe::rng_t(cluster_seedgen())) {}
-  explicit Generator(unsigned int seed) : rng_(new caffe::rng_t(seed)) {}
+  Generator() : counter_(0) { Seed(cluster_seedgen()); }
+  explicit Generator(unsigned int seed) : counter_(0) { Seed(seed); }
   caffe::rng_t* rng() { return rng_.get(); }
+  uint64_t ReserveBlocks(const uint64_t blocks, uint32_t key[2]) {
+    key[0] = key_[0];
+    key[1] = key_[1];
+    const uint64_t first = counter_;
+    counter_ += blocks;
+    return first;
+  }
  private:
+  // The key is the seed through the 64-bit finalizer of MurmurHash3, so
+  // that nearby seeds give unrelated keys.
+  void Seed(const int64_t seed) {
+    rng_.reset(new caffe::rng_t(static_cast<unsigned int>(seed)));
+    uint64_t z = static_cast<uint64_t>(seed);
+    z = (z ^ (z >> 33)) * 0xFF51AFD7ED558CCDull;
+    z = (z ^ (z >> 33)) * 0xC4CEB9FE1A85EC53ull;
+    z ^= z >> 33;
+    key_[0] = static_cast<uint32_t>(z);
+    key_[1] = static_cast<uint32_t>(z >> 32);
+  }
+
   shared_ptr<caffe::rng_t> rng_;
+  uint32_t key_[2];
+  uint64_t counter_;
 };
 
 Caffe::RNG::RNG() : generator_(new Generator()) { }
@@ -203,6 +250,10 @@ void* Caffe::RNG::generator() {
   return static_cast<void*>(generator_->rng());
 }
 
+uint64_t Caffe::RNG::ReserveBlocks(const uint64_t blocks, uint32_t key[2]) {
+  return generator_->ReserveBlocks(blocks, key);
+}
+
 const char* cublasGetErrorString(cublasStatus_t error) {
   switch (error) {
   case CUBLAS_STATUS_SUCCESS:
@@ -13,15 +13,36 @@ namespace caffe {
 template <typename Dtype>
 ConvolutionLayer<Dtype>* GetConvolutionLayer(const string& name,
     const LayerParameter& param) {
-  ConvolutionParameter_Engine engine = param.convolution_param().engine();
+  const ConvolutionParameter& conv_param = param.convolution_param();
+  ConvolutionParameter_Engine engine = conv_param.engine();
   if (engine == ConvolutionParameter_Engine_DEFAULT) {
     engine = ConvolutionParameter_Engine_CAFFE;
 #ifdef USE_CUDNN
     engine = ConvolutionParameter_Engine_CUDNN;
+#else
+    // Large kernels may be cheaper in the frequency domain. The FFT layer
+    // checks its cost model at setup and runs im2col if FFT does not pay.
+    // Autotuning measures that instead.
+    const int kernel_h = conv_param.has_kernel_size() ?
+        conv_param.kernel_size() : conv_param.kernel_h();
+    const int kernel_w = conv_param.has_kernel_size() ?
+        conv_param.kernel_size() : conv_param.kernel_w();
+    if (kernel_h >= 7 && kernel_w >= 7 && !conv_param.autotune()) {
+      engine = ConvolutionParameter_Engine_FFT;
+    }
 #endif
   }
   if (engine == ConvolutionParameter_Engine_CAFFE) {
+    if (conv_param.autotune()) {
+      return new AutotunedConvolutionLayer<Dtype>(param);
+    }
     return new ConvolutionLayer<Dtype>(param);
+  } else if (engine == ConvolutionParameter_Engine_WINOGRAD) {
+    return new WinogradConvolutionLayer<Dtype>(param);
+  } else if (engine == ConvolutionParameter_Engine_FFT) {
+    return new FFTConvolutionLayer<Dtype>(param);
+  } else if (engine == ConvolutionParameter_Engine_INT8) {
+    return new Int8ConvolutionLayer<Dtype>(param);
 #ifdef USE_CUDNN
   } else if (engine == ConvolutionParameter_Engine_CUDNN) {
     return new CuDNNConvolutionLayer<Dtype>(param);
@@ -36,6 +57,28 @@ template ConvolutionLayer<float>* GetConvolutionLayer(const string& name,
 template ConvolutionLayer<double>* GetConvolutionLayer(const string& name,
     const LayerParameter& param);
 
+// Get inner product layer according to engine.
+template <typename Dtype>
+InnerProductLayer<Dtype>* GetInnerProductLayer(const string& name,
+    const LayerParameter& param) {
+  InnerProductParameter_Engine engine = param.inner_product_param().engine();
+  if (engine == InnerProductParameter_Engine_DEFAULT) {
+    engine = InnerProductParameter_Engine_CAFFE;
+  }
+  if (engine == InnerProductParameter_Engine_CAFFE) {
+    return new InnerProductLayer<Dtype>(param);
+  } else if (engine == InnerProductParameter_Engine_INT8) {
+    return new Int8InnerProductLayer<Dtype>(param);
+  } else {
+    LOG(FATAL) << "Layer " << name << " has unknown engine.";
+  }
+}
+
+template InnerProductLayer<float>* GetInnerProductLayer(const string& name,
+    const LayerParameter& param);
+template InnerProductLayer<double>* GetInnerProductLayer(const string& name,
+    const LayerParameter& param);
+
 // Get pooling layer according to engine.
 template <typename Dtype>
 PoolingLayer<Dtype>* GetPoolingLayer(const string& name,
@@ -211,6 +254,8 @@ Layer<Dtype>* GetLayer(const LayerParameter& param) {
     return new HDF5DataLayer<Dtype>(param);
   case LayerParameter_LayerType_HDF5_OUTPUT:
     return new HDF5OutputLayer<Dtype>(param);
+  case LayerParameter_LayerType_HIERARCHICAL_SOFTMAX_LOSS:
+    return new HierarchicalSoftmaxLossLayer<Dtype>(param);
   case LayerParameter_LayerType_HINGE_LOSS:
     return new HingeLossLayer<Dtype>(param);
   case LayerParameter_LayerType_IMAGE_DATA:
@@ -220,7 +265,7 @@ Layer<Dtype>* GetLayer(const LayerParameter& param) {
   case LayerParameter_LayerType_INFOGAIN_LOSS:
     return new InfogainLossLayer<Dtype>(param);
   case LayerParameter_LayerType_INNER_PRODUCT:
-    return new InnerProductLayer<Dtype>(param);
+    return GetInnerProductLayer<Dtype>(name, param);
   case LayerParameter_LayerType_LRN:
     return new LRNLayer<Dtype>(param);
   case LayerParameter_LayerType_MEMORY_DATA:
@@ -237,6 +282,8 @@ Layer<Dtype>* GetLayer(const LayerParameter& param) {
 	return new PReLULayer<Dtype>(param);
   case LayerParameter_LayerType_RELU:
     return GetReLULayer<Dtype>(name, param);
+  case LayerParameter_LayerType_SAMPLED_SOFTMAX_LOSS:
+    return new SampledSoftmaxLossLayer<Dtype>(param);
   case LayerParameter_LayerType_SILENCE:
     return new SilenceLayer<Dtype>(param);
   case LayerParameter_LayerType_SIGMOID:
@@ -0,0 +1,283 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>  // NOLINT(readability/streams)
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#include <intrin.h>
+#elif defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#include <cpuid.h>
+#endif
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "caffe/layer.hpp"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/vision_layers.hpp"
+
+namespace caffe {
+
+// Workspace bound for the candidates when gemm_workspace_limit is unset.
+const uint64_t kAutotuneDefaultWorkspace = static_cast<uint64_t>(64) << 20;
+// Timed passes per candidate, after one warm-up pass; the best one counts.
+const int kAutotuneIters = 3;
+// The direct kernels scale with channels per group and are not worth timing
+// beyond this many.
+const int kAutotuneMaxDirectChannels = 16;
+// FFT never beats im2col for kernels smaller than this.
+const int kAutotuneMinFFTKernel = 5;
+
+static const char* const kAutotuneAlgorithms[] = {
+  "im2col", "batched", "direct", "winograd2", "winograd4", "fft"
+};
+
+// Fills a benchmark blob with values in [-1, 1] without drawing from the
+// Caffe RNG, so that the layers set up after this one get the same random
+// weights whether or not the cache held this layer's choice.
+template <typename Dtype>
+static void fill_benchmark_data(const int count, Dtype* data) {
+  for (int i = 0; i < count; ++i) {
+    data[i] = Dtype(static_cast<int64_t>(i) * 7919 % 2001) / 1000 - 1;
+  }
+}
+
+// The CPU brand string, which distinguishes machines in the cache.
+static string cpu_model_name() {
+  char brand[49] = { 0 };
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+  int regs[4];
+  __cpuid(regs, 0x80000000);
+  if (static_cast<unsigned int>(regs[0]) >= 0x80000004) {
+    for (int i = 0; i < 3; ++i) {
+      __cpuid(regs, 0x80000002 + i);
+      memcpy(brand + 16 * i, regs, sizeof(regs));
+    }
+  }
+#elif defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+  unsigned int regs[4];
+  if (__get_cpuid_max(0x80000000, NULL) >= 0x80000004) {
+    for (int i = 0; i < 3; ++i) {
+      __get_cpuid(0x80000002 + i, &regs[0], &regs[1], &regs[2], &regs[3]);
+      memcpy(brand + 16 * i, regs, sizeof(regs));
+    }
+  }
+#endif
+  string name(brand);
+  const size_t begin = name.find_first_not_of(' ');
+  if (begin == string::npos) {
+    return "unknown-cpu";
+  }
+  return name.substr(begin, name.find_last_not_of(' ') + 1 - begin);
+}
+
+template <typename Dtype>
+void AutotunedConvolutionLayer<Dtype>::LayerSetUp(
+    const vector<Blob<Dtype>*>& bottom, vector<Blob<Dtype>*>* top) {
+  ConvolutionLayer<Dtype>::LayerSetUp(bottom, top);
+  const ConvolutionParameter& conv_param =
+      this->layer_param_.convolution_param();
+  workspace_limit_ = conv_param.gemm_workspace_limit();
+  if (workspace_limit_ == 0) {
+    workspace_limit_ = kAutotuneDefaultWorkspace;
+  }
+  engine_layer_.reset();
+  algorithm_ = "im2col";
+  if (Caffe::mode() != Caffe::CPU) {
+    LOG(INFO) << this->layer_param_.name()
+        << ": autotuning is CPU only; running ConvolutionLayer.";
+    return;
+  }
+  const string key = CacheKey();
+  const string& cache_file = conv_param.autotune_cache();
+  if (!cache_file.empty()) {
+    std::ifstream cache(cache_file.c_str());
+    string line;
+    while (std::getline(cache, line)) {
+      // Each line is "<algorithm> <key>".
+      const size_t space = line.find(' ');
+      if (space != string::npos && line.compare(space + 1, string::npos, key)
+          == 0 && UseAlgorithm(line.substr(0, space), bottom, top)) {
+        LOG(INFO) << this->layer_param_.name() << ": using cached algorithm "
+            << algorithm_;
+        return;
+      }
+    }
+  }
+  string best;
+  float best_ms = 0;
+  const int num_algorithms =
+      sizeof(kAutotuneAlgorithms) / sizeof(kAutotuneAlgorithms[0]);
+  for (int a = 0; a < num_algorithms; ++a) {
+    const string algorithm = kAutotuneAlgorithms[a];
+    if (!UseAlgorithm(algorithm, bottom, top)) {
+      continue;
+    }
+    // im2col is always allowed since it is what ConvolutionLayer would run.
+    const uint64_t workspace = workspace_bytes();
+    if (algorithm != "im2col" && workspace > workspace_limit_) {
+      LOG(INFO) << this->layer_param_.name() << ": " << algorithm
+          << " needs " << workspace << " bytes of workspace; skipped.";
+      continue;
+    }
+    const float ms = TimeAlgorithm(bottom, top);
+    LOG(INFO) << this->layer_param_.name() << ": " << algorithm << " "
+        << ms << " ms";
+    if (best.empty() || ms < best_ms) {
+      best = algorithm;
+      best_ms = ms;
+    }
+  }
+  CHECK(UseAlgorithm(best, bottom, top));
+  LOG(INFO) << this->layer_param_.name() << ": autotuned to " << algorithm_;
+  if (!cache_file.empty()) {
+    std::ofstream cache(cache_file.c_str(), std::ios::app);
+    cache << algorithm_ << " " << key << std::endl;
+    if (!cache) {
+      LOG(WARNING) << "Could not write autotune cache " << cache_file;
+    }
+  }
+}
+
+template <typename Dtype>
+bool AutotunedConvolutionLayer<Dtype>::UseAlgorithm(const string& algorithm,
+    const vector<Blob<Dtype>*>& bottom, vector<Blob<Dtype>*>* top) {
+  engine_layer_.reset();
+  this->use_direct_ = false;
+  this->ReshapeWorkspace(1);
+  LayerParameter engine_param(this->layer_param_);
+  ConvolutionParameter* conv_param = engine_param.mutable_convolution_param();
+  conv_param->set_autotune(false);
+  if (algorithm == "batched") {
+    const uint64_t bytes_per_image = 2 * sizeof(Dtype)
+        * (this->channels_ * this->kernel_h_ * this->kernel_w_
+        + this->num_output_) * this->N_;
+    const int images = static_cast<int>(std::min<uint64_t>(this->num_,
+        workspace_limit_ / bytes_per_image));
+    if (images < 2) {
+      return false;
+    }
+    this->ReshapeWorkspace(images);
+  } else if (algorithm == "direct") {
+    if (this->channels_ / this->group_ > kAutotuneMaxDirectChannels) {
+      return false;
+    }
+    this->use_direct_ = true;
+  } else if (algorithm == "winograd2" || algorithm == "winograd4") {
+    if (this->kernel_h_ != 3 || this->kernel_w_ != 3 || this->stride_h_ != 1
+        || this->stride_w_ != 1) {
+      return false;
+    }
+    conv_param->set_engine(ConvolutionParameter_Engine_WINOGRAD);
+    conv_param->set_winograd_tile(algorithm == "winograd2" ? 2 : 4);
+    engine_layer_.reset(new WinogradConvolutionLayer<Dtype>(engine_param));
+  } else if (algorithm == "fft") {
+    if (std::min(this->kernel_h_, this->kernel_w_) < kAutotuneMinFFTKernel) {
+      return false;
+    }
+    conv_param->set_engine(ConvolutionParameter_Engine_FFT);
+    engine_layer_.reset(new FFTConvolutionLayer<Dtype>(engine_param));
+  } else if (algorithm != "im2col") {
+    return false;
+  }
+  if (engine_layer_) {
+    engine_layer_->blobs() = this->blobs_;
+    engine_layer_->SetUp(bottom, top);
+  }
+  algorithm_ = algorithm;
+  return true;
+}
+
+template <typename Dtype>
+float AutotunedConvolutionLayer<Dtype>::TimeAlgorithm(
+    const vector<Blob<Dtype>*>& bottom, vector<Blob<Dtype>*>* top) {
+  // Time on scratch blobs: the real bottom may not hold data yet.
+  Blob<Dtype> bottom_blob;
+  Blob<Dtype> top_blob;
+  bottom_blob.ReshapeLike(*bottom[0]);
+  top_blob.ReshapeLike(*(*top)[0]);
+  fill_benchmark_data(bottom_blob.count(), bottom_blob.mutable_cpu_data());
+  fill_benchmark_data(top_blob.count(), top_blob.mutable_cpu_data());
+  caffe_copy(top_blob.count(), top_blob.cpu_data(),
+      top_blob.mutable_cpu_diff());
+  vector<Blob<Dtype>*> bench_bottom(1, &bottom_blob);
+  vector<Blob<Dtype>*> bench_top(1, &top_blob);
+  const vector<bool> propagate_down(1, true);
+  const bool backward = Caffe::phase() == Caffe::TRAIN;
+  Timer timer;
+  float best_ms = 0;
+  for (int i = 0; i <= kAutotuneIters; ++i) {
+    timer.Start();
+    Forward_cpu(bench_bottom, &bench_top);
+    if (backward) {
+      Backward_cpu(bench_top, propagate_down, &bench_bottom);
+    }
+    const float ms = timer.MilliSeconds();
+    // Pass 0 warms up caches and transforms the weights.
+    if (i == 1 || (i > 1 && ms < best_ms)) {
+      best_ms = ms;
+    }
+  }
+  return best_ms;
+}
+
+template <typename Dtype>
+string AutotunedConvolutionLayer<Dtype>::CacheKey() const {
+  int threads = 1;
+#ifdef _OPENMP
+  threads = omp_get_max_threads();
+#endif
+  std::ostringstream key;
+  key << cpu_model_name() << " threads " << threads
+      << (sizeof(Dtype) == sizeof(float) ? " float" : " double")
+      << (Caffe::phase() == Caffe::TRAIN ? " train" : " test")
+      << " bottom " << this->num_ << "x" << this->channels_ << "x"
+      << this->height_ << "x" << this->width_
+      << " output " << this->num_output_
+      << " kernel " << this->kernel_h_ << "x" << this->kernel_w_
+      << " stride " << this->stride_h_ << "x" << this->stride_w_
+      << " pad " << this->pad_h_ << "x" << this->pad_w_
+      << " group " << this->group_ << " bias " << this->bias_term_
+      << " workspace " << workspace_limit_;
+  return key.str();
+}
+
+template <typename Dtype>
+uint64_t AutotunedConvolutionLayer<Dtype>::workspace_bytes() const {
+  if (engine_layer_) {
+    return engine_layer_->workspace_bytes();
+  }
+  return ConvolutionLayer<Dtype>::workspace_bytes();
+}
+
+template <typename Dtype>
+void AutotunedConvolutionLayer<Dtype>::Forward_cpu(
+    const vector<Blob<Dtype>*>& bottom, vector<Blob<Dtype>*>* top) {
+  if (engine_layer_) {
+    engine_layer_->Forward(bottom, top);
+    return;
+  }
+  ConvolutionLayer<Dtype>::Forward_cpu(bottom, top);
+}
+
+template <typename Dtype>
+void AutotunedConvolutionLayer<Dtype>::Backward_cpu(
+    const vector<Blob<Dtype>*>& top, const vector<bool>& propagate_down,
+    vector<Blob<Dtype>*>* bottom) {
+  if (engine_layer_) {
+    for (int i = 0; i < this->blobs_.size(); ++i) {
+      engine_layer_->set_param_propagate_down(i,
+          this->param_propagate_down_[i]);
+    }
+    engine_layer_->Backward(top, propagate_down, bottom);
+    return;
+  }
+  ConvolutionLayer<Dtype>::Backward_cpu(top, propagate_down, bottom);
+}
+
+INSTANTIATE_CLASS(AutotunedConvolutionLayer);
+
+}  // namespace caffe
@@ -1,4 +1,5 @@
 #include <algorithm>
+#include <cmath>
 #include <vector>
 
 #include "caffe/common_layers.hpp"
@@ -26,6 +27,7 @@ namespace caffe {
 		(*top)[0]->Reshape(num_, channels_, height_, width_);
 		x_norm_.Reshape(num_, channels_, height_, width_);
 		x_std_.Reshape(1, channels_, 1, 1);
+		x_mean_.Reshape(1, channels_, 1, 1);
 
 		// statistic
 		spatial_statistic_.Reshape(num_, channels_, 1, 1);
@@ -73,183 +75,176 @@ namespace caffe {
 		this->param_propagate_down_.resize(this->blobs_.size(), true);
 	}
 
+	// Mean and biased variance of channel c over the batch in one pass. Each
+	// image's plane is summed shifted by its first value, which keeps the
+	// squares well conditioned, and the per-image statistics are merged with
+	// Chan et al.'s pairwise update of Welford's algorithm.
+	template <typename Dtype>
+	static void channel_statistics(const Dtype* data, const int num,
+		const int channels, const int spatial_dim, const int c,
+		Dtype* mean, Dtype* variance) {
+		double count = 0;
+		double running_mean = 0;
+		double m2 = 0;
+		for (int n = 0; n < num; ++n) {
+			const Dtype* x = data + (n * channels + c) * spatial_dim;
+			const Dtype shift = x[0];
+			Dtype sum = 0;
+			Dtype sum_sq = 0;
+			for (int i = 0; i < spatial_dim; ++i) {
+				const Dtype d = x[i] - shift;
+				sum += d;
+				sum_sq += d * d;
+			}
+			const double plane_mean = shift + double(sum) / spatial_dim;
+			const double plane_m2 = std::max(0.,
+				double(sum_sq) - double(sum) * sum / spatial_dim);
+			const double delta = plane_mean - running_mean;
+			const double merged = count + spatial_dim;
+			running_mean += delta * spatial_dim / merged;
+			m2 += plane_m2 + delta * delta * count * spatial_dim / merged;
+			count = merged;
+		}
+		*mean = running_mean;
+		*variance = m2 / count;
+	}
+
 	template <typename Dtype>
 	void BNLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
 		vector<Blob<Dtype>*>* top) {
-		const Dtype* const_bottom_data = bottom[0]->cpu_data();
-		const Dtype* const_top_data = (*top)[0]->cpu_data();
+		const Dtype* bottom_data = bottom[0]->cpu_data();
 		Dtype* top_data = (*top)[0]->mutable_cpu_data();
-
 		const Dtype* scale_data = this->blobs_[0]->cpu_data();
 		const Dtype* shift_data = this->blobs_[1]->cpu_data();
-
-		// ---------- mean subtraction ---------- //
-		// statistic across spatial
-		caffe_cpu_gemv<Dtype>(CblasNoTrans, num_ * channels_, height_ * width_, Dtype(1. / (height_ * width_)), const_bottom_data,
-			spatial_sum_multiplier_.cpu_data(), Dtype(0), spatial_statistic_.mutable_cpu_data());
-		// statistic across batch
-		caffe_cpu_gemv<Dtype>(CblasTrans, num_, channels_, Dtype(1. / num_), spatial_statistic_.cpu_data(),
-			batch_sum_multiplier_.cpu_data(), Dtype(0), batch_statistic_.mutable_cpu_data());
-		// save history mean
-		if (Caffe::phase() == Caffe::TRAIN) {
-		    caffe_cpu_axpby(batch_statistic_.count(), Dtype(1) - decay_, batch_statistic_.cpu_data(), decay_,
-			    this->blobs_[2]->mutable_cpu_data());
+		const Dtype* history_mean = this->blobs_[2]->cpu_data();
+		const Dtype* history_var = this->blobs_[3]->cpu_data();
+		Dtype* mean_data = x_mean_.mutable_cpu_data();
+		Dtype* std_data = x_std_.mutable_cpu_data();
+		Dtype* var_data = batch_statistic_.mutable_cpu_data();
+		// In place, backward can no longer recompute x_norm from the bottom.
+		Dtype* x_norm_data = bottom[0] == (*top)[0] ?
+			x_norm_.mutable_cpu_data() : NULL;
+		const int spatial_dim = height_ * width_;
+		const bool use_history = Caffe::phase() == Caffe::TEST && moving_average_;
+
+		// Statistics and the normalize, scale and shift pass, per channel.
+#pragma omp parallel for schedule(static) \
+    if (bottom[0]->count() >= caffe_parallel_grain())
+		for (int c = 0; c < channels_; ++c) {
+			Dtype mean, variance;
+			if (use_history) {
+				mean = history_mean[c];
+				variance = history_var[c];
+			} else {
+				channel_statistics(bottom_data, num_, channels_, spatial_dim, c,
+					&mean, &variance);
+			}
+			const Dtype std = std::sqrt(variance + var_eps_);
+			mean_data[c] = mean;
+			std_data[c] = std;
+			var_data[c] = variance;
+			const Dtype inv_std = Dtype(1) / std;
+			const Dtype a = scale_data[c] * inv_std;
+			const Dtype b = shift_data[c];
+			for (int n = 0; n < num_; ++n) {
+				const int offset = (n * channels_ + c) * spatial_dim;
+				const Dtype* x = bottom_data + offset;
+				Dtype* y = top_data + offset;
+				if (x_norm_data) {
+					Dtype* x_norm = x_norm_data + offset;
+					for (int i = 0; i < spatial_dim; ++i) {
+						x_norm[i] = (x[i] - mean) * inv_std;
+						y[i] = x_norm[i] * scale_data[c] + b;
+					}
+				} else {
+					for (int i = 0; i < spatial_dim; ++i) {
+						y[i] = (x[i] - mean) * a + b;
+					}
+				}
+			}
 		}
-		if (Caffe::phase() == Caffe::TEST && moving_average_) {
-			// use moving average mean
-			caffe_copy(batch_statistic_.count(), this->blobs_[2]->cpu_data(), batch_statistic_.mutable_cpu_data());
-		}
-		// put mean blob into buffer_blob_
-		caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_, channels_, 1, Dtype(1),
-			batch_sum_multiplier_.cpu_data(), batch_statistic_.cpu_data(), Dtype(0),
-			spatial_statistic_.mutable_cpu_data());
-		caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_ * channels_, height_ * width_, 1, Dtype(-1),
-			spatial_statistic_.cpu_data(), spatial_sum_multiplier_.cpu_data(), Dtype(0),
-			buffer_blob_.mutable_cpu_data());
-		// substract mean
-		caffe_add(buffer_blob_.count(), const_bottom_data, buffer_blob_.cpu_data(), top_data);
 
-		// ---------- variance normalization ---------- //
-		// put the squares of X - mean into buffer_blob_
-		caffe_powx(buffer_blob_.count(), const_top_data, Dtype(2), buffer_blob_.mutable_cpu_data());
-		// statistic across spatial
-		caffe_cpu_gemv<Dtype>(CblasNoTrans, num_ * channels_, height_ * width_, Dtype(1. / (height_ * width_)), buffer_blob_.cpu_data(),
-			spatial_sum_multiplier_.cpu_data(), Dtype(0), spatial_statistic_.mutable_cpu_data());
-		// statistic across batch
-		caffe_cpu_gemv<Dtype>(CblasTrans, num_, channels_, Dtype(1. / num_), spatial_statistic_.cpu_data(),
-			batch_sum_multiplier_.cpu_data(), Dtype(0), batch_statistic_.mutable_cpu_data());
-		// save history variance
+		// save history mean and variance
 		if (Caffe::phase() == Caffe::TRAIN) {
-		    caffe_cpu_axpby(batch_statistic_.count(), Dtype(1) - decay_, batch_statistic_.cpu_data(), decay_,
-			    this->blobs_[3]->mutable_cpu_data());
-		}
-		if (Caffe::phase() == Caffe::TEST && moving_average_) {
-			// use moving average variance
-			caffe_copy(batch_statistic_.count(), this->blobs_[3]->cpu_data(), batch_statistic_.mutable_cpu_data());
+			caffe_cpu_axpby(channels_, Dtype(1) - decay_, x_mean_.cpu_data(), decay_,
+				this->blobs_[2]->mutable_cpu_data());
+			caffe_cpu_axpby(channels_, Dtype(1) - decay_, batch_statistic_.cpu_data(),
+				decay_, this->blobs_[3]->mutable_cpu_data());
 		}
-		// add eps
-		caffe_add_scalar(batch_statistic_.count(), var_eps_, batch_statistic_.mutable_cpu_data());
-		// std
-		caffe_powx(batch_statistic_.count(), batch_statistic_.cpu_data(), Dtype(0.5),
-			batch_statistic_.mutable_cpu_data());
-		// put std blob into buffer_blob_
-		caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_, channels_, 1, Dtype(1),
-			batch_sum_multiplier_.cpu_data(), batch_statistic_.cpu_data(), Dtype(0),
-			spatial_statistic_.mutable_cpu_data());
-		caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_ * channels_, height_ * width_, 1, Dtype(1),
-			spatial_statistic_.cpu_data(), spatial_sum_multiplier_.cpu_data(), Dtype(0),
-			buffer_blob_.mutable_cpu_data());
-		// variance normalization
-		caffe_div(buffer_blob_.count(), const_top_data, buffer_blob_.cpu_data(), top_data);
-
-		// ---------- save x_norm and x_std ---------- //
-		caffe_copy(buffer_blob_.count(), const_top_data, x_norm_.mutable_cpu_data());
-		caffe_copy(batch_statistic_.count(), batch_statistic_.cpu_data(), x_std_.mutable_cpu_data());
-
-		// ---------- scale ---------- //
-		caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_, channels_, 1, Dtype(1),
-			batch_sum_multiplier_.cpu_data(), scale_data, Dtype(0),
-			spatial_statistic_.mutable_cpu_data());
-		caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_ * channels_, height_ * width_, 1, Dtype(1),
-			spatial_statistic_.cpu_data(), spatial_sum_multiplier_.cpu_data(), Dtype(0),
-			buffer_blob_.mutable_cpu_data());
-		caffe_mul(buffer_blob_.count(), const_top_data, buffer_blob_.cpu_data(), top_data);
-
-		// ---------- shift ---------- //
-		caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_, channels_, 1, Dtype(1),
-			batch_sum_multiplier_.cpu_data(), shift_data, Dtype(0),
-			spatial_statistic_.mutable_cpu_data());
-		caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_ * channels_, height_ * width_, 1, Dtype(1),
-			spatial_statistic_.cpu_data(), spatial_sum_multiplier_.cpu_data(), Dtype(0),
-			buffer_blob_.mutable_cpu_data());
-		caffe_add(buffer_blob_.count(), const_top_data, buffer_blob_.cpu_data(), top_data);
-
 	}
 
 	template <typename Dtype>
 	void BNLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
 		const vector<bool>& propagate_down,
 		vector<Blob<Dtype>*>* bottom) {
-		const Dtype* const_bottom_diff = (*bottom)[0]->cpu_diff();
-		Dtype* bottom_diff = (*bottom)[0]->mutable_cpu_diff();
-		const Dtype* const_top_diff = top[0]->cpu_diff();	
-
+		const Dtype* top_diff = top[0]->cpu_diff();
+		const Dtype* bottom_data = (*bottom)[0]->cpu_data();
+		const Dtype* x_norm_data = (*bottom)[0] == top[0] ?
+			x_norm_.cpu_data() : NULL;
+		Dtype* bottom_diff = propagate_down[0] ?
+			(*bottom)[0]->mutable_cpu_diff() : NULL;
 		Dtype* scale_diff = this->blobs_[0]->mutable_cpu_diff();
 		Dtype* shift_diff = this->blobs_[1]->mutable_cpu_diff();
 		const Dtype* scale_data = this->blobs_[0]->cpu_data();
-
-		// ---------- gradient w.r.t. scale ---------- //
-		caffe_mul(buffer_blob_.count(), x_norm_.cpu_data(), const_top_diff, buffer_blob_.mutable_cpu_data());
-		// statistic across spatial
-		caffe_cpu_gemv<Dtype>(CblasNoTrans, num_ * channels_, height_ * width_, Dtype(1), buffer_blob_.cpu_data(),
-			spatial_sum_multiplier_.cpu_data(), Dtype(0), spatial_statistic_.mutable_cpu_data());
-		// statistic across batch
-		caffe_cpu_gemv<Dtype>(CblasTrans, num_, channels_, Dtype(1), spatial_statistic_.cpu_data(),
-			batch_sum_multiplier_.cpu_data(), Dtype(0), scale_diff);
-
-		// ---------- gradient w.r.t. shift ---------- //
-		// statistic across spatial
-		caffe_cpu_gemv<Dtype>(CblasNoTrans, num_ * channels_, height_ * width_, Dtype(1), const_top_diff,
-			spatial_sum_multiplier_.cpu_data(), Dtype(0), spatial_statistic_.mutable_cpu_data());
-		// statistic across batch
-		caffe_cpu_gemv<Dtype>(CblasTrans, num_, channels_, Dtype(1), spatial_statistic_.cpu_data(),
-			batch_sum_multiplier_.cpu_data(), Dtype(0), shift_diff);
-
-		// ---------- gradient w.r.t. to bottom blob ---------- //
-		// put scale * top_diff to buffer_blob_
-		caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_, channels_, 1, Dtype(1),
-			batch_sum_multiplier_.cpu_data(), scale_data, Dtype(0),
-			spatial_statistic_.mutable_cpu_data());
-		caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_ * channels_, height_ * width_, 1, Dtype(1),
-			spatial_statistic_.cpu_data(), spatial_sum_multiplier_.cpu_data(), Dtype(0),
-			buffer_blob_.mutable_cpu_data());
-		caffe_mul(buffer_blob_.count(), const_top_diff, buffer_blob_.cpu_data(), buffer_blob_.mutable_cpu_data());
-
-		// use new top diff for computation
-		caffe_mul(buffer_blob_.count(), x_norm_.cpu_data(), buffer_blob_.cpu_data(), bottom_diff);
-		// statistic across spatial
-		caffe_cpu_gemv<Dtype>(CblasNoTrans, num_ * channels_, height_ * width_, Dtype(1), const_bottom_diff,
-			spatial_sum_multiplier_.cpu_data(), Dtype(0), spatial_statistic_.mutable_cpu_data());
-		// statistic across batch
-		caffe_cpu_gemv<Dtype>(CblasTrans, num_, channels_, Dtype(1), spatial_statistic_.cpu_data(),
-			batch_sum_multiplier_.cpu_data(), Dtype(0), batch_statistic_.mutable_cpu_data());
-
-		caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_, channels_, 1, Dtype(1),
-			batch_sum_multiplier_.cpu_data(), batch_statistic_.cpu_data(), Dtype(0),
-			spatial_statistic_.mutable_cpu_data());
-		caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_ * channels_, height_ * width_, 1, Dtype(1),
-			spatial_statistic_.cpu_data(), spatial_sum_multiplier_.cpu_data(), Dtype(0),
-			bottom_diff);
-
-		caffe_mul(buffer_blob_.count(), x_norm_.cpu_data(), const_bottom_diff, bottom_diff);
-
-		// statistic across spatial
-		caffe_cpu_gemv<Dtype>(CblasNoTrans, num_ * channels_, height_ * width_, Dtype(1), buffer_blob_.cpu_data(),
-			spatial_sum_multiplier_.cpu_data(), Dtype(0), spatial_statistic_.mutable_cpu_data());
-		// statistic across batch
-		caffe_cpu_gemv<Dtype>(CblasTrans, num_, channels_, Dtype(1), spatial_statistic_.cpu_data(),
-			batch_sum_multiplier_.cpu_data(), Dtype(0), batch_statistic_.mutable_cpu_data());
-
-		caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_, channels_, 1, Dtype(1),
-			batch_sum_multiplier_.cpu_data(), batch_statistic_.cpu_data(), Dtype(0),
-			spatial_statistic_.mutable_cpu_data());
-		caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_ * channels_, height_ * width_, 1, Dtype(1),
-			spatial_statistic_.cpu_data(), spatial_sum_multiplier_.cpu_data(), Dtype(1),
-			bottom_diff);
-
-		caffe_cpu_axpby(buffer_blob_.count(), Dtype(1), buffer_blob_.cpu_data(), Dtype(-1. / (num_ * height_ * width_)),
-			bottom_diff);
-        
-		// variance normalization
-		caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_, channels_, 1, Dtype(1),
-			batch_sum_multiplier_.cpu_data(), x_std_.cpu_data(), Dtype(0),
-			spatial_statistic_.mutable_cpu_data());
-		caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_ * channels_, height_ * width_, 1, Dtype(1),
-			spatial_statistic_.cpu_data(), spatial_sum_multiplier_.cpu_data(), Dtype(0),
-			buffer_blob_.mutable_cpu_data());
-
-		caffe_div(buffer_blob_.count(), const_bottom_diff, buffer_blob_.cpu_data(), bottom_diff);
-
+		const Dtype* mean_data = x_mean_.cpu_data();
+		const Dtype* std_data = x_std_.cpu_data();
+		const int spatial_dim = height_ * width_;
+		const Dtype m = num_ * spatial_dim;
+
+		// With x_norm = (x - mean) / std and y = scale * x_norm + shift,
+		//   dscale = sum(dy * x_norm), dshift = sum(dy),
+		//   dx = scale / std * (dy - dshift / m - x_norm * dscale / m),
+		// one pass for the sums and one for dx, per channel.
+#pragma omp parallel for schedule(static) \
+    if (top[0]->count() >= caffe_parallel_grain())
+		for (int c = 0; c < channels_; ++c) {
+			const Dtype mean = mean_data[c];
+			const Dtype inv_std = Dtype(1) / std_data[c];
+			Dtype sum_dy = 0;
+			Dtype sum_dy_x_norm = 0;
+			for (int n = 0; n < num_; ++n) {
+				const int offset = (n * channels_ + c) * spatial_dim;
+				const Dtype* dy = top_diff + offset;
+				if (x_norm_data) {
+					const Dtype* x_norm = x_norm_data + offset;
+					for (int i = 0; i < spatial_dim; ++i) {
+						sum_dy += dy[i];
+						sum_dy_x_norm += dy[i] * x_norm[i];
+					}
+				} else {
+					const Dtype* x = bottom_data + offset;
+					for (int i = 0; i < spatial_dim; ++i) {
+						sum_dy += dy[i];
+						sum_dy_x_norm += dy[i] * (x[i] - mean) * inv_std;
+					}
+				}
+			}
+			scale_diff[c] = sum_dy_x_norm;
+			shift_diff[c] = sum_dy;
+			if (!bottom_diff) {
+				continue;
+			}
+			const Dtype a = scale_data[c] * inv_std;
+			const Dtype mean_dy = sum_dy / m;
+			const Dtype mean_dy_x_norm = sum_dy_x_norm / m;
+			for (int n = 0; n < num_; ++n) {
+				const int offset = (n * channels_ + c) * spatial_dim;
+				const Dtype* dy = top_diff + offset;
+				Dtype* dx = bottom_diff + offset;
+				if (x_norm_data) {
+					const Dtype* x_norm = x_norm_data + offset;
+					for (int i = 0; i < spatial_dim; ++i) {
+						dx[i] = a * (dy[i] - mean_dy - x_norm[i] * mean_dy_x_norm);
+					}
+				} else {
+					const Dtype* x = bottom_data + offset;
+					for (int i = 0; i < spatial_dim; ++i) {
+						dx[i] = a * (dy[i] - mean_dy
+							- (x[i] - mean) * inv_std * mean_dy_x_norm);
+					}
+				}
+			}
+		}
 	}
 
 #ifdef CPU_ONLY
@@ -2,6 +2,7 @@
 #include <vector>
 
 #include "caffe/layer.hpp"
+#include "caffe/util/math_functions.hpp"
 #include "caffe/vision_layers.hpp"
 
 namespace caffe {
@@ -14,11 +15,16 @@ void BNLLLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = (*top)[0]->mutable_cpu_data();
   const int count = bottom[0]->count();
-  for (int i = 0; i < count; ++i) {
-    top_data[i] = bottom_data[i] > 0 ?
-        bottom_data[i] + log(1. + exp(-bottom_data[i])) :
-        log(1. + exp(bottom_data[i]));
+  if (caffe_strict_math()) {
+    // The original formula, bit for bit.
+    for (int i = 0; i < count; ++i) {
+      top_data[i] = bottom_data[i] > 0 ?
+          bottom_data[i] + log(1. + exp(-bottom_data[i])) :
+          log(1. + exp(bottom_data[i]));
+    }
+    return;
   }
+  caffe_log1p_exp(count, bottom_data, top_data);
 }
 
 template <typename Dtype>
@@ -30,11 +36,17 @@ void BNLLLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const Dtype* top_diff = top[0]->cpu_diff();
     Dtype* bottom_diff = (*bottom)[0]->mutable_cpu_diff();
     const int count = (*bottom)[0]->count();
-    Dtype expval;
-    for (int i = 0; i < count; ++i) {
-      expval = exp(std::min(bottom_data[i], Dtype(kBNLL_THRESHOLD)));
-      bottom_diff[i] = top_diff[i] * expval / (expval + 1.);
+    if (caffe_strict_math()) {
+      Dtype expval;
+      for (int i = 0; i < count; ++i) {
+        expval = exp(std::min(bottom_data[i], Dtype(kBNLL_THRESHOLD)));
+        bottom_diff[i] = top_diff[i] * expval / (expval + 1.);
+      }
+      return;
     }
+    // d/dx log(1 + exp(x)) = sigmoid(x)
+    caffe_sigmoid(count, bottom_data, bottom_diff);
+    caffe_mul(count, top_diff, bottom_diff, bottom_diff);
   }
 }
 
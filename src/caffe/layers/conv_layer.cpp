@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <vector>
 
 #include "caffe/filler.hpp"
@@ -8,6 +9,10 @@
 
 namespace caffe {
 
+// Grouped convolutions with at most this many input channels per group run
+// the direct sliding-window kernels on CPU instead of per-group GEMMs.
+const int kDirectConvMaxGroupChannels = 4;
+
 template <typename Dtype>
 void ConvolutionLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       vector<Blob<Dtype>*>* top) {
@@ -65,12 +70,26 @@ void ConvolutionLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   CHECK_GT(num_output_, 0);
   CHECK_EQ(channels_ % group_, 0);
   // The im2col result buffer would only hold one image at a time to avoid
-  // overly large memory usage.
+  // overly large memory usage. It is not needed at all for 1x1 convolutions
+  // with unit stride and no padding, which GEMM directly on the input.
   height_out_ =
       (height_ + 2 * pad_h_ - kernel_h_) / stride_h_ + 1;
   width_out_ = (width_ + 2 * pad_w_ - kernel_w_) / stride_w_ + 1;
-  col_buffer_.Reshape(
-      1, channels_ * kernel_h_ * kernel_w_, height_out_, width_out_);
+  is_1x1_ = kernel_h_ == 1 && kernel_w_ == 1 && stride_h_ == 1
+      && stride_w_ == 1 && pad_h_ == 0 && pad_w_ == 0;
+  // Depthwise and small-group convolutions spend most of their time in
+  // im2col and in GEMMs with a tiny K_, so the CPU path runs them directly.
+  use_direct_ = group_ > 1
+      && channels_ / group_ <= kDirectConvMaxGroupChannels;
+  // With a GEMM workspace limit, the CPU path instead unrolls as many images
+  // as fit (column data and diff plus the GEMM output and its diff) into one
+  // wide column matrix.
+  const uint64_t workspace_limit = conv_param.gemm_workspace_limit();
+  const uint64_t bytes_per_image = 2 * sizeof(Dtype)
+      * (channels_ * kernel_h_ * kernel_w_ + num_output_)
+      * height_out_ * width_out_;
+  const int images_per_gemm = static_cast<int>(std::min<uint64_t>(num_,
+      workspace_limit / bytes_per_image));
   // Set the parameters
   CHECK_EQ(num_output_ % group_, 0)
       << "Number of output should be multiples of group.";
@@ -106,31 +125,74 @@ void ConvolutionLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       bias_filler->Fill(this->blobs_[1].get());
     }
   }
-  // Set up the all ones "bias multiplier" for adding bias using blas
+  ReshapeWorkspace(images_per_gemm);
+  this->param_propagate_down_.resize(this->blobs_.size(), true);
+}
+
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::ReshapeWorkspace(const int images_per_gemm) {
+  images_per_gemm_ = std::max(1, images_per_gemm);
+  if (images_per_gemm_ > 1) {
+    col_buffer_.Reshape(1, channels_ * kernel_h_ * kernel_w_,
+        images_per_gemm_ * height_out_, width_out_);
+    gemm_buffer_.Reshape(1, num_output_,
+        images_per_gemm_ * height_out_, width_out_);
+  } else {
+    if (!is_1x1_) {
+      col_buffer_.Reshape(
+          1, channels_ * kernel_h_ * kernel_w_, height_out_, width_out_);
+    } else {
+      col_buffer_.Reshape(0, 0, 0, 0);
+    }
+    gemm_buffer_.Reshape(0, 0, 0, 0);
+  }
+  // Set up the all ones "bias multiplier" for adding bias using blas on the
+  // GPU; the CPU paths use the axis primitives.
   if (bias_term_) {
     bias_multiplier_.Reshape(1, 1, 1, N_);
-    caffe_set(N_, Dtype(1), bias_multiplier_.mutable_cpu_data());
+    caffe_set(bias_multiplier_.count(), Dtype(1),
+        bias_multiplier_.mutable_cpu_data());
   }
-  this->param_propagate_down_.resize(this->blobs_.size(), true);
+}
+
+template <typename Dtype>
+uint64_t ConvolutionLayer<Dtype>::workspace_bytes() const {
+  // The direct kernels never touch the column buffers on CPU.
+  if (use_direct_) {
+    return 0;
+  }
+  return 2 * sizeof(Dtype)
+      * (static_cast<uint64_t>(col_buffer_.count()) + gemm_buffer_.count());
 }
 
 
 template <typename Dtype>
 void ConvolutionLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       vector<Blob<Dtype>*>* top) {
+  if (use_direct_) {
+    DirectForward_cpu(bottom, top);
+    return;
+  }
+  if (images_per_gemm_ > 1) {
+    BatchedForward_cpu(bottom, top);
+    return;
+  }
   for (int i = 0; i < bottom.size(); ++i) {
     const Dtype* bottom_data = bottom[i]->cpu_data();
     Dtype* top_data = (*top)[i]->mutable_cpu_data();
-    Dtype* col_data = col_buffer_.mutable_cpu_data();
     const Dtype* weight = this->blobs_[0]->cpu_data();
     int weight_offset = M_ * K_;
     int col_offset = K_ * N_;
     int top_offset = M_ * N_;
     for (int n = 0; n < num_; ++n) {
-      // First, im2col
-      im2col_cpu(bottom_data + bottom[i]->offset(n), channels_, height_,
-          width_, kernel_h_, kernel_w_, pad_h_, pad_w_, stride_h_, stride_w_,
-          col_data);
+      // First, im2col (the input already is the column matrix for 1x1)
+      const Dtype* col_data = bottom_data + bottom[i]->offset(n);
+      if (!is_1x1_) {
+        im2col_cpu(bottom_data + bottom[i]->offset(n), channels_, height_,
+            width_, kernel_h_, kernel_w_, pad_h_, pad_w_, stride_h_,
+            stride_w_, col_buffer_.mutable_cpu_data());
+        col_data = col_buffer_.cpu_data();
+      }
       // Second, innerproduct with groups
       for (int g = 0; g < group_; ++g) {
         caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, M_, N_, K_,
@@ -139,10 +201,8 @@ void ConvolutionLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       }
       // third, add bias
       if (bias_term_) {
-        caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_output_,
-            N_, 1, (Dtype)1., this->blobs_[1]->cpu_data(),
-            bias_multiplier_.cpu_data(),
-            (Dtype)1., top_data + (*top)[i]->offset(n));
+        caffe_cpu_axis_add<Dtype>(num_output_, N_, 1, 1.,
+            this->blobs_[1]->cpu_data(), top_data + (*top)[i]->offset(n));
       }
     }
   }
@@ -151,6 +211,14 @@ void ConvolutionLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
 template <typename Dtype>
 void ConvolutionLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, vector<Blob<Dtype>*>* bottom) {
+  if (use_direct_) {
+    DirectBackward_cpu(top, propagate_down, bottom);
+    return;
+  }
+  if (images_per_gemm_ > 1) {
+    BatchedBackward_cpu(top, propagate_down, bottom);
+    return;
+  }
   const Dtype* weight = NULL;
   Dtype* weight_diff = NULL;
   if (this->param_propagate_down_[0]) {
@@ -172,26 +240,29 @@ void ConvolutionLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     if (bias_term_ && this->param_propagate_down_[1]) {
       top_diff = top[i]->cpu_diff();
       for (int n = 0; n < num_; ++n) {
-        caffe_cpu_gemv<Dtype>(CblasNoTrans, num_output_, N_,
-            1., top_diff + top[0]->offset(n),
-            bias_multiplier_.cpu_data(), 1.,
-            bias_diff);
+        caffe_cpu_axis_sum<Dtype>(num_output_, N_, 1, 1.,
+            top_diff + top[0]->offset(n), 1., bias_diff);
       }
     }
     if (this->param_propagate_down_[0] || propagate_down[i]) {
       if (!top_diff) {
         top_diff = top[i]->cpu_diff();
       }
-      Dtype* col_data = col_buffer_.mutable_cpu_data();
-      Dtype* col_diff = col_buffer_.mutable_cpu_diff();
       const Dtype* bottom_data = (*bottom)[i]->cpu_data();
       Dtype* bottom_diff = (*bottom)[i]->mutable_cpu_diff();
       for (int n = 0; n < num_; ++n) {
         // Since we saved memory in the forward pass by not storing all col
-        // data, we will need to recompute them.
-        im2col_cpu(bottom_data + (*bottom)[i]->offset(n), channels_, height_,
-                   width_, kernel_h_, kernel_w_, pad_h_, pad_w_,
-                   stride_h_, stride_w_, col_data);
+        // data, we will need to recompute them. For 1x1 convolutions the
+        // bottom data and diff serve as the column data and diff directly.
+        const Dtype* col_data = bottom_data + (*bottom)[i]->offset(n);
+        Dtype* col_diff = bottom_diff + (*bottom)[i]->offset(n);
+        if (!is_1x1_) {
+          im2col_cpu(bottom_data + (*bottom)[i]->offset(n), channels_,
+              height_, width_, kernel_h_, kernel_w_, pad_h_, pad_w_,
+              stride_h_, stride_w_, col_buffer_.mutable_cpu_data());
+          col_data = col_buffer_.cpu_data();
+          col_diff = col_buffer_.mutable_cpu_diff();
+        }
         // gradient w.r.t. weight. Note that we will accumulate diffs.
         if (this->param_propagate_down_[0]) {
           for (int g = 0; g < group_; ++g) {
@@ -213,9 +284,292 @@ void ConvolutionLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
                 (Dtype)0., col_diff + col_offset * g);
           }
           // col2im back to the data
-          col2im_cpu(col_diff, channels_, height_, width_,
-              kernel_h_, kernel_w_, pad_h_, pad_w_,
-              stride_h_, stride_w_, bottom_diff + (*bottom)[i]->offset(n));
+          if (!is_1x1_) {
+            col2im_cpu(col_diff, channels_, height_, width_,
+                kernel_h_, kernel_w_, pad_h_, pad_w_,
+                stride_h_, stride_w_, bottom_diff + (*bottom)[i]->offset(n));
+          }
+        }
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::BatchedForward_cpu(
+      const vector<Blob<Dtype>*>& bottom, vector<Blob<Dtype>*>* top) {
+  const Dtype* weight = this->blobs_[0]->cpu_data();
+  Dtype* col_data = col_buffer_.mutable_cpu_data();
+  Dtype* gemm_data = gemm_buffer_.mutable_cpu_data();
+  const int weight_offset = M_ * K_;
+  for (int i = 0; i < bottom.size(); ++i) {
+    const Dtype* bottom_data = bottom[i]->cpu_data();
+    Dtype* top_data = (*top)[i]->mutable_cpu_data();
+    for (int n0 = 0; n0 < num_; n0 += images_per_gemm_) {
+      const int batch = std::min(images_per_gemm_, num_ - n0);
+      // The column matrix has batch * N_ columns; image b owns the columns
+      // [b * N_, (b + 1) * N_).
+      const int col_width = batch * N_;
+      for (int b = 0; b < batch; ++b) {
+        im2col_cpu_ld(bottom_data + bottom[i]->offset(n0 + b), channels_,
+            height_, width_, kernel_h_, kernel_w_, pad_h_, pad_w_,
+            stride_h_, stride_w_, col_data + b * N_, col_width);
+      }
+      for (int g = 0; g < group_; ++g) {
+        caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, M_, col_width, K_,
+            (Dtype)1., weight + weight_offset * g,
+            col_data + K_ * col_width * g,
+            (Dtype)0., gemm_data + M_ * col_width * g);
+      }
+      if (bias_term_) {
+        caffe_cpu_axis_add<Dtype>(num_output_, col_width, 1, 1.,
+            this->blobs_[1]->cpu_data(), gemm_data);
+      }
+      // Scatter the output rows back to the per-image top layout.
+      for (int b = 0; b < batch; ++b) {
+        for (int c = 0; c < num_output_; ++c) {
+          caffe_copy(N_, gemm_data + c * col_width + b * N_,
+              top_data + (*top)[i]->offset(n0 + b, c));
+        }
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::BatchedBackward_cpu(
+      const vector<Blob<Dtype>*>& top, const vector<bool>& propagate_down,
+      vector<Blob<Dtype>*>* bottom) {
+  const Dtype* weight = this->blobs_[0]->cpu_data();
+  Dtype* weight_diff = NULL;
+  if (this->param_propagate_down_[0]) {
+    weight_diff = this->blobs_[0]->mutable_cpu_diff();
+    caffe_set(this->blobs_[0]->count(), Dtype(0), weight_diff);
+  }
+  Dtype* bias_diff = NULL;
+  if (bias_term_ && this->param_propagate_down_[1]) {
+    bias_diff = this->blobs_[1]->mutable_cpu_diff();
+    caffe_set(this->blobs_[1]->count(), Dtype(0), bias_diff);
+  }
+  const int weight_offset = M_ * K_;
+  for (int i = 0; i < top.size(); ++i) {
+    if (!weight_diff && !bias_diff && !propagate_down[i]) {
+      continue;
+    }
+    const Dtype* top_diff = top[i]->cpu_diff();
+    const Dtype* bottom_data = (*bottom)[i]->cpu_data();
+    Dtype* bottom_diff = (*bottom)[i]->mutable_cpu_diff();
+    Dtype* col_data = col_buffer_.mutable_cpu_data();
+    Dtype* col_diff = col_buffer_.mutable_cpu_diff();
+    Dtype* gemm_diff = gemm_buffer_.mutable_cpu_diff();
+    for (int n0 = 0; n0 < num_; n0 += images_per_gemm_) {
+      const int batch = std::min(images_per_gemm_, num_ - n0);
+      const int col_width = batch * N_;
+      // Gather the top diff into the same wide layout as the forward output.
+      for (int b = 0; b < batch; ++b) {
+        for (int c = 0; c < num_output_; ++c) {
+          caffe_copy(N_, top_diff + top[i]->offset(n0 + b, c),
+              gemm_diff + c * col_width + b * N_);
+        }
+      }
+      // Bias gradient, if necessary.
+      if (bias_diff) {
+        caffe_cpu_axis_sum<Dtype>(num_output_, col_width, 1, 1., gemm_diff,
+            1., bias_diff);
+      }
+      // gradient w.r.t. weight: a single GEMM per group over the whole chunk
+      // rather than one accumulating GEMM per image.
+      if (weight_diff) {
+        for (int b = 0; b < batch; ++b) {
+          im2col_cpu_ld(bottom_data + (*bottom)[i]->offset(n0 + b),
+              channels_, height_, width_, kernel_h_, kernel_w_, pad_h_,
+              pad_w_, stride_h_, stride_w_, col_data + b * N_, col_width);
+        }
+        for (int g = 0; g < group_; ++g) {
+          caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, M_, K_, col_width,
+              (Dtype)1., gemm_diff + M_ * col_width * g,
+              col_data + K_ * col_width * g, (Dtype)1.,
+              weight_diff + weight_offset * g);
+        }
+      }
+      // gradient w.r.t. bottom data, if necessary
+      if (propagate_down[i]) {
+        for (int g = 0; g < group_; ++g) {
+          caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, K_, col_width, M_,
+              (Dtype)1., weight + weight_offset * g,
+              gemm_diff + M_ * col_width * g,
+              (Dtype)0., col_diff + K_ * col_width * g);
+        }
+        for (int b = 0; b < batch; ++b) {
+          col2im_cpu_ld(col_diff + b * N_, col_width, channels_, height_,
+              width_, kernel_h_, kernel_w_, pad_h_, pad_w_, stride_h_,
+              stride_w_, bottom_diff + (*bottom)[i]->offset(n0 + b));
+        }
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::DirectForward_cpu(
+      const vector<Blob<Dtype>*>& bottom, vector<Blob<Dtype>*>* top) {
+  const Dtype* weight = this->blobs_[0]->cpu_data();
+  const Dtype* bias = bias_term_ ? this->blobs_[1]->cpu_data() : NULL;
+  const int group_channels = channels_ / group_;
+  const int group_outputs = num_output_ / group_;
+  const int in_size = height_ * width_;
+  const int filter_size = kernel_h_ * kernel_w_;
+  const int planes = num_ * num_output_;
+  for (int i = 0; i < bottom.size(); ++i) {
+    const Dtype* bottom_data = bottom[i]->cpu_data();
+    Dtype* top_data = (*top)[i]->mutable_cpu_data();
+    // Each output plane is independent; within a plane every filter tap is
+    // a scaled, shifted add of an input row over a contiguous output row.
+#pragma omp parallel for schedule(static) \
+    if (planes * N_ >= caffe_parallel_grain())
+    for (int p = 0; p < planes; ++p) {
+      const int n = p / num_output_;
+      const int k = p % num_output_;
+      const int g = k / group_outputs;
+      Dtype* out = top_data + p * N_;
+      caffe_set(N_, bias ? bias[k] : Dtype(0), out);
+      for (int cg = 0; cg < group_channels; ++cg) {
+        const Dtype* in = bottom_data
+            + (n * channels_ + g * group_channels + cg) * in_size;
+        const Dtype* w = weight + (k * group_channels + cg) * filter_size;
+        for (int kh = 0; kh < kernel_h_; ++kh) {
+          int y_begin, y_end;
+          im2col_valid_range(height_, height_out_, pad_h_, stride_h_, kh,
+              &y_begin, &y_end);
+          for (int kw = 0; kw < kernel_w_; ++kw) {
+            int x_begin, x_end;
+            im2col_valid_range(width_, width_out_, pad_w_, stride_w_, kw,
+                &x_begin, &x_end);
+            const Dtype w_tap = w[kh * kernel_w_ + kw];
+            for (int y = y_begin; y < y_end; ++y) {
+              const Dtype* in_row = in
+                  + (y * stride_h_ - pad_h_ + kh) * width_ - pad_w_ + kw;
+              Dtype* out_row = out + y * width_out_;
+              if (stride_w_ == 1) {
+                for (int x = x_begin; x < x_end; ++x) {
+                  out_row[x] += w_tap * in_row[x];
+                }
+              } else {
+                for (int x = x_begin; x < x_end; ++x) {
+                  out_row[x] += w_tap * in_row[x * stride_w_];
+                }
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::DirectBackward_cpu(
+      const vector<Blob<Dtype>*>& top, const vector<bool>& propagate_down,
+      vector<Blob<Dtype>*>* bottom) {
+  const Dtype* weight = this->blobs_[0]->cpu_data();
+  Dtype* weight_diff = NULL;
+  if (this->param_propagate_down_[0]) {
+    weight_diff = this->blobs_[0]->mutable_cpu_diff();
+    caffe_set(this->blobs_[0]->count(), Dtype(0), weight_diff);
+  }
+  Dtype* bias_diff = NULL;
+  if (bias_term_ && this->param_propagate_down_[1]) {
+    bias_diff = this->blobs_[1]->mutable_cpu_diff();
+    caffe_set(this->blobs_[1]->count(), Dtype(0), bias_diff);
+  }
+  const int group_channels = channels_ / group_;
+  const int group_outputs = num_output_ / group_;
+  const int in_size = height_ * width_;
+  const int filter_size = kernel_h_ * kernel_w_;
+  for (int i = 0; i < top.size(); ++i) {
+    const Dtype* top_diff = top[i]->cpu_diff();
+    const Dtype* bottom_data = (*bottom)[i]->cpu_data();
+    // Bias gradient, if necessary.
+    if (bias_diff) {
+      for (int n = 0; n < num_; ++n) {
+        caffe_cpu_axis_sum<Dtype>(num_output_, N_, 1, 1.,
+            top_diff + top[i]->offset(n), 1., bias_diff);
+      }
+    }
+    // gradient w.r.t. weight: every tap is a dot product of the output diff
+    // with a shifted input window. Threads own disjoint output channels.
+    if (weight_diff) {
+#pragma omp parallel for schedule(static) \
+    if (num_ * num_output_ * N_ >= caffe_parallel_grain())
+      for (int k = 0; k < num_output_; ++k) {
+        const int g = k / group_outputs;
+        for (int n = 0; n < num_; ++n) {
+          const Dtype* dout = top_diff + (n * num_output_ + k) * N_;
+          for (int cg = 0; cg < group_channels; ++cg) {
+            const Dtype* in = bottom_data
+                + (n * channels_ + g * group_channels + cg) * in_size;
+            Dtype* dw = weight_diff + (k * group_channels + cg) * filter_size;
+            for (int kh = 0; kh < kernel_h_; ++kh) {
+              int y_begin, y_end;
+              im2col_valid_range(height_, height_out_, pad_h_, stride_h_, kh,
+                  &y_begin, &y_end);
+              for (int kw = 0; kw < kernel_w_; ++kw) {
+                int x_begin, x_end;
+                im2col_valid_range(width_, width_out_, pad_w_, stride_w_, kw,
+                    &x_begin, &x_end);
+                Dtype sum = 0;
+                for (int y = y_begin; y < y_end; ++y) {
+                  const Dtype* in_row = in
+                      + (y * stride_h_ - pad_h_ + kh) * width_ - pad_w_ + kw;
+                  const Dtype* dout_row = dout + y * width_out_;
+                  for (int x = x_begin; x < x_end; ++x) {
+                    sum += dout_row[x] * in_row[x * stride_w_];
+                  }
+                }
+                dw[kh * kernel_w_ + kw] += sum;
+              }
+            }
+          }
+        }
+      }
+    }
+    // gradient w.r.t. bottom data, if necessary: scatter each output diff
+    // back through the taps. Threads own disjoint input planes.
+    if (propagate_down[i]) {
+      Dtype* bottom_diff = (*bottom)[i]->mutable_cpu_diff();
+      const int planes = num_ * channels_;
+#pragma omp parallel for schedule(static) \
+    if (planes * in_size >= caffe_parallel_grain())
+      for (int p = 0; p < planes; ++p) {
+        const int n = p / channels_;
+        const int c = p % channels_;
+        const int g = c / group_channels;
+        const int cg = c % group_channels;
+        Dtype* in_diff = bottom_diff + p * in_size;
+        caffe_set(in_size, Dtype(0), in_diff);
+        for (int kg = 0; kg < group_outputs; ++kg) {
+          const int k = g * group_outputs + kg;
+          const Dtype* dout = top_diff + (n * num_output_ + k) * N_;
+          const Dtype* w = weight + (k * group_channels + cg) * filter_size;
+          for (int kh = 0; kh < kernel_h_; ++kh) {
+            int y_begin, y_end;
+            im2col_valid_range(height_, height_out_, pad_h_, stride_h_, kh,
+                &y_begin, &y_end);
+            for (int kw = 0; kw < kernel_w_; ++kw) {
+              int x_begin, x_end;
+              im2col_valid_range(width_, width_out_, pad_w_, stride_w_, kw,
+                  &x_begin, &x_end);
+              const Dtype w_tap = w[kh * kernel_w_ + kw];
+              for (int y = y_begin; y < y_end; ++y) {
+                Dtype* in_row = in_diff
+                    + (y * stride_h_ - pad_h_ + kh) * width_ - pad_w_ + kw;
+                const Dtype* dout_row = dout + y * width_out_;
+                for (int x = x_begin; x < x_end; ++x) {
+                  in_row[x * stride_w_] += w_tap * dout_row[x];
+                }
+              }
+            }
+          }
         }
       }
     }
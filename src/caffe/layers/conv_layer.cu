@@ -14,16 +14,19 @@ void ConvolutionLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
   for (int i = 0; i < bottom.size(); ++i) {
     const Dtype* bottom_data = bottom[i]->gpu_data();
     Dtype* top_data = (*top)[i]->mutable_gpu_data();
-    Dtype* col_data = col_buffer_.mutable_gpu_data();
     const Dtype* weight = this->blobs_[0]->gpu_data();
     int weight_offset = M_ * K_;
     int col_offset = K_ * N_;
     int top_offset = M_ * N_;
     for (int n = 0; n < num_; ++n) {
-      // First, im2col
-      im2col_gpu(bottom_data + bottom[i]->offset(n), channels_, height_,
-          width_, kernel_h_, kernel_w_, pad_h_, pad_w_, stride_h_, stride_w_,
-          col_data);
+      // First, im2col (the input already is the column matrix for 1x1)
+      const Dtype* col_data = bottom_data + bottom[i]->offset(n);
+      if (!is_1x1_) {
+        im2col_gpu(bottom_data + bottom[i]->offset(n), channels_, height_,
+            width_, kernel_h_, kernel_w_, pad_h_, pad_w_, stride_h_,
+            stride_w_, col_buffer_.mutable_gpu_data());
+        col_data = col_buffer_.gpu_data();
+      }
       // Second, innerproduct with groups
       for (int g = 0; g < group_; ++g) {
         caffe_gpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, M_, N_, K_,
@@ -75,16 +78,21 @@ void ConvolutionLayer<Dtype>::Backward_gpu(const vector<Blob<Dtype>*>& top,
       if (!top_diff) {
         top_diff = top[i]->gpu_diff();
       }
-      Dtype* col_data = col_buffer_.mutable_gpu_data();
-      Dtype* col_diff = col_buffer_.mutable_gpu_diff();
       const Dtype* bottom_data = (*bottom)[i]->gpu_data();
       Dtype* bottom_diff = (*bottom)[i]->mutable_gpu_diff();
       for (int n = 0; n < num_; ++n) {
         // Since we saved memory in the forward pass by not storing all col
-        // data, we will need to recompute them.
-        im2col_gpu(bottom_data + (*bottom)[i]->offset(n), channels_, height_,
-                   width_, kernel_h_, kernel_w_, pad_h_, pad_w_,
-                   stride_h_, stride_w_, col_data);
+        // data, we will need to recompute them. For 1x1 convolutions the
+        // bottom data and diff serve as the column data and diff directly.
+        const Dtype* col_data = bottom_data + (*bottom)[i]->offset(n);
+        Dtype* col_diff = bottom_diff + (*bottom)[i]->offset(n);
+        if (!is_1x1_) {
+          im2col_gpu(bottom_data + (*bottom)[i]->offset(n), channels_,
+              height_, width_, kernel_h_, kernel_w_, pad_h_, pad_w_,
+              stride_h_, stride_w_, col_buffer_.mutable_gpu_data());
+          col_data = col_buffer_.gpu_data();
+          col_diff = col_buffer_.mutable_gpu_diff();
+        }
         // gradient w.r.t. weight. Note that we will accumulate diffs.
         if (this->param_propagate_down_[0]) {
           for (int g = 0; g < group_; ++g) {
@@ -106,9 +114,11 @@ void ConvolutionLayer<Dtype>::Backward_gpu(const vector<Blob<Dtype>*>& top,
                 (Dtype)0., col_diff + col_offset * g);
           }
           // col2im back to the data
-          col2im_gpu(col_diff, channels_, height_, width_,
-              kernel_h_, kernel_w_, pad_h_, pad_w_, stride_h_, stride_w_,
-              bottom_diff + (*bottom)[i]->offset(n));
+          if (!is_1x1_) {
+            col2im_gpu(col_diff, channels_, height_, width_,
+                kernel_h_, kernel_w_, pad_h_, pad_w_, stride_h_, stride_w_,
+                bottom_diff + (*bottom)[i]->offset(n));
+          }
         }
       }
     }
@@ -14,9 +14,11 @@ template <typename Dtype>
 void DropoutLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       vector<Blob<Dtype>*>* top) {
   NeuronLayer<Dtype>::LayerSetUp(bottom, top);
-  // Set up the cache for random number generation
+  // Set up the cache for random number generation; the GPU keeps a word
+  // per input, the CPU a bit.
   rand_vec_.Reshape(bottom[0]->num(), bottom[0]->channels(),
       bottom[0]->height(), bottom[0]->width());
+  mask_bits_.Reshape((bottom[0]->count() + 31) / 32, 1, 1, 1);
   threshold_ = this->layer_param_.dropout_param().dropout_ratio();
   DCHECK(threshold_ > 0.);
   DCHECK(threshold_ < 1.);
@@ -29,14 +31,12 @@ void DropoutLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     vector<Blob<Dtype>*>* top) {
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = (*top)[0]->mutable_cpu_data();
-  unsigned int* mask = rand_vec_.mutable_cpu_data();
   const int count = bottom[0]->count();
   if (Caffe::phase() == Caffe::TRAIN) {
     // Create random numbers
-    caffe_rng_bernoulli(count, 1. - threshold_, mask);
-    for (int i = 0; i < count; ++i) {
-      top_data[i] = bottom_data[i] * mask[i] * scale_;
-    }
+    unsigned int* mask = mask_bits_.mutable_cpu_data();
+    caffe_rng_bernoulli_bits(count, 1. - threshold_, mask);
+    caffe_cpu_mask_scale(count, mask, scale_, bottom_data, top_data);
   } else {
     caffe_copy(bottom[0]->count(), bottom_data, top_data);
   }
@@ -50,11 +50,9 @@ void DropoutLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const Dtype* top_diff = top[0]->cpu_diff();
     Dtype* bottom_diff = (*bottom)[0]->mutable_cpu_diff();
     if (Caffe::phase() == Caffe::TRAIN) {
-      const unsigned int* mask = rand_vec_.cpu_data();
+      const unsigned int* mask = mask_bits_.cpu_data();
       const int count = (*bottom)[0]->count();
-      for (int i = 0; i < count; ++i) {
-        bottom_diff[i] = top_diff[i] * mask[i] * scale_;
-      }
+      caffe_cpu_mask_scale(count, mask, scale_, top_diff, bottom_diff);
     } else {
       caffe_copy(top[0]->count(), top_diff, bottom_diff);
     }
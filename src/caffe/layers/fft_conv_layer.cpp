@@ -0,0 +1,387 @@
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <vector>
+
+#include "caffe/layer.hpp"
+#include "caffe/util/fft.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/vision_layers.hpp"
+
+namespace caffe {
+
+// Rough per-image flop estimates used to choose between FFT and im2col.
+// A radix-2 2-D complex FFT of size n x n costs about 5 n^2 log2(n^2); each
+// tile takes one per input channel and one per output, plus a complex
+// multiply-accumulate per (output, input channel) pair and frequency. Our FFT
+// runs at a fraction of the BLAS GEMM flop rate, which kFFTSlowdown accounts
+// for.
+const double kFFTSlowdown = 2.;
+
+static double fft_conv_cost(const int channels, const int num_output,
+    const int group, const int height, const int width, const int fft_size,
+    const int tile_h, const int tile_w) {
+  const double n2 = static_cast<double>(fft_size) * fft_size;
+  const double tiles = static_cast<double>((height + tile_h - 1) / tile_h)
+      * ((width + tile_w - 1) / tile_w);
+  const double transform = 5. * n2 * std::log(n2) / std::log(2.);
+  return kFFTSlowdown * tiles * ((channels + num_output) * transform
+      + 8. * num_output * (channels / group) * n2);
+}
+
+template <typename Dtype>
+void FFTConvolutionLayer<Dtype>::LayerSetUp(
+    const vector<Blob<Dtype>*>& bottom, vector<Blob<Dtype>*>* top) {
+  ConvolutionLayer<Dtype>::LayerSetUp(bottom, top);
+  height_full_ = this->height_ + 2 * this->pad_h_ - this->kernel_h_ + 1;
+  width_full_ = this->width_ + 2 * this->pad_w_ - this->kernel_w_ + 1;
+  // Pick the power-of-two FFT size with the lowest estimated cost. Each
+  // tile_h_ x tile_w_ input tile convolves to exactly fft_size_ x fft_size_.
+  const int kernel_max = std::max(this->kernel_h_, this->kernel_w_);
+  const int image_max = std::max(this->height_, this->width_) + kernel_max - 1;
+  double fft_cost = 0;
+  fft_size_ = 0;
+  for (int n = 8; n < 2 * image_max && n <= 256; n *= 2) {
+    if (n < 2 * kernel_max) {
+      continue;
+    }
+    const double cost = fft_conv_cost(this->channels_, this->num_output_,
+        this->group_, this->height_, this->width_, n,
+        n - this->kernel_h_ + 1, n - this->kernel_w_ + 1);
+    if (fft_size_ == 0 || cost < fft_cost) {
+      fft_size_ = n;
+      fft_cost = cost;
+    }
+  }
+  const double gemm_cost = 2. * this->num_output_
+      * (this->channels_ / this->group_) * this->kernel_h_ * this->kernel_w_
+      * this->height_out_ * this->width_out_;
+  const bool forced = this->layer_param_.convolution_param().engine()
+      == ConvolutionParameter_Engine_FFT;
+  use_fft_ = fft_size_ > 0 && (forced || fft_cost < gemm_cost);
+  LOG(INFO) << this->layer_param_.name() << ": FFT size " << fft_size_
+      << ", estimated " << fft_cost / 1e6 << " MFlop vs im2col "
+      << gemm_cost / 1e6 << " MFlop; using "
+      << (use_fft_ ? "FFT" : "im2col");
+  if (!use_fft_) {
+    return;
+  }
+  tile_h_ = fft_size_ - this->kernel_h_ + 1;
+  tile_w_ = fft_size_ - this->kernel_w_ + 1;
+  plan_.reset(new FFTPlan<Dtype>(fft_size_));
+  const int spectrum = fft_size_ * fft_size_;
+  const int group_channels = this->channels_ / this->group_;
+  const int group_outputs = this->num_output_ / this->group_;
+  weight_spectra_.resize(this->num_output_ * group_channels * spectrum);
+  input_spectra_.resize(group_channels * spectrum);
+  output_spectra_.resize(group_outputs * spectrum);
+  full_buffer_.Reshape(1, this->num_output_, height_full_, width_full_);
+  // Forces TransformWeights() on the first pass.
+  transformed_from_.reset();
+}
+
+template <typename Dtype>
+uint64_t FFTConvolutionLayer<Dtype>::workspace_bytes() const {
+  return ConvolutionLayer<Dtype>::workspace_bytes()
+      + sizeof(std::complex<Dtype>) * (static_cast<uint64_t>(
+      weight_spectra_.size()) + weight_diff_spectra_.size()
+      + input_spectra_.size() + output_spectra_.size())
+      + sizeof(Dtype) * 2 * static_cast<uint64_t>(full_buffer_.count());
+}
+
+template <typename Dtype>
+void FFTConvolutionLayer<Dtype>::TransformWeights() {
+  const Blob<Dtype>& weights = *this->blobs_[0];
+  if (transformed_from_ == weights.data() &&
+      transformed_version_ == weights.data()->version()) {
+    return;
+  }
+  const int spectrum = fft_size_ * fft_size_;
+  const int filters = this->num_output_ * (this->channels_ / this->group_);
+  const int filter_size = this->kernel_h_ * this->kernel_w_;
+  const Dtype* weight = weights.cpu_data();
+#pragma omp parallel for schedule(static)
+  for (int f = 0; f < filters; ++f) {
+    std::complex<Dtype>* w = &weight_spectra_[f * spectrum];
+    std::fill(w, w + spectrum, std::complex<Dtype>(0));
+    for (int i = 0; i < this->kernel_h_; ++i) {
+      for (int j = 0; j < this->kernel_w_; ++j) {
+        w[i * fft_size_ + j] =
+            weight[f * filter_size + i * this->kernel_w_ + j];
+      }
+    }
+    plan_->Transform2D(w, false);
+  }
+  transformed_from_ = weights.data();
+  transformed_version_ = weights.data()->version();
+}
+
+// Copies the rows [y0, y0 + fft_size) and columns [x0, x0 + fft_size) of a
+// height x width plane into a zeroed spectrum buffer, keeping at most
+// rows x cols of it, and transforms it.
+template <typename Dtype>
+static void fft_load_tile(const FFTPlan<Dtype>& plan, const Dtype* plane,
+    const int height, const int width, const int y0, const int x0,
+    const int rows, const int cols, std::complex<Dtype>* spectrum) {
+  const int n = plan.size();
+  std::fill(spectrum, spectrum + n * n, std::complex<Dtype>(0));
+  const int y_begin = std::max(0, -y0);
+  const int y_end = std::min(rows, height - y0);
+  const int x_begin = std::max(0, -x0);
+  const int x_end = std::min(cols, width - x0);
+  for (int y = y_begin; y < y_end; ++y) {
+    const Dtype* row = plane + (y0 + y) * width + x0;
+    for (int x = x_begin; x < x_end; ++x) {
+      spectrum[y * n + x] = row[x];
+    }
+  }
+  plan.Transform2D(spectrum, false);
+}
+
+// Inverse-transforms a spectrum and adds its entries (s_h, s_w), for
+// s in [s_begin, s_begin + fft_size), to plane(y0 + s_h, x0 + s_w), indexing
+// the spectrum circularly and skipping entries outside the plane.
+template <typename Dtype>
+static void fft_add_tile(const FFTPlan<Dtype>& plan,
+    std::complex<Dtype>* spectrum, const int s_begin_h, const int s_begin_w,
+    const int y0, const int x0, const int height, const int width,
+    Dtype* plane) {
+  const int n = plan.size();
+  plan.Transform2D(spectrum, true);
+  const Dtype scale = Dtype(1) / (n * n);
+  for (int s_h = s_begin_h; s_h < s_begin_h + n; ++s_h) {
+    const int y = y0 + s_h;
+    if (y < 0 || y >= height) {
+      continue;
+    }
+    const std::complex<Dtype>* row = spectrum + ((s_h + n) % n) * n;
+    Dtype* out = plane + y * width;
+    for (int s_w = s_begin_w; s_w < s_begin_w + n; ++s_w) {
+      const int x = x0 + s_w;
+      if (x >= 0 && x < width) {
+        out[x] += scale * row[(s_w + n) % n].real();
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void FFTConvolutionLayer<Dtype>::Forward_cpu(
+    const vector<Blob<Dtype>*>& bottom, vector<Blob<Dtype>*>* top) {
+  if (!use_fft_) {
+    ConvolutionLayer<Dtype>::Forward_cpu(bottom, top);
+    return;
+  }
+  TransformWeights();
+  const int spectrum = fft_size_ * fft_size_;
+  const int group_channels = this->channels_ / this->group_;
+  const int group_outputs = this->num_output_ / this->group_;
+  const int full_size = height_full_ * width_full_;
+  const int in_size = this->height_ * this->width_;
+  Dtype* full = full_buffer_.mutable_cpu_data();
+  for (int i = 0; i < bottom.size(); ++i) {
+    const Dtype* bottom_data = bottom[i]->cpu_data();
+    Dtype* top_data = (*top)[i]->mutable_cpu_data();
+    for (int n = 0; n < this->num_; ++n) {
+      caffe_set(full_buffer_.count(), Dtype(0), full);
+      const Dtype* image = bottom_data + bottom[i]->offset(n);
+      for (int g = 0; g < this->group_; ++g) {
+        // Overlap-add: input tile (bh, bw) contributes to the outputs
+        // (bh + pad_h + s_h, bw + pad_w + s_w) for s in (-kernel, tile).
+        for (int bh = 0; bh < this->height_; bh += tile_h_) {
+          for (int bw = 0; bw < this->width_; bw += tile_w_) {
+#pragma omp parallel for schedule(static)
+            for (int c = 0; c < group_channels; ++c) {
+              fft_load_tile(*plan_,
+                  image + (g * group_channels + c) * in_size, this->height_,
+                  this->width_, bh, bw, tile_h_, tile_w_,
+                  &input_spectra_[c * spectrum]);
+            }
+#pragma omp parallel for schedule(static)
+            for (int k = 0; k < group_outputs; ++k) {
+              std::complex<Dtype>* out = &output_spectra_[k * spectrum];
+              std::fill(out, out + spectrum, std::complex<Dtype>(0));
+              const std::complex<Dtype>* w = &weight_spectra_[
+                  (g * group_outputs + k) * group_channels * spectrum];
+              for (int c = 0; c < group_channels; ++c) {
+                const std::complex<Dtype>* in = &input_spectra_[c * spectrum];
+                for (int f = 0; f < spectrum; ++f) {
+                  out[f] += in[f] * std::conj(w[f]);
+                }
+                w += spectrum;
+              }
+              fft_add_tile(*plan_, out, 1 - this->kernel_h_,
+                  1 - this->kernel_w_, bh + this->pad_h_, bw + this->pad_w_,
+                  height_full_, width_full_,
+                  full + (g * group_outputs + k) * full_size);
+            }
+          }
+        }
+      }
+      // Subsample the stride 1 result and add the bias.
+      for (int k = 0; k < this->num_output_; ++k) {
+        const Dtype bias = this->bias_term_ ?
+            this->blobs_[1]->cpu_data()[k] : Dtype(0);
+        Dtype* out = top_data + (*top)[i]->offset(n, k);
+        const Dtype* in = full + k * full_size;
+        for (int y = 0; y < this->height_out_; ++y) {
+          for (int x = 0; x < this->width_out_; ++x) {
+            out[y * this->width_out_ + x] = bias + in[
+                y * this->stride_h_ * width_full_ + x * this->stride_w_];
+          }
+        }
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void FFTConvolutionLayer<Dtype>::Backward_cpu(
+    const vector<Blob<Dtype>*>& top, const vector<bool>& propagate_down,
+    vector<Blob<Dtype>*>* bottom) {
+  if (!use_fft_) {
+    ConvolutionLayer<Dtype>::Backward_cpu(top, propagate_down, bottom);
+    return;
+  }
+  const int spectrum = fft_size_ * fft_size_;
+  const int group_channels = this->channels_ / this->group_;
+  const int group_outputs = this->num_output_ / this->group_;
+  const int full_size = height_full_ * width_full_;
+  const int in_size = this->height_ * this->width_;
+  const bool weight_grad = this->param_propagate_down_[0];
+  Dtype* bias_diff = NULL;
+  if (this->bias_term_ && this->param_propagate_down_[1]) {
+    bias_diff = this->blobs_[1]->mutable_cpu_diff();
+    caffe_set(this->blobs_[1]->count(), Dtype(0), bias_diff);
+  }
+  if (weight_grad) {
+    weight_diff_spectra_.assign(weight_spectra_.size(),
+        std::complex<Dtype>(0));
+  }
+  bool need_weights = false;
+  for (int i = 0; i < top.size(); ++i) {
+    need_weights = need_weights || propagate_down[i];
+  }
+  if (need_weights) {
+    TransformWeights();
+  }
+  Dtype* full_diff = full_buffer_.mutable_cpu_diff();
+  for (int i = 0; i < top.size(); ++i) {
+    const Dtype* top_diff = top[i]->cpu_diff();
+    if (bias_diff) {
+      for (int n = 0; n < this->num_; ++n) {
+        caffe_cpu_axis_sum<Dtype>(this->num_output_, this->N_, 1, 1.,
+            top_diff + top[i]->offset(n), 1., bias_diff);
+      }
+    }
+    if (!weight_grad && !propagate_down[i]) {
+      continue;
+    }
+    const Dtype* bottom_data = (*bottom)[i]->cpu_data();
+    Dtype* bottom_diff = (*bottom)[i]->mutable_cpu_diff();
+    if (propagate_down[i]) {
+      caffe_set((*bottom)[i]->count(), Dtype(0), bottom_diff);
+    }
+    for (int n = 0; n < this->num_; ++n) {
+      // Upsample the top diff to the stride 1 output.
+      caffe_set(full_buffer_.count(), Dtype(0), full_diff);
+      for (int k = 0; k < this->num_output_; ++k) {
+        const Dtype* in = top_diff + top[i]->offset(n, k);
+        Dtype* out = full_diff + k * full_size;
+        for (int y = 0; y < this->height_out_; ++y) {
+          for (int x = 0; x < this->width_out_; ++x) {
+            out[y * this->stride_h_ * width_full_ + x * this->stride_w_] =
+                in[y * this->width_out_ + x];
+          }
+        }
+      }
+      const Dtype* image = bottom_data + (*bottom)[i]->offset(n);
+      Dtype* image_diff = bottom_diff + (*bottom)[i]->offset(n);
+      for (int g = 0; g < this->group_; ++g) {
+        // Output tile (bh, bw) of the diff reads the inputs
+        // (bh - pad_h + s_h, bw - pad_w + s_w) for s in [0, fft_size).
+        for (int bh = 0; bh < height_full_; bh += tile_h_) {
+          for (int bw = 0; bw < width_full_; bw += tile_w_) {
+            const int y0 = bh - this->pad_h_;
+            const int x0 = bw - this->pad_w_;
+#pragma omp parallel for schedule(static)
+            for (int k = 0; k < group_outputs; ++k) {
+              fft_load_tile(*plan_,
+                  full_diff + (g * group_outputs + k) * full_size,
+                  height_full_, width_full_, bh, bw, tile_h_, tile_w_,
+                  &output_spectra_[k * spectrum]);
+            }
+            // gradient w.r.t. weight: correlate the input with the diff,
+            // accumulated in the frequency domain over tiles and images.
+            if (weight_grad) {
+#pragma omp parallel for schedule(static)
+              for (int c = 0; c < group_channels; ++c) {
+                fft_load_tile(*plan_,
+                    image + (g * group_channels + c) * in_size,
+                    this->height_, this->width_, y0, x0, fft_size_,
+                    fft_size_, &input_spectra_[c * spectrum]);
+              }
+#pragma omp parallel for schedule(static)
+              for (int k = 0; k < group_outputs; ++k) {
+                const std::complex<Dtype>* d = &output_spectra_[k * spectrum];
+                std::complex<Dtype>* dw = &weight_diff_spectra_[
+                    (g * group_outputs + k) * group_channels * spectrum];
+                for (int c = 0; c < group_channels; ++c) {
+                  const std::complex<Dtype>* in =
+                      &input_spectra_[c * spectrum];
+                  for (int f = 0; f < spectrum; ++f) {
+                    dw[f] += in[f] * std::conj(d[f]);
+                  }
+                  dw += spectrum;
+                }
+              }
+            }
+            // gradient w.r.t. bottom data: convolve the diff with the
+            // filters, reusing the input spectra as accumulators.
+            if (propagate_down[i]) {
+#pragma omp parallel for schedule(static)
+              for (int c = 0; c < group_channels; ++c) {
+                std::complex<Dtype>* acc = &input_spectra_[c * spectrum];
+                std::fill(acc, acc + spectrum, std::complex<Dtype>(0));
+                for (int k = 0; k < group_outputs; ++k) {
+                  const std::complex<Dtype>* d =
+                      &output_spectra_[k * spectrum];
+                  const std::complex<Dtype>* w = &weight_spectra_[
+                      ((g * group_outputs + k) * group_channels + c)
+                      * spectrum];
+                  for (int f = 0; f < spectrum; ++f) {
+                    acc[f] += d[f] * w[f];
+                  }
+                }
+                fft_add_tile(*plan_, acc, 0, 0, y0, x0, this->height_,
+                    this->width_,
+                    image_diff + (g * group_channels + c) * in_size);
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+  if (weight_grad) {
+    Dtype* weight_diff = this->blobs_[0]->mutable_cpu_diff();
+    const int filters = this->num_output_ * group_channels;
+    const int filter_size = this->kernel_h_ * this->kernel_w_;
+    const Dtype scale = Dtype(1) / spectrum;
+#pragma omp parallel for schedule(static)
+    for (int f = 0; f < filters; ++f) {
+      std::complex<Dtype>* dw = &weight_diff_spectra_[f * spectrum];
+      plan_->Transform2D(dw, true);
+      for (int y = 0; y < this->kernel_h_; ++y) {
+        for (int x = 0; x < this->kernel_w_; ++x) {
+          weight_diff[f * filter_size + y * this->kernel_w_ + x] =
+              scale * dw[y * fft_size_ + x].real();
+        }
+      }
+    }
+  }
+}
+
+INSTANTIATE_CLASS(FFTConvolutionLayer);
+
+}  // namespace caffe
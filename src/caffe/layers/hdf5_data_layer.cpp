@@ -6,6 +6,7 @@ TODO:
   :: don't forget to update hdf5_daa_layer.cu accordingly
 - add ability to shuffle filenames if flag is set
 */
+#include <algorithm>
 #include <fstream>  // NOLINT(readability/streams)
 #include <string>
 #include <vector>
@@ -23,6 +24,24 @@ namespace caffe {
 template <typename Dtype>
 HDF5DataLayer<Dtype>::~HDF5DataLayer<Dtype>() { }
 
+// Reads the one-dimensional numeric dataset dataset_name into values.
+static void hdf5_load_int_dataset(hid_t file_id, const char* dataset_name,
+    vector<int>* values) {
+  int ndims;
+  herr_t status = H5LTget_dataset_ndims(file_id, dataset_name, &ndims);
+  CHECK_GE(status, 0) << "Failed to get dataset ndims for " << dataset_name;
+  CHECK_EQ(ndims, 1) << dataset_name << " must be one-dimensional";
+  hsize_t dim;
+  H5T_class_t class_;
+  status = H5LTget_dataset_info(file_id, dataset_name, &dim, &class_, NULL);
+  CHECK_GE(status, 0) << "Failed to get dataset info for " << dataset_name;
+  values->resize(dim);
+  if (dim) {
+    status = H5LTread_dataset_int(file_id, dataset_name, &(*values)[0]);
+    CHECK_GE(status, 0) << "Failed to read int dataset " << dataset_name;
+  }
+}
+
 // Load data and label from HDF5 filename into the class property blobs.
 template <typename Dtype>
 void HDF5DataLayer<Dtype>::LoadHDF5FileData(const char* filename) {
@@ -33,10 +52,14 @@ void HDF5DataLayer<Dtype>::LoadHDF5FileData(const char* filename) {
     return;
   }
 
-  const int MIN_DATA_DIM = 2;
-  const int MAX_DATA_DIM = 4;
+  const int MIN_DATA_DIM = sparse_ ? 1 : 2;
+  const int MAX_DATA_DIM = sparse_ ? 1 : 4;
   hdf5_load_nd_dataset(
     file_id, "data",  MIN_DATA_DIM, MAX_DATA_DIM, &data_blob_);
+  if (sparse_) {
+    hdf5_load_int_dataset(file_id, "indices", &indices_);
+    hdf5_load_int_dataset(file_id, "indptr", &indptr_);
+  }
 
   const int MIN_LABEL_DIM = 1;
   const int MAX_LABEL_DIM = 2;
@@ -45,7 +68,15 @@ void HDF5DataLayer<Dtype>::LoadHDF5FileData(const char* filename) {
 
   herr_t status = H5Fclose(file_id);
   CHECK_GE(status, 0) << "Failed to close HDF5 file " << filename;
-  CHECK_EQ(data_blob_.num(), label_blob_.num());
+  if (sparse_) {
+    const int nonzeros = indices_.size();
+    CHECK_EQ(static_cast<int>(indptr_.size()), label_blob_.num() + 1);
+    CHECK_EQ(indptr_[0], 0);
+    CHECK_EQ(indptr_.back(), nonzeros);
+    CHECK_EQ(data_blob_.count(), nonzeros);
+  } else {
+    CHECK_EQ(data_blob_.num(), label_blob_.num());
+  }
   //LOG(INFO) << "Successully loaded " << data_blob_.num() << " rows";
 }
 
@@ -64,6 +95,10 @@ void HDF5DataLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
     }
   }
   source_file.close();
+  CHECK(top->size() == 2 || top->size() == 4) << this->type_name()
+      << " Layer outputs the data and label, or the sparse data values,"
+      << " indices and row pointers and the label.";
+  sparse_ = top->size() == 4;
   num_files_ = hdf_filenames_.size();
   current_file_ = 0;
   LOG(INFO) << "Number of files: " << num_files_;
@@ -74,6 +109,20 @@ void HDF5DataLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
 
   // Reshape blobs.
   const int batch_size = this->layer_param_.hdf5_data_param().batch_size();
+  if (sparse_) {
+    // The value and index tops start at the nonzeros of an average batch.
+    const int rows = label_blob_.num();
+    const int nonzeros = std::max(1, static_cast<int>(
+        static_cast<int64_t>(indices_.size()) * batch_size / rows));
+    (*top)[0]->Reshape(nonzeros, 1, 1, 1);
+    (*top)[1]->Reshape(nonzeros, 1, 1, 1);
+    (*top)[2]->Reshape(batch_size + 1, 1, 1, 1);
+    (*top)[3]->Reshape(batch_size, label_blob_.channels(),
+                       label_blob_.width(), label_blob_.height());
+    LOG(INFO) << "output sparse data: " << rows << " rows, "
+        << indices_.size() << " nonzeros in the first file";
+    return;
+  }
   (*top)[0]->Reshape(batch_size, data_blob_.channels(),
                      data_blob_.width(), data_blob_.height());
   (*top)[1]->Reshape(batch_size, label_blob_.channels(),
@@ -83,9 +132,58 @@ void HDF5DataLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       << (*top)[0]->width();
 }
 
+template <typename Dtype>
+void HDF5DataLayer<Dtype>::ForwardSparse(vector<Blob<Dtype>*>* top) {
+  const int batch_size = this->layer_param_.hdf5_data_param().batch_size();
+  const int label_data_count = (*top)[3]->count() / (*top)[3]->num();
+  Dtype* row_ptr = (*top)[2]->mutable_cpu_data();
+  Dtype* label = (*top)[3]->mutable_cpu_data();
+  // The rows of a batch may span two files, so they are gathered first.
+  vector<Dtype> values;
+  vector<Dtype> indices;
+  row_ptr[0] = 0;
+  for (int i = 0; i < batch_size; ++i, ++current_row_) {
+    if (current_row_ == label_blob_.num()) {
+      if (num_files_ > 1) {
+        current_file_ += 1;
+        if (current_file_ == num_files_) {
+          current_file_ = 0;
+        }
+        LoadHDF5FileData(hdf_filenames_[current_file_].c_str());
+      }
+      current_row_ = 0;
+    }
+    const int begin = indptr_[current_row_];
+    const int end = indptr_[current_row_ + 1];
+    if (end > begin) {
+      const Dtype* data = data_blob_.cpu_data();
+      values.insert(values.end(), data + begin, data + end);
+      indices.insert(indices.end(), indices_.begin() + begin,
+                     indices_.begin() + end);
+    }
+    row_ptr[i + 1] = values.size();
+    caffe_copy(label_data_count,
+               &label_blob_.cpu_data()[current_row_ * label_data_count],
+               label + i * label_data_count);
+  }
+  const int nonzeros = values.size();
+  if ((*top)[0]->count() < nonzeros) {
+    (*top)[0]->Reshape(nonzeros, 1, 1, 1);
+    (*top)[1]->Reshape(nonzeros, 1, 1, 1);
+  }
+  if (nonzeros) {
+    caffe_copy(nonzeros, &values[0], (*top)[0]->mutable_cpu_data());
+    caffe_copy(nonzeros, &indices[0], (*top)[1]->mutable_cpu_data());
+  }
+}
+
 template <typename Dtype>
 void HDF5DataLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       vector<Blob<Dtype>*>* top) {
+  if (sparse_) {
+    ForwardSparse(top);
+    return;
+  }
   const int batch_size = this->layer_param_.hdf5_data_param().batch_size();
   const int data_count = (*top)[0]->count() / (*top)[0]->num();
   const int label_data_count = (*top)[1]->count() / (*top)[1]->num();
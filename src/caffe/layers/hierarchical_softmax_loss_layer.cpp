@@ -0,0 +1,351 @@
+#include <algorithm>
+#include <fstream>  // NOLINT(readability/streams)
+#include <string>
+#include <vector>
+
+#include "caffe/filler.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/vision_layers.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+void HierarchicalSoftmaxLossLayer<Dtype>::LayerSetUp(
+    const vector<Blob<Dtype>*>& bottom, vector<Blob<Dtype>*>* top) {
+  const bool default_loss_weights =
+      this->layer_param_.loss_weight_size() == 0;
+  LossLayer<Dtype>::LayerSetUp(bottom, top);
+  if (default_loss_weights && top->size() == 2) {
+    this->layer_param_.add_loss_weight(Dtype(0));
+  }
+  const HierarchicalSoftmaxParameter& param =
+      this->layer_param_.hierarchical_softmax_param();
+  num_output_ = param.num_output();
+  CHECK_GT(num_output_, 0) << "num_output must be positive.";
+  bias_term_ = param.bias_term();
+  dim_ = bottom[0]->count() / bottom[0]->num();
+  if (top->size() == 2) {
+    (*top)[1]->Reshape(bottom[0]->num(), num_output_, 1, 1);
+  }
+  std::ifstream infile(param.cluster_file().c_str());
+  CHECK(infile.good()) << "Failed to open cluster file "
+      << param.cluster_file();
+  cluster_of_.clear();
+  int cluster;
+  num_clusters_ = 0;
+  while (infile >> cluster) {
+    CHECK_GE(cluster, 0) << "Negative cluster in " << param.cluster_file();
+    cluster_of_.push_back(cluster);
+    num_clusters_ = std::max(num_clusters_, cluster + 1);
+  }
+  CHECK_EQ(cluster_of_.size(), num_output_)
+      << "The cluster file needs one line per class.";
+  // Group the classes by cluster, keeping their order within each.
+  cluster_begin_.assign(num_clusters_ + 1, 0);
+  for (int k = 0; k < num_output_; ++k) {
+    ++cluster_begin_[cluster_of_[k] + 1];
+  }
+  for (int c = 0; c < num_clusters_; ++c) {
+    CHECK_GT(cluster_begin_[c + 1], 0) << "Cluster " << c << " is empty.";
+    cluster_begin_[c + 1] += cluster_begin_[c];
+  }
+  members_.resize(num_output_);
+  slot_of_.resize(num_output_);
+  vector<int> filled(cluster_begin_.begin(), cluster_begin_.end() - 1);
+  for (int k = 0; k < num_output_; ++k) {
+    const int c = cluster_of_[k];
+    slot_of_[k] = filled[c] - cluster_begin_[c];
+    members_[filled[c]++] = k;
+  }
+  if (this->blobs_.size() > 0) {
+    LOG(INFO) << "Skipping parameter initialization";
+  } else {
+    this->blobs_.resize(bias_term_ ? 4 : 2);
+    shared_ptr<Filler<Dtype> > weight_filler(GetFiller<Dtype>(
+        param.weight_filler()));
+    this->blobs_[0].reset(new Blob<Dtype>(num_clusters_, 1, 1, dim_));
+    weight_filler->Fill(this->blobs_[0].get());
+    this->blobs_[1].reset(new Blob<Dtype>(num_output_, 1, 1, dim_));
+    weight_filler->Fill(this->blobs_[1].get());
+    if (bias_term_) {
+      shared_ptr<Filler<Dtype> > bias_filler(GetFiller<Dtype>(
+          param.bias_filler()));
+      this->blobs_[2].reset(new Blob<Dtype>(num_clusters_, 1, 1, 1));
+      bias_filler->Fill(this->blobs_[2].get());
+      this->blobs_[3].reset(new Blob<Dtype>(num_output_, 1, 1, 1));
+      bias_filler->Fill(this->blobs_[3].get());
+    }
+  }
+  CHECK_EQ(this->blobs_[0]->num(), num_clusters_)
+      << "The cluster weights do not match the cluster file.";
+  this->param_propagate_down_.resize(this->blobs_.size(), true);
+  class_weight_sparse_ = false;
+  class_bias_sparse_ = false;
+}
+
+template <typename Dtype>
+void HierarchicalSoftmaxLossLayer<Dtype>::GatherClassRows(const int c) {
+  const int begin = cluster_begin_[c];
+  const int size = cluster_begin_[c + 1] - begin;
+  const Dtype* weight = this->blobs_[1]->cpu_data();
+  class_weight_.resize(size * dim_);
+  for (int j = 0; j < size; ++j) {
+    caffe_copy(dim_, weight + members_[begin + j] * dim_,
+        &class_weight_[j * dim_]);
+  }
+  if (bias_term_) {
+    const Dtype* bias = this->blobs_[3]->cpu_data();
+    class_bias_.resize(size);
+    for (int j = 0; j < size; ++j) {
+      class_bias_[j] = bias[members_[begin + j]];
+    }
+  }
+}
+
+template <typename Dtype>
+void HierarchicalSoftmaxLossLayer<Dtype>::FullProbabilities(
+    const Dtype* bottom_data, const int num, Dtype* prob) {
+  vector<Dtype> class_prob;
+  for (int c = 0; c < num_clusters_; ++c) {
+    const int begin = cluster_begin_[c];
+    const int size = cluster_begin_[c + 1] - begin;
+    GatherClassRows(c);
+    class_prob.resize(num * size);
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, num, size, dim_,
+        Dtype(1), bottom_data, &class_weight_[0], Dtype(0), &class_prob[0]);
+    if (bias_term_) {
+      caffe_cpu_axis_add<Dtype>(1, num, size, Dtype(1), &class_bias_[0],
+          &class_prob[0]);
+    }
+#pragma omp parallel for schedule(static) \
+    if (num * size >= caffe_parallel_grain())
+    for (int n = 0; n < num; ++n) {
+      Dtype* row = &class_prob[n * size];
+      caffe_cpu_softmax(size, row);
+      const Dtype cluster_prob = cluster_prob_[n * num_clusters_ + c];
+      for (int j = 0; j < size; ++j) {
+        prob[n * num_output_ + members_[begin + j]] = cluster_prob * row[j];
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void HierarchicalSoftmaxLossLayer<Dtype>::Forward_cpu(
+    const vector<Blob<Dtype>*>& bottom, vector<Blob<Dtype>*>* top) {
+  const Dtype* bottom_data = bottom[0]->cpu_data();
+  const Dtype* label = bottom[1]->cpu_data();
+  const int num = bottom[0]->num();
+  vector<Dtype> row_loss(num);
+  // The cluster softmax, over all clusters for every example.
+  cluster_prob_.resize(num * num_clusters_);
+  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, num, num_clusters_, dim_,
+      Dtype(1), bottom_data, this->blobs_[0]->cpu_data(), Dtype(0),
+      &cluster_prob_[0]);
+  if (bias_term_) {
+    caffe_cpu_axis_add<Dtype>(1, num, num_clusters_, Dtype(1),
+        this->blobs_[2]->cpu_data(), &cluster_prob_[0]);
+  }
+#pragma omp parallel for schedule(static) \
+    if (num * num_clusters_ >= caffe_parallel_grain())
+  for (int n = 0; n < num; ++n) {
+    Dtype* row = &cluster_prob_[n * num_clusters_];
+    const Dtype label_score = row[cluster_of_[static_cast<int>(label[n])]];
+    row_loss[n] = caffe_cpu_softmax(num_clusters_, row) - label_score;
+  }
+  // Group the batch by label cluster so that each cluster's class rows are
+  // gathered once.
+  vector<int> count(num_clusters_ + 1, 0);
+  for (int n = 0; n < num; ++n) {
+    const int label_value = static_cast<int>(label[n]);
+    DCHECK_GE(label_value, 0);
+    DCHECK_LT(label_value, num_output_);
+    ++count[cluster_of_[label_value] + 1];
+  }
+  group_begin_.clear();
+  group_cluster_.clear();
+  for (int c = 0; c < num_clusters_; ++c) {
+    if (count[c + 1] > 0) {
+      group_begin_.push_back(count[c]);
+      group_cluster_.push_back(c);
+    }
+    count[c + 1] += count[c];
+  }
+  group_begin_.push_back(num);
+  order_.resize(num);
+  for (int n = 0; n < num; ++n) {
+    order_[count[cluster_of_[static_cast<int>(label[n])]]++] = n;
+  }
+  // The class softmax within each group's cluster.
+  int offset = 0;
+  for (int g = 0; g < group_cluster_.size(); ++g) {
+    offset += (group_begin_[g + 1] - group_begin_[g]) *
+        (cluster_begin_[group_cluster_[g] + 1] -
+         cluster_begin_[group_cluster_[g]]);
+  }
+  class_prob_.resize(offset);
+  offset = 0;
+  for (int g = 0; g < group_cluster_.size(); ++g) {
+    const int c = group_cluster_[g];
+    const int size = cluster_begin_[c + 1] - cluster_begin_[c];
+    const int group_size = group_begin_[g + 1] - group_begin_[g];
+    const int* examples = &order_[group_begin_[g]];
+    GatherClassRows(c);
+    group_data_.resize(group_size * dim_);
+    for (int i = 0; i < group_size; ++i) {
+      caffe_copy(dim_, bottom_data + examples[i] * dim_,
+          &group_data_[i * dim_]);
+    }
+    Dtype* prob = &class_prob_[offset];
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, group_size, size, dim_,
+        Dtype(1), &group_data_[0], &class_weight_[0], Dtype(0), prob);
+    if (bias_term_) {
+      caffe_cpu_axis_add<Dtype>(1, group_size, size, Dtype(1),
+          &class_bias_[0], prob);
+    }
+    for (int i = 0; i < group_size; ++i) {
+      Dtype* row = prob + i * size;
+      const int n = examples[i];
+      const Dtype label_score = row[slot_of_[static_cast<int>(label[n])]];
+      row_loss[n] += caffe_cpu_softmax(size, row) - label_score;
+    }
+    offset += group_size * size;
+  }
+  Dtype loss = 0;
+  for (int n = 0; n < num; ++n) {
+    loss += row_loss[n];
+  }
+  (*top)[0]->mutable_cpu_data()[0] = loss / num;
+  if (top->size() == 2) {
+    FullProbabilities(bottom_data, num, (*top)[1]->mutable_cpu_data());
+  }
+}
+
+template <typename Dtype>
+void HierarchicalSoftmaxLossLayer<Dtype>::Backward_cpu(
+    const vector<Blob<Dtype>*>& top, const vector<bool>& propagate_down,
+    vector<Blob<Dtype>*>* bottom) {
+  if (propagate_down[1]) {
+    LOG(FATAL) << this->type_name()
+               << " Layer cannot backpropagate to label inputs.";
+  }
+  const Dtype* bottom_data = (*bottom)[0]->cpu_data();
+  const Dtype* label = (*bottom)[1]->cpu_data();
+  Dtype* bottom_diff = propagate_down[0] ?
+      (*bottom)[0]->mutable_cpu_diff() : NULL;
+  const int num = (*bottom)[0]->num();
+  const Dtype scale = top[0]->cpu_diff()[0] / num;
+  // The cluster softmax, whose parameters are dense.
+  vector<Dtype> cluster_diff(cluster_prob_);
+  for (int n = 0; n < num; ++n) {
+    cluster_diff[n * num_clusters_ +
+        cluster_of_[static_cast<int>(label[n])]] -= 1;
+  }
+  if (bottom_diff) {
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num, dim_,
+        num_clusters_, scale, &cluster_diff[0], this->blobs_[0]->cpu_data(),
+        Dtype(0), bottom_diff);
+  }
+  if (this->param_propagate_down_[0]) {
+    caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, num_clusters_, dim_,
+        num, scale, &cluster_diff[0], bottom_data, Dtype(0),
+        this->blobs_[0]->mutable_cpu_diff());
+  }
+  if (bias_term_ && this->param_propagate_down_[2]) {
+    caffe_cpu_axis_sum<Dtype>(1, num, num_clusters_, scale,
+        &cluster_diff[0], Dtype(0), this->blobs_[2]->mutable_cpu_diff());
+  }
+  // The class softmax, writing only the rows of the clusters in the batch.
+  const bool class_weight_down = this->param_propagate_down_[1];
+  const bool class_bias_down = bias_term_ && this->param_propagate_down_[3];
+  Dtype* class_weight_diff = class_weight_down ?
+      this->blobs_[1]->mutable_cpu_diff() : NULL;
+  Dtype* class_bias_diff = class_bias_down ?
+      this->blobs_[3]->mutable_cpu_diff() : NULL;
+  vector<Dtype> class_diff;
+  vector<Dtype> row_diff;
+  class_rows_.clear();
+  int offset = 0;
+  for (int g = 0; g < group_cluster_.size(); ++g) {
+    const int c = group_cluster_[g];
+    const int begin = cluster_begin_[c];
+    const int size = cluster_begin_[c + 1] - begin;
+    const int group_size = group_begin_[g + 1] - group_begin_[g];
+    const int* examples = &order_[group_begin_[g]];
+    class_diff.assign(class_prob_.begin() + offset,
+        class_prob_.begin() + offset + group_size * size);
+    offset += group_size * size;
+    for (int i = 0; i < group_size; ++i) {
+      class_diff[i * size + slot_of_[static_cast<int>(label[examples[i]])]]
+          -= 1;
+    }
+    if (class_weight_down) {
+      group_data_.resize(group_size * dim_);
+      for (int i = 0; i < group_size; ++i) {
+        caffe_copy(dim_, bottom_data + examples[i] * dim_,
+            &group_data_[i * dim_]);
+      }
+      row_diff.resize(size * dim_);
+      caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, size, dim_,
+          group_size, scale, &class_diff[0], &group_data_[0], Dtype(0),
+          &row_diff[0]);
+      for (int j = 0; j < size; ++j) {
+        caffe_copy(dim_, &row_diff[j * dim_],
+            class_weight_diff + members_[begin + j] * dim_);
+      }
+    }
+    if (class_bias_down) {
+      row_diff.resize(size);
+      caffe_cpu_axis_sum<Dtype>(1, group_size, size, scale, &class_diff[0],
+          Dtype(0), &row_diff[0]);
+      for (int j = 0; j < size; ++j) {
+        class_bias_diff[members_[begin + j]] = row_diff[j];
+      }
+    }
+    if (bottom_diff) {
+      GatherClassRows(c);
+      group_diff_.resize(group_size * dim_);
+      caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, group_size, dim_,
+          size, scale, &class_diff[0], &class_weight_[0], Dtype(0),
+          &group_diff_[0]);
+      for (int i = 0; i < group_size; ++i) {
+        caffe_axpy(dim_, Dtype(1), &group_diff_[i * dim_],
+            bottom_diff + examples[i] * dim_);
+      }
+    }
+    class_rows_.insert(class_rows_.end(), members_.begin() + begin,
+        members_.begin() + begin + size);
+  }
+  std::sort(class_rows_.begin(), class_rows_.end());
+  class_weight_sparse_ = class_weight_down;
+  class_bias_sparse_ = class_bias_down;
+}
+
+template <typename Dtype>
+const vector<int>* HierarchicalSoftmaxLossLayer<Dtype>::sparse_param_rows(
+    const int param_id) const {
+  if ((param_id == 1 && class_weight_sparse_) ||
+      (param_id == 3 && class_bias_sparse_)) {
+    return &class_rows_;
+  }
+  return NULL;
+}
+
+template <typename Dtype>
+void HierarchicalSoftmaxLossLayer<Dtype>::DensifyParamDiff(
+    const int param_id) {
+  if (!sparse_param_rows(param_id)) { return; }
+  Blob<Dtype>* param = this->blobs_[param_id].get();
+  caffe_cpu_zero_other_rows(param->num(), param->count() / param->num(),
+      class_rows_, param->mutable_cpu_diff());
+  if (param_id == 1) {
+    class_weight_sparse_ = false;
+  } else {
+    class_bias_sparse_ = false;
+  }
+}
+
+INSTANTIATE_CLASS(HierarchicalSoftmaxLossLayer);
+
+}  // namespace caffe
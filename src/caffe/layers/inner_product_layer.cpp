@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <limits>
 #include <vector>
 
 #include "caffe/blob.hpp"
@@ -15,10 +17,24 @@ void InnerProductLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   const int num_output = this->layer_param_.inner_product_param().num_output();
   bias_term_ = this->layer_param_.inner_product_param().bias_term();
   // Figure out the dimensions
-  M_ = bottom[0]->num();
-  K_ = bottom[0]->count() / bottom[0]->num();
+  CHECK(bottom.size() == 1 || bottom.size() == 3) << this->type_name()
+      << " Layer takes a dense input or the values, indices and row pointers"
+      << " of a sparse one.";
+  sparse_input_ = bottom.size() == 3;
+  if (sparse_input_) {
+    M_ = bottom[2]->count() - 1;
+    K_ = this->layer_param_.inner_product_param().sparse_input_dim();
+    CHECK_GT(K_, 0) << "sparse_input_dim must be set for a sparse input.";
+    if (std::numeric_limits<Dtype>::digits < 31) {
+      CHECK_LE(K_, 1 << std::numeric_limits<Dtype>::digits)
+          << "The feature indices must be exact in Dtype.";
+    }
+  } else {
+    M_ = bottom[0]->num();
+    K_ = bottom[0]->count() / bottom[0]->num();
+  }
   N_ = num_output;
-  (*top)[0]->Reshape(bottom[0]->num(), num_output, 1, 1);
+  (*top)[0]->Reshape(M_, num_output, 1, 1);
   // Check if we need to set up the weights
   if (this->blobs_.size() > 0) {
     LOG(INFO) << "Skipping parameter initialization";
@@ -28,8 +44,12 @@ void InnerProductLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
     } else {
       this->blobs_.resize(1);
     }
-    // Intialize the weight
-    this->blobs_[0].reset(new Blob<Dtype>(1, 1, N_, K_));
+    // Intialize the weight, with one row per feature for a sparse input
+    if (sparse_input_) {
+      this->blobs_[0].reset(new Blob<Dtype>(K_, 1, 1, N_));
+    } else {
+      this->blobs_[0].reset(new Blob<Dtype>(1, 1, N_, K_));
+    }
     // fill the weights
     shared_ptr<Filler<Dtype> > weight_filler(GetFiller<Dtype>(
         this->layer_param_.inner_product_param().weight_filler()));
@@ -42,26 +62,178 @@ void InnerProductLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       bias_filler->Fill(this->blobs_[1].get());
     }
   }  // parameter initialization
-  // Setting up the bias multiplier
+  // Setting up the bias multiplier, used on the GPU
   if (bias_term_) {
     bias_multiplier_.Reshape(1, 1, 1, M_);
     caffe_set(M_, Dtype(1), bias_multiplier_.mutable_cpu_data());
   }
   this->param_propagate_down_.resize(this->blobs_.size(), true);
+  // Forces UseSparseWeights() to measure the weights on the first pass.
+  sparse_from_.reset();
+  weight_diff_sparse_ = false;
+}
+
+template <typename Dtype>
+bool InnerProductLayer<Dtype>::UseSparseWeights() {
+  const Dtype max_density =
+      this->layer_param_.inner_product_param().sparse_density();
+  if (Caffe::phase() != Caffe::TEST || max_density <= 0 || sparse_input_) {
+    return false;
+  }
+  const Blob<Dtype>& weights = *this->blobs_[0];
+  if (sparse_from_ == weights.data() &&
+      sparse_version_ == weights.data()->version()) {
+    return use_sparse_;
+  }
+  sparse_from_ = weights.data();
+  sparse_version_ = weights.data()->version();
+  const Dtype* w = weights.cpu_data();
+  int nonzeros = 0;
+  for (int i = 0; i < N_ * K_; ++i) {
+    nonzeros += w[i] != 0;
+  }
+  use_sparse_ = nonzeros <= max_density * N_ * K_;
+  if (!use_sparse_) {
+    sparse_row_ptr_.clear();
+    sparse_col_index_.clear();
+    sparse_values_.clear();
+    return false;
+  }
+  sparse_row_ptr_.resize(N_ + 1);
+  sparse_col_index_.resize(nonzeros);
+  sparse_values_.resize(nonzeros);
+  int i = 0;
+  for (int n = 0; n < N_; ++n) {
+    sparse_row_ptr_[n] = i;
+    for (int k = 0; k < K_; ++k) {
+      if (w[n * K_ + k] != 0) {
+        sparse_col_index_[i] = k;
+        sparse_values_[i] = w[n * K_ + k];
+        ++i;
+      }
+    }
+  }
+  sparse_row_ptr_[N_] = i;
+  return true;
+}
+
+template <typename Dtype>
+void InnerProductLayer<Dtype>::ForwardSparseInput(
+    const vector<Blob<Dtype>*>& bottom, vector<Blob<Dtype>*>* top) {
+  const Dtype* values = bottom[0]->cpu_data();
+  const Dtype* indices = bottom[1]->cpu_data();
+  const Dtype* row_ptr = bottom[2]->cpu_data();
+  const Dtype* weight = this->blobs_[0]->cpu_data();
+  const Dtype* bias = bias_term_ ? this->blobs_[1]->cpu_data() : NULL;
+  Dtype* top_data = (*top)[0]->mutable_cpu_data();
+  // The pointers and indices are only exact in Dtype up to its mantissa.
+  if (std::numeric_limits<Dtype>::digits < 31) {
+    CHECK_LE(bottom[0]->count(), 1 << std::numeric_limits<Dtype>::digits)
+        << "The row pointers must be exact in Dtype.";
+  }
+  // Validate the batch before the parallel loop, where a CHECK cannot fail
+  // cleanly.
+  CHECK_EQ(row_ptr[0], 0);
+  for (int m = 0; m < M_; ++m) {
+    CHECK_LE(row_ptr[m], row_ptr[m + 1]) << "Row pointers must not decrease.";
+  }
+  const int nonzeros = static_cast<int>(row_ptr[M_]);
+  CHECK_LE(nonzeros, bottom[0]->count());
+  CHECK_LE(nonzeros, bottom[1]->count());
+  for (int j = 0; j < nonzeros; ++j) {
+    const int k = static_cast<int>(indices[j]);
+    CHECK(k >= 0 && k < K_) << "Feature index " << k << " out of range.";
+  }
+  const bool parallel = (nonzeros + M_) * N_ >= caffe_parallel_grain();
+#pragma omp parallel for schedule(static) if (parallel)
+  for (int m = 0; m < M_; ++m) {
+    Dtype* y = top_data + m * N_;
+    if (bias) {
+      std::copy(bias, bias + N_, y);
+    } else {
+      caffe_set(N_, Dtype(0), y);
+    }
+    const int end = static_cast<int>(row_ptr[m + 1]);
+    for (int j = static_cast<int>(row_ptr[m]); j < end; ++j) {
+      const Dtype v = values[j];
+      const Dtype* w = weight + static_cast<int>(indices[j]) * N_;
+      for (int n = 0; n < N_; ++n) {
+        y[n] += v * w[n];
+      }
+    }
+  }
+  weight_diff_sparse_ = false;
 }
 
 template <typename Dtype>
 void InnerProductLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     vector<Blob<Dtype>*>* top) {
+  if (sparse_input_) {
+    ForwardSparseInput(bottom, top);
+    return;
+  }
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = (*top)[0]->mutable_cpu_data();
-  const Dtype* weight = this->blobs_[0]->cpu_data();
-  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, M_, N_, K_, (Dtype)1.,
-      bottom_data, weight, (Dtype)0., top_data);
+  if (UseSparseWeights()) {
+    caffe_cpu_csr_gemm<Dtype>(M_, N_, K_, bottom_data, &sparse_row_ptr_[0],
+        sparse_col_index_.empty() ? NULL : &sparse_col_index_[0],
+        sparse_values_.empty() ? NULL : &sparse_values_[0], top_data);
+  } else {
+    const Dtype* weight = this->blobs_[0]->cpu_data();
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, M_, N_, K_, (Dtype)1.,
+        bottom_data, weight, (Dtype)0., top_data);
+  }
   if (bias_term_) {
-    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, M_, N_, 1, (Dtype)1.,
-        bias_multiplier_.cpu_data(),
-        this->blobs_[1]->cpu_data(), (Dtype)1., top_data);
+    caffe_cpu_axis_add<Dtype>(1, M_, N_, 1., this->blobs_[1]->cpu_data(),
+        top_data);
+  }
+}
+
+template <typename Dtype>
+void InnerProductLayer<Dtype>::BackwardSparseInput(
+    const vector<Blob<Dtype>*>& top, const vector<bool>& propagate_down,
+    vector<Blob<Dtype>*>* bottom) {
+  for (int i = 0; i < propagate_down.size(); ++i) {
+    if (propagate_down[i]) {
+      LOG(FATAL) << this->type_name()
+          << " Layer cannot backpropagate to sparse inputs.";
+    }
+  }
+  const Dtype* top_diff = top[0]->cpu_diff();
+  if (this->param_propagate_down_[0]) {
+    const Dtype* values = (*bottom)[0]->cpu_data();
+    const Dtype* indices = (*bottom)[1]->cpu_data();
+    const Dtype* row_ptr = (*bottom)[2]->cpu_data();
+    const int nonzeros = static_cast<int>(row_ptr[M_]);
+    active_features_.resize(nonzeros);
+    for (int j = 0; j < nonzeros; ++j) {
+      active_features_[j] = static_cast<int>(indices[j]);
+    }
+    std::sort(active_features_.begin(), active_features_.end());
+    active_features_.erase(std::unique(active_features_.begin(),
+        active_features_.end()), active_features_.end());
+    // Gradient with respect to the weight rows of the active features
+    Dtype* weight_diff = this->blobs_[0]->mutable_cpu_diff();
+    for (int i = 0; i < active_features_.size(); ++i) {
+      caffe_set(N_, Dtype(0), weight_diff + active_features_[i] * N_);
+    }
+    for (int m = 0; m < M_; ++m) {
+      const Dtype* dy = top_diff + m * N_;
+      const int end = static_cast<int>(row_ptr[m + 1]);
+      for (int j = static_cast<int>(row_ptr[m]); j < end; ++j) {
+        const Dtype v = values[j];
+        Dtype* dw = weight_diff + static_cast<int>(indices[j]) * N_;
+        for (int n = 0; n < N_; ++n) {
+          dw[n] += v * dy[n];
+        }
+      }
+    }
+    weight_diff_sparse_ = true;
+  }
+  if (bias_term_ && this->param_propagate_down_[1]) {
+    // Gradient with respect to bias
+    caffe_cpu_axis_sum<Dtype>(1, M_, N_, 1., top_diff, 0.,
+        this->blobs_[1]->mutable_cpu_diff());
   }
 }
 
@@ -69,6 +241,10 @@ template <typename Dtype>
 void InnerProductLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down,
     vector<Blob<Dtype>*>* bottom) {
+  if (sparse_input_) {
+    BackwardSparseInput(top, propagate_down, bottom);
+    return;
+  }
   if (this->param_propagate_down_[0]) {
     const Dtype* top_diff = top[0]->cpu_diff();
     const Dtype* bottom_data = (*bottom)[0]->cpu_data();
@@ -79,8 +255,7 @@ void InnerProductLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   if (bias_term_ && this->param_propagate_down_[1]) {
     const Dtype* top_diff = top[0]->cpu_diff();
     // Gradient with respect to bias
-    caffe_cpu_gemv<Dtype>(CblasTrans, M_, N_, (Dtype)1., top_diff,
-        bias_multiplier_.cpu_data(), (Dtype)0.,
+    caffe_cpu_axis_sum<Dtype>(1, M_, N_, 1., top_diff, 0.,
         this->blobs_[1]->mutable_cpu_diff());
   }
   if (propagate_down[0]) {
@@ -92,6 +267,20 @@ void InnerProductLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   }
 }
 
+template <typename Dtype>
+const vector<int>* InnerProductLayer<Dtype>::sparse_param_rows(
+    const int param_id) const {
+  return param_id == 0 && weight_diff_sparse_ ? &active_features_ : NULL;
+}
+
+template <typename Dtype>
+void InnerProductLayer<Dtype>::DensifyParamDiff(const int param_id) {
+  if (!sparse_param_rows(param_id)) { return; }
+  caffe_cpu_zero_other_rows(K_, N_, active_features_,
+      this->blobs_[0]->mutable_cpu_diff());
+  weight_diff_sparse_ = false;
+}
+
 #ifdef CPU_ONLY
 STUB_GPU(InnerProductLayer);
 #endif
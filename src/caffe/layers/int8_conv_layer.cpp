@@ -0,0 +1,105 @@
+#include <algorithm>
+#include <vector>
+
+#include "caffe/layer.hpp"
+#include "caffe/util/im2col.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/vision_layers.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+void Int8ConvolutionLayer<Dtype>::LayerSetUp(
+    const vector<Blob<Dtype>*>& bottom, vector<Blob<Dtype>*>* top) {
+  ConvolutionLayer<Dtype>::LayerSetUp(bottom, top);
+  quantized_image_.resize(this->channels_ * this->height_ * this->width_);
+  quantized_rows_.resize(this->N_ * this->K_);
+  engines_.resize(this->group_);
+  for (int g = 0; g < this->group_; ++g) {
+    engines_[g].reset(
+        new Int8Engine<Dtype>(this->layer_param_.quantization_param()));
+  }
+  // Forces QuantizeWeights() on the first forward pass.
+  quantized_from_.reset();
+}
+
+template <typename Dtype>
+uint64_t Int8ConvolutionLayer<Dtype>::workspace_bytes() const {
+  uint64_t bytes = ConvolutionLayer<Dtype>::workspace_bytes()
+      + quantized_image_.size() + quantized_rows_.size();
+  for (int g = 0; g < engines_.size(); ++g) {
+    bytes += engines_[g]->workspace_bytes();
+  }
+  return bytes;
+}
+
+template <typename Dtype>
+void Int8ConvolutionLayer<Dtype>::QuantizeWeights() {
+  const Blob<Dtype>& weights = *this->blobs_[0];
+  if (quantized_from_ == weights.data() &&
+      quantized_version_ == weights.data()->version()) {
+    return;
+  }
+  for (int g = 0; g < this->group_; ++g) {
+    engines_[g]->SetWeights(this->M_, this->K_,
+        weights.cpu_data() + g * this->M_ * this->K_);
+  }
+  quantized_from_ = weights.data();
+  quantized_version_ = weights.data()->version();
+}
+
+// Each image is quantized once and unrolled by im2row straight into the
+// N_ x K_ rows the engine of each group multiplies with its filters.
+template <typename Dtype>
+void Int8ConvolutionLayer<Dtype>::Forward_cpu(
+    const vector<Blob<Dtype>*>& bottom, vector<Blob<Dtype>*>* top) {
+  QuantizeWeights();
+  const Dtype* bias = this->bias_term_ ? this->blobs_[1]->cpu_data() : NULL;
+  const int image_size = this->channels_ * this->height_ * this->width_;
+  const int group_size = image_size / this->group_;
+  const int top_offset = this->M_ * this->N_;
+  for (int i = 0; i < bottom.size(); ++i) {
+    const Dtype* bottom_data = bottom[i]->cpu_data();
+    Dtype* top_data = (*top)[i]->mutable_cpu_data();
+    for (int n = 0; n < this->num_; ++n) {
+      const Dtype* image = bottom_data + bottom[i]->offset(n);
+      Dtype scale;
+      int zero_point;
+      engines_[0]->InputQuantization(image_size, image, &scale, &zero_point);
+      caffe_cpu_quantize_u8(image_size, image, scale, zero_point,
+          &quantized_image_[0]);
+      for (int g = 0; g < this->group_; ++g) {
+        im2row_cpu(&quantized_image_[0] + group_size * g,
+            this->channels_ / this->group_, this->height_, this->width_,
+            this->kernel_h_, this->kernel_w_, this->pad_h_, this->pad_w_,
+            this->stride_h_, this->stride_w_,
+            static_cast<uint8_t>(zero_point), &quantized_rows_[0]);
+        engines_[g]->Forward(this->N_, &quantized_rows_[0], scale,
+            zero_point, bias ? bias + this->M_ * g : NULL, true,
+            top_data + (*top)[i]->offset(n) + top_offset * g);
+      }
+    }
+  }
+}
+
+// The GPU pass is the float one, which cannot apply the fused ReLU.
+template <typename Dtype>
+void Int8ConvolutionLayer<Dtype>::Forward_gpu(
+    const vector<Blob<Dtype>*>& bottom, vector<Blob<Dtype>*>* top) {
+  CHECK(!this->layer_param_.quantization_param().fuse_relu())
+      << "The INT8 engine runs on the CPU only; GPU mode has no fused ReLU.";
+  ConvolutionLayer<Dtype>::Forward_gpu(bottom, top);
+}
+
+template <typename Dtype>
+void Int8ConvolutionLayer<Dtype>::Backward_cpu(
+    const vector<Blob<Dtype>*>& top, const vector<bool>& propagate_down,
+    vector<Blob<Dtype>*>* bottom) {
+  CHECK(!this->layer_param_.quantization_param().fuse_relu())
+      << "The INT8 engine has no backward pass for a fused ReLU.";
+  ConvolutionLayer<Dtype>::Backward_cpu(top, propagate_down, bottom);
+}
+
+INSTANTIATE_CLASS(Int8ConvolutionLayer);
+
+}  // namespace caffe
@@ -0,0 +1,63 @@
+#include <algorithm>
+#include <vector>
+
+#include "caffe/common_layers.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+void Int8InnerProductLayer<Dtype>::LayerSetUp(
+    const vector<Blob<Dtype>*>& bottom, vector<Blob<Dtype>*>* top) {
+  // Also enforced by ExactNumBottomBlobs(); the engine has no sparse path.
+  CHECK_EQ(bottom.size(), 1) << "The INT8 engine takes a dense input only.";
+  InnerProductLayer<Dtype>::LayerSetUp(bottom, top);
+  engine_.reset(
+      new Int8Engine<Dtype>(this->layer_param_.quantization_param()));
+  // Forces QuantizeWeights() on the first forward pass.
+  quantized_from_.reset();
+}
+
+template <typename Dtype>
+void Int8InnerProductLayer<Dtype>::QuantizeWeights() {
+  const Blob<Dtype>& weights = *this->blobs_[0];
+  if (quantized_from_ == weights.data() &&
+      quantized_version_ == weights.data()->version()) {
+    return;
+  }
+  engine_->SetWeights(this->N_, this->K_, weights.cpu_data());
+  quantized_from_ = weights.data();
+  quantized_version_ = weights.data()->version();
+}
+
+template <typename Dtype>
+void Int8InnerProductLayer<Dtype>::Forward_cpu(
+    const vector<Blob<Dtype>*>& bottom, vector<Blob<Dtype>*>* top) {
+  QuantizeWeights();
+  engine_->Forward(this->M_, bottom[0]->cpu_data(),
+      this->bias_term_ ? this->blobs_[1]->cpu_data() : NULL,
+      (*top)[0]->mutable_cpu_data());
+}
+
+// The GPU pass is the float one, which cannot apply the fused ReLU.
+template <typename Dtype>
+void Int8InnerProductLayer<Dtype>::Forward_gpu(
+    const vector<Blob<Dtype>*>& bottom, vector<Blob<Dtype>*>* top) {
+  CHECK(!this->layer_param_.quantization_param().fuse_relu())
+      << "The INT8 engine runs on the CPU only; GPU mode has no fused ReLU.";
+  InnerProductLayer<Dtype>::Forward_gpu(bottom, top);
+}
+
+template <typename Dtype>
+void Int8InnerProductLayer<Dtype>::Backward_cpu(
+    const vector<Blob<Dtype>*>& top, const vector<bool>& propagate_down,
+    vector<Blob<Dtype>*>* bottom) {
+  CHECK(!this->layer_param_.quantization_param().fuse_relu())
+      << "The INT8 engine has no backward pass for a fused ReLU.";
+  InnerProductLayer<Dtype>::Backward_cpu(top, propagate_down, bottom);
+}
+
+INSTANTIATE_CLASS(Int8InnerProductLayer);
+
+}  // namespace caffe
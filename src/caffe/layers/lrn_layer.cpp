@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <cmath>
 #include <vector>
 
 #include "caffe/layer.hpp"
@@ -6,6 +8,90 @@
 
 namespace caffe {
 
+// Spatial positions the cross-channel kernels carry down the channels at a
+// time; the running sums for one tile stay in L1.
+const int kLRNTile = 256;
+
+// out = s^-beta. The usual beta of 0.75 takes two square roots, and 1 a
+// division, instead of a pow per element.
+template <typename Dtype>
+static void lrn_negative_pow(const int n, const Dtype* s, const Dtype beta,
+    Dtype* out) {
+  if (beta == Dtype(0.75)) {
+    for (int i = 0; i < n; ++i) {
+      const Dtype root = sqrt(s[i]);
+      out[i] = Dtype(1) / (root * sqrt(root));
+    }
+  } else if (beta == Dtype(1)) {
+    for (int i = 0; i < n; ++i) {
+      out[i] = Dtype(1) / s[i];
+    }
+  } else {
+    for (int i = 0; i < n; ++i) {
+      out[i] = pow(s[i], -beta);
+    }
+  }
+}
+
+template <typename Dtype>
+static void lrn_accumulate_square(const int n, const Dtype* x,
+    const Dtype sign, Dtype* accum) {
+  for (int i = 0; i < n; ++i) {
+    accum[i] += sign * x[i] * x[i];
+  }
+}
+
+template <typename Dtype>
+static void lrn_accumulate_ratio(const int n, const Dtype* dy, const Dtype* y,
+    const Dtype* scale, const Dtype sign, Dtype* accum) {
+  for (int i = 0; i < n; ++i) {
+    accum[i] += sign * dy[i] * y[i] / scale[i];
+  }
+}
+
+// out(h, w) = sum of in (squared if square is set) over rows [h - pre,
+// h + post] and columns [w - pre, w + post], clipped to the plane. The rows
+// are summed first, into row_sum; each pass adds whole shifted rows so the
+// inner loops vectorize.
+template <typename Dtype>
+static void lrn_box_sum(const int height, const int width, const int pre,
+    const int post, const bool square, const Dtype* in, Dtype* row_sum,
+    Dtype* out) {
+  for (int h = 0; h < height; ++h) {
+    const Dtype* in_row = in + h * width;
+    Dtype* sum_row = row_sum + h * width;
+    for (int w = 0; w < width; ++w) {
+      sum_row[w] = 0;
+    }
+    for (int k = -pre; k <= post; ++k) {
+      const int w_begin = std::max(0, -k);
+      const int w_end = std::min(width, width - k);
+      if (square) {
+        for (int w = w_begin; w < w_end; ++w) {
+          sum_row[w] += in_row[w + k] * in_row[w + k];
+        }
+      } else {
+        for (int w = w_begin; w < w_end; ++w) {
+          sum_row[w] += in_row[w + k];
+        }
+      }
+    }
+  }
+  for (int h = 0; h < height; ++h) {
+    Dtype* out_row = out + h * width;
+    for (int w = 0; w < width; ++w) {
+      out_row[w] = 0;
+    }
+    for (int r = std::max(0, h - pre); r <= std::min(height - 1, h + post);
+        ++r) {
+      const Dtype* sum_row = row_sum + r * width;
+      for (int w = 0; w < width; ++w) {
+        out_row[w] += sum_row[w];
+      }
+    }
+  }
+}
+
 template <typename Dtype>
 void LRNLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       vector<Blob<Dtype>*>* top) {
@@ -24,6 +110,9 @@ void LRNLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
     break;
   case LRNParameter_NormRegion_WITHIN_CHANNEL:
     {
+      // The CPU kernels only need scale_; the subnet below runs on the GPU,
+      // and its blobs are never allocated on the CPU.
+      scale_.Reshape(num_, channels_, height_, width_);
       // Set up split_layer_ to use inputs in the numerator and denominator.
       split_top_vec_.clear();
       split_top_vec_.push_back(&product_input_);
@@ -102,7 +191,7 @@ void LRNLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     CrossChannelForward_cpu(bottom, top);
     break;
   case LRNParameter_NormRegion_WITHIN_CHANNEL:
-    WithinChannelForward(bottom, top);
+    WithinChannelForward_cpu(bottom, top);
     break;
   default:
     LOG(FATAL) << "Unknown normalization region.";
@@ -115,45 +204,81 @@ void LRNLayer<Dtype>::CrossChannelForward_cpu(
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = (*top)[0]->mutable_cpu_data();
   Dtype* scale_data = scale_.mutable_cpu_data();
-  // start with the constant value
-  for (int i = 0; i < scale_.count(); ++i) {
-    scale_data[i] = 1.;
-  }
-  Blob<Dtype> padded_square(1, channels_ + size_ - 1, height_, width_);
-  Dtype* padded_square_data = padded_square.mutable_cpu_data();
-  caffe_set(padded_square.count(), Dtype(0), padded_square_data);
-  Dtype alpha_over_size = alpha_ / size_;
-  // go through the images
-  for (int n = 0; n < num_; ++n) {
-    // compute the padded square
-    caffe_sqr(channels_ * height_ * width_,
-        bottom_data + bottom[0]->offset(n),
-        padded_square_data + padded_square.offset(0, pre_pad_));
-    // Create the first channel scale
-    for (int c = 0; c < size_; ++c) {
-      caffe_axpy<Dtype>(height_ * width_, alpha_over_size,
-          padded_square_data + padded_square.offset(0, c),
-          scale_data + scale_.offset(n, 0));
+  const int spatial = height_ * width_;
+  const int tiles = (spatial + kLRNTile - 1) / kLRNTile;
+  const int post_pad = size_ - pre_pad_ - 1;
+  const Dtype alpha_over_size = alpha_ / size_;
+  // Every (image, spatial tile) slides its own window of squares down the
+  // channels, so scale_ and the top are each written once.
+#pragma omp parallel for schedule(static) \
+    if (scale_.count() >= caffe_parallel_grain())
+  for (int task = 0; task < num_ * tiles; ++task) {
+    const int begin = (task % tiles) * kLRNTile;
+    const int len = std::min(kLRNTile, spatial - begin);
+    const int offset = scale_.offset(task / tiles) + begin;
+    const Dtype* x = bottom_data + offset;
+    Dtype accum[kLRNTile];
+    Dtype power[kLRNTile];
+    for (int i = 0; i < len; ++i) {
+      accum[i] = 0;
     }
-    for (int c = 1; c < channels_; ++c) {
-      // copy previous scale
-      caffe_copy<Dtype>(height_ * width_,
-          scale_data + scale_.offset(n, c - 1),
-          scale_data + scale_.offset(n, c));
-      // add head
-      caffe_axpy<Dtype>(height_ * width_, alpha_over_size,
-          padded_square_data + padded_square.offset(0, c + size_ - 1),
-          scale_data + scale_.offset(n, c));
-      // subtract tail
-      caffe_axpy<Dtype>(height_ * width_, -alpha_over_size,
-          padded_square_data + padded_square.offset(0, c - 1),
-          scale_data + scale_.offset(n, c));
+    // The window of channel c is [c - pre_pad_, c + post_pad].
+    for (int c = 0; c < std::min(post_pad, channels_); ++c) {
+      lrn_accumulate_square(len, x + c * spatial, Dtype(1), accum);
+    }
+    for (int c = 0; c < channels_; ++c) {
+      const int head = c + post_pad;
+      const int tail = c - pre_pad_ - 1;
+      if (head < channels_) {
+        lrn_accumulate_square(len, x + head * spatial, Dtype(1), accum);
+      }
+      if (tail >= 0) {
+        lrn_accumulate_square(len, x + tail * spatial, Dtype(-1), accum);
+      }
+      const Dtype* x_c = x + c * spatial;
+      Dtype* scale_c = scale_data + offset + c * spatial;
+      Dtype* top_c = top_data + offset + c * spatial;
+      for (int i = 0; i < len; ++i) {
+        scale_c[i] = 1. + alpha_over_size * accum[i];
+      }
+      lrn_negative_pow(len, scale_c, beta_, power);
+      for (int i = 0; i < len; ++i) {
+        top_c[i] = x_c[i] * power[i];
+      }
     }
   }
+}
 
-  // In the end, compute output
-  caffe_powx<Dtype>(scale_.count(), scale_data, -beta_, top_data);
-  caffe_mul<Dtype>(scale_.count(), top_data, bottom_data, top_data);
+template <typename Dtype>
+void LRNLayer<Dtype>::WithinChannelForward_cpu(
+    const vector<Blob<Dtype>*>& bottom, vector<Blob<Dtype>*>* top) {
+  const Dtype* bottom_data = bottom[0]->cpu_data();
+  Dtype* top_data = (*top)[0]->mutable_cpu_data();
+  Dtype* scale_data = scale_.mutable_cpu_data();
+  const int spatial = height_ * width_;
+  const int post_pad = size_ - pre_pad_ - 1;
+  // Matches the AVE pooling of the subnet, which always divides by the
+  // full size_ x size_ window.
+  const Dtype alpha_over_area = alpha_ / (size_ * size_);
+#pragma omp parallel if (scale_.count() >= caffe_parallel_grain())
+  {
+    vector<Dtype> row_sum(spatial);
+#pragma omp for schedule(static)
+    for (int plane = 0; plane < num_ * channels_; ++plane) {
+      const Dtype* x = bottom_data + plane * spatial;
+      Dtype* scale = scale_data + plane * spatial;
+      Dtype* y = top_data + plane * spatial;
+      lrn_box_sum(height_, width_, pre_pad_, post_pad, true, x, &row_sum[0],
+          scale);
+      for (int i = 0; i < spatial; ++i) {
+        scale[i] = 1. + alpha_over_area * scale[i];
+      }
+      lrn_negative_pow(spatial, scale, beta_, y);
+      for (int i = 0; i < spatial; ++i) {
+        y[i] *= x[i];
+      }
+    }
+  }
 }
 
 template <typename Dtype>
@@ -174,7 +299,7 @@ void LRNLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     CrossChannelBackward_cpu(top, propagate_down, bottom);
     break;
   case LRNParameter_NormRegion_WITHIN_CHANNEL:
-    WithinChannelBackward(top, propagate_down, bottom);
+    WithinChannelBackward_cpu(top, propagate_down, bottom);
     break;
   default:
     LOG(FATAL) << "Unknown normalization region.";
@@ -185,53 +310,98 @@ template <typename Dtype>
 void LRNLayer<Dtype>::CrossChannelBackward_cpu(
     const vector<Blob<Dtype>*>& top, const vector<bool>& propagate_down,
     vector<Blob<Dtype>*>* bottom) {
+  if (!propagate_down[0]) {
+    return;
+  }
   const Dtype* top_diff = top[0]->cpu_diff();
   const Dtype* top_data = top[0]->cpu_data();
   const Dtype* bottom_data = (*bottom)[0]->cpu_data();
   const Dtype* scale_data = scale_.cpu_data();
   Dtype* bottom_diff = (*bottom)[0]->mutable_cpu_diff();
-  Blob<Dtype> padded_ratio(1, channels_ + size_ - 1, height_, width_);
-  Blob<Dtype> accum_ratio(1, 1, height_, width_);
-  Dtype* padded_ratio_data = padded_ratio.mutable_cpu_data();
-  Dtype* accum_ratio_data = accum_ratio.mutable_cpu_data();
-  // We hack a little bit by using the diff() to store an additional result
-  Dtype* accum_ratio_times_bottom = accum_ratio.mutable_cpu_diff();
-  caffe_set(padded_ratio.count(), Dtype(0), padded_ratio_data);
-  Dtype cache_ratio_value = 2. * alpha_ * beta_ / size_;
-
-  caffe_powx<Dtype>(scale_.count(), scale_data, -beta_, bottom_diff);
-  caffe_mul<Dtype>(scale_.count(), top_diff, bottom_diff, bottom_diff);
-
-  // go through individual data
-  int inverse_pre_pad = size_ - (size_ + 1) / 2;
-  for (int n = 0; n < num_; ++n) {
-    int block_offset = scale_.offset(n);
-    // first, compute diff_i * y_i / s_i
-    caffe_mul<Dtype>(channels_ * height_ * width_,
-        top_diff + block_offset, top_data + block_offset,
-        padded_ratio_data + padded_ratio.offset(0, inverse_pre_pad));
-    caffe_div<Dtype>(channels_ * height_ * width_,
-        padded_ratio_data + padded_ratio.offset(0, inverse_pre_pad),
-        scale_data + block_offset,
-        padded_ratio_data + padded_ratio.offset(0, inverse_pre_pad));
-    // Now, compute the accumulated ratios and the bottom diff
-    caffe_set(accum_ratio.count(), Dtype(0), accum_ratio_data);
-    for (int c = 0; c < size_ - 1; ++c) {
-      caffe_axpy<Dtype>(height_ * width_, 1.,
-          padded_ratio_data + padded_ratio.offset(0, c), accum_ratio_data);
+  const int spatial = height_ * width_;
+  const int tiles = (spatial + kLRNTile - 1) / kLRNTile;
+  const int post_pad = size_ - pre_pad_ - 1;
+  const Dtype cache_ratio_value = 2. * alpha_ * beta_ / size_;
+#pragma omp parallel for schedule(static) \
+    if (scale_.count() >= caffe_parallel_grain())
+  for (int task = 0; task < num_ * tiles; ++task) {
+    const int begin = (task % tiles) * kLRNTile;
+    const int len = std::min(kLRNTile, spatial - begin);
+    const int offset = scale_.offset(task / tiles) + begin;
+    const Dtype* dy = top_diff + offset;
+    const Dtype* y = top_data + offset;
+    const Dtype* scale = scale_data + offset;
+    Dtype accum[kLRNTile];
+    Dtype power[kLRNTile];
+    for (int i = 0; i < len; ++i) {
+      accum[i] = 0;
+    }
+    // Channel c gets the ratios dy * y / scale of every channel whose window
+    // holds it, [c - post_pad, c + pre_pad_].
+    for (int c = 0; c < std::min(pre_pad_, channels_); ++c) {
+      lrn_accumulate_ratio(len, dy + c * spatial, y + c * spatial,
+          scale + c * spatial, Dtype(1), accum);
     }
     for (int c = 0; c < channels_; ++c) {
-      caffe_axpy<Dtype>(height_ * width_, 1.,
-          padded_ratio_data + padded_ratio.offset(0, c + size_ - 1),
-          accum_ratio_data);
-      // compute bottom diff
-      caffe_mul<Dtype>(height_ * width_,
-          bottom_data + top[0]->offset(n, c),
-          accum_ratio_data, accum_ratio_times_bottom);
-      caffe_axpy<Dtype>(height_ * width_, -cache_ratio_value,
-          accum_ratio_times_bottom, bottom_diff + top[0]->offset(n, c));
-      caffe_axpy<Dtype>(height_ * width_, -1.,
-          padded_ratio_data + padded_ratio.offset(0, c), accum_ratio_data);
+      const int head = c + pre_pad_;
+      const int tail = c - post_pad - 1;
+      if (head < channels_) {
+        lrn_accumulate_ratio(len, dy + head * spatial, y + head * spatial,
+            scale + head * spatial, Dtype(1), accum);
+      }
+      if (tail >= 0) {
+        lrn_accumulate_ratio(len, dy + tail * spatial, y + tail * spatial,
+            scale + tail * spatial, Dtype(-1), accum);
+      }
+      const Dtype* dy_c = dy + c * spatial;
+      const Dtype* x_c = bottom_data + offset + c * spatial;
+      Dtype* dx_c = bottom_diff + offset + c * spatial;
+      lrn_negative_pow(len, scale + c * spatial, beta_, power);
+      for (int i = 0; i < len; ++i) {
+        dx_c[i] = dy_c[i] * power[i] - cache_ratio_value * x_c[i] * accum[i];
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void LRNLayer<Dtype>::WithinChannelBackward_cpu(
+    const vector<Blob<Dtype>*>& top, const vector<bool>& propagate_down,
+    vector<Blob<Dtype>*>* bottom) {
+  if (!propagate_down[0]) {
+    return;
+  }
+  const Dtype* top_diff = top[0]->cpu_diff();
+  const Dtype* top_data = top[0]->cpu_data();
+  const Dtype* bottom_data = (*bottom)[0]->cpu_data();
+  const Dtype* scale_data = scale_.cpu_data();
+  Dtype* bottom_diff = (*bottom)[0]->mutable_cpu_diff();
+  const int spatial = height_ * width_;
+  const int post_pad = size_ - pre_pad_ - 1;
+  const Dtype cache_ratio_value = 2. * alpha_ * beta_ / (size_ * size_);
+#pragma omp parallel if (scale_.count() >= caffe_parallel_grain())
+  {
+    vector<Dtype> ratio(spatial);
+    vector<Dtype> row_sum(spatial);
+#pragma omp for schedule(static)
+    for (int plane = 0; plane < num_ * channels_; ++plane) {
+      const int offset = plane * spatial;
+      const Dtype* dy = top_diff + offset;
+      const Dtype* y = top_data + offset;
+      const Dtype* x = bottom_data + offset;
+      const Dtype* scale = scale_data + offset;
+      Dtype* dx = bottom_diff + offset;
+      for (int i = 0; i < spatial; ++i) {
+        ratio[i] = dy[i] * y[i] / scale[i];
+      }
+      // Sum the ratios over the transposed window into dx, then finish dx
+      // in place with ratio reused for scale^-beta.
+      lrn_box_sum(height_, width_, post_pad, pre_pad_, false, &ratio[0],
+          &row_sum[0], dx);
+      lrn_negative_pow(spatial, scale, beta_, &ratio[0]);
+      for (int i = 0; i < spatial; ++i) {
+        dx[i] = dy[i] * ratio[i] - cache_ratio_value * x[i] * dx[i];
+      }
     }
   }
 }
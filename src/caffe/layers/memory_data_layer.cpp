@@ -18,20 +18,34 @@ void MemoryDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
   CHECK_GT(batch_size_ * this->datum_size_, 0) <<
       "batch_size, channels, height, and width must be specified and"
       " positive in memory_data_param";
+  CHECK(top->size() == 2 || top->size() == 4) << this->type_name()
+      << " Layer outputs the data and label, or the sparse data values,"
+      << " indices and row pointers and the label.";
+  sparse_ = top->size() == 4;
+  data_ = NULL;
+  labels_ = NULL;
+  values_ = NULL;
+  if (sparse_) {
+    // The value and index tops grow to the nonzeros of the largest batch.
+    (*top)[0]->Reshape(batch_size_, 1, 1, 1);
+    (*top)[1]->Reshape(batch_size_, 1, 1, 1);
+    (*top)[2]->Reshape(batch_size_ + 1, 1, 1, 1);
+    (*top)[3]->Reshape(batch_size_, 1, 1, 1);
+    return;
+  }
   (*top)[0]->Reshape(batch_size_, this->datum_channels_, this->datum_height_,
                      this->datum_width_);
   (*top)[1]->Reshape(batch_size_, 1, 1, 1);
   added_data_.Reshape(batch_size_, this->datum_channels_, this->datum_height_,
                       this->datum_width_);
   added_label_.Reshape(batch_size_, 1, 1, 1);
-  data_ = NULL;
-  labels_ = NULL;
   added_data_.cpu_data();
   added_label_.cpu_data();
 }
 
 template <typename Dtype>
 void MemoryDataLayer<Dtype>::AddDatumVector(const vector<Datum>& datum_vector) {
+  CHECK(!sparse_) << "AddDatumVector needs dense data";
   CHECK(!has_new_data_) <<
       "Can't add Datum when earlier ones haven't been consumed"
       << " by the upper layers";
@@ -55,6 +69,7 @@ void MemoryDataLayer<Dtype>::AddDatumVector(const vector<Datum>& datum_vector) {
 
 template <typename Dtype>
 void MemoryDataLayer<Dtype>::Reset(Dtype* data, Dtype* labels, int n) {
+  CHECK(!sparse_) << "Reset needs dense data; use ResetSparse";
   CHECK(data);
   CHECK(labels);
   CHECK_EQ(n % batch_size_, 0) << "n must be a multiple of batch size";
@@ -64,9 +79,50 @@ void MemoryDataLayer<Dtype>::Reset(Dtype* data, Dtype* labels, int n) {
   pos_ = 0;
 }
 
+template <typename Dtype>
+void MemoryDataLayer<Dtype>::ResetSparse(const Dtype* values,
+    const int* indices, const int* indptr, Dtype* labels, int n) {
+  CHECK(sparse_) << "ResetSparse needs the four tops of sparse data";
+  CHECK(indptr);
+  CHECK(labels);
+  CHECK_EQ(n % batch_size_, 0) << "n must be a multiple of batch size";
+  CHECK_EQ(indptr[0], 0);
+  CHECK(indptr[n] == 0 || (values && indices));
+  values_ = values;
+  indices_ = indices;
+  indptr_ = indptr;
+  labels_ = labels;
+  n_ = n;
+  pos_ = 0;
+}
+
 template <typename Dtype>
 void MemoryDataLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       vector<Blob<Dtype>*>* top) {
+  if (sparse_) {
+    CHECK(labels_)
+        << "MemoryDataLayer needs to be initalized by calling ResetSparse";
+    const int begin = indptr_[pos_];
+    const int nonzeros = indptr_[pos_ + batch_size_] - begin;
+    if ((*top)[0]->count() < nonzeros) {
+      (*top)[0]->Reshape(nonzeros, 1, 1, 1);
+      (*top)[1]->Reshape(nonzeros, 1, 1, 1);
+    }
+    if (nonzeros) {
+      caffe_copy(nonzeros, values_ + begin, (*top)[0]->mutable_cpu_data());
+      Dtype* indices = (*top)[1]->mutable_cpu_data();
+      for (int j = 0; j < nonzeros; ++j) {
+        indices[j] = indices_[begin + j];
+      }
+    }
+    Dtype* row_ptr = (*top)[2]->mutable_cpu_data();
+    for (int i = 0; i <= batch_size_; ++i) {
+      row_ptr[i] = indptr_[pos_ + i] - begin;
+    }
+    (*top)[3]->set_cpu_data(labels_ + pos_);
+    pos_ = (pos_ + batch_size_) % n_;
+    return;
+  }
   CHECK(data_) << "MemoryDataLayer needs to be initalized by calling Reset";
   (*top)[0]->set_cpu_data(data_ + pos_ * this->datum_size_);
   (*top)[1]->set_cpu_data(labels_ + pos_);
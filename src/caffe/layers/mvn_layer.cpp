@@ -18,6 +18,7 @@ void MVNLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       1, 1);
   temp_.Reshape(bottom[0]->num(), bottom[0]->channels(),
       bottom[0]->height(), bottom[0]->width());
+  // temp_ and sum_multiplier_ are only used on the GPU.
   sum_multiplier_.Reshape(1, 1,
       bottom[0]->height(), bottom[0]->width());
   Dtype* multiplier_data = sum_multiplier_.mutable_cpu_data();
@@ -39,50 +40,23 @@ void MVNLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   Dtype eps = 1e-10;
 
   if (this->layer_param_.mvn_param().normalize_variance()) {
-    // put the squares of bottom into temp_
-    caffe_powx(bottom[0]->count(), bottom_data, Dtype(2),
-        temp_.mutable_cpu_data());
-
-    // computes variance using var(X) = E(X^2) - (EX)^2
-    caffe_cpu_gemv<Dtype>(CblasNoTrans, num, dim, 1. / dim, bottom_data,
-        sum_multiplier_.cpu_data(), 0., mean_.mutable_cpu_data());  // EX
-    caffe_cpu_gemv<Dtype>(CblasNoTrans, num, dim, 1. / dim, temp_.cpu_data(),
-        sum_multiplier_.cpu_data(), 0.,
-        variance_.mutable_cpu_data());  // E(X^2)
-    caffe_powx(mean_.count(), mean_.cpu_data(), Dtype(2),
-        temp_.mutable_cpu_data());  // (EX)^2
-    caffe_sub(mean_.count(), variance_.cpu_data(), temp_.cpu_data(),
-        variance_.mutable_cpu_data());  // variance
-
+    caffe_cpu_axis_mean_var(num, dim, 1, bottom_data,
+        mean_.mutable_cpu_data(), variance_.mutable_cpu_data());
+    // variance_ keeps 1 / (std + eps) for backward
+    Dtype* variance_data = variance_.mutable_cpu_data();
+    for (int i = 0; i < num; ++i) {
+      variance_data[i] = Dtype(1) / (sqrt(variance_data[i]) + eps);
+    }
     // do mean and variance normalization
-    // subtract mean
-    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num, dim, 1, -1.,
-            mean_.cpu_data(), sum_multiplier_.cpu_data(), 0.,
-            temp_.mutable_cpu_data());
-
-    caffe_add(temp_.count(), bottom_data, temp_.cpu_data(), top_data);
-
-    // normalize variance
-    caffe_powx(variance_.count(), variance_.cpu_data(), Dtype(0.5),
-          variance_.mutable_cpu_data());
-
-    caffe_add_scalar(variance_.count(), eps, variance_.mutable_cpu_data());
-
-    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num, dim, 1, 1.,
-          variance_.cpu_data(), sum_multiplier_.cpu_data(), 0.,
-          temp_.mutable_cpu_data());
-
-    caffe_div(temp_.count(), top_data, temp_.cpu_data(), top_data);
+    caffe_cpu_axis_normalize(num, dim, 1, bottom_data, mean_.cpu_data(),
+        variance_.cpu_data(), top_data);
   } else {
-    caffe_cpu_gemv<Dtype>(CblasNoTrans, num, dim, 1. / dim, bottom_data,
-            sum_multiplier_.cpu_data(), 0., mean_.mutable_cpu_data());  // EX
+    caffe_cpu_axis_sum<Dtype>(num, dim, 1, 1. / dim, bottom_data, 0.,
+        mean_.mutable_cpu_data());  // EX
 
     // subtract mean
-    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num, dim, 1, -1.,
-            mean_.cpu_data(), sum_multiplier_.cpu_data(), 0.,
-            temp_.mutable_cpu_data());
-
-    caffe_add(temp_.count(), bottom_data, temp_.cpu_data(), top_data);
+    caffe_cpu_axis_normalize<Dtype>(num, dim, 1, bottom_data,
+        mean_.cpu_data(), NULL, top_data);
   }
 }
 
@@ -92,7 +66,6 @@ void MVNLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     vector<Blob<Dtype>*>* bottom) {
   const Dtype* top_diff = top[0]->cpu_diff();
   const Dtype* top_data = top[0]->cpu_data();
-  const Dtype* bottom_data = (*bottom)[0]->cpu_data();
   Dtype* bottom_diff = (*bottom)[0]->mutable_cpu_diff();
 
   int num;
@@ -102,52 +75,25 @@ void MVNLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     num = (*bottom)[0]->num() * (*bottom)[0]->channels();
 
   int dim = (*bottom)[0]->count() / num;
-  Dtype eps = 1e-10;
 
   if (this->layer_param_.mvn_param().normalize_variance()) {
-    caffe_mul(temp_.count(), top_data, top_diff, bottom_diff);
-    caffe_cpu_gemv<Dtype>(CblasNoTrans, num, dim, 1., bottom_diff,
-          sum_multiplier_.cpu_data(), 0., mean_.mutable_cpu_data());
-    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num, dim, 1, 1.,
-          mean_.cpu_data(), sum_multiplier_.cpu_data(), 0.,
-          bottom_diff);
-    caffe_mul(temp_.count(), top_data, bottom_diff, bottom_diff);
-
-    caffe_cpu_gemv<Dtype>(CblasNoTrans, num, dim, 1., top_diff,
-            sum_multiplier_.cpu_data(), 0., mean_.mutable_cpu_data());
-    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num, dim, 1, 1.,
-            mean_.cpu_data(), sum_multiplier_.cpu_data(), 1.,
-            bottom_diff);
-
-    caffe_cpu_axpby(temp_.count(), Dtype(1), top_diff, Dtype(-1. / dim),
-        bottom_diff);
-
-    // put the squares of bottom into temp_
-    caffe_powx(temp_.count(), bottom_data, Dtype(2),
-        temp_.mutable_cpu_data());
-
-    // computes variance using var(X) = E(X^2) - (EX)^2
-    caffe_cpu_gemv<Dtype>(CblasNoTrans, num, dim, 1. / dim, bottom_data,
-        sum_multiplier_.cpu_data(), 0., mean_.mutable_cpu_data());  // EX
-    caffe_cpu_gemv<Dtype>(CblasNoTrans, num, dim, 1. / dim, temp_.cpu_data(),
-        sum_multiplier_.cpu_data(), 0.,
-        variance_.mutable_cpu_data());  // E(X^2)
-    caffe_powx(mean_.count(), mean_.cpu_data(), Dtype(2),
-        temp_.mutable_cpu_data());  // (EX)^2
-    caffe_sub(mean_.count(), variance_.cpu_data(), temp_.cpu_data(),
-        variance_.mutable_cpu_data());  // variance
-
-    // normalize variance
-    caffe_powx(variance_.count(), variance_.cpu_data(), Dtype(0.5),
-          variance_.mutable_cpu_data());
-
-    caffe_add_scalar(variance_.count(), eps, variance_.mutable_cpu_data());
-
-    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num, dim, 1, 1.,
-        variance_.cpu_data(), sum_multiplier_.cpu_data(), 0.,
-        temp_.mutable_cpu_data());
-
-    caffe_div(temp_.count(), bottom_diff, temp_.cpu_data(), bottom_diff);
+    // bottom_diff = (top_diff - E(top_diff) - top * E(top * top_diff))
+    //     / (std + eps)
+    Dtype* mean_diff = mean_.mutable_cpu_data();
+    Dtype* mean_product = mean_.mutable_cpu_diff();
+    caffe_cpu_axis_sum<Dtype>(num, dim, 1, 1. / dim, top_diff, 0., mean_diff);
+    caffe_cpu_axis_dot(num, dim, 1, top_data, top_diff, mean_product);
+    const Dtype* inv_std = variance_.cpu_data();
+    const bool parallel = top[0]->count() >= caffe_parallel_grain();
+#pragma omp parallel for schedule(static) if (parallel)
+    for (int i = 0; i < num; ++i) {
+      const Dtype product = mean_product[i] / dim;
+      const int offset = i * dim;
+      for (int j = offset; j < offset + dim; ++j) {
+        bottom_diff[j] = (top_diff[j] - mean_diff[i] - top_data[j] * product)
+            * inv_std[i];
+      }
+    }
   } else {
     caffe_copy(temp_.count(), top_diff, bottom_diff);
   }
@@ -1,5 +1,6 @@
+#include <stdint.h>
+
 #include <algorithm>
-#include <cfloat>
 #include <vector>
 
 #include "caffe/common.hpp"
@@ -89,6 +90,13 @@ void PoolingLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       PoolingParameter_PoolMethod_MAX && top->size() == 1) {
     max_idx_.Reshape(bottom[0]->num(), channels_, pooled_height_,
         pooled_width_);
+    // On the CPU, a window offset fits in a byte for kernels up to 256
+    // elements; max_idx_ then stays unallocated unless the GPU runs.
+    if (kernel_h_ * kernel_w_ <= 256) {
+      max_offset_.reset(new SyncedMemory(max_idx_.count() * sizeof(uint8_t)));
+    } else {
+      max_offset_.reset();
+    }
   }
   // If stochastic pooling, we will initialize the random index part.
   if (this->layer_param_.pooling_param().pool() ==
@@ -98,100 +106,201 @@ void PoolingLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   }
 }
 
-// TODO(Yangqing): Is there a faster way to do pooling in the channel-first
-// case?
+// Interior windows of a KERNEL x KERNEL, stride 2 pooling without padding,
+// which are never clipped: the window unrolls into branch-free selects and
+// sums over a row of outputs.
+template <typename Dtype, int KERNEL>
+static void max_pool_row_fixed(const Dtype* bottom_row, const int width,
+    const int pooled, Dtype* top_row, int* offset) {
+  for (int pw = 0; pw < pooled; ++pw) {
+    const Dtype* window = bottom_row + 2 * pw;
+    Dtype best = window[0];
+    int best_offset = 0;
+    for (int kh = 0; kh < KERNEL; ++kh) {
+      for (int kw = 0; kw < KERNEL; ++kw) {
+        const Dtype value = window[kh * width + kw];
+        const bool greater = value > best;
+        best = greater ? value : best;
+        best_offset = greater ? kh * KERNEL + kw : best_offset;
+      }
+    }
+    top_row[pw] = best;
+    offset[pw] = best_offset;
+  }
+}
+
+template <typename Dtype, int KERNEL>
+static void ave_pool_row_fixed(const Dtype* bottom_row, const int width,
+    const int pooled, Dtype* top_row) {
+  const Dtype scale = Dtype(1) / (KERNEL * KERNEL);
+  for (int pw = 0; pw < pooled; ++pw) {
+    const Dtype* window = bottom_row + 2 * pw;
+    Dtype sum = 0;
+    for (int kh = 0; kh < KERNEL; ++kh) {
+      for (int kw = 0; kw < KERNEL; ++kw) {
+        sum += window[kh * width + kw];
+      }
+    }
+    top_row[pw] = sum * scale;
+  }
+}
+
+// The 2x2 and 3x3 stride 2 poolings of most nets take the fixed-size
+// kernels for all but their clipped last row and column.
+static int fixed_kernel(const int kernel_h, const int kernel_w,
+    const int stride_h, const int stride_w, const int pad_h,
+    const int pad_w) {
+  if (kernel_h == kernel_w && (kernel_h == 2 || kernel_h == 3)
+      && stride_h == 2 && stride_w == 2 && pad_h == 0 && pad_w == 0) {
+    return kernel_h;
+  }
+  return 0;
+}
+
+template <typename Dtype>
+void PoolingLayer<Dtype>::MaxPoolPlane_cpu(const Dtype* bottom_data,
+    Dtype* top_data, int* offset) {
+  const int kernel = fixed_kernel(kernel_h_, kernel_w_, stride_h_, stride_w_,
+      pad_h_, pad_w_);
+  const int full_height =
+      kernel && height_ >= kernel ? (height_ - kernel) / 2 + 1 : 0;
+  const int full_width =
+      kernel && width_ >= kernel ? (width_ - kernel) / 2 + 1 : 0;
+  for (int ph = 0; ph < pooled_height_; ++ph) {
+    const int pool_row = ph * pooled_width_;
+    int pw = 0;
+    if (ph < full_height) {
+      if (kernel == 2) {
+        max_pool_row_fixed<Dtype, 2>(bottom_data + 2 * ph * width_, width_,
+            full_width, top_data + pool_row, offset + pool_row);
+      } else {
+        max_pool_row_fixed<Dtype, 3>(bottom_data + 2 * ph * width_, width_,
+            full_width, top_data + pool_row, offset + pool_row);
+      }
+      pw = full_width;
+    }
+    for (; pw < pooled_width_; ++pw) {
+      const int hstart = ph * stride_h_ - pad_h_;
+      const int wstart = pw * stride_w_ - pad_w_;
+      const int hend = min(hstart + kernel_h_, height_);
+      const int wend = min(wstart + kernel_w_, width_);
+      const int h0 = max(hstart, 0);
+      const int w0 = max(wstart, 0);
+      // Every window holds at least one bottom element, which seeds the max.
+      Dtype best = bottom_data[h0 * width_ + w0];
+      int best_offset = (h0 - hstart) * kernel_w_ + w0 - wstart;
+      for (int h = h0; h < hend; ++h) {
+        for (int w = w0; w < wend; ++w) {
+          if (bottom_data[h * width_ + w] > best) {
+            best = bottom_data[h * width_ + w];
+            best_offset = (h - hstart) * kernel_w_ + w - wstart;
+          }
+        }
+      }
+      top_data[pool_row + pw] = best;
+      offset[pool_row + pw] = best_offset;
+    }
+  }
+}
+
+template <typename Dtype>
+void PoolingLayer<Dtype>::AvePoolPlane_cpu(const Dtype* bottom_data,
+    Dtype* top_data) {
+  const int kernel = fixed_kernel(kernel_h_, kernel_w_, stride_h_, stride_w_,
+      pad_h_, pad_w_);
+  const int full_height =
+      kernel && height_ >= kernel ? (height_ - kernel) / 2 + 1 : 0;
+  const int full_width =
+      kernel && width_ >= kernel ? (width_ - kernel) / 2 + 1 : 0;
+  for (int ph = 0; ph < pooled_height_; ++ph) {
+    const int pool_row = ph * pooled_width_;
+    int pw = 0;
+    if (ph < full_height) {
+      if (kernel == 2) {
+        ave_pool_row_fixed<Dtype, 2>(bottom_data + 2 * ph * width_, width_,
+            full_width, top_data + pool_row);
+      } else {
+        ave_pool_row_fixed<Dtype, 3>(bottom_data + 2 * ph * width_, width_,
+            full_width, top_data + pool_row);
+      }
+      pw = full_width;
+    }
+    for (; pw < pooled_width_; ++pw) {
+      int hstart = ph * stride_h_ - pad_h_;
+      int wstart = pw * stride_w_ - pad_w_;
+      int hend = min(hstart + kernel_h_, height_ + pad_h_);
+      int wend = min(wstart + kernel_w_, width_ + pad_w_);
+      const int pool_size = (hend - hstart) * (wend - wstart);
+      hstart = max(hstart, 0);
+      wstart = max(wstart, 0);
+      hend = min(hend, height_);
+      wend = min(wend, width_);
+      Dtype sum = 0;
+      for (int h = hstart; h < hend; ++h) {
+        for (int w = wstart; w < wend; ++w) {
+          sum += bottom_data[h * width_ + w];
+        }
+      }
+      top_data[pool_row + pw] = sum / pool_size;
+    }
+  }
+}
+
+// Planes are independent, so both directions run in parallel over
+// num * channels.
 template <typename Dtype>
 void PoolingLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       vector<Blob<Dtype>*>* top) {
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = (*top)[0]->mutable_cpu_data();
-  const int top_count = (*top)[0]->count();
+  const int planes = bottom[0]->num() * channels_;
+  const int bottom_size = height_ * width_;
+  const int top_size = pooled_height_ * pooled_width_;
+  const bool parallel = bottom[0]->count() >= caffe_parallel_grain();
   // We'll output the mask to top[1] if it's of size >1.
   const bool use_top_mask = top->size() > 1;
+  uint8_t* compact_mask = NULL;
   int* mask = NULL;  // suppress warnings about uninitalized variables
   Dtype* top_mask = NULL;
-  // Different pooling methods. We explicitly do the switch outside the for
-  // loop to save time, although this results in more code.
   switch (this->layer_param_.pooling_param().pool()) {
   case PoolingParameter_PoolMethod_MAX:
-    // Initialize
     if (use_top_mask) {
       top_mask = (*top)[1]->mutable_cpu_data();
-      caffe_set(top_count, Dtype(-1), top_mask);
+    } else if (max_offset_) {
+      compact_mask = static_cast<uint8_t*>(max_offset_->mutable_cpu_data());
     } else {
       mask = max_idx_.mutable_cpu_data();
-      caffe_set(top_count, -1, mask);
     }
-    caffe_set(top_count, Dtype(-FLT_MAX), top_data);
-    // The main loop
-    for (int n = 0; n < bottom[0]->num(); ++n) {
-      for (int c = 0; c < channels_; ++c) {
-        for (int ph = 0; ph < pooled_height_; ++ph) {
-          for (int pw = 0; pw < pooled_width_; ++pw) {
-            int hstart = ph * stride_h_ - pad_h_;
-            int wstart = pw * stride_w_ - pad_w_;
-            int hend = min(hstart + kernel_h_, height_);
-            int wend = min(wstart + kernel_w_, width_);
-            hstart = max(hstart, 0);
-            wstart = max(wstart, 0);
-            const int pool_index = ph * pooled_width_ + pw;
-            for (int h = hstart; h < hend; ++h) {
-              for (int w = wstart; w < wend; ++w) {
-                const int index = h * width_ + w;
-                if (bottom_data[index] > top_data[pool_index]) {
-                  top_data[pool_index] = bottom_data[index];
-                  if (use_top_mask) {
-                    top_mask[pool_index] = static_cast<Dtype>(index);
-                  } else {
-                    mask[pool_index] = index;
-                  }
-                }
-              }
-            }
+#pragma omp parallel if (parallel)
+    {
+      vector<int> offset(top_size);
+#pragma omp for schedule(static)
+      for (int plane = 0; plane < planes; ++plane) {
+        const int top_offset = plane * top_size;
+        MaxPoolPlane_cpu(bottom_data + plane * bottom_size,
+            top_data + top_offset, &offset[0]);
+        if (compact_mask) {
+          for (int i = 0; i < top_size; ++i) {
+            compact_mask[top_offset + i] = static_cast<uint8_t>(offset[i]);
+          }
+        } else if (use_top_mask) {
+          for (int i = 0; i < top_size; ++i) {
+            top_mask[top_offset + i] =
+                static_cast<Dtype>(WindowIndex(i, offset[i]));
           }
-        }
-        // compute offset
-        bottom_data += bottom[0]->offset(0, 1);
-        top_data += (*top)[0]->offset(0, 1);
-        if (use_top_mask) {
-          top_mask += (*top)[0]->offset(0, 1);
         } else {
-          mask += (*top)[0]->offset(0, 1);
+          for (int i = 0; i < top_size; ++i) {
+            mask[top_offset + i] = WindowIndex(i, offset[i]);
+          }
         }
       }
     }
     break;
   case PoolingParameter_PoolMethod_AVE:
-    for (int i = 0; i < top_count; ++i) {
-      top_data[i] = 0;
-    }
-    // The main loop
-    for (int n = 0; n < bottom[0]->num(); ++n) {
-      for (int c = 0; c < channels_; ++c) {
-        for (int ph = 0; ph < pooled_height_; ++ph) {
-          for (int pw = 0; pw < pooled_width_; ++pw) {
-            int hstart = ph * stride_h_ - pad_h_;
-            int wstart = pw * stride_w_ - pad_w_;
-            int hend = min(hstart + kernel_h_, height_ + pad_h_);
-            int wend = min(wstart + kernel_w_, width_ + pad_w_);
-            int pool_size = (hend - hstart) * (wend - wstart);
-            hstart = max(hstart, 0);
-            wstart = max(wstart, 0);
-            hend = min(hend, height_);
-            wend = min(wend, width_);
-            for (int h = hstart; h < hend; ++h) {
-              for (int w = wstart; w < wend; ++w) {
-                top_data[ph * pooled_width_ + pw] +=
-                    bottom_data[h * width_ + w];
-              }
-            }
-            top_data[ph * pooled_width_ + pw] /= pool_size;
-          }
-        }
-        // compute offset
-        bottom_data += bottom[0]->offset(0, 1);
-        top_data += (*top)[0]->offset(0, 1);
-      }
+#pragma omp parallel for schedule(static) if (parallel)
+    for (int plane = 0; plane < planes; ++plane) {
+      AvePoolPlane_cpu(bottom_data + plane * bottom_size,
+          top_data + plane * top_size);
     }
     break;
   case PoolingParameter_PoolMethod_STOCHASTIC:
@@ -210,67 +319,66 @@ void PoolingLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   }
   const Dtype* top_diff = top[0]->cpu_diff();
   Dtype* bottom_diff = (*bottom)[0]->mutable_cpu_diff();
-  // Different pooling methods. We explicitly do the switch outside the for
-  // loop to save time, although this results in more codes.
-  caffe_set((*bottom)[0]->count(), Dtype(0), bottom_diff);
+  const int planes = top[0]->num() * channels_;
+  const int bottom_size = height_ * width_;
+  const int top_size = pooled_height_ * pooled_width_;
+  const bool parallel = (*bottom)[0]->count() >= caffe_parallel_grain();
   // We'll output the mask to top[1] if it's of size >1.
   const bool use_top_mask = top.size() > 1;
+  const uint8_t* compact_mask = NULL;
   const int* mask = NULL;  // suppress warnings about uninitialized variables
   const Dtype* top_mask = NULL;
   switch (this->layer_param_.pooling_param().pool()) {
   case PoolingParameter_PoolMethod_MAX:
-    // The main loop
     if (use_top_mask) {
       top_mask = top[1]->cpu_data();
+    } else if (max_offset_) {
+      compact_mask = static_cast<const uint8_t*>(max_offset_->cpu_data());
     } else {
       mask = max_idx_.cpu_data();
     }
-    for (int n = 0; n < top[0]->num(); ++n) {
-      for (int c = 0; c < channels_; ++c) {
-        for (int ph = 0; ph < pooled_height_; ++ph) {
-          for (int pw = 0; pw < pooled_width_; ++pw) {
-            const int index = ph * pooled_width_ + pw;
-            const int bottom_index =
-                use_top_mask ? top_mask[index] : mask[index];
-            bottom_diff[bottom_index] += top_diff[index];
-          }
-        }
-        bottom_diff += (*bottom)[0]->offset(0, 1);
-        top_diff += top[0]->offset(0, 1);
-        if (use_top_mask) {
-          top_mask += top[0]->offset(0, 1);
-        } else {
-          mask += top[0]->offset(0, 1);
-        }
+#pragma omp parallel for schedule(static) if (parallel)
+    for (int plane = 0; plane < planes; ++plane) {
+      const int top_offset = plane * top_size;
+      Dtype* bottom_plane = bottom_diff + plane * bottom_size;
+      for (int i = 0; i < bottom_size; ++i) {
+        bottom_plane[i] = 0;
+      }
+      for (int i = 0; i < top_size; ++i) {
+        const int bottom_index = compact_mask ?
+            WindowIndex(i, compact_mask[top_offset + i]) :
+            (use_top_mask ? static_cast<int>(top_mask[top_offset + i]) :
+            mask[top_offset + i]);
+        bottom_plane[bottom_index] += top_diff[top_offset + i];
       }
     }
     break;
   case PoolingParameter_PoolMethod_AVE:
-    // The main loop
-    for (int n = 0; n < top[0]->num(); ++n) {
-      for (int c = 0; c < channels_; ++c) {
-        for (int ph = 0; ph < pooled_height_; ++ph) {
-          for (int pw = 0; pw < pooled_width_; ++pw) {
-            int hstart = ph * stride_h_ - pad_h_;
-            int wstart = pw * stride_w_ - pad_w_;
-            int hend = min(hstart + kernel_h_, height_ + pad_h_);
-            int wend = min(wstart + kernel_w_, width_ + pad_w_);
-            int pool_size = (hend - hstart) * (wend - wstart);
-            hstart = max(hstart, 0);
-            wstart = max(wstart, 0);
-            hend = min(hend, height_);
-            wend = min(wend, width_);
-            for (int h = hstart; h < hend; ++h) {
-              for (int w = wstart; w < wend; ++w) {
-                bottom_diff[h * width_ + w] +=
-                  top_diff[ph * pooled_width_ + pw] / pool_size;
-              }
+#pragma omp parallel for schedule(static) if (parallel)
+    for (int plane = 0; plane < planes; ++plane) {
+      const Dtype* top_plane = top_diff + plane * top_size;
+      Dtype* bottom_plane = bottom_diff + plane * bottom_size;
+      for (int i = 0; i < bottom_size; ++i) {
+        bottom_plane[i] = 0;
+      }
+      for (int ph = 0; ph < pooled_height_; ++ph) {
+        for (int pw = 0; pw < pooled_width_; ++pw) {
+          int hstart = ph * stride_h_ - pad_h_;
+          int wstart = pw * stride_w_ - pad_w_;
+          int hend = min(hstart + kernel_h_, height_ + pad_h_);
+          int wend = min(wstart + kernel_w_, width_ + pad_w_);
+          int pool_size = (hend - hstart) * (wend - wstart);
+          hstart = max(hstart, 0);
+          wstart = max(wstart, 0);
+          hend = min(hend, height_);
+          wend = min(wend, width_);
+          const Dtype gradient = top_plane[ph * pooled_width_ + pw] / pool_size;
+          for (int h = hstart; h < hend; ++h) {
+            for (int w = wstart; w < wend; ++w) {
+              bottom_plane[h * width_ + w] += gradient;
             }
           }
         }
-        // offset
-        bottom_diff += (*bottom)[0]->offset(0, 1);
-        top_diff += top[0]->offset(0, 1);
       }
     }
     break;
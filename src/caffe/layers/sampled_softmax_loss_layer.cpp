@@ -0,0 +1,318 @@
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <fstream>  // NOLINT(readability/streams)
+#include <string>
+#include <vector>
+
+#include "caffe/filler.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/vision_layers.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+void SampledSoftmaxLossLayer<Dtype>::LayerSetUp(
+    const vector<Blob<Dtype>*>& bottom, vector<Blob<Dtype>*>* top) {
+  const bool default_loss_weights =
+      this->layer_param_.loss_weight_size() == 0;
+  LossLayer<Dtype>::LayerSetUp(bottom, top);
+  if (default_loss_weights && top->size() == 2) {
+    this->layer_param_.add_loss_weight(Dtype(0));
+  }
+  const SampledSoftmaxParameter& param =
+      this->layer_param_.sampled_softmax_param();
+  num_output_ = param.num_output();
+  CHECK_GT(num_output_, 0) << "num_output must be positive.";
+  num_sampled_ = param.num_sampled();
+  CHECK_GT(num_sampled_, 0) << "num_sampled must be positive.";
+  bias_term_ = param.bias_term();
+  dim_ = bottom[0]->count() / bottom[0]->num();
+  if (top->size() == 2) {
+    (*top)[1]->Reshape(bottom[0]->num(), num_output_, 1, 1);
+  }
+  if (param.proposal() == SampledSoftmaxParameter_Proposal_UNIGRAM) {
+    std::ifstream infile(param.proposal_file().c_str());
+    CHECK(infile.good()) << "Failed to open proposal file "
+        << param.proposal_file();
+    proposal_.clear();
+    double count;
+    while (infile >> count) {
+      CHECK_GE(count, 0) << "Negative class count in "
+          << param.proposal_file();
+      proposal_.push_back(pow(count, double(param.distortion())));
+    }
+    CHECK_EQ(proposal_.size(), num_output_)
+        << "The proposal file needs one count per class.";
+    proposal_cdf_.resize(num_output_);
+    double sum = 0;
+    for (int k = 0; k < num_output_; ++k) {
+      sum += proposal_[k];
+      proposal_cdf_[k] = sum;
+    }
+    CHECK_GT(sum, 0) << "The proposal file has no counts.";
+    for (int k = 0; k < num_output_; ++k) {
+      proposal_[k] /= sum;
+      proposal_cdf_[k] /= sum;
+    }
+  }
+  if (this->blobs_.size() > 0) {
+    LOG(INFO) << "Skipping parameter initialization";
+  } else {
+    this->blobs_.resize(bias_term_ ? 2 : 1);
+    this->blobs_[0].reset(new Blob<Dtype>(num_output_, 1, 1, dim_));
+    shared_ptr<Filler<Dtype> > weight_filler(GetFiller<Dtype>(
+        param.weight_filler()));
+    weight_filler->Fill(this->blobs_[0].get());
+    if (bias_term_) {
+      this->blobs_[1].reset(new Blob<Dtype>(num_output_, 1, 1, 1));
+      shared_ptr<Filler<Dtype> > bias_filler(GetFiller<Dtype>(
+          param.bias_filler()));
+      bias_filler->Fill(this->blobs_[1].get());
+    }
+  }
+  this->param_propagate_down_.resize(this->blobs_.size(), true);
+  sampled_ = false;
+  weight_sparse_ = false;
+  bias_sparse_ = false;
+}
+
+template <typename Dtype>
+double SampledSoftmaxLossLayer<Dtype>::ProposalProbability(const int k) const {
+  switch (this->layer_param_.sampled_softmax_param().proposal()) {
+  case SampledSoftmaxParameter_Proposal_UNIFORM:
+    return 1. / num_output_;
+  case SampledSoftmaxParameter_Proposal_LOG_UNIFORM:
+    return log((k + 2.) / (k + 1.)) / log(num_output_ + 1.);
+  case SampledSoftmaxParameter_Proposal_UNIGRAM:
+    return proposal_[k];
+  default:
+    LOG(FATAL) << "Unknown proposal";
+  }
+  return 0;
+}
+
+template <typename Dtype>
+int SampledSoftmaxLossLayer<Dtype>::ProposalClass(const double u) const {
+  int k = 0;
+  switch (this->layer_param_.sampled_softmax_param().proposal()) {
+  case SampledSoftmaxParameter_Proposal_UNIFORM:
+    k = static_cast<int>(u * num_output_);
+    break;
+  case SampledSoftmaxParameter_Proposal_LOG_UNIFORM:
+    // The inverse of the CDF log(k + 1) / log(num_output + 1).
+    k = static_cast<int>(exp(u * log(num_output_ + 1.))) - 1;
+    break;
+  case SampledSoftmaxParameter_Proposal_UNIGRAM:
+    k = std::upper_bound(proposal_cdf_.begin(), proposal_cdf_.end(), u) -
+        proposal_cdf_.begin();
+    break;
+  default:
+    LOG(FATAL) << "Unknown proposal";
+  }
+  return std::min(std::max(k, 0), num_output_ - 1);
+}
+
+template <typename Dtype>
+Dtype SampledSoftmaxLossLayer<Dtype>::FullSoftmax(const Dtype* bottom_data,
+    const Dtype* label, const int num, Dtype* prob) {
+  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, num, num_output_, dim_,
+      Dtype(1), bottom_data, this->blobs_[0]->cpu_data(), Dtype(0), prob);
+  if (bias_term_) {
+    caffe_cpu_axis_add<Dtype>(1, num, num_output_, Dtype(1),
+        this->blobs_[1]->cpu_data(), prob);
+  }
+  vector<Dtype> row_loss(num);
+#pragma omp parallel for schedule(static) \
+    if (num * num_output_ >= caffe_parallel_grain())
+  for (int n = 0; n < num; ++n) {
+    Dtype* row = prob + n * num_output_;
+    const Dtype label_score = row[static_cast<int>(label[n])];
+    const Dtype log_sum_exp = caffe_cpu_softmax(num_output_, row);
+    row_loss[n] = std::min(log_sum_exp - label_score,
+        -log(Dtype(FLT_MIN)));
+  }
+  Dtype loss = 0;
+  for (int n = 0; n < num; ++n) {
+    loss += row_loss[n];
+  }
+  return loss;
+}
+
+template <typename Dtype>
+void SampledSoftmaxLossLayer<Dtype>::Forward_cpu(
+    const vector<Blob<Dtype>*>& bottom, vector<Blob<Dtype>*>* top) {
+  const Dtype* bottom_data = bottom[0]->cpu_data();
+  const Dtype* label = bottom[1]->cpu_data();
+  const int num = bottom[0]->num();
+  Dtype* prob = NULL;
+  if (top->size() == 2) {
+    prob = (*top)[1]->mutable_cpu_data();
+  }
+  if (Caffe::phase() == Caffe::TEST) {
+    if (!prob) {
+      prob_.resize(num * num_output_);
+      prob = &prob_[0];
+    }
+    sampled_ = false;
+    (*top)[0]->mutable_cpu_data()[0] =
+        FullSoftmax(bottom_data, label, num, prob) / num;
+    return;
+  }
+  // One set of samples serves the whole batch.
+  vector<double> uniform(num_sampled_);
+  caffe_rng_uniform<double>(num_sampled_, 0, 1, &uniform[0]);
+  vector<int> samples(num_sampled_);
+  for (int j = 0; j < num_sampled_; ++j) {
+    samples[j] = ProposalClass(uniform[j]);
+  }
+  candidates_ = samples;
+  for (int n = 0; n < num; ++n) {
+    const int label_value = static_cast<int>(label[n]);
+    DCHECK_GE(label_value, 0);
+    DCHECK_LT(label_value, num_output_);
+    candidates_.push_back(label_value);
+  }
+  std::sort(candidates_.begin(), candidates_.end());
+  candidates_.erase(std::unique(candidates_.begin(), candidates_.end()),
+      candidates_.end());
+  const int num_candidates = candidates_.size();
+  // Score the batch against the candidate rows only.
+  const Dtype* weight = this->blobs_[0]->cpu_data();
+  candidate_weight_.resize(num_candidates * dim_);
+  for (int m = 0; m < num_candidates; ++m) {
+    caffe_copy(dim_, weight + candidates_[m] * dim_,
+        &candidate_weight_[m * dim_]);
+  }
+  scores_.resize(num * num_candidates);
+  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, num, num_candidates, dim_,
+      Dtype(1), bottom_data, &candidate_weight_[0], Dtype(0), &scores_[0]);
+  if (bias_term_) {
+    const Dtype* bias = this->blobs_[1]->cpu_data();
+    candidate_bias_.resize(num_candidates);
+    for (int m = 0; m < num_candidates; ++m) {
+      candidate_bias_[m] = bias[candidates_[m]];
+    }
+    caffe_cpu_axis_add<Dtype>(1, num, num_candidates, Dtype(1),
+        &candidate_bias_[0], &scores_[0]);
+  }
+  // Logits are corrected by the log of each class's expected sample count.
+  vector<Dtype> log_expected(num_candidates);
+  for (int m = 0; m < num_candidates; ++m) {
+    log_expected[m] = log(num_sampled_ * ProposalProbability(candidates_[m]));
+  }
+  vector<int> sample_slot(num_sampled_);
+  for (int j = 0; j < num_sampled_; ++j) {
+    sample_slot[j] = std::lower_bound(candidates_.begin(), candidates_.end(),
+        samples[j]) - candidates_.begin();
+  }
+  const bool remove_hits =
+      this->layer_param_.sampled_softmax_param().remove_accidental_hits();
+  // candidate_diff_ collects, per example, the softmax mass of each
+  // candidate less one at the label: the gradient before scaling.
+  candidate_diff_.assign(num * num_candidates, Dtype(0));
+  vector<Dtype> row_loss(num);
+#pragma omp parallel if (num * num_candidates >= caffe_parallel_grain())
+  {
+    vector<Dtype> logits(num_sampled_ + 1);
+    vector<int> slots(num_sampled_ + 1);
+#pragma omp for schedule(static)
+    for (int n = 0; n < num; ++n) {
+      const Dtype* score = &scores_[n * num_candidates];
+      const int label_value = static_cast<int>(label[n]);
+      const int label_slot = std::lower_bound(candidates_.begin(),
+          candidates_.end(), label_value) - candidates_.begin();
+      int size = 0;
+      slots[size] = label_slot;
+      logits[size++] = score[label_slot] - log_expected[label_slot];
+      for (int j = 0; j < num_sampled_; ++j) {
+        if (remove_hits && samples[j] == label_value) { continue; }
+        slots[size] = sample_slot[j];
+        logits[size++] = score[sample_slot[j]] - log_expected[sample_slot[j]];
+      }
+      const Dtype label_logit = logits[0];
+      row_loss[n] = caffe_cpu_softmax(size, &logits[0]) - label_logit;
+      Dtype* diff = &candidate_diff_[n * num_candidates];
+      for (int i = 0; i < size; ++i) {
+        diff[slots[i]] += logits[i];
+      }
+      diff[label_slot] -= 1;
+    }
+  }
+  Dtype loss = 0;
+  for (int n = 0; n < num; ++n) {
+    loss += row_loss[n];
+  }
+  (*top)[0]->mutable_cpu_data()[0] = loss / num;
+  sampled_ = true;
+  if (prob) {
+    FullSoftmax(bottom_data, label, num, prob);
+  }
+}
+
+template <typename Dtype>
+void SampledSoftmaxLossLayer<Dtype>::Backward_cpu(
+    const vector<Blob<Dtype>*>& top, const vector<bool>& propagate_down,
+    vector<Blob<Dtype>*>* bottom) {
+  if (propagate_down[1]) {
+    LOG(FATAL) << this->type_name()
+               << " Layer cannot backpropagate to label inputs.";
+  }
+  CHECK(sampled_) << this->type_name()
+      << " Layer backpropagates the sampled loss; run it in the TRAIN phase.";
+  const int num = (*bottom)[0]->num();
+  const int num_candidates = candidates_.size();
+  const Dtype scale = top[0]->cpu_diff()[0] / num;
+  if (propagate_down[0]) {
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num, dim_,
+        num_candidates, scale, &candidate_diff_[0], &candidate_weight_[0],
+        Dtype(0), (*bottom)[0]->mutable_cpu_diff());
+  }
+  if (this->param_propagate_down_[0]) {
+    vector<Dtype> candidate_weight_diff(num_candidates * dim_);
+    caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, num_candidates, dim_,
+        num, scale, &candidate_diff_[0], (*bottom)[0]->cpu_data(), Dtype(0),
+        &candidate_weight_diff[0]);
+    Dtype* weight_diff = this->blobs_[0]->mutable_cpu_diff();
+    for (int m = 0; m < num_candidates; ++m) {
+      caffe_copy(dim_, &candidate_weight_diff[m * dim_],
+          weight_diff + candidates_[m] * dim_);
+    }
+    weight_sparse_ = true;
+  }
+  if (bias_term_ && this->param_propagate_down_[1]) {
+    vector<Dtype> candidate_bias_diff(num_candidates);
+    caffe_cpu_axis_sum<Dtype>(1, num, num_candidates, scale,
+        &candidate_diff_[0], Dtype(0), &candidate_bias_diff[0]);
+    Dtype* bias_diff = this->blobs_[1]->mutable_cpu_diff();
+    for (int m = 0; m < num_candidates; ++m) {
+      bias_diff[candidates_[m]] = candidate_bias_diff[m];
+    }
+    bias_sparse_ = true;
+  }
+}
+
+template <typename Dtype>
+const vector<int>* SampledSoftmaxLossLayer<Dtype>::sparse_param_rows(
+    const int param_id) const {
+  const bool sparse = param_id == 0 ? weight_sparse_ : bias_sparse_;
+  return sparse ? &candidates_ : NULL;
+}
+
+template <typename Dtype>
+void SampledSoftmaxLossLayer<Dtype>::DensifyParamDiff(const int param_id) {
+  if (!sparse_param_rows(param_id)) { return; }
+  Blob<Dtype>* param = this->blobs_[param_id].get();
+  caffe_cpu_zero_other_rows(param->num(), param->count() / param->num(),
+      candidates_, param->mutable_cpu_diff());
+  if (param_id == 0) {
+    weight_sparse_ = false;
+  } else {
+    bias_sparse_ = false;
+  }
+}
+
+INSTANTIATE_CLASS(SampledSoftmaxLossLayer);
+
+}  // namespace caffe
@@ -30,13 +30,30 @@ void SigmoidCrossEntropyLossLayer<Dtype>::Forward_cpu(
   // Compute the loss (negative log likelihood)
   const int count = bottom[0]->count();
   const int num = bottom[0]->num();
-  // Stable version of loss computation from input data
+  // Stable version of loss computation from input data: each element adds
+  // log(1 + exp(x)) - x * target, the softplus taken a block at a time.
   const Dtype* input_data = bottom[0]->cpu_data();
   const Dtype* target = bottom[1]->cpu_data();
+  if (caffe_strict_math()) {
+    // The original sum, bit for bit.
+    Dtype loss = 0;
+    for (int i = 0; i < count; ++i) {
+      loss -= input_data[i] * (target[i] - (input_data[i] >= 0)) -
+          log(1 + exp(input_data[i] -
+              2 * input_data[i] * (input_data[i] >= 0)));
+    }
+    (*top)[0]->mutable_cpu_data()[0] = loss / num;
+    return;
+  }
+  const int kBlock = 256;
+  Dtype softplus[kBlock];
   Dtype loss = 0;
-  for (int i = 0; i < count; ++i) {
-    loss -= input_data[i] * (target[i] - (input_data[i] >= 0)) -
-        log(1 + exp(input_data[i] - 2 * input_data[i] * (input_data[i] >= 0)));
+  for (int begin = 0; begin < count; begin += kBlock) {
+    const int len = std::min(kBlock, count - begin);
+    caffe_log1p_exp(len, input_data + begin, softplus);
+    for (int i = 0; i < len; ++i) {
+      loss += softplus[i] - input_data[begin + i] * target[begin + i];
+    }
   }
   (*top)[0]->mutable_cpu_data()[0] = loss / num;
 }
@@ -8,42 +8,114 @@
 
 namespace caffe {
 
+// Spatial positions whose channels the fused forward walks together.
+const int kSoftmaxLossTile = 256;
+
 template <typename Dtype>
 void SoftmaxWithLossLayer<Dtype>::LayerSetUp(
     const vector<Blob<Dtype>*>& bottom, vector<Blob<Dtype>*>* top) {
   LossLayer<Dtype>::LayerSetUp(bottom, top);
-  softmax_bottom_vec_.clear();
-  softmax_bottom_vec_.push_back(bottom[0]);
-  softmax_top_vec_.clear();
-  softmax_top_vec_.push_back(&prob_);
-  softmax_layer_->SetUp(softmax_bottom_vec_, &softmax_top_vec_);
+  log_sum_exp_.Reshape(bottom[0]->num(), 1, bottom[0]->height(),
+      bottom[0]->width());
   if (top->size() >= 2) {
     // softmax output
     (*top)[1]->ReshapeLike(*bottom[0]);
   }
 }
 
+// No probability blob is formed. Each (image, position) gets its log-sum-exp
+// lse = max + log(sum(exp(x - max))) from one max pass and one exp pass over
+// its logits, and a loss of lse - x[label]; backward rebuilds the gradient
+// exp(x - lse) - 1[label] straight into the bottom diff.
 template <typename Dtype>
 void SoftmaxWithLossLayer<Dtype>::Forward_cpu(
     const vector<Blob<Dtype>*>& bottom, vector<Blob<Dtype>*>* top) {
-  // The forward pass computes the softmax prob values.
-  softmax_layer_->Forward(softmax_bottom_vec_, &softmax_top_vec_);
-  const Dtype* prob_data = prob_.cpu_data();
+  const Dtype* bottom_data = bottom[0]->cpu_data();
   const Dtype* label = bottom[1]->cpu_data();
-  int num = prob_.num();
-  int dim = prob_.count() / num;
-  int spatial_dim = prob_.height() * prob_.width();
-  Dtype loss = 0;
-  for (int i = 0; i < num; ++i) {
-    for (int j = 0; j < spatial_dim; j++) {
-      loss -= log(std::max(prob_data[i * dim +
-          static_cast<int>(label[i * spatial_dim + j]) * spatial_dim + j],
-                           Dtype(FLT_MIN)));
+  Dtype* lse = log_sum_exp_.mutable_cpu_data();
+  // Per position losses, summed in order below so that the total does not
+  // depend on the thread count.
+  Dtype* position_loss = log_sum_exp_.mutable_cpu_diff();
+  const int num = bottom[0]->num();
+  const int channels = bottom[0]->channels();
+  const int spatial_dim = bottom[0]->height() * bottom[0]->width();
+  // The old prob clamp at FLT_MIN bounds the loss of one position.
+  const Dtype max_loss = -log(Dtype(FLT_MIN));
+  const bool parallel = bottom[0]->count() >= caffe_parallel_grain();
+  if (spatial_dim == 1) {
+#pragma omp parallel if (parallel)
+    {
+      vector<Dtype> shifted(channels);
+#pragma omp for schedule(static)
+      for (int i = 0; i < num; ++i) {
+        const Dtype* x = bottom_data + i * channels;
+        Dtype max_value = x[0];
+        for (int c = 1; c < channels; ++c) {
+          max_value = std::max(max_value, x[c]);
+        }
+        for (int c = 0; c < channels; ++c) {
+          shifted[c] = x[c] - max_value;
+        }
+        caffe_exp(channels, &shifted[0], &shifted[0]);
+        Dtype sum = 0;
+        for (int c = 0; c < channels; ++c) {
+          sum += shifted[c];
+        }
+        lse[i] = max_value + log(sum);
+        position_loss[i] = std::min(lse[i] - x[static_cast<int>(label[i])],
+            max_loss);
+      }
+    }
+  } else {
+    const int tiles = (spatial_dim + kSoftmaxLossTile - 1) / kSoftmaxLossTile;
+#pragma omp parallel for schedule(static) if (parallel)
+    for (int task = 0; task < num * tiles; ++task) {
+      const int n = task / tiles;
+      const int begin = (task % tiles) * kSoftmaxLossTile;
+      const int len = std::min(kSoftmaxLossTile, spatial_dim - begin);
+      const Dtype* x = bottom_data + n * channels * spatial_dim + begin;
+      Dtype max_value[kSoftmaxLossTile];
+      Dtype sum[kSoftmaxLossTile];
+      Dtype shifted[kSoftmaxLossTile];
+      for (int j = 0; j < len; ++j) {
+        max_value[j] = x[j];
+        sum[j] = 0;
+      }
+      for (int c = 1; c < channels; ++c) {
+        const Dtype* x_c = x + c * spatial_dim;
+        for (int j = 0; j < len; ++j) {
+          max_value[j] = std::max(max_value[j], x_c[j]);
+        }
+      }
+      for (int c = 0; c < channels; ++c) {
+        const Dtype* x_c = x + c * spatial_dim;
+        for (int j = 0; j < len; ++j) {
+          shifted[j] = x_c[j] - max_value[j];
+        }
+        caffe_exp(len, shifted, shifted);
+        for (int j = 0; j < len; ++j) {
+          sum[j] += shifted[j];
+        }
+      }
+      const int offset = n * spatial_dim + begin;
+      for (int j = 0; j < len; ++j) {
+        lse[offset + j] = max_value[j] + log(sum[j]);
+        const int label_value = static_cast<int>(label[offset + j]);
+        position_loss[offset + j] = std::min(
+            lse[offset + j] - x[label_value * spatial_dim + j], max_loss);
+      }
     }
   }
+  Dtype loss = 0;
+  for (int i = 0; i < log_sum_exp_.count(); ++i) {
+    loss += position_loss[i];
+  }
   (*top)[0]->mutable_cpu_data()[0] = loss / num / spatial_dim;
   if (top->size() == 2) {
-    (*top)[1]->ShareData(prob_);
+    Dtype* prob_data = (*top)[1]->mutable_cpu_data();
+    caffe_cpu_axis_normalize<Dtype>(num, channels, spatial_dim, bottom_data,
+        lse, NULL, prob_data);
+    caffe_exp((*top)[1]->count(), prob_data, prob_data);
   }
 }
 
@@ -56,22 +128,35 @@ void SoftmaxWithLossLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
                << " Layer cannot backpropagate to label inputs.";
   }
   if (propagate_down[0]) {
+    const Dtype* bottom_data = (*bottom)[0]->cpu_data();
     Dtype* bottom_diff = (*bottom)[0]->mutable_cpu_diff();
-    const Dtype* prob_data = prob_.cpu_data();
-    caffe_copy(prob_.count(), prob_data, bottom_diff);
     const Dtype* label = (*bottom)[1]->cpu_data();
-    int num = prob_.num();
-    int dim = prob_.count() / num;
-    int spatial_dim = prob_.height() * prob_.width();
+    const int num = (*bottom)[0]->num();
+    const int channels = (*bottom)[0]->channels();
+    const int spatial_dim = (*bottom)[0]->height() * (*bottom)[0]->width();
+    const int count = (*bottom)[0]->count();
+    const Dtype loss_weight = top[0]->cpu_diff()[0];
+    const Dtype scale = loss_weight / num / spatial_dim;
+    // A positive scale folds into the exponent as exp(x - (lse - log scale)),
+    // leaving two passes: subtract and exponentiate.
+    const Dtype* lse = log_sum_exp_.cpu_data();
+    Dtype* shift = log_sum_exp_.mutable_cpu_diff();
+    const Dtype log_scale = scale > 0 ? log(scale) : Dtype(0);
+    for (int i = 0; i < log_sum_exp_.count(); ++i) {
+      shift[i] = lse[i] - log_scale;
+    }
+    caffe_cpu_axis_normalize<Dtype>(num, channels, spatial_dim, bottom_data,
+        shift, NULL, bottom_diff);
+    caffe_exp(count, bottom_diff, bottom_diff);
+    if (!(scale > 0)) {
+      caffe_scal(count, scale, bottom_diff);
+    }
     for (int i = 0; i < num; ++i) {
       for (int j = 0; j < spatial_dim; ++j) {
-        bottom_diff[i * dim + static_cast<int>(label[i * spatial_dim + j])
-            * spatial_dim + j] -= 1;
+        bottom_diff[(i * channels + static_cast<int>(
+            label[i * spatial_dim + j])) * spatial_dim + j] -= scale;
       }
     }
-    // Scale gradient
-    const Dtype loss_weight = top[0]->cpu_diff()[0];
-    caffe_scal(prob_.count(), loss_weight / num / spatial_dim, bottom_diff);
   }
 }
 
@@ -27,7 +27,12 @@ void SplitLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
 template <typename Dtype>
 void SplitLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       vector<Blob<Dtype>*>* top) {
+  // The value and index tops of sparse data layers grow between batches.
+  count_ = bottom[0]->count();
   for (int i = 0; i < top->size(); ++i) {
+    if ((*top)[i]->count() != count_) {
+      (*top)[i]->ReshapeLike(*bottom[0]);
+    }
     (*top)[i]->ShareData(*bottom[0]);
   }
 }
@@ -5,6 +5,7 @@
 #include <vector>
 
 #include "caffe/layer.hpp"
+#include "caffe/util/math_functions.hpp"
 #include "caffe/vision_layers.hpp"
 
 namespace caffe {
@@ -14,12 +15,17 @@ void TanHLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     vector<Blob<Dtype>*>* top) {
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = (*top)[0]->mutable_cpu_data();
-  Dtype exp2x;
   const int count = bottom[0]->count();
-  for (int i = 0; i < count; ++i) {
-    exp2x = exp(2 * bottom_data[i]);
-    top_data[i] = (exp2x - Dtype(1)) / (exp2x + Dtype(1));
+  if (caffe_strict_math()) {
+    // The original formula, bit for bit.
+    Dtype exp2x;
+    for (int i = 0; i < count; ++i) {
+      exp2x = exp(2 * bottom_data[i]);
+      top_data[i] = (exp2x - Dtype(1)) / (exp2x + Dtype(1));
+    }
+    return;
   }
+  caffe_tanh(count, bottom_data, top_data);
 }
 
 template <typename Dtype>
@@ -0,0 +1,310 @@
+#include <algorithm>
+#include <vector>
+
+#include "caffe/layer.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/vision_layers.hpp"
+
+namespace caffe {
+
+// Transform matrices of Winograd's minimal filtering algorithm F(MxM, 3x3)
+// (Lavin & Gray, "Fast Algorithms for Convolutional Neural Networks"):
+//   Y = A^T [(G g G^T) .* (B^T d B)] A
+// for a 3x3 filter g, an (M+2)x(M+2) input tile d and an MxM output tile Y.
+template <int M> struct WinogradMatrices;
+
+template <> struct WinogradMatrices<2> {
+  static const int kAlpha = 4;
+  static const double BT[4][4];
+  static const double G[4][3];
+  static const double AT[2][4];
+};
+
+const double WinogradMatrices<2>::BT[4][4] = {
+  {1,  0, -1,  0},
+  {0,  1,  1,  0},
+  {0, -1,  1,  0},
+  {0,  1,  0, -1}
+};
+const double WinogradMatrices<2>::G[4][3] = {
+  {1,    0,   0},
+  {0.5,  0.5, 0.5},
+  {0.5, -0.5, 0.5},
+  {0,    0,   1}
+};
+const double WinogradMatrices<2>::AT[2][4] = {
+  {1, 1,  1,  0},
+  {0, 1, -1, -1}
+};
+
+template <> struct WinogradMatrices<4> {
+  static const int kAlpha = 6;
+  static const double BT[6][6];
+  static const double G[6][3];
+  static const double AT[4][6];
+};
+
+const double WinogradMatrices<4>::BT[6][6] = {
+  {4,  0, -5,  0, 1, 0},
+  {0, -4, -4,  1, 1, 0},
+  {0,  4, -4, -1, 1, 0},
+  {0, -2, -1,  2, 1, 0},
+  {0,  2, -1, -2, 1, 0},
+  {0,  4,  0, -5, 0, 1}
+};
+const double WinogradMatrices<4>::G[6][3] = {
+  { 1. / 4,       0,       0},
+  {-1. / 6, -1. / 6, -1. / 6},
+  {-1. / 6,  1. / 6, -1. / 6},
+  { 1. / 24, 1. / 12,  1. / 6},
+  { 1. / 24, -1. / 12, 1. / 6},
+  {       0,       0,       1}
+};
+const double WinogradMatrices<4>::AT[4][6] = {
+  {1, 1,  1, 1,  1, 0},
+  {0, 1, -1, 2, -2, 0},
+  {0, 1,  1, 4,  4, 0},
+  {0, 1, -1, 8, -8, 1}
+};
+
+// u[xi * count + f] = (G g_f G^T)[xi] for count 3x3 filters g_f.
+template <typename Dtype, int M>
+void winograd_transform_weights(const Dtype* weight, const int count,
+    Dtype* u) {
+  typedef WinogradMatrices<M> W;
+  const int A = W::kAlpha;
+  for (int f = 0; f < count; ++f) {
+    const Dtype* g = weight + f * 9;
+    Dtype tmp[A][3];
+    for (int i = 0; i < A; ++i) {
+      for (int j = 0; j < 3; ++j) {
+        tmp[i][j] = W::G[i][0] * g[j] + W::G[i][1] * g[3 + j]
+            + W::G[i][2] * g[6 + j];
+      }
+    }
+    for (int i = 0; i < A; ++i) {
+      for (int j = 0; j < A; ++j) {
+        u[(i * A + j) * count + f] = tmp[i][0] * W::G[j][0]
+            + tmp[i][1] * W::G[j][1] + tmp[i][2] * W::G[j][2];
+      }
+    }
+  }
+}
+
+// v[(xi * channels + c) * P + p] = (B^T d B)[xi] for the input tile d at
+// tile position p of channel c, with zero padding outside the image.
+template <typename Dtype, int M>
+void winograd_transform_input(const Dtype* data_im, const int channels,
+    const int height, const int width, const int pad_h, const int pad_w,
+    const int tiles_h, const int tiles_w, Dtype* v) {
+  typedef WinogradMatrices<M> W;
+  const int A = W::kAlpha;
+  const int P = tiles_h * tiles_w;
+  Dtype bt[A][A];
+  for (int i = 0; i < A; ++i) {
+    for (int j = 0; j < A; ++j) {
+      bt[i][j] = W::BT[i][j];
+    }
+  }
+#pragma omp parallel for schedule(static) if (channels * P >= 256)
+  for (int c = 0; c < channels; ++c) {
+    const Dtype* im = data_im + c * height * width;
+    for (int ty = 0; ty < tiles_h; ++ty) {
+      for (int tx = 0; tx < tiles_w; ++tx) {
+        const int y0 = ty * M - pad_h;
+        const int x0 = tx * M - pad_w;
+        Dtype d[A][A];
+        for (int i = 0; i < A; ++i) {
+          const int y = y0 + i;
+          for (int j = 0; j < A; ++j) {
+            const int x = x0 + j;
+            d[i][j] = (y >= 0 && y < height && x >= 0 && x < width) ?
+                im[y * width + x] : Dtype(0);
+          }
+        }
+        Dtype tmp[A][A];
+        for (int i = 0; i < A; ++i) {
+          for (int j = 0; j < A; ++j) {
+            Dtype sum = 0;
+            for (int l = 0; l < A; ++l) {
+              sum += bt[i][l] * d[l][j];
+            }
+            tmp[i][j] = sum;
+          }
+        }
+        const int p = ty * tiles_w + tx;
+        for (int i = 0; i < A; ++i) {
+          for (int j = 0; j < A; ++j) {
+            Dtype sum = 0;
+            for (int l = 0; l < A; ++l) {
+              sum += tmp[i][l] * bt[j][l];
+            }
+            v[((i * A + j) * channels + c) * P + p] = sum;
+          }
+        }
+      }
+    }
+  }
+}
+
+// Inverse of the tile layout above: gathers the alpha x alpha products of
+// every tile, applies A^T m A, adds the bias and writes the valid outputs.
+template <typename Dtype, int M>
+void winograd_transform_output(const Dtype* m, const int num_output,
+    const int tiles_h, const int tiles_w, const int height_out,
+    const int width_out, const Dtype* bias, Dtype* data_out) {
+  typedef WinogradMatrices<M> W;
+  const int A = W::kAlpha;
+  const int P = tiles_h * tiles_w;
+  Dtype at[M][A];
+  for (int i = 0; i < M; ++i) {
+    for (int j = 0; j < A; ++j) {
+      at[i][j] = W::AT[i][j];
+    }
+  }
+#pragma omp parallel for schedule(static) if (num_output * P >= 256)
+  for (int k = 0; k < num_output; ++k) {
+    Dtype* out = data_out + k * height_out * width_out;
+    const Dtype b = bias ? bias[k] : Dtype(0);
+    for (int ty = 0; ty < tiles_h; ++ty) {
+      for (int tx = 0; tx < tiles_w; ++tx) {
+        const int p = ty * tiles_w + tx;
+        Dtype tmp[M][A];
+        for (int i = 0; i < M; ++i) {
+          for (int j = 0; j < A; ++j) {
+            Dtype sum = 0;
+            for (int l = 0; l < A; ++l) {
+              sum += at[i][l] * m[((l * A + j) * num_output + k) * P + p];
+            }
+            tmp[i][j] = sum;
+          }
+        }
+        const int h_end = std::min(M, height_out - ty * M);
+        const int w_end = std::min(M, width_out - tx * M);
+        for (int i = 0; i < h_end; ++i) {
+          Dtype* out_row = out + (ty * M + i) * width_out + tx * M;
+          for (int j = 0; j < w_end; ++j) {
+            Dtype sum = b;
+            for (int l = 0; l < A; ++l) {
+              sum += tmp[i][l] * at[j][l];
+            }
+            out_row[j] = sum;
+          }
+        }
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::LayerSetUp(
+    const vector<Blob<Dtype>*>& bottom, vector<Blob<Dtype>*>* top) {
+  ConvolutionLayer<Dtype>::LayerSetUp(bottom, top);
+  use_winograd_ = this->kernel_h_ == 3 && this->kernel_w_ == 3
+      && this->stride_h_ == 1 && this->stride_w_ == 1;
+  if (!use_winograd_) {
+    LOG(INFO) << "Winograd convolution supports only 3x3 stride 1 kernels; "
+        << this->layer_param_.name() << " falls back to im2col.";
+    return;
+  }
+  tile_ = this->layer_param_.convolution_param().winograd_tile();
+  if (tile_ == 0) {
+    tile_ = std::min(this->height_out_, this->width_out_) >= 8 ? 4 : 2;
+  }
+  CHECK(tile_ == 2 || tile_ == 4) << "winograd_tile must be 0, 2 or 4.";
+  alpha_ = tile_ + 2;
+  tiles_h_ = (this->height_out_ + tile_ - 1) / tile_;
+  tiles_w_ = (this->width_out_ + tile_ - 1) / tile_;
+  const int num_tiles = tiles_h_ * tiles_w_;
+  transformed_weights_.Reshape(alpha_ * alpha_, this->num_output_,
+      this->channels_ / this->group_, 1);
+  transformed_input_.Reshape(alpha_ * alpha_, this->channels_, num_tiles, 1);
+  transformed_output_.Reshape(alpha_ * alpha_, this->num_output_, num_tiles,
+      1);
+  // Forces TransformWeights() on the first forward pass.
+  transformed_from_.reset();
+}
+
+template <typename Dtype>
+uint64_t WinogradConvolutionLayer<Dtype>::workspace_bytes() const {
+  return ConvolutionLayer<Dtype>::workspace_bytes() + sizeof(Dtype)
+      * (static_cast<uint64_t>(transformed_weights_.count())
+      + transformed_input_.count() + transformed_output_.count());
+}
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::TransformWeights() {
+  const Blob<Dtype>& weights = *this->blobs_[0];
+  if (transformed_from_ == weights.data() &&
+      transformed_version_ == weights.data()->version()) {
+    return;
+  }
+  const int count = this->num_output_ * (this->channels_ / this->group_);
+  if (tile_ == 2) {
+    winograd_transform_weights<Dtype, 2>(weights.cpu_data(), count,
+        transformed_weights_.mutable_cpu_data());
+  } else {
+    winograd_transform_weights<Dtype, 4>(weights.cpu_data(), count,
+        transformed_weights_.mutable_cpu_data());
+  }
+  transformed_from_ = weights.data();
+  transformed_version_ = weights.data()->version();
+}
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::Forward_cpu(
+    const vector<Blob<Dtype>*>& bottom, vector<Blob<Dtype>*>* top) {
+  if (!use_winograd_) {
+    ConvolutionLayer<Dtype>::Forward_cpu(bottom, top);
+    return;
+  }
+  TransformWeights();
+  const int positions = alpha_ * alpha_;
+  const int num_tiles = tiles_h_ * tiles_w_;
+  const int group_outputs = this->num_output_ / this->group_;
+  const int group_channels = this->channels_ / this->group_;
+  const Dtype* u = transformed_weights_.cpu_data();
+  Dtype* v = transformed_input_.mutable_cpu_data();
+  Dtype* m = transformed_output_.mutable_cpu_data();
+  const Dtype* bias = this->bias_term_ ? this->blobs_[1]->cpu_data() : NULL;
+  for (int i = 0; i < bottom.size(); ++i) {
+    const Dtype* bottom_data = bottom[i]->cpu_data();
+    Dtype* top_data = (*top)[i]->mutable_cpu_data();
+    for (int n = 0; n < this->num_; ++n) {
+      if (tile_ == 2) {
+        winograd_transform_input<Dtype, 2>(bottom_data + bottom[i]->offset(n),
+            this->channels_, this->height_, this->width_, this->pad_h_,
+            this->pad_w_, tiles_h_, tiles_w_, v);
+      } else {
+        winograd_transform_input<Dtype, 4>(bottom_data + bottom[i]->offset(n),
+            this->channels_, this->height_, this->width_, this->pad_h_,
+            this->pad_w_, tiles_h_, tiles_w_, v);
+      }
+      // One GEMM per tile position and group, over all tiles of the image.
+      for (int xi = 0; xi < positions; ++xi) {
+        for (int g = 0; g < this->group_; ++g) {
+          caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, group_outputs,
+              num_tiles, group_channels, (Dtype)1.,
+              u + (xi * this->num_output_ + g * group_outputs)
+                  * group_channels,
+              v + (xi * this->channels_ + g * group_channels) * num_tiles,
+              (Dtype)0.,
+              m + (xi * this->num_output_ + g * group_outputs) * num_tiles);
+        }
+      }
+      if (tile_ == 2) {
+        winograd_transform_output<Dtype, 2>(m, this->num_output_, tiles_h_,
+            tiles_w_, this->height_out_, this->width_out_, bias,
+            top_data + (*top)[i]->offset(n));
+      } else {
+        winograd_transform_output<Dtype, 4>(m, this->num_output_, tiles_h_,
+            tiles_w_, this->height_out_, this->width_out_, bias,
+            top_data + (*top)[i]->offset(n));
+      }
+    }
+  }
+}
+
+INSTANTIATE_CLASS(WinogradConvolutionLayer);
+
+}  // namespace caffe
@@ -1,4 +1,5 @@
 #include <algorithm>
+#include <cmath>
 #include <map>
 #include <set>
 #include <string>
@@ -9,8 +10,10 @@
 #include "caffe/layer.hpp"
 #include "caffe/net.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/benchmark.hpp"
 #include "caffe/util/insert_splits.hpp"
 #include "caffe/util/io.hpp"
+#include "caffe/util/mapped_weights.hpp"
 #include "caffe/util/math_functions.hpp"
 #include "caffe/util/upgrade_proto.hpp"
 
@@ -18,6 +21,49 @@
 
 namespace caffe {
 
+namespace {
+
+// The layers whose fillers Init may skip, as trained has blobs for them.
+set<string> TrainedLayers(const NetParameter& trained) {
+  set<string> layers;
+  for (int i = 0; i < trained.layers_size(); ++i) {
+    if (trained.layers(i).blobs_size()) {
+      layers.insert(trained.layers(i).name());
+    }
+  }
+  return layers;
+}
+
+set<string> TrainedLayers(const MappedWeights& trained) {
+  set<string> layers;
+  for (int i = 0; i < trained.entries().size(); ++i) {
+    layers.insert(trained.entries()[i].layer);
+  }
+  return layers;
+}
+
+// Copies a mapped entry into blob. Float blobs may instead share the page.
+template <typename Dtype>
+void LoadMappedBlob(const MappedWeights::Entry& entry, const bool share,
+    Blob<Dtype>* blob) {
+  Dtype* data = blob->mutable_cpu_data();
+  for (int i = 0; i < blob->count(); ++i) {
+    data[i] = entry.data[i];
+  }
+}
+
+template <>
+void LoadMappedBlob<float>(const MappedWeights::Entry& entry, const bool share,
+    Blob<float>* blob) {
+  if (share && blob->count()) {
+    blob->set_cpu_data(const_cast<float*>(entry.data));
+  } else {
+    caffe_copy(blob->count(), entry.data, blob->mutable_cpu_data());
+  }
+}
+
+}  // namespace
+
 template <typename Dtype>
 Net<Dtype>::Net(const NetParameter& param) {
   Init(param);
@@ -31,7 +77,37 @@ Net<Dtype>::Net(const string& param_file) {
 }
 
 template <typename Dtype>
-void Net<Dtype>::Init(const NetParameter& in_param) {
+Net<Dtype>::Net(const NetParameter& param, const NetParameter& trained) {
+  Init(param, TrainedLayers(trained));
+  CopyTrainedLayersFrom(trained);
+}
+
+template <typename Dtype>
+Net<Dtype>::Net(const NetParameter& param, const MappedWeights& trained) {
+  Init(param, TrainedLayers(trained));
+  CopyTrainedLayersFrom(trained);
+}
+
+template <typename Dtype>
+Net<Dtype>::Net(const string& param_file, const string& trained_file) {
+  NetParameter param;
+  ReadNetParamsFromTextFileOrDie(param_file, &param);
+  if (MappedWeights::IsMappedWeightsFile(trained_file)) {
+    shared_ptr<MappedWeights> trained(new MappedWeights(trained_file));
+    Init(param, TrainedLayers(*trained));
+    LoadMappedLayers(*trained, true);
+    mapped_weights_.push_back(trained);
+    return;
+  }
+  NetParameter trained;
+  ReadNetParamsFromBinaryFileOrDie(trained_file, &trained);
+  Init(param, TrainedLayers(trained));
+  CopyTrainedLayersFrom(trained);
+}
+
+template <typename Dtype>
+void Net<Dtype>::Init(const NetParameter& in_param,
+    const set<string>& skip_fill) {
   // Filter layers based on their include/exclude rules and
   // the current NetState.
   NetParameter filtered_param;
@@ -94,7 +170,9 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
     }
     // After this layer is connected, set it up.
     LOG(INFO) << "Setting up " << layer_names_[layer_id];
+    Caffe::set_skip_fill(skip_fill.count(layer_param.name()) > 0);
     layers_[layer_id]->SetUp(bottom_vecs_[layer_id], &top_vecs_[layer_id]);
+    Caffe::set_skip_fill(false);
     for (int top_id = 0; top_id < top_vecs_[layer_id].size(); ++top_id) {
       if (blob_loss_weights_.size() <= top_id_vecs_[layer_id][top_id]) {
         blob_loss_weights_.resize(top_id_vecs_[layer_id][top_id] + 1, Dtype(0));
@@ -531,6 +609,33 @@ const vector<Blob<Dtype>*>& Net<Dtype>::ForwardPrefilled(Dtype* loss) {
   return net_output_blobs_;
 }
 
+template <typename Dtype>
+double Net<Dtype>::MeanOutputs(const int iterations, vector<string>* names,
+    vector<double>* means) {
+  names->clear();
+  means->clear();
+  Timer timer;
+  double total_ms = 0;
+  for (int i = 0; i < iterations; ++i) {
+    timer.Start();
+    const vector<Blob<Dtype>*>& result = ForwardPrefilled();
+    total_ms += timer.MilliSeconds();
+    int k = 0;
+    for (int j = 0; j < result.size(); ++j) {
+      const string& name = blob_names_[net_output_blob_indices_[j]];
+      const Dtype* data = result[j]->cpu_data();
+      for (int m = 0; m < result[j]->count(); ++m, ++k) {
+        if (means->size() <= k) {
+          names->push_back(name);
+          means->push_back(0);
+        }
+        (*means)[k] += data[m] / iterations;
+      }
+    }
+  }
+  return total_ms / iterations;
+}
+
 template <typename Dtype>
 const vector<Blob<Dtype>*>& Net<Dtype>::Forward(
     const vector<Blob<Dtype>*> & bottom, Dtype* loss) {
@@ -709,15 +814,57 @@ void Net<Dtype>::CopyTrainedLayersFrom(const NetParameter& param) {
   }
 }
 
+template <typename Dtype>
+void Net<Dtype>::CopyTrainedLayersFrom(const MappedWeights& weights) {
+  LoadMappedLayers(weights, false);
+}
+
 template <typename Dtype>
 void Net<Dtype>::CopyTrainedLayersFrom(const string trained_filename) {
+  if (MappedWeights::IsMappedWeightsFile(trained_filename)) {
+    MappedWeights weights(trained_filename);
+    CopyTrainedLayersFrom(weights);
+    return;
+  }
   NetParameter param;
   ReadNetParamsFromBinaryFileOrDie(trained_filename, &param);
   CopyTrainedLayersFrom(param);
 }
 
 template <typename Dtype>
-void Net<Dtype>::ToProto(NetParameter* param, bool write_diff) {
+void Net<Dtype>::MapTrainedLayersFrom(const string& trained_filename) {
+  shared_ptr<MappedWeights> weights(new MappedWeights(trained_filename));
+  LoadMappedLayers(*weights, true);
+  // Blobs the file does not cover may still point into earlier mappings.
+  mapped_weights_.push_back(weights);
+}
+
+template <typename Dtype>
+void Net<Dtype>::LoadMappedLayers(const MappedWeights& weights,
+    const bool share) {
+  for (int i = 0; i < layers_.size(); ++i) {
+    const vector<const MappedWeights::Entry*> source =
+        weights.layer_entries(layer_names_[i]);
+    if (source.empty()) {
+      continue;
+    }
+    DLOG(INFO) << "Loading source layer " << layer_names_[i];
+    vector<shared_ptr<Blob<Dtype> > >& target_blobs = layers_[i]->blobs();
+    CHECK_EQ(target_blobs.size(), source.size())
+        << "Incompatible number of blobs for layer " << layer_names_[i];
+    for (int j = 0; j < target_blobs.size(); ++j) {
+      CHECK_EQ(target_blobs[j]->num(), source[j]->num);
+      CHECK_EQ(target_blobs[j]->channels(), source[j]->channels);
+      CHECK_EQ(target_blobs[j]->height(), source[j]->height);
+      CHECK_EQ(target_blobs[j]->width(), source[j]->width);
+      LoadMappedBlob(*source[j], share, target_blobs[j].get());
+    }
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::ToProto(NetParameter* param, bool write_diff,
+    BlobProto_DataType data_type) {
   param->Clear();
   param->set_name(name_);
   // Add bottom and top
@@ -733,10 +880,21 @@ void Net<Dtype>::ToProto(NetParameter* param, bool write_diff) {
     for (int j = 0; j < top_id_vecs_[i].size(); ++j) {
       layer_param->add_top(blob_names_[top_id_vecs_[i][j]]);
     }
-    layers_[i]->ToProto(layer_param, write_diff);
+    layers_[i]->ToProto(layer_param, write_diff, data_type);
   }
 }
 
+template <typename Dtype>
+void Net<Dtype>::ToMappedWeights(const string& filename) {
+  vector<vector<Blob<Dtype>*> > blobs(layers_.size());
+  for (int i = 0; i < layers_.size(); ++i) {
+    for (int j = 0; j < layers_[i]->blobs().size(); ++j) {
+      blobs[i].push_back(layers_[i]->blobs()[j].get());
+    }
+  }
+  WriteMappedWeights(layer_names_, blobs, filename);
+}
+
 template <typename Dtype>
 void Net<Dtype>::Update() {
   // First, accumulate the diffs of any shared parameters into their owner's
@@ -745,6 +903,8 @@ void Net<Dtype>::Update() {
   for (int i = 0; i < params_.size(); ++i) {
     if (param_owners_[i] < 0) { continue; }
     if (debug_info_) { UpdateDebugInfo(i); }
+    CHECK(!param_sparse_rows(i) && !param_sparse_rows(param_owners_[i]))
+        << "Parameters with sparse rows cannot be shared; densify first.";
     const int count = params_[i]->count();
     const Dtype* this_diff;
     Dtype* owner_diff;
@@ -771,7 +931,110 @@ void Net<Dtype>::Update() {
   for (int i = 0; i < params_.size(); ++i) {
     if (param_owners_[i] >= 0) { continue; }
     if (debug_info_) { UpdateDebugInfo(i); }
-    params_[i]->Update();
+    const vector<int>* rows = param_sparse_rows(i);
+    if (rows) {
+      // The layers with sparse parameters run on the CPU, so their rows are
+      // updated there in either mode.
+      Blob<Dtype>* param = params_[i].get();
+      const int row_dim = param->count() / param->num();
+      const Dtype* diff = param->cpu_diff();
+      Dtype* data = param->mutable_cpu_data();
+      const Dtype* mask = param_mask(i) ? param_mask(i)->cpu_data() : NULL;
+      for (int j = 0; j < rows->size(); ++j) {
+        const int offset = (*rows)[j] * row_dim;
+        caffe_axpy(row_dim, Dtype(-1), diff + offset, data + offset);
+        if (mask) {
+          caffe_mul(row_dim, mask + offset, data + offset, data + offset);
+        }
+      }
+    } else {
+      params_[i]->Update();
+      if (param_mask(i)) {
+        ApplyParamMask(i);
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::ApplyParamMask(const int param_id) {
+  Blob<Dtype>* param = params_[param_id].get();
+  const Blob<Dtype>& mask = *param_masks_[param_id];
+  switch (Caffe::mode()) {
+  case Caffe::CPU:
+    caffe_mul(param->count(), mask.cpu_data(), param->cpu_data(),
+        param->mutable_cpu_data());
+    break;
+#ifndef CPU_ONLY
+  case Caffe::GPU:
+    caffe_gpu_mul(param->count(), mask.gpu_data(), param->gpu_data(),
+        param->mutable_gpu_data());
+    break;
+#else
+    NO_GPU;
+#endif
+  default:
+    LOG(FATAL) << "Unknown caffe mode: " << Caffe::mode();
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::PruneLayer(const string& layer_name, const float sparsity) {
+  CHECK(has_layer(layer_name)) << "Unknown layer " << layer_name;
+  CHECK(sparsity >= 0 && sparsity < 1)
+      << "The sparsity must be in [0, 1), not " << sparsity;
+  const int layer_id = layer_names_index_[layer_name];
+  int param_id = 0;
+  while (param_id < params_.size() &&
+      param_layer_indices_[param_id] != make_pair(layer_id, 0)) {
+    ++param_id;
+  }
+  CHECK_LT(param_id, params_.size())
+      << "Layer " << layer_name << " has no weights to prune.";
+  if (param_owners_[param_id] >= 0) {
+    param_id = param_owners_[param_id];
+  }
+  Blob<Dtype>* param = params_[param_id].get();
+  param_masks_.resize(params_.size());
+  if (!param_masks_[param_id]) {
+    param_masks_[param_id].reset(new Blob<Dtype>(param->num(),
+        param->channels(), param->height(), param->width()));
+  }
+  const int count = param->count();
+  Dtype* data = param->mutable_cpu_data();
+  Dtype* mask = param_masks_[param_id]->mutable_cpu_data();
+  caffe_set(count, Dtype(1), mask);
+  const int pruned = static_cast<int>(sparsity * count);
+  if (pruned == 0) {
+    return;
+  }
+  vector<Dtype> magnitudes(count);
+  for (int i = 0; i < count; ++i) {
+    magnitudes[i] = std::fabs(data[i]);
+  }
+  std::nth_element(magnitudes.begin(), magnitudes.begin() + pruned - 1,
+      magnitudes.end());
+  const Dtype threshold = magnitudes[pruned - 1];
+  // Exactly pruned weights go: all those below the threshold, and the first
+  // of those at it.
+  int ties = pruned;
+  for (int i = 0; i < count; ++i) {
+    ties -= std::fabs(data[i]) < threshold;
+  }
+  for (int i = 0; i < count; ++i) {
+    const Dtype magnitude = std::fabs(data[i]);
+    if (magnitude < threshold || (magnitude == threshold && ties-- > 0)) {
+      mask[i] = 0;
+      data[i] = 0;
+    }
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::DensifyParamDiffs() {
+  for (int i = 0; i < params_.size(); ++i) {
+    const pair<int, int>& index = param_layer_indices_[i];
+    layers_[index.first]->DensifyParamDiff(index.second);
   }
 }
 
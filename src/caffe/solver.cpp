@@ -8,6 +8,7 @@
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/solver.hpp"
 #include "caffe/util/io.hpp"
+#include "caffe/util/mapped_weights.hpp"
 #include "caffe/util/math_functions.hpp"
 #include "caffe/util/upgrade_proto.hpp"
 
@@ -86,7 +87,20 @@ void Solver<Dtype>::InitTrainNet() {
   net_state.MergeFrom(net_param.state());
   net_state.MergeFrom(param_.train_state());
   net_param.mutable_state()->CopyFrom(net_state);
-  net_.reset(new Net<Dtype>(net_param));
+  if (param_.has_weights()) {
+    LOG(INFO) << "Initializing train net weights from " << param_.weights();
+    if (MappedWeights::IsMappedWeightsFile(param_.weights())) {
+      // Copied rather than shared: training writes every parameter.
+      MappedWeights trained(param_.weights());
+      net_.reset(new Net<Dtype>(net_param, trained));
+    } else {
+      NetParameter trained;
+      ReadNetParamsFromBinaryFileOrDie(param_.weights(), &trained);
+      net_.reset(new Net<Dtype>(net_param, trained));
+    }
+  } else {
+    net_.reset(new Net<Dtype>(net_param));
+  }
 }
 
 template <typename Dtype>
@@ -190,6 +204,8 @@ void Solver<Dtype>::Solve(const char* resume_file) {
   // should be given, and we will just provide dummy vecs.
   vector<Blob<Dtype>*> bottom_vec;
   for (; iter_ < param_.max_iter(); ++iter_) {
+    Prune(start_iter);
+
     // Save a snapshot if needed.
     if (param_.snapshot() && iter_ > start_iter &&
         iter_ % param_.snapshot() == 0) {
@@ -210,9 +226,12 @@ void Solver<Dtype>::Solve(const char* resume_file) {
     else{
       for (int acum_num = 0; acum_num < param_.update_interval() - 1; ++acum_num){
         loss += net_->ForwardBackward(bottom_vec);
+        // Each pass writes different sparse rows; accumulate full diffs.
+        net_->DensifyParamDiffs();
         net_->AccumulateDiff();
       }
       loss += net_->ForwardBackward(bottom_vec);
+      net_->DensifyParamDiffs();
       net_->UpdateDiff();
       loss /= Dtype(param_.update_interval());
     }
@@ -250,6 +269,7 @@ void Solver<Dtype>::Solve(const char* resume_file) {
       }
     }
 
+    if (!SparseUpdates()) { net_->DensifyParamDiffs(); }
     ComputeUpdateValue();
     net_->Update();
   }
@@ -344,17 +364,26 @@ void Solver<Dtype>::Test(const int test_net_id) {
 
 template <typename Dtype>
 void Solver<Dtype>::Snapshot() {
-  NetParameter net_param;
-  // For intermediate results, we will also dump the gradient values.
-  net_->ToProto(&net_param, param_.snapshot_diff());
   string filename(param_.snapshot_prefix());
   const int kBufferSize = 20;
   char iter_str_buffer[kBufferSize];
   sprintf_s(iter_str_buffer, kBufferSize, "_iter_%d", iter_);
   filename += iter_str_buffer;
-  filename += ".caffemodel";
-  LOG(INFO) << "Snapshotting to " << filename;
-  WriteProtoToBinaryFile(net_param, filename.c_str());
+  if (param_.snapshot_format() == SolverParameter_SnapshotFormat_MAPPED) {
+    filename += ".caffemap";
+    LOG(INFO) << "Snapshotting to " << filename;
+    LOG_IF(WARNING, param_.snapshot_diff())
+        << "The mapped weights format does not hold diffs.";
+    net_->ToMappedWeights(filename);
+  } else {
+    NetParameter net_param;
+    // For intermediate results, we will also dump the gradient values.
+    net_->ToProto(&net_param, param_.snapshot_diff(),
+        param_.snapshot_data_type());
+    filename += ".caffemodel";
+    LOG(INFO) << "Snapshotting to " << filename;
+    WriteProtoToBinaryFile(net_param, filename.c_str());
+  }
   SolverState state;
   SnapshotSolverState(&state);
   state.set_iter(iter_);
@@ -364,14 +393,63 @@ void Solver<Dtype>::Snapshot() {
   WriteProtoToBinaryFile(state, filename.c_str());
 }
 
+template <typename Dtype>
+float Solver<Dtype>::PruningSparsity(const int iter) const {
+  const PruningParameter& pruning = param_.pruning_param();
+  const int begin = pruning.begin_iter();
+  const int end = std::max(begin, pruning.end_iter());
+  if (iter >= end) {
+    return pruning.target_sparsity();
+  }
+  const float remaining = 1 - float(iter - begin) / (end - begin);
+  return pruning.target_sparsity() *
+      (1 - remaining * remaining * remaining);
+}
+
+template <typename Dtype>
+void Solver<Dtype>::Prune(const int start_iter) {
+  if (!param_.has_pruning_param()) {
+    return;
+  }
+  const PruningParameter& pruning = param_.pruning_param();
+  CHECK_GT(pruning.interval(), 0) << "The pruning interval must be positive.";
+  const int begin = pruning.begin_iter();
+  const int end = std::max(begin, pruning.end_iter());
+  if (iter_ < begin) {
+    return;
+  }
+  const bool scheduled = iter_ == end ||
+      (iter_ < end && (iter_ - begin) % pruning.interval() == 0);
+  // The masks are not in the snapshots, so a resumed run rebuilds them.
+  if (!scheduled && iter_ != start_iter) {
+    return;
+  }
+  // After a restore between steps, the masks are those of the last step.
+  const int last_step = iter_ >= end ? end :
+      begin + (iter_ - begin) / pruning.interval() * pruning.interval();
+  const float sparsity = PruningSparsity(last_step);
+  vector<string> layers(pruning.layer().begin(), pruning.layer().end());
+  if (layers.empty()) {
+    for (int i = 0; i < net_->layers().size(); ++i) {
+      if (net_->layers()[i]->type() ==
+          LayerParameter_LayerType_INNER_PRODUCT) {
+        layers.push_back(net_->layer_names()[i]);
+      }
+    }
+  }
+  for (int i = 0; i < layers.size(); ++i) {
+    net_->PruneLayer(layers[i], sparsity);
+  }
+  LOG(INFO) << "Iteration " << iter_ << ", pruned " << layers.size()
+      << " layers to sparsity " << sparsity;
+}
+
 template <typename Dtype>
 void Solver<Dtype>::Restore(const char* state_file) {
   SolverState state;
-  NetParameter net_param;
   ReadProtoFromBinaryFile(state_file, &state);
   if (state.has_learned_net()) {
-    ReadProtoFromBinaryFile(state.learned_net().c_str(), &net_param);
-    net_->CopyTrainedLayersFrom(net_param);
+    net_->CopyTrainedLayersFrom(state.learned_net());
   }
   iter_ = state.iter();
   RestoreSolverState(state);
@@ -452,6 +530,12 @@ void SGDSolver<Dtype>::ComputeUpdateValue() {
       // Compute the value to history, and then copy them to the blob's diff.
       Dtype local_rate = rate * net_params_lr[param_id];
       Dtype local_decay = weight_decay * net_params_weight_decay[param_id];
+      const vector<int>* rows = this->net_->param_sparse_rows(param_id);
+      if (rows) {
+        ComputeSparseUpdateValue(param_id, *rows, local_rate, local_decay,
+            momentum);
+        continue;
+      }
 
       if (local_decay) {
         if (regularization_type == "L2") {
@@ -488,6 +572,12 @@ void SGDSolver<Dtype>::ComputeUpdateValue() {
       // Compute the value to history, and then copy them to the blob's diff.
       Dtype local_rate = rate * net_params_lr[param_id];
       Dtype local_decay = weight_decay * net_params_weight_decay[param_id];
+      const vector<int>* rows = this->net_->param_sparse_rows(param_id);
+      if (rows) {
+        ComputeSparseUpdateValue(param_id, *rows, local_rate, local_decay,
+            momentum);
+        continue;
+      }
 
       if (local_decay) {
         if (regularization_type == "L2") {
@@ -526,6 +616,38 @@ void SGDSolver<Dtype>::ComputeUpdateValue() {
   }
 }
 
+// The layers with sparse parameters run on the CPU, so this works on CPU
+// memory in either mode.
+template <typename Dtype>
+void SGDSolver<Dtype>::ComputeSparseUpdateValue(const int param_id,
+    const vector<int>& rows, const Dtype local_rate, const Dtype local_decay,
+    const Dtype momentum) {
+  Blob<Dtype>* param = this->net_->params()[param_id].get();
+  const string& regularization_type = this->param_.regularization_type();
+  const int row_dim = param->count() / param->num();
+  const Dtype* data = param->cpu_data();
+  Dtype* diff = param->mutable_cpu_diff();
+  Dtype* history = history_[param_id]->mutable_cpu_data();
+  Dtype* temp = (local_decay && regularization_type == "L1") ?
+      temp_[param_id]->mutable_cpu_data() : NULL;
+  for (int i = 0; i < rows.size(); ++i) {
+    const int offset = rows[i] * row_dim;
+    if (local_decay) {
+      if (regularization_type == "L2") {
+        caffe_axpy(row_dim, local_decay, data + offset, diff + offset);
+      } else if (regularization_type == "L1") {
+        caffe_cpu_sign(row_dim, data + offset, temp + offset);
+        caffe_axpy(row_dim, local_decay, temp + offset, diff + offset);
+      } else {
+        LOG(FATAL) << "Unknown regularization type: " << regularization_type;
+      }
+    }
+    caffe_cpu_axpby(row_dim, local_rate, diff + offset, momentum,
+        history + offset);
+    caffe_copy(row_dim, history + offset, diff + offset);
+  }
+}
+
 template <typename Dtype>
 void SGDSolver<Dtype>::SnapshotSolverState(SolverState* state) {
   state->clear_history();
@@ -81,6 +81,7 @@ void SyncedMemory::set_cpu_data(void* data) {
   cpu_ptr_ = data;
   head_ = HEAD_AT_CPU;
   own_cpu_data_ = false;
+  ++version_;
 }
 
 const void* SyncedMemory::gpu_data() {
@@ -95,6 +96,7 @@ const void* SyncedMemory::gpu_data() {
 void* SyncedMemory::mutable_cpu_data() {
   to_cpu();
   head_ = HEAD_AT_CPU;
+  ++version_;
   return cpu_ptr_;
 }
 
@@ -102,6 +104,7 @@ void* SyncedMemory::mutable_gpu_data() {
 #ifndef CPU_ONLY
   to_gpu();
   head_ = HEAD_AT_GPU;
+  ++version_;
   return gpu_ptr_;
 #else
   NO_GPU;
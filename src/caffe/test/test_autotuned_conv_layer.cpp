@@ -0,0 +1,202 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>  // NOLINT(readability/streams)
+#include <string>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/net.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/vision_layers.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+#include "caffe/test/test_gradient_check_util.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class AutotunedConvolutionLayerTest : public ::testing::Test {
+ protected:
+  AutotunedConvolutionLayerTest()
+      : blob_bottom_(new Blob<Dtype>(2, 4, 9, 7)),
+        blob_top_(new Blob<Dtype>()),
+        blob_top_ref_(new Blob<Dtype>()) {
+    MakeTempFilename(&cache_file_);
+  }
+  virtual void SetUp() {
+    Caffe::set_mode(Caffe::CPU);
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_);
+    blob_bottom_vec_.push_back(blob_bottom_);
+    blob_top_vec_.push_back(blob_top_);
+    blob_top_ref_vec_.push_back(blob_top_ref_);
+    std::remove(cache_file_.c_str());
+  }
+  virtual ~AutotunedConvolutionLayerTest() {
+    delete blob_bottom_;
+    delete blob_top_;
+    delete blob_top_ref_;
+    std::remove(cache_file_.c_str());
+  }
+
+  LayerParameter MakeParam(const int kernel_size) {
+    LayerParameter layer_param;
+    ConvolutionParameter* convolution_param =
+        layer_param.mutable_convolution_param();
+    convolution_param->set_kernel_size(kernel_size);
+    convolution_param->set_pad(kernel_size / 2);
+    convolution_param->set_num_output(4);
+    convolution_param->set_autotune(true);
+    convolution_param->set_autotune_cache(cache_file_);
+    convolution_param->mutable_weight_filler()->set_type("gaussian");
+    convolution_param->mutable_bias_filler()->set_type("gaussian");
+    return layer_param;
+  }
+
+  // Runs an autotuned layer and the im2col ConvolutionLayer with the same
+  // weights and expects the same output. Returns the chosen algorithm.
+  string CheckAgainstIm2col(const LayerParameter& layer_param) {
+    AutotunedConvolutionLayer<Dtype> layer(layer_param);
+    layer.SetUp(blob_bottom_vec_, &blob_top_vec_);
+    LayerParameter ref_param(layer_param);
+    ref_param.mutable_convolution_param()->set_autotune(false);
+    ConvolutionLayer<Dtype> ref_layer(ref_param);
+    ref_layer.blobs() = layer.blobs();
+    ref_layer.SetUp(blob_bottom_vec_, &blob_top_ref_vec_);
+    layer.Forward(blob_bottom_vec_, &blob_top_vec_);
+    ref_layer.Forward(blob_bottom_vec_, &blob_top_ref_vec_);
+    EXPECT_EQ(blob_top_->count(), blob_top_ref_->count());
+    for (int i = 0; i < blob_top_->count(); ++i) {
+      const Dtype expected = blob_top_ref_->cpu_data()[i];
+      EXPECT_NEAR(blob_top_->cpu_data()[i], expected,
+          1e-4 * std::max(Dtype(1), std::fabs(expected)));
+    }
+    return layer.algorithm();
+  }
+
+  vector<string> ReadCache() {
+    vector<string> lines;
+    std::ifstream cache(cache_file_.c_str());
+    string line;
+    while (std::getline(cache, line)) {
+      lines.push_back(line);
+    }
+    return lines;
+  }
+
+  Blob<Dtype>* const blob_bottom_;
+  Blob<Dtype>* const blob_top_;
+  Blob<Dtype>* const blob_top_ref_;
+  string cache_file_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+  vector<Blob<Dtype>*> blob_top_ref_vec_;
+};
+
+TYPED_TEST_CASE(AutotunedConvolutionLayerTest, TestDtypes);
+
+TYPED_TEST(AutotunedConvolutionLayerTest, TestForward3x3) {
+  const string algorithm = this->CheckAgainstIm2col(this->MakeParam(3));
+  const vector<string> cache = this->ReadCache();
+  ASSERT_EQ(cache.size(), 1);
+  EXPECT_EQ(cache[0].substr(0, cache[0].find(' ')), algorithm);
+}
+
+TYPED_TEST(AutotunedConvolutionLayerTest, TestForward7x7) {
+  this->CheckAgainstIm2col(this->MakeParam(7));
+}
+
+TYPED_TEST(AutotunedConvolutionLayerTest, TestForwardDepthwise) {
+  LayerParameter layer_param = this->MakeParam(3);
+  layer_param.mutable_convolution_param()->set_group(4);
+  this->CheckAgainstIm2col(layer_param);
+}
+
+TYPED_TEST(AutotunedConvolutionLayerTest, TestCachedChoice) {
+  // A second layer of the same shape takes its algorithm from the cache
+  // rather than benchmarking again.
+  const LayerParameter layer_param = this->MakeParam(3);
+  const string tuned = this->CheckAgainstIm2col(layer_param);
+  vector<string> cache = this->ReadCache();
+  ASSERT_EQ(cache.size(), 1);
+  const string forced = tuned == "direct" ? "winograd2" : "direct";
+  {
+    std::ofstream out(this->cache_file_.c_str());
+    out << "unknown " << cache[0].substr(cache[0].find(' ') + 1) << "\n";
+    out << forced << " " << cache[0].substr(cache[0].find(' ') + 1) << "\n";
+  }
+  EXPECT_EQ(this->CheckAgainstIm2col(layer_param), forced);
+  EXPECT_EQ(this->ReadCache().size(), 2);
+}
+
+TYPED_TEST(AutotunedConvolutionLayerTest, TestWithoutCache) {
+  LayerParameter layer_param = this->MakeParam(3);
+  layer_param.mutable_convolution_param()->set_autotune_cache("");
+  this->CheckAgainstIm2col(layer_param);
+  EXPECT_EQ(this->ReadCache().size(), 0);
+}
+
+TYPED_TEST(AutotunedConvolutionLayerTest, TestCacheKeepsRandomStream) {
+  // Benchmarking on a cache miss must not draw from the RNG, or the layers
+  // after an autotuned one would be initialized differently on a cache hit.
+  typedef TypeParam Dtype;
+  const string proto =
+      "input: 'data' input_dim: 2 input_dim: 4 input_dim: 9 input_dim: 7 "
+      "layers { name: 'conv' type: CONVOLUTION bottom: 'data' top: 'conv' "
+      "  convolution_param { num_output: 4 kernel_size: 3 pad: 1 "
+      "    autotune: true autotune_cache: '" + this->cache_file_ + "' "
+      "    weight_filler { type: 'gaussian' } "
+      "    bias_filler { type: 'gaussian' } } } "
+      "layers { name: 'ip' type: INNER_PRODUCT bottom: 'conv' top: 'ip' "
+      "  inner_product_param { num_output: 3 "
+      "    weight_filler { type: 'gaussian' } "
+      "    bias_filler { type: 'gaussian' } } } ";
+  NetParameter param;
+  CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+  Caffe::set_random_seed(1701);
+  Net<Dtype> cold(param);
+  ASSERT_EQ(this->ReadCache().size(), 1);
+  Caffe::set_random_seed(1701);
+  Net<Dtype> warm(param);
+  EXPECT_EQ(this->ReadCache().size(), 1);
+  ASSERT_EQ(cold.params().size(), warm.params().size());
+  for (int i = 0; i < cold.params().size(); ++i) {
+    const Blob<Dtype>& expected = *cold.params()[i];
+    const Blob<Dtype>& actual = *warm.params()[i];
+    ASSERT_EQ(expected.count(), actual.count());
+    for (int j = 0; j < expected.count(); ++j) {
+      EXPECT_EQ(expected.cpu_data()[j], actual.cpu_data()[j]);
+    }
+  }
+}
+
+TYPED_TEST(AutotunedConvolutionLayerTest, TestFactory) {
+  typedef TypeParam Dtype;
+  LayerParameter layer_param = this->MakeParam(3);
+  layer_param.set_type(LayerParameter_LayerType_CONVOLUTION);
+  shared_ptr<Layer<Dtype> > layer(GetLayer<Dtype>(layer_param));
+  EXPECT_TRUE(dynamic_cast<AutotunedConvolutionLayer<Dtype>*>(layer.get()));
+}
+
+TYPED_TEST(AutotunedConvolutionLayerTest, TestGradient) {
+  typedef TypeParam Dtype;
+  this->blob_bottom_->Reshape(2, 3, 6, 4);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  LayerParameter layer_param = this->MakeParam(3);
+  layer_param.mutable_convolution_param()->set_num_output(2);
+  AutotunedConvolutionLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, &(this->blob_bottom_vec_),
+      &(this->blob_top_vec_));
+}
+
+}  // namespace caffe
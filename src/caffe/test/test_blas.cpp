@@ -0,0 +1,184 @@
+#include <limits>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/util/blas.hpp"
+#include "caffe/util/math_functions.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class BlasDispatchTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    backend_ = caffe_blas_backend();
+    profiling_ = caffe_blas_profiling();
+  }
+  virtual void TearDown() {
+    caffe_set_blas_backend(backend_);
+    caffe_blas_set_profiling(profiling_);
+  }
+
+  void Fill(Blob<Dtype>* blob) {
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(blob);
+  }
+
+  // Checks caffe_cpu_gemm against a naive product, for both beta = 0 over
+  // a C holding NaNs, which must be ignored, and beta != 0.
+  void CheckGemm(const CBLAS_TRANSPOSE trans_a, const CBLAS_TRANSPOSE trans_b,
+      const int M, const int N, const int K) {
+    Blob<Dtype> A(1, 1, M, K);
+    Blob<Dtype> B(1, 1, K, N);
+    Blob<Dtype> C(1, 1, M, N);
+    Fill(&A);
+    Fill(&B);
+    const Dtype* a = A.cpu_data();
+    const Dtype* b = B.cpu_data();
+    for (int pass = 0; pass < 2; ++pass) {
+      const Dtype alpha = 1.5;
+      const Dtype beta = pass == 0 ? 0 : 0.5;
+      if (pass == 0) {
+        caffe_set(C.count(), std::numeric_limits<Dtype>::quiet_NaN(),
+            C.mutable_cpu_data());
+      } else {
+        Fill(&C);
+      }
+      vector<Dtype> c_before(C.cpu_data(), C.cpu_data() + C.count());
+      caffe_cpu_gemm<Dtype>(trans_a, trans_b, M, N, K, alpha, a, b, beta,
+          C.mutable_cpu_data());
+      for (int i = 0; i < M; ++i) {
+        for (int j = 0; j < N; ++j) {
+          double expected = 0;
+          for (int k = 0; k < K; ++k) {
+            const Dtype a_ik = trans_a == CblasNoTrans ?
+                a[i * K + k] : a[k * M + i];
+            const Dtype b_kj = trans_b == CblasNoTrans ?
+                b[k * N + j] : b[j * K + k];
+            expected += a_ik * b_kj;
+          }
+          expected *= alpha;
+          if (beta != 0) {
+            expected += beta * c_before[i * N + j];
+          }
+          EXPECT_NEAR(C.cpu_data()[i * N + j], expected, 1e-4 * (1 + K))
+              << "M " << M << " N " << N << " K " << K << " beta " << beta;
+        }
+      }
+    }
+  }
+
+  void CheckAllShapes() {
+    // GEMV routing (M or N is 1), the small kernel, and blocked shapes with
+    // partial blocks in every dimension.
+    const int kShapes[][3] = {
+      {1, 7, 5}, {6, 1, 9}, {1, 1, 4}, {3, 5, 2}, {6, 7, 8},
+      {4, 8, 8}, {9, 13, 11}, {70, 300, 270}, {5, 600, 3}
+    };
+    const int num_shapes = sizeof(kShapes) / sizeof(kShapes[0]);
+    const CBLAS_TRANSPOSE trans[2] = { CblasNoTrans, CblasTrans };
+    for (int s = 0; s < num_shapes; ++s) {
+      for (int ta = 0; ta < 2; ++ta) {
+        for (int tb = 0; tb < 2; ++tb) {
+          CheckGemm(trans[ta], trans[tb], kShapes[s][0], kShapes[s][1],
+              kShapes[s][2]);
+        }
+      }
+    }
+  }
+
+  void CheckGemv(const CBLAS_TRANSPOSE trans_a, const int M, const int N) {
+    Blob<Dtype> A(1, 1, M, N);
+    const int x_size = trans_a == CblasNoTrans ? N : M;
+    const int y_size = trans_a == CblasNoTrans ? M : N;
+    Blob<Dtype> x(1, 1, 1, x_size);
+    Blob<Dtype> y(1, 1, 1, y_size);
+    Fill(&A);
+    Fill(&x);
+    Fill(&y);
+    vector<Dtype> y_before(y.cpu_data(), y.cpu_data() + y_size);
+    caffe_cpu_gemv<Dtype>(trans_a, M, N, Dtype(2), A.cpu_data(), x.cpu_data(),
+        Dtype(-1), y.mutable_cpu_data());
+    for (int i = 0; i < y_size; ++i) {
+      double expected = 0;
+      for (int k = 0; k < x_size; ++k) {
+        expected += (trans_a == CblasNoTrans ?
+            A.cpu_data()[i * N + k] : A.cpu_data()[k * N + i])
+            * x.cpu_data()[k];
+      }
+      EXPECT_NEAR(y.cpu_data()[i], 2 * expected - y_before[i],
+          1e-4 * (1 + x_size));
+    }
+  }
+
+  BlasBackend backend_;
+  bool profiling_;
+};
+
+TYPED_TEST_CASE(BlasDispatchTest, TestDtypes);
+
+TYPED_TEST(BlasDispatchTest, TestGemmCblas) {
+  caffe_set_blas_backend(BLAS_CBLAS);
+  this->CheckAllShapes();
+}
+
+TYPED_TEST(BlasDispatchTest, TestGemmBuiltin) {
+  caffe_set_blas_backend(BLAS_BUILTIN);
+  this->CheckAllShapes();
+}
+
+TYPED_TEST(BlasDispatchTest, TestGemvBuiltin) {
+  caffe_set_blas_backend(BLAS_BUILTIN);
+  this->CheckGemv(CblasNoTrans, 7, 300);
+  this->CheckGemv(CblasTrans, 7, 300);
+  this->CheckGemv(CblasNoTrans, 200, 100);
+  this->CheckGemv(CblasTrans, 200, 100);
+}
+
+TYPED_TEST(BlasDispatchTest, TestProfilingCounters) {
+  typedef TypeParam Dtype;
+  Blob<Dtype> A(1, 1, 32, 32);
+  Blob<Dtype> B(1, 1, 32, 32);
+  Blob<Dtype> C(1, 1, 32, 32);
+  this->Fill(&A);
+  this->Fill(&B);
+  caffe_blas_set_profiling(true);
+  caffe_blas_reset_stats();
+  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, 32, 32, 32, 1.,
+      A.cpu_data(), B.cpu_data(), 0., C.mutable_cpu_data());
+  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, 32, 1, 32, 1.,
+      A.cpu_data(), B.cpu_data(), 0., C.mutable_cpu_data());
+  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, 4, 4, 4, 1.,
+      A.cpu_data(), B.cpu_data(), 0., C.mutable_cpu_data());
+  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, 4, 4, 4, 1.,
+      A.cpu_data(), B.cpu_data(), 0., C.mutable_cpu_data());
+  caffe_cpu_gemv<Dtype>(CblasNoTrans, 32, 32, 1., A.cpu_data(),
+      B.cpu_data(), 0., C.mutable_cpu_data());
+  EXPECT_EQ(caffe_blas_stats(BLAS_GEMM).calls, 1);
+  EXPECT_EQ(caffe_blas_stats(BLAS_GEMM).flops, 2. * 32 * 32 * 32);
+  EXPECT_EQ(caffe_blas_stats(BLAS_GEMM_AS_GEMV).calls, 1);
+  EXPECT_EQ(caffe_blas_stats(BLAS_GEMM_SMALL).calls, 2);
+  EXPECT_EQ(caffe_blas_stats(BLAS_GEMV).calls, 1);
+  caffe_blas_set_profiling(false);
+  caffe_cpu_gemv<Dtype>(CblasNoTrans, 32, 32, 1., A.cpu_data(),
+      B.cpu_data(), 0., C.mutable_cpu_data());
+  EXPECT_EQ(caffe_blas_stats(BLAS_GEMV).calls, 1);
+  caffe_blas_reset_stats();
+  EXPECT_EQ(caffe_blas_stats(BLAS_GEMM).calls, 0);
+}
+
+TYPED_TEST(BlasDispatchTest, TestBackendFromName) {
+  EXPECT_EQ(caffe_blas_backend_from_name("builtin"), BLAS_BUILTIN);
+  EXPECT_EQ(caffe_blas_backend_from_name("cblas"), BLAS_CBLAS);
+  EXPECT_EQ(caffe_blas_backend_from_name(
+      caffe_blas_backend_name(BLAS_CBLAS)), BLAS_CBLAS);
+}
+
+}  // namespace caffe
@@ -1,3 +1,4 @@
+#include <cmath>
 #include <cstring>
 
 #include "gtest/gtest.h"
@@ -54,4 +55,30 @@ TYPED_TEST(BlobSimpleTest, TestReshape) {
   EXPECT_EQ(this->blob_->count(), 120);
 }
 
+TYPED_TEST(BlobSimpleTest, TestProtoHalfPrecision) {
+  typedef TypeParam Dtype;
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_preshaped_);
+  const int count = this->blob_preshaped_->count();
+  // Relative rounding error bounds: 11 and 8 significant bits.
+  const BlobProto_DataType types[] = {BlobProto_DataType_FP16,
+      BlobProto_DataType_BF16};
+  const Dtype bounds[] = {Dtype(1) / 2048, Dtype(1) / 256};
+  for (int t = 0; t < 2; ++t) {
+    BlobProto proto;
+    this->blob_preshaped_->ToProto(&proto, false, types[t]);
+    EXPECT_EQ(types[t], proto.data_type());
+    EXPECT_EQ(0, proto.data_size());
+    EXPECT_EQ(2 * count, proto.half_data().size());
+    this->blob_->FromProto(proto);
+    ASSERT_EQ(count, this->blob_->count());
+    for (int i = 0; i < count; ++i) {
+      const Dtype expected = this->blob_preshaped_->cpu_data()[i];
+      EXPECT_LE(std::fabs(this->blob_->cpu_data()[i] - expected),
+          bounds[t] * std::fabs(expected));
+    }
+  }
+}
+
 }  // namespace caffe
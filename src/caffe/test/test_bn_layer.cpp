@@ -0,0 +1,171 @@
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/common_layers.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "gtest/gtest.h"
+
+#include "caffe/test/test_caffe_main.hpp"
+#include "caffe/test/test_gradient_check_util.hpp"
+
+namespace caffe {
+
+template <typename TypeParam>
+class BNLayerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+ protected:
+  BNLayerTest()
+      : blob_bottom_(new Blob<Dtype>(3, 4, 5, 6)),
+        blob_top_(new Blob<Dtype>()) {
+    // fill the values, away from zero mean and unit variance
+    FillerParameter filler_param;
+    filler_param.set_mean(2);
+    filler_param.set_std(3);
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_);
+    blob_bottom_vec_.push_back(blob_bottom_);
+    blob_top_vec_.push_back(blob_top_);
+    Caffe::set_phase(Caffe::TRAIN);
+  }
+  virtual ~BNLayerTest() {
+    delete blob_bottom_;
+    delete blob_top_;
+    Caffe::set_phase(Caffe::TRAIN);
+  }
+
+  LayerParameter MakeParam() {
+    LayerParameter layer_param;
+    BNParameter* bn_param = layer_param.mutable_bn_param();
+    bn_param->mutable_scale_filler()->set_type("constant");
+    bn_param->mutable_scale_filler()->set_value(1);
+    bn_param->mutable_shift_filler()->set_type("constant");
+    bn_param->mutable_shift_filler()->set_value(0);
+    return layer_param;
+  }
+
+  // Per-channel mean and variance of blob over num, height and width.
+  void ChannelStatistics(Blob<Dtype>* blob, const int c, Dtype* mean,
+      Dtype* variance) {
+    double sum = 0;
+    double sum_sq = 0;
+    for (int n = 0; n < blob->num(); ++n) {
+      for (int h = 0; h < blob->height(); ++h) {
+        for (int w = 0; w < blob->width(); ++w) {
+          const double value = blob->data_at(n, c, h, w);
+          sum += value;
+          sum_sq += value * value;
+        }
+      }
+    }
+    const int count = blob->num() * blob->height() * blob->width();
+    *mean = sum / count;
+    *variance = sum_sq / count - (sum / count) * (sum / count);
+  }
+
+  Blob<Dtype>* const blob_bottom_;
+  Blob<Dtype>* const blob_top_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(BNLayerTest, TestDtypesAndDevices);
+
+TYPED_TEST(BNLayerTest, TestForward) {
+  typedef typename TypeParam::Dtype Dtype;
+  BNLayer<Dtype> layer(this->MakeParam());
+  layer.SetUp(this->blob_bottom_vec_, &(this->blob_top_vec_));
+  layer.Forward(this->blob_bottom_vec_, &(this->blob_top_vec_));
+  for (int c = 0; c < this->blob_top_->channels(); ++c) {
+    Dtype mean, variance;
+    this->ChannelStatistics(this->blob_top_, c, &mean, &variance);
+    EXPECT_NEAR(0, mean, 1e-4);
+    EXPECT_NEAR(1, variance, 1e-3);
+  }
+}
+
+TYPED_TEST(BNLayerTest, TestForwardInPlace) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param = this->MakeParam();
+  layer_param.mutable_bn_param()->mutable_scale_filler()->set_type("gaussian");
+  layer_param.mutable_bn_param()->mutable_shift_filler()->set_type("gaussian");
+  BNLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, &(this->blob_top_vec_));
+  layer.Forward(this->blob_bottom_vec_, &(this->blob_top_vec_));
+  // SetUp reshapes the top, so the in-place blob gets its data afterwards.
+  Blob<Dtype> in_place_blob;
+  vector<Blob<Dtype>*> in_place_vec(1, &in_place_blob);
+  in_place_blob.ReshapeLike(*this->blob_bottom_);
+  BNLayer<Dtype> in_place_layer(layer_param);
+  in_place_layer.SetUp(in_place_vec, &in_place_vec);
+  in_place_layer.blobs()[0] = layer.blobs()[0];
+  in_place_layer.blobs()[1] = layer.blobs()[1];
+  caffe_copy(this->blob_bottom_->count(), this->blob_bottom_->cpu_data(),
+      in_place_blob.mutable_cpu_data());
+  in_place_layer.Forward(in_place_vec, &in_place_vec);
+  for (int i = 0; i < this->blob_top_->count(); ++i) {
+    EXPECT_NEAR(this->blob_top_->cpu_data()[i], in_place_blob.cpu_data()[i],
+        1e-4);
+  }
+  // Backward in place recovers x_norm from what forward kept.
+  caffe_copy(this->blob_top_->count(), this->blob_top_->cpu_data(),
+      this->blob_top_->mutable_cpu_diff());
+  caffe_copy(this->blob_top_->count(), this->blob_top_->cpu_data(),
+      in_place_blob.mutable_cpu_diff());
+  const vector<bool> propagate_down(1, true);
+  layer.Backward(this->blob_top_vec_, propagate_down,
+      &(this->blob_bottom_vec_));
+  in_place_layer.Backward(in_place_vec, propagate_down, &in_place_vec);
+  for (int i = 0; i < this->blob_bottom_->count(); ++i) {
+    EXPECT_NEAR(this->blob_bottom_->cpu_diff()[i],
+        in_place_blob.cpu_diff()[i], 1e-4);
+  }
+}
+
+TYPED_TEST(BNLayerTest, TestMovingAverage) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param = this->MakeParam();
+  layer_param.mutable_bn_param()->set_moving_average(true);
+  layer_param.mutable_bn_param()->set_decay(0.5);
+  BNLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, &(this->blob_top_vec_));
+  layer.Forward(this->blob_bottom_vec_, &(this->blob_top_vec_));
+  // One training pass from zero history leaves half the batch statistics.
+  for (int c = 0; c < this->blob_bottom_->channels(); ++c) {
+    Dtype mean, variance;
+    this->ChannelStatistics(this->blob_bottom_, c, &mean, &variance);
+    EXPECT_NEAR(mean / 2, layer.blobs()[2]->cpu_data()[c], 1e-4);
+    EXPECT_NEAR(variance / 2, layer.blobs()[3]->cpu_data()[c], 1e-3);
+  }
+  // Testing normalizes with the history instead.
+  Caffe::set_phase(Caffe::TEST);
+  layer.Forward(this->blob_bottom_vec_, &(this->blob_top_vec_));
+  for (int n = 0; n < this->blob_bottom_->num(); ++n) {
+    for (int c = 0; c < this->blob_bottom_->channels(); ++c) {
+      const Dtype mean = layer.blobs()[2]->cpu_data()[c];
+      const Dtype std = sqrt(layer.blobs()[3]->cpu_data()[c] + 1e-10);
+      for (int h = 0; h < this->blob_bottom_->height(); ++h) {
+        for (int w = 0; w < this->blob_bottom_->width(); ++w) {
+          EXPECT_NEAR((this->blob_bottom_->data_at(n, c, h, w) - mean) / std,
+              this->blob_top_->data_at(n, c, h, w), 1e-4);
+        }
+      }
+    }
+  }
+}
+
+TYPED_TEST(BNLayerTest, TestGradient) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param = this->MakeParam();
+  layer_param.mutable_bn_param()->mutable_scale_filler()->set_type("gaussian");
+  layer_param.mutable_bn_param()->mutable_shift_filler()->set_type("gaussian");
+  BNLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, &(this->blob_bottom_vec_),
+      &(this->blob_top_vec_));
+}
+
+}  // namespace caffe
@@ -302,6 +302,447 @@ TYPED_TEST(ConvolutionLayerTest, TestGradientGroup) {
       &(this->blob_top_vec_));
 }
 
+TYPED_TEST(ConvolutionLayerTest, Test1x1Convolution) {
+  // Check the im2col-free 1x1 path (stride 1) and the subsampling 1x1 path
+  // (stride 2) against a direct per-pixel channel mix.
+  typedef typename TypeParam::Dtype Dtype;
+  for (int stride = 1; stride <= 2; ++stride) {
+    LayerParameter layer_param;
+    ConvolutionParameter* convolution_param =
+        layer_param.mutable_convolution_param();
+    convolution_param->set_kernel_size(1);
+    convolution_param->set_stride(stride);
+    convolution_param->set_num_output(4);
+    convolution_param->mutable_weight_filler()->set_type("gaussian");
+    convolution_param->mutable_bias_filler()->set_type("gaussian");
+    ConvolutionLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, &(this->blob_top_vec_));
+    EXPECT_EQ(this->blob_top_->height(), (6 - 1) / stride + 1);
+    EXPECT_EQ(this->blob_top_->width(), (4 - 1) / stride + 1);
+    layer.Forward(this->blob_bottom_vec_, &(this->blob_top_vec_));
+    const Dtype* weights = layer.blobs()[0]->cpu_data();
+    const Dtype* bias = layer.blobs()[1]->cpu_data();
+    const Blob<Dtype>& bottom = *this->blob_bottom_;
+    const Blob<Dtype>& top = *this->blob_top_;
+    for (int n = 0; n < top.num(); ++n) {
+      for (int o = 0; o < top.channels(); ++o) {
+        for (int h = 0; h < top.height(); ++h) {
+          for (int w = 0; w < top.width(); ++w) {
+            Dtype expected = bias[o];
+            for (int c = 0; c < bottom.channels(); ++c) {
+              expected += weights[o * bottom.channels() + c] *
+                  bottom.data_at(n, c, h * stride, w * stride);
+            }
+            EXPECT_NEAR(top.data_at(n, o, h, w), expected, 1e-4);
+          }
+        }
+      }
+    }
+  }
+}
+
+TYPED_TEST(ConvolutionLayerTest, Test1x1Gradient) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  this->blob_bottom_vec_.push_back(this->blob_bottom_2_);
+  this->blob_top_vec_.push_back(this->blob_top_2_);
+  convolution_param->set_kernel_size(1);
+  convolution_param->set_stride(1);
+  convolution_param->set_num_output(2);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  ConvolutionLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, &(this->blob_bottom_vec_),
+      &(this->blob_top_vec_));
+}
+
+TYPED_TEST(ConvolutionLayerTest, Test1x1GradientStrided) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->set_kernel_size(1);
+  convolution_param->set_stride(2);
+  convolution_param->set_num_output(3);
+  convolution_param->set_group(3);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  ConvolutionLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, &(this->blob_bottom_vec_),
+      &(this->blob_top_vec_));
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestGroupConvolutionGemm) {
+  // With five channels per group, too many for the direct kernels, the
+  // groups run as separate GEMMs; each output sums its own group only.
+  typedef typename TypeParam::Dtype Dtype;
+  Blob<Dtype> bottom(2, 10, 6, 4);
+  Dtype* bottom_data = bottom.mutable_cpu_data();
+  for (int n = 0; n < bottom.num(); ++n) {
+    for (int c = 0; c < bottom.channels(); ++c) {
+      for (int i = 0; i < bottom.height() * bottom.width(); ++i) {
+        bottom_data[bottom.offset(n, c) + i] = c;
+      }
+    }
+  }
+  vector<Blob<Dtype>*> bottom_vec(1, &bottom);
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->set_kernel_size(3);
+  convolution_param->set_stride(2);
+  convolution_param->set_num_output(4);
+  convolution_param->set_group(2);
+  convolution_param->mutable_weight_filler()->set_type("constant");
+  convolution_param->mutable_weight_filler()->set_value(1);
+  convolution_param->mutable_bias_filler()->set_type("constant");
+  convolution_param->mutable_bias_filler()->set_value(0.1);
+  ConvolutionLayer<Dtype> layer(layer_param);
+  layer.SetUp(bottom_vec, &(this->blob_top_vec_));
+  layer.Forward(bottom_vec, &(this->blob_top_vec_));
+  // Group 0 sums channels 0..4 (10 per pixel), group 1 channels 5..9 (35).
+  const Blob<Dtype>& top = *this->blob_top_;
+  for (int n = 0; n < top.num(); ++n) {
+    for (int k = 0; k < top.channels(); ++k) {
+      const Dtype expected = (k < 2 ? 10 : 35) * 9 + 0.1;
+      for (int h = 0; h < top.height(); ++h) {
+        for (int w = 0; w < top.width(); ++w) {
+          EXPECT_NEAR(top.data_at(n, k, h, w), expected, 1e-4);
+        }
+      }
+    }
+  }
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestGradientGroupGemm) {
+  typedef typename TypeParam::Dtype Dtype;
+  Blob<Dtype> bottom(2, 10, 5, 4);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(&bottom);
+  vector<Blob<Dtype>*> bottom_vec(1, &bottom);
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->set_kernel_size(3);
+  convolution_param->set_stride(2);
+  convolution_param->set_num_output(4);
+  convolution_param->set_group(2);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  ConvolutionLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, &bottom_vec,
+      &(this->blob_top_vec_));
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestSmallGroupConvolution) {
+  // Two channels per group take the direct kernels on CPU, here with unit
+  // stride and padding, checked against a direct evaluation of the
+  // definition.
+  typedef typename TypeParam::Dtype Dtype;
+  Blob<Dtype> bottom(2, 4, 6, 4);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(&bottom);
+  vector<Blob<Dtype>*> bottom_vec(1, &bottom);
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->set_kernel_size(3);
+  convolution_param->set_pad(1);
+  convolution_param->set_num_output(6);
+  convolution_param->set_group(2);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  ConvolutionLayer<Dtype> layer(layer_param);
+  layer.SetUp(bottom_vec, &(this->blob_top_vec_));
+  layer.Forward(bottom_vec, &(this->blob_top_vec_));
+  const Blob<Dtype>& top = *this->blob_top_;
+  const Blob<Dtype>& weights = *layer.blobs()[0];
+  const Dtype* bias = layer.blobs()[1]->cpu_data();
+  for (int n = 0; n < top.num(); ++n) {
+    for (int k = 0; k < top.channels(); ++k) {
+      const int g = k / 3;
+      for (int y = 0; y < top.height(); ++y) {
+        for (int x = 0; x < top.width(); ++x) {
+          Dtype expected = bias[k];
+          for (int c = 0; c < 2; ++c) {
+            for (int i = 0; i < 3; ++i) {
+              for (int j = 0; j < 3; ++j) {
+                const int h = y - 1 + i;
+                const int w = x - 1 + j;
+                if (h >= 0 && h < bottom.height() && w >= 0 &&
+                    w < bottom.width()) {
+                  expected += weights.data_at(k, c, i, j) *
+                      bottom.data_at(n, g * 2 + c, h, w);
+                }
+              }
+            }
+          }
+          EXPECT_NEAR(top.data_at(n, k, y, x), expected, 1e-4);
+        }
+      }
+    }
+  }
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestSmallGroupGradient) {
+  typedef typename TypeParam::Dtype Dtype;
+  Blob<Dtype> bottom(2, 4, 6, 4);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(&bottom);
+  vector<Blob<Dtype>*> bottom_vec(1, &bottom);
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->set_kernel_size(3);
+  convolution_param->set_pad(1);
+  convolution_param->set_num_output(6);
+  convolution_param->set_group(2);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  ConvolutionLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, &bottom_vec,
+      &(this->blob_top_vec_));
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestDepthwiseConvolution) {
+  // Depthwise convolution with a channel multiplier of 2, padding and
+  // stride, checked against a direct evaluation of the definition.
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->set_kernel_size(3);
+  convolution_param->set_stride(2);
+  convolution_param->set_pad(1);
+  convolution_param->set_num_output(6);
+  convolution_param->set_group(3);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  ConvolutionLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, &(this->blob_top_vec_));
+  layer.Forward(this->blob_bottom_vec_, &(this->blob_top_vec_));
+  const Blob<Dtype>& bottom = *this->blob_bottom_;
+  const Blob<Dtype>& top = *this->blob_top_;
+  const Blob<Dtype>& weights = *layer.blobs()[0];
+  const Dtype* bias = layer.blobs()[1]->cpu_data();
+  for (int n = 0; n < top.num(); ++n) {
+    for (int k = 0; k < top.channels(); ++k) {
+      const int c = k / 2;
+      for (int y = 0; y < top.height(); ++y) {
+        for (int x = 0; x < top.width(); ++x) {
+          Dtype expected = bias[k];
+          for (int i = 0; i < 3; ++i) {
+            for (int j = 0; j < 3; ++j) {
+              const int h = y * 2 - 1 + i;
+              const int w = x * 2 - 1 + j;
+              if (h >= 0 && h < bottom.height() && w >= 0 &&
+                  w < bottom.width()) {
+                expected += weights.data_at(k, 0, i, j) *
+                    bottom.data_at(n, c, h, w);
+              }
+            }
+          }
+          EXPECT_NEAR(top.data_at(n, k, y, x), expected, 1e-4);
+        }
+      }
+    }
+  }
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestDepthwiseGradient) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  this->blob_bottom_vec_.push_back(this->blob_bottom_2_);
+  this->blob_top_vec_.push_back(this->blob_top_2_);
+  convolution_param->set_kernel_size(3);
+  convolution_param->set_stride(2);
+  convolution_param->set_pad(1);
+  convolution_param->set_num_output(6);
+  convolution_param->set_group(3);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  ConvolutionLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, &(this->blob_bottom_vec_),
+      &(this->blob_top_vec_));
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestBatchedGemm) {
+  // Convolving several images per GEMM must match the per-image path,
+  // including a final partial chunk (5 images, 2 per GEMM).
+  typedef typename TypeParam::Dtype Dtype;
+  Blob<Dtype> bottom(5, 4, 6, 4);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(&bottom);
+  vector<Blob<Dtype>*> bottom_vec(1, &bottom);
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->set_kernel_size(3);
+  convolution_param->set_pad(1);
+  convolution_param->set_num_output(4);
+  convolution_param->set_group(2);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  ConvolutionLayer<Dtype> layer(layer_param);
+  layer.SetUp(bottom_vec, &(this->blob_top_vec_));
+  // Workspace per image: (column rows + outputs) * N, for data and diff.
+  const int bytes_per_image = 2 * sizeof(Dtype) * (4 * 3 * 3 + 4) * 6 * 4;
+  convolution_param->set_gemm_workspace_limit(2 * bytes_per_image + 1);
+  ConvolutionLayer<Dtype> batched_layer(layer_param);
+  batched_layer.blobs().resize(2);
+  for (int j = 0; j < 2; ++j) {
+    batched_layer.blobs()[j].reset(new Blob<Dtype>());
+    batched_layer.blobs()[j]->CopyFrom(*layer.blobs()[j], false, true);
+  }
+  vector<Blob<Dtype>*> batched_top_vec(1, this->blob_top_2_);
+  batched_layer.SetUp(bottom_vec, &batched_top_vec);
+  layer.Forward(bottom_vec, &(this->blob_top_vec_));
+  batched_layer.Forward(bottom_vec, &batched_top_vec);
+  ASSERT_EQ(this->blob_top_->count(), this->blob_top_2_->count());
+  for (int i = 0; i < this->blob_top_->count(); ++i) {
+    EXPECT_NEAR(this->blob_top_->cpu_data()[i],
+        this->blob_top_2_->cpu_data()[i], 1e-4);
+  }
+  // Backward with the same top diff through both layers.
+  filler.Fill(this->blob_top_);
+  caffe_copy(this->blob_top_->count(), this->blob_top_->cpu_data(),
+      this->blob_top_->mutable_cpu_diff());
+  caffe_copy(this->blob_top_->count(), this->blob_top_->cpu_data(),
+      this->blob_top_2_->mutable_cpu_diff());
+  vector<bool> propagate_down(1, true);
+  Blob<Dtype> bottom_diff;
+  layer.Backward(this->blob_top_vec_, propagate_down, &bottom_vec);
+  bottom_diff.CopyFrom(bottom, true, true);
+  batched_layer.Backward(batched_top_vec, propagate_down, &bottom_vec);
+  for (int i = 0; i < bottom.count(); ++i) {
+    EXPECT_NEAR(bottom_diff.cpu_diff()[i], bottom.cpu_diff()[i], 1e-4);
+  }
+  for (int j = 0; j < 2; ++j) {
+    const Blob<Dtype>& expected = *layer.blobs()[j];
+    const Blob<Dtype>& actual = *batched_layer.blobs()[j];
+    for (int i = 0; i < expected.count(); ++i) {
+      EXPECT_NEAR(expected.cpu_diff()[i], actual.cpu_diff()[i], 1e-4);
+    }
+  }
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestBatchedGemmGradient) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  this->blob_bottom_vec_.push_back(this->blob_bottom_2_);
+  this->blob_top_vec_.push_back(this->blob_top_2_);
+  convolution_param->set_kernel_size(3);
+  convolution_param->set_stride(2);
+  convolution_param->set_num_output(3);
+  convolution_param->set_group(3);
+  convolution_param->set_gemm_workspace_limit(1 << 20);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  ConvolutionLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, &(this->blob_bottom_vec_),
+      &(this->blob_top_vec_));
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestBatchedGemmWideGroups) {
+  // As TestBatchedGemm, with five channels per group so that the groups run
+  // as batched GEMMs rather than the direct kernels.
+  typedef typename TypeParam::Dtype Dtype;
+  Blob<Dtype> bottom(5, 10, 6, 4);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(&bottom);
+  vector<Blob<Dtype>*> bottom_vec(1, &bottom);
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->set_kernel_size(3);
+  convolution_param->set_pad(1);
+  convolution_param->set_num_output(4);
+  convolution_param->set_group(2);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  ConvolutionLayer<Dtype> layer(layer_param);
+  layer.SetUp(bottom_vec, &(this->blob_top_vec_));
+  // Workspace per image: (column rows + outputs) * N, for data and diff.
+  const int bytes_per_image = 2 * sizeof(Dtype) * (10 * 3 * 3 + 4) * 6 * 4;
+  convolution_param->set_gemm_workspace_limit(2 * bytes_per_image + 1);
+  ConvolutionLayer<Dtype> batched_layer(layer_param);
+  batched_layer.blobs().resize(2);
+  for (int j = 0; j < 2; ++j) {
+    batched_layer.blobs()[j].reset(new Blob<Dtype>());
+    batched_layer.blobs()[j]->CopyFrom(*layer.blobs()[j], false, true);
+  }
+  vector<Blob<Dtype>*> batched_top_vec(1, this->blob_top_2_);
+  batched_layer.SetUp(bottom_vec, &batched_top_vec);
+  layer.Forward(bottom_vec, &(this->blob_top_vec_));
+  batched_layer.Forward(bottom_vec, &batched_top_vec);
+  ASSERT_EQ(this->blob_top_->count(), this->blob_top_2_->count());
+  for (int i = 0; i < this->blob_top_->count(); ++i) {
+    EXPECT_NEAR(this->blob_top_->cpu_data()[i],
+        this->blob_top_2_->cpu_data()[i], 1e-4);
+  }
+  // Backward with the same top diff through both layers.
+  filler.Fill(this->blob_top_);
+  caffe_copy(this->blob_top_->count(), this->blob_top_->cpu_data(),
+      this->blob_top_->mutable_cpu_diff());
+  caffe_copy(this->blob_top_->count(), this->blob_top_->cpu_data(),
+      this->blob_top_2_->mutable_cpu_diff());
+  vector<bool> propagate_down(1, true);
+  Blob<Dtype> bottom_diff;
+  layer.Backward(this->blob_top_vec_, propagate_down, &bottom_vec);
+  bottom_diff.CopyFrom(bottom, true, true);
+  batched_layer.Backward(batched_top_vec, propagate_down, &bottom_vec);
+  for (int i = 0; i < bottom.count(); ++i) {
+    EXPECT_NEAR(bottom_diff.cpu_diff()[i], bottom.cpu_diff()[i], 1e-4);
+  }
+  for (int j = 0; j < 2; ++j) {
+    const Blob<Dtype>& expected = *layer.blobs()[j];
+    const Blob<Dtype>& actual = *batched_layer.blobs()[j];
+    for (int i = 0; i < expected.count(); ++i) {
+      EXPECT_NEAR(expected.cpu_diff()[i], actual.cpu_diff()[i], 1e-4);
+    }
+  }
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestBatchedGemmGradientWideGroups) {
+  typedef typename TypeParam::Dtype Dtype;
+  Blob<Dtype> bottom(2, 10, 5, 4);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(&bottom);
+  vector<Blob<Dtype>*> bottom_vec(1, &bottom);
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->set_kernel_size(3);
+  convolution_param->set_stride(2);
+  convolution_param->set_num_output(4);
+  convolution_param->set_group(2);
+  convolution_param->set_gemm_workspace_limit(1 << 20);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  ConvolutionLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, &bottom_vec,
+      &(this->blob_top_vec_));
+}
+
 #ifdef USE_CUDNN
 
 template <typename Dtype>
@@ -0,0 +1,272 @@
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/fft.hpp"
+#include "caffe/vision_layers.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+#include "caffe/test/test_gradient_check_util.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class FFTPlanTest : public ::testing::Test {};
+
+TYPED_TEST_CASE(FFTPlanTest, TestDtypes);
+
+TYPED_TEST(FFTPlanTest, TestAgainstDFT) {
+  typedef TypeParam Dtype;
+  const double pi = std::acos(-1.);
+  for (int n = 1; n <= 32; n *= 2) {
+    FFTPlan<Dtype> plan(n);
+    vector<std::complex<Dtype> > x(n);
+    for (int i = 0; i < n; ++i) {
+      x[i] = std::complex<Dtype>(std::sin(1. + i), std::cos(2. * i));
+    }
+    vector<std::complex<Dtype> > y(x);
+    plan.Transform(&y[0], 1, false);
+    for (int k = 0; k < n; ++k) {
+      std::complex<double> expected(0);
+      for (int i = 0; i < n; ++i) {
+        expected += std::complex<double>(x[i].real(), x[i].imag())
+            * std::polar(1., -2. * pi * i * k / n);
+      }
+      EXPECT_NEAR(y[k].real(), expected.real(), 1e-4);
+      EXPECT_NEAR(y[k].imag(), expected.imag(), 1e-4);
+    }
+    // The unnormalized inverse restores n times the input.
+    plan.Transform(&y[0], 1, true);
+    for (int i = 0; i < n; ++i) {
+      EXPECT_NEAR(y[i].real() / n, x[i].real(), 1e-5);
+      EXPECT_NEAR(y[i].imag() / n, x[i].imag(), 1e-5);
+    }
+  }
+}
+
+// Exposes the cost model decision.
+template <typename Dtype>
+class FFTConvolutionLayerProbe : public FFTConvolutionLayer<Dtype> {
+ public:
+  explicit FFTConvolutionLayerProbe(const LayerParameter& param)
+      : FFTConvolutionLayer<Dtype>(param) {}
+  bool use_fft() const { return this->use_fft_; }
+};
+
+template <typename Dtype>
+class FFTConvolutionLayerTest : public ::testing::Test {
+ protected:
+  FFTConvolutionLayerTest()
+      : blob_bottom_(new Blob<Dtype>(2, 4, 45, 37)),
+        blob_top_(new Blob<Dtype>()),
+        blob_top_ref_(new Blob<Dtype>()) {}
+  virtual void SetUp() {
+    Caffe::set_mode(Caffe::CPU);
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_);
+    blob_bottom_vec_.push_back(blob_bottom_);
+    blob_top_vec_.push_back(blob_top_);
+    blob_top_ref_vec_.push_back(blob_top_ref_);
+  }
+  virtual ~FFTConvolutionLayerTest() {
+    delete blob_bottom_;
+    delete blob_top_;
+    delete blob_top_ref_;
+  }
+
+  static void ExpectBlobsNear(const int count, const Dtype* actual,
+      const Dtype* expected) {
+    for (int i = 0; i < count; ++i) {
+      EXPECT_NEAR(actual[i], expected[i],
+          1e-4 * std::max(Dtype(1), std::fabs(expected[i])));
+    }
+  }
+
+  // Runs the FFT engine and the im2col ConvolutionLayer with the same
+  // weights and top diff, and expects the same output and gradients.
+  void CheckAgainstIm2col(const LayerParameter& layer_param) {
+    FFTConvolutionLayerProbe<Dtype> layer(layer_param);
+    layer.SetUp(blob_bottom_vec_, &blob_top_vec_);
+    EXPECT_TRUE(layer.use_fft());
+    ConvolutionLayer<Dtype> ref_layer(layer_param);
+    ref_layer.blobs().resize(layer.blobs().size());
+    for (int i = 0; i < layer.blobs().size(); ++i) {
+      ref_layer.blobs()[i].reset(new Blob<Dtype>());
+      ref_layer.blobs()[i]->CopyFrom(*layer.blobs()[i], false, true);
+    }
+    ref_layer.SetUp(blob_bottom_vec_, &blob_top_ref_vec_);
+    layer.Forward(blob_bottom_vec_, &blob_top_vec_);
+    ref_layer.Forward(blob_bottom_vec_, &blob_top_ref_vec_);
+    ASSERT_EQ(blob_top_->count(), blob_top_ref_->count());
+    ExpectBlobsNear(blob_top_->count(), blob_top_->cpu_data(),
+        blob_top_ref_->cpu_data());
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(blob_top_ref_);
+    caffe_copy(blob_top_->count(), blob_top_ref_->cpu_data(),
+        blob_top_->mutable_cpu_diff());
+    caffe_copy(blob_top_->count(), blob_top_ref_->cpu_data(),
+        blob_top_ref_->mutable_cpu_diff());
+    vector<bool> propagate_down(1, true);
+    ref_layer.Backward(blob_top_ref_vec_, propagate_down, &blob_bottom_vec_);
+    Blob<Dtype> ref_bottom_diff;
+    ref_bottom_diff.CopyFrom(*blob_bottom_, true, true);
+    layer.Backward(blob_top_vec_, propagate_down, &blob_bottom_vec_);
+    ExpectBlobsNear(blob_bottom_->count(), blob_bottom_->cpu_diff(),
+        ref_bottom_diff.cpu_diff());
+    for (int i = 0; i < layer.blobs().size(); ++i) {
+      ExpectBlobsNear(layer.blobs()[i]->count(), layer.blobs()[i]->cpu_diff(),
+          ref_layer.blobs()[i]->cpu_diff());
+    }
+  }
+
+  Blob<Dtype>* const blob_bottom_;
+  Blob<Dtype>* const blob_top_;
+  Blob<Dtype>* const blob_top_ref_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+  vector<Blob<Dtype>*> blob_top_ref_vec_;
+};
+
+TYPED_TEST_CASE(FFTConvolutionLayerTest, TestDtypes);
+
+TYPED_TEST(FFTConvolutionLayerTest, TestTiled) {
+  // 7x7 kernels on a 45x37 image take several overlap-added tiles.
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->set_kernel_size(7);
+  convolution_param->set_pad(3);
+  convolution_param->set_num_output(5);
+  convolution_param->set_engine(ConvolutionParameter_Engine_FFT);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  this->CheckAgainstIm2col(layer_param);
+}
+
+TYPED_TEST(FFTConvolutionLayerTest, TestStridedGroupRectangular) {
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->set_kernel_h(5);
+  convolution_param->set_kernel_w(3);
+  convolution_param->set_stride_h(2);
+  convolution_param->set_stride_w(3);
+  convolution_param->set_pad_h(1);
+  convolution_param->set_pad_w(0);
+  convolution_param->set_num_output(6);
+  convolution_param->set_group(2);
+  convolution_param->set_engine(ConvolutionParameter_Engine_FFT);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  this->CheckAgainstIm2col(layer_param);
+}
+
+TYPED_TEST(FFTConvolutionLayerTest, TestGradient) {
+  typedef TypeParam Dtype;
+  this->blob_bottom_->Reshape(2, 3, 6, 4);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->set_kernel_size(3);
+  convolution_param->set_stride(2);
+  convolution_param->set_pad(1);
+  convolution_param->set_num_output(2);
+  convolution_param->set_engine(ConvolutionParameter_Engine_FFT);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  FFTConvolutionLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, &(this->blob_bottom_vec_),
+      &(this->blob_top_vec_));
+}
+
+TYPED_TEST(FFTConvolutionLayerTest, TestCostModel) {
+  // The DEFAULT engine sends large kernels to the FFT layer, which keeps
+  // im2col where FFT does not pay off.
+  typedef TypeParam Dtype;
+  LayerParameter layer_param;
+  layer_param.set_type(LayerParameter_LayerType_CONVOLUTION);
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->set_kernel_size(7);
+  convolution_param->set_num_output(64);
+  shared_ptr<Layer<Dtype> > layer(GetLayer<Dtype>(layer_param));
+  EXPECT_TRUE(dynamic_cast<FFTConvolutionLayer<Dtype>*>(layer.get()));
+  // 7x7 stride 1 on a deep input: FFT.
+  Blob<Dtype> deep(1, 64, 56, 56);
+  vector<Blob<Dtype>*> bottom_vec(1, &deep);
+  FFTConvolutionLayerProbe<Dtype> deep_layer(layer_param);
+  deep_layer.SetUp(bottom_vec, &(this->blob_top_vec_));
+  EXPECT_TRUE(deep_layer.use_fft());
+  // AlexNet conv1, 11x11 stride 4 on RGB: im2col.
+  Blob<Dtype> rgb(1, 3, 227, 227);
+  bottom_vec[0] = &rgb;
+  convolution_param->set_kernel_size(11);
+  convolution_param->set_stride(4);
+  convolution_param->set_num_output(96);
+  FFTConvolutionLayerProbe<Dtype> rgb_layer(layer_param);
+  rgb_layer.SetUp(bottom_vec, &(this->blob_top_vec_));
+  EXPECT_FALSE(rgb_layer.use_fft());
+  // Small kernels keep the plain im2col layer.
+  convolution_param->set_kernel_size(3);
+  convolution_param->set_stride(1);
+  layer.reset(GetLayer<Dtype>(layer_param));
+  EXPECT_FALSE(dynamic_cast<FFTConvolutionLayer<Dtype>*>(layer.get()));
+}
+
+TYPED_TEST(FFTConvolutionLayerTest, TestSpeedVsIm2col) {
+  typedef TypeParam Dtype;
+  // (channels, size, num_output, kernel) of large-kernel stride 1 layers.
+  const int kShapes[][4] = {
+    {64, 56, 64, 7}, {16, 64, 16, 9}, {3, 128, 32, 11}
+  };
+  const int kNumShapes = sizeof(kShapes) / sizeof(kShapes[0]);
+  for (int s = 0; s < kNumShapes; ++s) {
+    const int* shape = kShapes[s];
+    Blob<Dtype> bottom(1, shape[0], shape[1], shape[1]);
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(&bottom);
+    vector<Blob<Dtype>*> bottom_vec(1, &bottom);
+    LayerParameter layer_param;
+    ConvolutionParameter* convolution_param =
+        layer_param.mutable_convolution_param();
+    convolution_param->set_kernel_size(shape[3]);
+    convolution_param->set_pad(shape[3] / 2);
+    convolution_param->set_num_output(shape[2]);
+    convolution_param->set_engine(ConvolutionParameter_Engine_FFT);
+    convolution_param->mutable_weight_filler()->set_type("gaussian");
+    convolution_param->mutable_bias_filler()->set_type("gaussian");
+    ConvolutionLayer<Dtype> im2col_layer(layer_param);
+    im2col_layer.SetUp(bottom_vec, &(this->blob_top_ref_vec_));
+    FFTConvolutionLayer<Dtype> layer(layer_param);
+    layer.blobs() = im2col_layer.blobs();
+    layer.SetUp(bottom_vec, &(this->blob_top_vec_));
+    // Warm up, which also transforms the weights once.
+    layer.Forward(bottom_vec, &(this->blob_top_vec_));
+    Timer timer;
+    timer.Start();
+    im2col_layer.Forward(bottom_vec, &(this->blob_top_ref_vec_));
+    const float im2col_ms = timer.MilliSeconds();
+    timer.Start();
+    layer.Forward(bottom_vec, &(this->blob_top_vec_));
+    const float fft_ms = timer.MilliSeconds();
+    LOG(INFO) << shape[3] << "x" << shape[3] << " conv C=" << shape[0]
+        << " HW=" << shape[1] << " K=" << shape[2] << ": im2col "
+        << im2col_ms << " ms, FFT " << fft_ms << " ms";
+  }
+}
+
+}  // namespace caffe
@@ -56,7 +56,8 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
   }
 
   void RunLeastSquaresSolver(const Dtype learning_rate,
-      const Dtype weight_decay, const Dtype momentum, const int num_iters) {
+      const Dtype weight_decay, const Dtype momentum, const int num_iters,
+      const string& extra_proto = "") {
     ostringstream proto;
     proto <<
        "max_iter: " << num_iters << " "
@@ -113,6 +114,7 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
     if (momentum != 0) {
       proto << "momentum: " << momentum << " ";
     }
+    proto << extra_proto;
     Caffe::set_random_seed(this->seed_);
     this->InitSolverFromProtoString(proto.str());
     this->solver_->Solve();
@@ -327,6 +329,28 @@ TYPED_TEST(SGDSolverTest, TestLeastSquaresUpdate) {
   this->TestLeastSquaresUpdate();
 }
 
+TYPED_TEST(SGDSolverTest, TestPruningSchedule) {
+  typedef typename TypeParam::Dtype Dtype;
+  const string pruning = "pruning_param { target_sparsity: 0.5 "
+      "begin_iter: 0 end_iter: 4 interval: 2 } ";
+  const int count = this->channels_ * this->height_ * this->width_;
+  // Iteration 2 prunes to 0.5 * (1 - 0.5^3), iteration 4 to the target; the
+  // momentum does not bring the pruned weights back in between.
+  const int iters[] = {3, 6};
+  const float sparsities[] = {0.4375, 0.5};
+  for (int i = 0; i < 2; ++i) {
+    this->RunLeastSquaresSolver(0.1, 0, 0.9, iters[i], pruning);
+    const Blob<Dtype>& weights =
+        *this->solver_->net()->layers()[1]->blobs()[0];
+    ASSERT_EQ(count, weights.count());
+    int zeros = 0;
+    for (int j = 0; j < count; ++j) {
+      zeros += weights.cpu_data()[j] == 0;
+    }
+    EXPECT_EQ(static_cast<int>(sparsities[i] * count), zeros);
+  }
+}
+
 TYPED_TEST(SGDSolverTest, TestLeastSquaresUpdateLROneTenth) {
   typedef typename TypeParam::Dtype Dtype;
   const Dtype kLearningRate = 0.1;
@@ -1,6 +1,10 @@
+#include <cstdio>
+#include <fstream>  // NOLINT(readability/streams)
 #include <string>
 #include <vector>
 
+#include "hdf5/hdf5.h"
+#include "hdf5/hdf5_hl.h"
 #include "leveldb/db.h"
 
 #include "gtest/gtest.h"
@@ -9,6 +13,7 @@
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/io.hpp"
 #include "caffe/vision_layers.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
@@ -121,4 +126,79 @@ TYPED_TEST(HDF5DataLayerTest, TestRead) {
   }
 }
 
+TYPED_TEST(HDF5DataLayerTest, TestReadSparse) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Seven rows over 10 features; row r has r % 4 nonzeros, the values
+  // 10r + j at the features (3r + j) % 10.
+  const int rows = 7;
+  vector<float> values;
+  vector<int> indices;
+  vector<int> indptr(1, 0);
+  vector<float> labels;
+  for (int r = 0; r < rows; ++r) {
+    for (int j = 0; j < r % 4; ++j) {
+      values.push_back(10 * r + j);
+      indices.push_back((3 * r + j) % 10);
+    }
+    indptr.push_back(values.size());
+    labels.push_back(r);
+  }
+  string data_file, list_file;
+  MakeTempFilename(&data_file);
+  MakeTempFilename(&list_file);
+  {
+    hid_t file_id = H5Fcreate(data_file.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT,
+        H5P_DEFAULT);
+    ASSERT_GE(file_id, 0);
+    hsize_t nonzeros = values.size();
+    hsize_t offsets = indptr.size();
+    hsize_t num = rows;
+    EXPECT_GE(H5LTmake_dataset_float(file_id, "data", 1, &nonzeros,
+        &values[0]), 0);
+    EXPECT_GE(H5LTmake_dataset_int(file_id, "indices", 1, &nonzeros,
+        &indices[0]), 0);
+    EXPECT_GE(H5LTmake_dataset_int(file_id, "indptr", 1, &offsets,
+        &indptr[0]), 0);
+    EXPECT_GE(H5LTmake_dataset_float(file_id, "label", 1, &num,
+        &labels[0]), 0);
+    EXPECT_GE(H5Fclose(file_id), 0);
+    std::ofstream list(list_file.c_str());
+    list << data_file << std::endl;
+  }
+  LayerParameter param;
+  HDF5DataParameter* hdf5_data_param = param.mutable_hdf5_data_param();
+  const int batch_size = 3;
+  hdf5_data_param->set_batch_size(batch_size);
+  hdf5_data_param->set_source(list_file);
+  Blob<Dtype> indices_blob, row_ptr_blob;
+  vector<Blob<Dtype>*> top_vec;
+  top_vec.push_back(this->blob_top_data_);
+  top_vec.push_back(&indices_blob);
+  top_vec.push_back(&row_ptr_blob);
+  top_vec.push_back(this->blob_top_label_);
+  HDF5DataLayer<Dtype> layer(param);
+  layer.SetUp(this->blob_bottom_vec_, &top_vec);
+  EXPECT_EQ(row_ptr_blob.count(), batch_size + 1);
+  EXPECT_EQ(this->blob_top_label_->num(), batch_size);
+
+  // The batches wrap around the seven rows.
+  int row = 0;
+  for (int iter = 0; iter < 5; ++iter) {
+    layer.Forward(this->blob_bottom_vec_, &top_vec);
+    int nonzeros = 0;
+    EXPECT_EQ(row_ptr_blob.cpu_data()[0], 0);
+    for (int i = 0; i < batch_size; ++i, row = (row + 1) % rows) {
+      EXPECT_EQ(this->blob_top_label_->cpu_data()[i], row);
+      for (int j = indptr[row]; j < indptr[row + 1]; ++j, ++nonzeros) {
+        ASSERT_LT(nonzeros, this->blob_top_data_->count());
+        EXPECT_EQ(this->blob_top_data_->cpu_data()[nonzeros], values[j]);
+        EXPECT_EQ(indices_blob.cpu_data()[nonzeros], indices[j]);
+      }
+      EXPECT_EQ(row_ptr_blob.cpu_data()[i + 1], nonzeros);
+    }
+  }
+  remove(data_file.c_str());
+  remove(list_file.c_str());
+}
+
 }  // namespace caffe
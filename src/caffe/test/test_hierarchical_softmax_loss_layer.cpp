@@ -0,0 +1,193 @@
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>  // NOLINT(readability/streams)
+#include <string>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/solver.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/vision_layers.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+#include "caffe/test/test_gradient_check_util.hpp"
+
+namespace caffe {
+
+template <typename TypeParam>
+class HierarchicalSoftmaxLossLayerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  HierarchicalSoftmaxLossLayerTest()
+      : num_output_(10), num_clusters_(3),
+        blob_bottom_data_(new Blob<Dtype>(6, 2, 1, 2)),
+        blob_bottom_label_(new Blob<Dtype>(6, 1, 1, 1)),
+        blob_top_loss_(new Blob<Dtype>()),
+        blob_top_prob_(new Blob<Dtype>()) {
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_data_);
+    blob_bottom_vec_.push_back(blob_bottom_data_);
+    for (int i = 0; i < blob_bottom_label_->count(); ++i) {
+      blob_bottom_label_->mutable_cpu_data()[i] =
+          caffe_rng_rand() % num_output_;
+    }
+    blob_bottom_vec_.push_back(blob_bottom_label_);
+    blob_top_vec_.push_back(blob_top_loss_);
+    // Class k belongs to cluster k % 3.
+    MakeTempFilename(&cluster_file_);
+    std::ofstream outfile(cluster_file_.c_str());
+    for (int k = 0; k < num_output_; ++k) {
+      outfile << k % num_clusters_ << std::endl;
+    }
+  }
+  virtual ~HierarchicalSoftmaxLossLayerTest() {
+    delete blob_bottom_data_;
+    delete blob_bottom_label_;
+    delete blob_top_loss_;
+    delete blob_top_prob_;
+    remove(cluster_file_.c_str());
+  }
+
+  LayerParameter MakeParam() {
+    LayerParameter layer_param;
+    HierarchicalSoftmaxParameter* param =
+        layer_param.mutable_hierarchical_softmax_param();
+    param->set_num_output(num_output_);
+    param->set_cluster_file(cluster_file_);
+    param->mutable_weight_filler()->set_type("gaussian");
+    param->mutable_bias_filler()->set_type("gaussian");
+    return layer_param;
+  }
+
+  const int num_output_;
+  const int num_clusters_;
+  Blob<Dtype>* const blob_bottom_data_;
+  Blob<Dtype>* const blob_bottom_label_;
+  Blob<Dtype>* const blob_top_loss_;
+  Blob<Dtype>* const blob_top_prob_;
+  string cluster_file_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(HierarchicalSoftmaxLossLayerTest, TestDtypesAndDevices);
+
+TYPED_TEST(HierarchicalSoftmaxLossLayerTest, TestForward) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->blob_top_vec_.push_back(this->blob_top_prob_);
+  HierarchicalSoftmaxLossLayer<Dtype> layer(this->MakeParam());
+  layer.SetUp(this->blob_bottom_vec_, &(this->blob_top_vec_));
+  layer.Forward(this->blob_bottom_vec_, &(this->blob_top_vec_));
+  const int num = this->blob_bottom_data_->num();
+  const int dim = this->blob_bottom_data_->count() / num;
+  const Dtype* data = this->blob_bottom_data_->cpu_data();
+  const Dtype* cluster_weight = layer.blobs()[0]->cpu_data();
+  const Dtype* class_weight = layer.blobs()[1]->cpu_data();
+  const Dtype* cluster_bias = layer.blobs()[2]->cpu_data();
+  const Dtype* class_bias = layer.blobs()[3]->cpu_data();
+  double loss = 0;
+  for (int n = 0; n < num; ++n) {
+    vector<double> cluster_exp(this->num_clusters_);
+    double cluster_sum = 0;
+    for (int c = 0; c < this->num_clusters_; ++c) {
+      double score = cluster_bias[c];
+      for (int d = 0; d < dim; ++d) {
+        score += data[n * dim + d] * cluster_weight[c * dim + d];
+      }
+      cluster_exp[c] = exp(score);
+      cluster_sum += cluster_exp[c];
+    }
+    vector<double> class_exp(this->num_output_);
+    vector<double> class_sum(this->num_clusters_, 0);
+    for (int k = 0; k < this->num_output_; ++k) {
+      double score = class_bias[k];
+      for (int d = 0; d < dim; ++d) {
+        score += data[n * dim + d] * class_weight[k * dim + d];
+      }
+      class_exp[k] = exp(score);
+      class_sum[k % this->num_clusters_] += class_exp[k];
+    }
+    double total = 0;
+    for (int k = 0; k < this->num_output_; ++k) {
+      const int c = k % this->num_clusters_;
+      const double prob =
+          cluster_exp[c] / cluster_sum * class_exp[k] / class_sum[c];
+      EXPECT_NEAR(prob, this->blob_top_prob_->data_at(n, k, 0, 0), 1e-5);
+      total += this->blob_top_prob_->data_at(n, k, 0, 0);
+      if (k == static_cast<int>(this->blob_bottom_label_->cpu_data()[n])) {
+        loss -= log(prob);
+      }
+    }
+    EXPECT_NEAR(1, total, 1e-5);
+  }
+  EXPECT_NEAR(loss / num, this->blob_top_loss_->cpu_data()[0], 1e-4);
+}
+
+TYPED_TEST(HierarchicalSoftmaxLossLayerTest, TestGradient) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param = this->MakeParam();
+  layer_param.add_loss_weight(3);
+  HierarchicalSoftmaxLossLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-2, 1701);
+  checker.CheckGradientExhaustive(&layer, &(this->blob_bottom_vec_),
+      &(this->blob_top_vec_), 0);
+}
+
+TYPED_TEST(HierarchicalSoftmaxLossLayerTest, TestSolverUpdatesSparseRows) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Every label is class 0, so only the rows of cluster 0 may move.
+  ostringstream proto;
+  proto <<
+      "max_iter: 2 base_lr: 0.1 lr_policy: 'fixed' momentum: 0.9 "
+      "weight_decay: 0.01 snapshot_after_train: false "
+      "net_param { "
+      "  name: 'TestNetwork' "
+      "  layers: { "
+      "    name: 'data' type: DUMMY_DATA "
+      "    dummy_data_param { "
+      "      num: 4 channels: 5 height: 1 width: 1 "
+      "      num: 4 channels: 1 height: 1 width: 1 "
+      "      data_filler { type: 'gaussian' } "
+      "      data_filler { type: 'constant' value: 0 } "
+      "    } "
+      "    top: 'data' top: 'label' "
+      "  } "
+      "  layers: { "
+      "    name: 'loss' type: HIERARCHICAL_SOFTMAX_LOSS "
+      "    hierarchical_softmax_param { "
+      "      num_output: " << this->num_output_ << " "
+      "      cluster_file: '" << this->cluster_file_ << "' "
+      "      weight_filler { type: 'gaussian' } "
+      "    } "
+      "    bottom: 'data' bottom: 'label' "
+      "  } "
+      "} ";
+  SolverParameter param;
+  CHECK(google::protobuf::TextFormat::ParseFromString(proto.str(), &param));
+  param.set_solver_mode(Caffe::mode() == Caffe::CPU ?
+      SolverParameter_SolverMode_CPU : SolverParameter_SolverMode_GPU);
+  SGDSolver<Dtype> solver(param);
+  const shared_ptr<Blob<Dtype> > class_weight =
+      solver.net()->layers().back()->blobs()[1];
+  const vector<Dtype> before(class_weight->cpu_data(),
+      class_weight->cpu_data() + class_weight->count());
+  solver.Solve();
+  const int dim = class_weight->count() / this->num_output_;
+  for (int k = 0; k < this->num_output_; ++k) {
+    bool moved = false;
+    for (int d = 0; d < dim; ++d) {
+      moved |= class_weight->cpu_data()[k * dim + d] != before[k * dim + d];
+    }
+    EXPECT_EQ(k % this->num_clusters_ == 0, moved) << "class " << k;
+  }
+}
+
+}  // namespace caffe
@@ -6,6 +6,8 @@
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/im2col.hpp"
 #include "caffe/vision_layers.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
@@ -115,4 +117,188 @@ TYPED_TEST(Im2colLayerTest, TestRectGradient) {
       &(this->blob_top_vec_));
 }
 
+// Straightforward single-threaded im2col/col2im, kept as the reference the
+// parallel, specialized CPU kernels are checked and timed against.
+template <typename Dtype>
+void im2col_cpu_reference(const Dtype* data_im, const int channels,
+    const int height, const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h, const int stride_w,
+    Dtype* data_col) {
+  int height_col = (height + 2 * pad_h - kernel_h) / stride_h + 1;
+  int width_col = (width + 2 * pad_w - kernel_w) / stride_w + 1;
+  int channels_col = channels * kernel_h * kernel_w;
+  for (int c = 0; c < channels_col; ++c) {
+    int w_offset = c % kernel_w;
+    int h_offset = (c / kernel_w) % kernel_h;
+    int c_im = c / kernel_h / kernel_w;
+    for (int h = 0; h < height_col; ++h) {
+      for (int w = 0; w < width_col; ++w) {
+        int h_pad = h * stride_h - pad_h + h_offset;
+        int w_pad = w * stride_w - pad_w + w_offset;
+        if (h_pad >= 0 && h_pad < height && w_pad >= 0 && w_pad < width)
+          data_col[(c * height_col + h) * width_col + w] =
+            data_im[(c_im * height + h_pad) * width + w_pad];
+        else
+          data_col[(c * height_col + h) * width_col + w] = 0;
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void col2im_cpu_reference(const Dtype* data_col, const int channels,
+    const int height, const int width, const int patch_h, const int patch_w,
+    const int pad_h, const int pad_w, const int stride_h, const int stride_w,
+    Dtype* data_im) {
+  caffe_set(height * width * channels, Dtype(0), data_im);
+  int height_col = (height + 2 * pad_h - patch_h) / stride_h + 1;
+  int width_col = (width + 2 * pad_w - patch_w) / stride_w + 1;
+  int channels_col = channels * patch_h * patch_w;
+  for (int c = 0; c < channels_col; ++c) {
+    int w_offset = c % patch_w;
+    int h_offset = (c / patch_w) % patch_h;
+    int c_im = c / patch_h / patch_w;
+    for (int h = 0; h < height_col; ++h) {
+      for (int w = 0; w < width_col; ++w) {
+        int h_pad = h * stride_h - pad_h + h_offset;
+        int w_pad = w * stride_w - pad_w + w_offset;
+        if (h_pad >= 0 && h_pad < height && w_pad >= 0 && w_pad < width)
+          data_im[(c_im * height + h_pad) * width + w_pad] +=
+              data_col[(c * height_col + h) * width_col + w];
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+class Im2colCPUKernelTest : public ::testing::Test {
+ protected:
+  Im2colCPUKernelTest()
+      : blob_im_(new Blob<Dtype>()),
+        blob_col_(new Blob<Dtype>()),
+        blob_col_ref_(new Blob<Dtype>()) {}
+  virtual ~Im2colCPUKernelTest() {
+    delete blob_im_;
+    delete blob_col_;
+    delete blob_col_ref_;
+  }
+
+  void SetUpShape(const int channels, const int height, const int width,
+      const int kernel, const int pad, const int stride) {
+    channels_ = channels;
+    height_ = height;
+    width_ = width;
+    kernel_ = kernel;
+    pad_ = pad;
+    stride_ = stride;
+    const int height_col = (height + 2 * pad - kernel) / stride + 1;
+    const int width_col = (width + 2 * pad - kernel) / stride + 1;
+    blob_im_->Reshape(1, channels, height, width);
+    blob_col_->Reshape(1, channels * kernel * kernel, height_col, width_col);
+    blob_col_ref_->Reshape(1, channels * kernel * kernel, height_col,
+        width_col);
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(blob_im_);
+    filler.Fill(blob_col_);
+    caffe_copy(blob_col_->count(), blob_col_->cpu_data(),
+        blob_col_ref_->mutable_cpu_diff());
+  }
+
+  // Compares both directions against the reference for the current shape.
+  void CheckAgainstReference() {
+    im2col_cpu(blob_im_->cpu_data(), channels_, height_, width_, kernel_,
+        kernel_, pad_, pad_, stride_, stride_, blob_col_->mutable_cpu_data());
+    im2col_cpu_reference(blob_im_->cpu_data(), channels_, height_, width_,
+        kernel_, kernel_, pad_, pad_, stride_, stride_,
+        blob_col_ref_->mutable_cpu_data());
+    for (int i = 0; i < blob_col_->count(); ++i) {
+      EXPECT_EQ(blob_col_ref_->cpu_data()[i], blob_col_->cpu_data()[i]);
+    }
+    col2im_cpu(blob_col_ref_->cpu_diff(), channels_, height_, width_, kernel_,
+        kernel_, pad_, pad_, stride_, stride_, blob_im_->mutable_cpu_data());
+    col2im_cpu_reference(blob_col_ref_->cpu_diff(), channels_, height_,
+        width_, kernel_, kernel_, pad_, pad_, stride_, stride_,
+        blob_im_->mutable_cpu_diff());
+    for (int i = 0; i < blob_im_->count(); ++i) {
+      EXPECT_NEAR(blob_im_->cpu_diff()[i], blob_im_->cpu_data()[i], 1e-4);
+    }
+  }
+
+  Blob<Dtype>* const blob_im_;
+  Blob<Dtype>* const blob_col_;
+  Blob<Dtype>* const blob_col_ref_;
+  int channels_, height_, width_;
+  int kernel_, pad_, stride_;
+};
+
+TYPED_TEST_CASE(Im2colCPUKernelTest, TestDtypes);
+
+TYPED_TEST(Im2colCPUKernelTest, TestSpecializedShapes) {
+  Caffe::set_mode(Caffe::CPU);
+  this->SetUpShape(4, 13, 11, 3, 1, 1);
+  this->CheckAgainstReference();
+  this->SetUpShape(3, 12, 14, 5, 2, 1);
+  this->CheckAgainstReference();
+  this->SetUpShape(3, 23, 20, 7, 3, 2);
+  this->CheckAgainstReference();
+  this->SetUpShape(3, 47, 39, 11, 0, 4);
+  this->CheckAgainstReference();
+}
+
+TYPED_TEST(Im2colCPUKernelTest, TestGenericShapes) {
+  Caffe::set_mode(Caffe::CPU);
+  this->SetUpShape(2, 9, 7, 3, 0, 2);
+  this->CheckAgainstReference();
+  this->SetUpShape(3, 6, 5, 4, 3, 3);
+  this->CheckAgainstReference();
+  this->SetUpShape(5, 8, 8, 1, 0, 1);
+  this->CheckAgainstReference();
+  // Large enough to take the multithreaded path.
+  this->SetUpShape(64, 28, 28, 2, 1, 2);
+  this->CheckAgainstReference();
+}
+
+TYPED_TEST(Im2colCPUKernelTest, TestSpeedVsReference) {
+  typedef TypeParam Dtype;
+  Caffe::set_mode(Caffe::CPU);
+  // (channels, size, kernel, pad, stride) of representative conv layers.
+  const int kShapes[][5] = {
+    {3, 227, 11, 0, 4}, {96, 27, 5, 2, 1}, {256, 13, 3, 1, 1},
+    {3, 224, 7, 3, 2}, {64, 56, 3, 1, 1}
+  };
+  const int kNumShapes = sizeof(kShapes) / sizeof(kShapes[0]);
+  const int kIters = 3;
+  for (int s = 0; s < kNumShapes; ++s) {
+    const int* shape = kShapes[s];
+    this->SetUpShape(shape[0], shape[1], shape[1], shape[2], shape[3],
+        shape[4]);
+    const Dtype* im = this->blob_im_->cpu_data();
+    const Dtype* col = this->blob_col_ref_->cpu_diff();
+    Dtype* col_out = this->blob_col_->mutable_cpu_data();
+    Dtype* im_out = this->blob_im_->mutable_cpu_diff();
+    Timer timer;
+    timer.Start();
+    for (int i = 0; i < kIters; ++i) {
+      im2col_cpu_reference(im, shape[0], shape[1], shape[1], shape[2],
+          shape[2], shape[3], shape[3], shape[4], shape[4], col_out);
+      col2im_cpu_reference(col, shape[0], shape[1], shape[1], shape[2],
+          shape[2], shape[3], shape[3], shape[4], shape[4], im_out);
+    }
+    const float reference_ms = timer.MilliSeconds() / kIters;
+    timer.Start();
+    for (int i = 0; i < kIters; ++i) {
+      im2col_cpu(im, shape[0], shape[1], shape[1], shape[2], shape[2],
+          shape[3], shape[3], shape[4], shape[4], col_out);
+      col2im_cpu(col, shape[0], shape[1], shape[1], shape[2], shape[2],
+          shape[3], shape[3], shape[4], shape[4], im_out);
+    }
+    const float fast_ms = timer.MilliSeconds() / kIters;
+    LOG(INFO) << "im2col+col2im C=" << shape[0] << " HW=" << shape[1]
+        << " k=" << shape[2] << " p=" << shape[3] << " s=" << shape[4]
+        << ": reference " << reference_ms << " ms, current " << fast_ms
+        << " ms";
+  }
+}
+
 }  // namespace caffe
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cstring>
 #include <vector>
 
@@ -6,6 +7,7 @@
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
+#include "caffe/util/math_functions.hpp"
 #include "caffe/vision_layers.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
@@ -85,6 +87,157 @@ TYPED_TEST(InnerProductLayerTest, TestForward) {
   }
 }
 
+TYPED_TEST(InnerProductLayerTest, TestForwardSparse) {
+  typedef typename TypeParam::Dtype Dtype;
+  if (Caffe::mode() != Caffe::CPU) {
+    return;
+  }
+  LayerParameter layer_param;
+  InnerProductParameter* inner_product_param =
+      layer_param.mutable_inner_product_param();
+  inner_product_param->set_num_output(10);
+  inner_product_param->mutable_weight_filler()->set_type("gaussian");
+  inner_product_param->mutable_bias_filler()->set_type("gaussian");
+  InnerProductLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, &(this->blob_top_vec_));
+  // Keep one weight in seven, so that the weights are 14% dense, and one row
+  // empty.
+  Dtype* weights = layer.blobs()[0]->mutable_cpu_data();
+  const int count = layer.blobs()[0]->count();
+  for (int i = 0; i < count; ++i) {
+    if (i % 7 || i < 60) {
+      weights[i] = 0;
+    }
+  }
+  const Caffe::Phase phase = Caffe::phase();
+  // The dense result of the TRAIN phase is the reference.
+  Caffe::set_phase(Caffe::TRAIN);
+  layer.Forward(this->blob_bottom_vec_, &(this->blob_top_vec_));
+  Blob<Dtype> expected;
+  expected.CopyFrom(*this->blob_top_, false, true);
+  Caffe::set_phase(Caffe::TEST);
+  EXPECT_TRUE(layer.UseSparseWeights());
+  caffe_set(this->blob_top_->count(), Dtype(0),
+      this->blob_top_->mutable_cpu_data());
+  layer.Forward(this->blob_bottom_vec_, &(this->blob_top_vec_));
+  for (int i = 0; i < expected.count(); ++i) {
+    EXPECT_NEAR(expected.cpu_data()[i], this->blob_top_->cpu_data()[i],
+        1e-5);
+  }
+  // Written weights are measured again; dense ones go back to the GEMM.
+  caffe_set(count, Dtype(0.5), layer.blobs()[0]->mutable_cpu_data());
+  EXPECT_FALSE(layer.UseSparseWeights());
+  layer.Forward(this->blob_bottom_vec_, &(this->blob_top_vec_));
+  const Dtype* bias = layer.blobs()[1]->cpu_data();
+  const int dim = count / 10;
+  for (int n = 0; n < 2; ++n) {
+    Dtype sum = 0;
+    for (int k = 0; k < dim; ++k) {
+      sum += 0.5 * this->blob_bottom_->cpu_data()[n * dim + k];
+    }
+    for (int j = 0; j < 10; ++j) {
+      EXPECT_NEAR(sum + bias[j], this->blob_top_->cpu_data()[n * 10 + j],
+          1e-5);
+    }
+  }
+  Caffe::set_phase(phase);
+}
+
+TYPED_TEST(InnerProductLayerTest, TestSparseInput) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  InnerProductParameter* inner_product_param =
+      layer_param.mutable_inner_product_param();
+  inner_product_param->set_num_output(10);
+  inner_product_param->mutable_weight_filler()->set_type("gaussian");
+  inner_product_param->mutable_bias_filler()->set_type("gaussian");
+  // Keep one input in seven, which leaves feature 0 inactive.
+  const int dim = 60;
+  vector<int> active;
+  Dtype* bottom_data = this->blob_bottom_->mutable_cpu_data();
+  Blob<Dtype> values(dim * 2, 1, 1, 1);
+  Blob<Dtype> indices(dim * 2, 1, 1, 1);
+  Blob<Dtype> row_ptr(3, 1, 1, 1);
+  int nonzeros = 0;
+  row_ptr.mutable_cpu_data()[0] = 0;
+  for (int n = 0; n < 2; ++n) {
+    for (int k = 0; k < dim; ++k) {
+      if ((n * dim + k) % 7 != 3) {
+        bottom_data[n * dim + k] = 0;
+      } else {
+        values.mutable_cpu_data()[nonzeros] = bottom_data[n * dim + k];
+        indices.mutable_cpu_data()[nonzeros++] = k;
+        active.push_back(k);
+      }
+    }
+    row_ptr.mutable_cpu_data()[n + 1] = nonzeros;
+  }
+  InnerProductLayer<Dtype> dense_layer(layer_param);
+  dense_layer.SetUp(this->blob_bottom_vec_, &(this->blob_top_vec_));
+  inner_product_param->set_sparse_input_dim(dim);
+  InnerProductLayer<Dtype> layer(layer_param);
+  vector<Blob<Dtype>*> sparse_bottom_vec;
+  sparse_bottom_vec.push_back(&values);
+  sparse_bottom_vec.push_back(&indices);
+  sparse_bottom_vec.push_back(&row_ptr);
+  Blob<Dtype> top;
+  vector<Blob<Dtype>*> sparse_top_vec(1, &top);
+  layer.SetUp(sparse_bottom_vec, &sparse_top_vec);
+  EXPECT_EQ(top.num(), 2);
+  EXPECT_EQ(top.channels(), 10);
+  Blob<Dtype>& weights = *layer.blobs()[0];
+  const Blob<Dtype>& dense_weights = *dense_layer.blobs()[0];
+  ASSERT_EQ(weights.num(), dim);
+  ASSERT_EQ(weights.width(), 10);
+  for (int k = 0; k < dim; ++k) {
+    for (int n = 0; n < 10; ++n) {
+      weights.mutable_cpu_data()[k * 10 + n] =
+          dense_weights.cpu_data()[n * dim + k];
+    }
+  }
+  layer.blobs()[1]->CopyFrom(*dense_layer.blobs()[1]);
+  dense_layer.Forward(this->blob_bottom_vec_, &(this->blob_top_vec_));
+  layer.Forward(sparse_bottom_vec, &sparse_top_vec);
+  for (int i = 0; i < top.count(); ++i) {
+    EXPECT_NEAR(this->blob_top_->cpu_data()[i], top.cpu_data()[i], 1e-5);
+  }
+
+  // Backward writes only the rows of the active features.
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_top_);
+  caffe_copy(top.count(), this->blob_top_->cpu_data(),
+      top.mutable_cpu_diff());
+  caffe_copy(top.count(), this->blob_top_->cpu_data(),
+      this->blob_top_->mutable_cpu_diff());
+  caffe_set(weights.count(), Dtype(7), weights.mutable_cpu_diff());
+  vector<bool> propagate_down(1, false);
+  dense_layer.Backward(this->blob_top_vec_, propagate_down,
+      &(this->blob_bottom_vec_));
+  propagate_down.resize(3, false);
+  layer.Backward(sparse_top_vec, propagate_down, &sparse_bottom_vec);
+  const vector<int>* rows = layer.sparse_param_rows(0);
+  ASSERT_TRUE(rows != NULL);
+  EXPECT_TRUE(layer.sparse_param_rows(1) == NULL);
+  std::sort(active.begin(), active.end());
+  EXPECT_TRUE(*rows == active);
+  for (int n = 0; n < 10; ++n) {
+    EXPECT_EQ(weights.cpu_diff()[n], 7);
+  }
+  layer.DensifyParamDiff(0);
+  EXPECT_TRUE(layer.sparse_param_rows(0) == NULL);
+  for (int k = 0; k < dim; ++k) {
+    for (int n = 0; n < 10; ++n) {
+      EXPECT_NEAR(dense_weights.cpu_diff()[n * dim + k],
+          weights.cpu_diff()[k * 10 + n], 1e-5);
+    }
+  }
+  for (int n = 0; n < 10; ++n) {
+    EXPECT_NEAR(dense_layer.blobs()[1]->cpu_diff()[n],
+        layer.blobs()[1]->cpu_diff()[n], 1e-5);
+  }
+}
+
 TYPED_TEST(InnerProductLayerTest, TestGradient) {
   typedef typename TypeParam::Dtype Dtype;
   bool IS_VALID_CUDA = false;
@@ -0,0 +1,174 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/vision_layers.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class Int8ConvolutionLayerTest : public ::testing::Test {
+ protected:
+  Int8ConvolutionLayerTest()
+      : blob_bottom_(new Blob<Dtype>(2, 4, 9, 7)),
+        blob_top_(new Blob<Dtype>()),
+        blob_top_ref_(new Blob<Dtype>()) {}
+  virtual void SetUp() {
+    Caffe::set_mode(Caffe::CPU);
+    Caffe::set_random_seed(1701);
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_);
+    blob_bottom_vec_.push_back(blob_bottom_);
+    blob_top_vec_.push_back(blob_top_);
+    blob_top_ref_vec_.push_back(blob_top_ref_);
+  }
+  virtual ~Int8ConvolutionLayerTest() {
+    delete blob_bottom_;
+    delete blob_top_;
+    delete blob_top_ref_;
+  }
+
+  // Runs the INT8 engine and the float ConvolutionLayer with the same
+  // weights; with relu, the reference output goes through a ReLU.
+  void CheckAgainstFloat(const LayerParameter& layer_param,
+      const bool relu = false) {
+    Int8ConvolutionLayer<Dtype> layer(layer_param);
+    layer.SetUp(blob_bottom_vec_, &blob_top_vec_);
+    ConvolutionLayer<Dtype> ref_layer(layer_param);
+    ref_layer.blobs().resize(layer.blobs().size());
+    for (int i = 0; i < layer.blobs().size(); ++i) {
+      ref_layer.blobs()[i].reset(new Blob<Dtype>());
+      ref_layer.blobs()[i]->CopyFrom(*layer.blobs()[i], false, true);
+    }
+    ref_layer.SetUp(blob_bottom_vec_, &blob_top_ref_vec_);
+    layer.Forward(blob_bottom_vec_, &blob_top_vec_);
+    ref_layer.Forward(blob_bottom_vec_, &blob_top_ref_vec_);
+    if (relu) {
+      Dtype* ref = blob_top_ref_->mutable_cpu_data();
+      for (int i = 0; i < blob_top_ref_->count(); ++i) {
+        ref[i] = std::max(ref[i], Dtype(0));
+      }
+    }
+    CheckTopsClose();
+  }
+
+  // 8-bit inputs and weights leave errors of about 1% of the largest
+  // output.
+  void CheckTopsClose() {
+    ASSERT_EQ(blob_top_->count(), blob_top_ref_->count());
+    Dtype max_abs = 0;
+    for (int i = 0; i < blob_top_ref_->count(); ++i) {
+      max_abs = std::max(max_abs, std::fabs(blob_top_ref_->cpu_data()[i]));
+    }
+    for (int i = 0; i < blob_top_->count(); ++i) {
+      EXPECT_NEAR(blob_top_->cpu_data()[i], blob_top_ref_->cpu_data()[i],
+          0.03 * max_abs);
+    }
+  }
+
+  Blob<Dtype>* const blob_bottom_;
+  Blob<Dtype>* const blob_top_;
+  Blob<Dtype>* const blob_top_ref_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+  vector<Blob<Dtype>*> blob_top_ref_vec_;
+};
+
+TYPED_TEST_CASE(Int8ConvolutionLayerTest, TestDtypes);
+
+TYPED_TEST(Int8ConvolutionLayerTest, TestForward) {
+  for (int stride = 1; stride <= 2; ++stride) {
+    LayerParameter layer_param;
+    ConvolutionParameter* convolution_param =
+        layer_param.mutable_convolution_param();
+    convolution_param->set_kernel_size(3);
+    convolution_param->set_pad(1);
+    convolution_param->set_stride(stride);
+    convolution_param->set_num_output(5);
+    convolution_param->mutable_weight_filler()->set_type("gaussian");
+    convolution_param->mutable_bias_filler()->set_type("gaussian");
+    this->CheckAgainstFloat(layer_param);
+  }
+}
+
+TYPED_TEST(Int8ConvolutionLayerTest, TestForward1x1) {
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->set_kernel_size(1);
+  convolution_param->set_num_output(6);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  this->CheckAgainstFloat(layer_param);
+}
+
+TYPED_TEST(Int8ConvolutionLayerTest, TestForwardGroup) {
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->set_kernel_size(3);
+  convolution_param->set_num_output(6);
+  convolution_param->set_group(2);
+  convolution_param->set_bias_term(false);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  this->CheckAgainstFloat(layer_param);
+}
+
+TYPED_TEST(Int8ConvolutionLayerTest, TestForwardCalibratedReLU) {
+  typedef TypeParam Dtype;
+  // Non-negative inputs, as after a ReLU, with a fixed scale covering them.
+  Dtype* bottom = this->blob_bottom_->mutable_cpu_data();
+  Dtype max_x = 0;
+  for (int i = 0; i < this->blob_bottom_->count(); ++i) {
+    bottom[i] = std::fabs(bottom[i]);
+    max_x = std::max(max_x, bottom[i]);
+  }
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->set_kernel_size(3);
+  convolution_param->set_num_output(5);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  QuantizationParameter* quantization_param =
+      layer_param.mutable_quantization_param();
+  quantization_param->set_input_scale(max_x / 255);
+  quantization_param->set_input_zero_point(0);
+  quantization_param->set_fuse_relu(true);
+  this->CheckAgainstFloat(layer_param, true);
+}
+
+TYPED_TEST(Int8ConvolutionLayerTest, TestRequantizeOnWeightChange) {
+  typedef TypeParam Dtype;
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->set_kernel_size(3);
+  convolution_param->set_num_output(5);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->set_bias_term(false);
+  Int8ConvolutionLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, &this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, &this->blob_top_vec_);
+  // Negating the weights must negate the output.
+  vector<Dtype> first(this->blob_top_->cpu_data(),
+      this->blob_top_->cpu_data() + this->blob_top_->count());
+  caffe_scal(layer.blobs()[0]->count(), Dtype(-1),
+      layer.blobs()[0]->mutable_cpu_data());
+  layer.Forward(this->blob_bottom_vec_, &this->blob_top_vec_);
+  for (int i = 0; i < this->blob_top_->count(); ++i) {
+    EXPECT_NEAR(this->blob_top_->cpu_data()[i], -first[i],
+        1e-4 * std::max(Dtype(1), std::fabs(first[i])));
+  }
+}
+
+}  // namespace caffe
@@ -0,0 +1,112 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/common_layers.hpp"
+#include "caffe/filler.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class Int8InnerProductLayerTest : public ::testing::Test {
+ protected:
+  Int8InnerProductLayerTest()
+      : blob_bottom_(new Blob<Dtype>(3, 5, 4, 5)),
+        blob_top_(new Blob<Dtype>()),
+        blob_top_ref_(new Blob<Dtype>()) {}
+  virtual void SetUp() {
+    Caffe::set_mode(Caffe::CPU);
+    Caffe::set_random_seed(1701);
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_);
+    blob_bottom_vec_.push_back(blob_bottom_);
+    blob_top_vec_.push_back(blob_top_);
+    blob_top_ref_vec_.push_back(blob_top_ref_);
+  }
+  virtual ~Int8InnerProductLayerTest() {
+    delete blob_bottom_;
+    delete blob_top_;
+    delete blob_top_ref_;
+  }
+
+  LayerParameter MakeParam(const bool bias_term) {
+    LayerParameter layer_param;
+    InnerProductParameter* inner_product_param =
+        layer_param.mutable_inner_product_param();
+    inner_product_param->set_num_output(19);
+    inner_product_param->set_bias_term(bias_term);
+    inner_product_param->mutable_weight_filler()->set_type("gaussian");
+    inner_product_param->mutable_bias_filler()->set_type("gaussian");
+    return layer_param;
+  }
+
+  // Runs the INT8 engine and the float InnerProductLayer with the same
+  // weights; with relu, the reference output goes through a ReLU. 8-bit
+  // inputs and weights leave errors of about 1% of the largest output.
+  void CheckAgainstFloat(const LayerParameter& layer_param,
+      const bool relu = false) {
+    Int8InnerProductLayer<Dtype> layer(layer_param);
+    layer.SetUp(blob_bottom_vec_, &blob_top_vec_);
+    InnerProductLayer<Dtype> ref_layer(layer_param);
+    ref_layer.blobs().resize(layer.blobs().size());
+    for (int i = 0; i < layer.blobs().size(); ++i) {
+      ref_layer.blobs()[i].reset(new Blob<Dtype>());
+      ref_layer.blobs()[i]->CopyFrom(*layer.blobs()[i], false, true);
+    }
+    ref_layer.SetUp(blob_bottom_vec_, &blob_top_ref_vec_);
+    layer.Forward(blob_bottom_vec_, &blob_top_vec_);
+    ref_layer.Forward(blob_bottom_vec_, &blob_top_ref_vec_);
+    ASSERT_EQ(blob_top_->count(), blob_top_ref_->count());
+    Dtype* ref = blob_top_ref_->mutable_cpu_data();
+    Dtype max_abs = 0;
+    for (int i = 0; i < blob_top_ref_->count(); ++i) {
+      if (relu) {
+        ref[i] = std::max(ref[i], Dtype(0));
+      }
+      max_abs = std::max(max_abs, std::fabs(ref[i]));
+    }
+    for (int i = 0; i < blob_top_->count(); ++i) {
+      EXPECT_NEAR(blob_top_->cpu_data()[i], ref[i], 0.03 * max_abs);
+    }
+  }
+
+  Blob<Dtype>* const blob_bottom_;
+  Blob<Dtype>* const blob_top_;
+  Blob<Dtype>* const blob_top_ref_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+  vector<Blob<Dtype>*> blob_top_ref_vec_;
+};
+
+TYPED_TEST_CASE(Int8InnerProductLayerTest, TestDtypes);
+
+TYPED_TEST(Int8InnerProductLayerTest, TestForward) {
+  for (int bias_term = 0; bias_term <= 1; ++bias_term) {
+    this->CheckAgainstFloat(this->MakeParam(bias_term));
+  }
+}
+
+TYPED_TEST(Int8InnerProductLayerTest, TestForwardCalibrated) {
+  typedef TypeParam Dtype;
+  Dtype max_abs = 0;
+  for (int i = 0; i < this->blob_bottom_->count(); ++i) {
+    max_abs = std::max(max_abs, std::fabs(this->blob_bottom_->cpu_data()[i]));
+  }
+  LayerParameter layer_param = this->MakeParam(true);
+  QuantizationParameter* quantization_param =
+      layer_param.mutable_quantization_param();
+  quantization_param->set_input_scale(max_abs / 127);
+  quantization_param->set_input_zero_point(128);
+  this->CheckAgainstFloat(layer_param);
+  quantization_param->set_fuse_relu(true);
+  this->CheckAgainstFloat(layer_param, true);
+}
+
+}  // namespace caffe
@@ -159,6 +159,40 @@ TYPED_TEST(LRNLayerTest, TestGradientAcrossChannels) {
       &(this->blob_top_vec_));
 }
 
+TYPED_TEST(LRNLayerTest, TestForwardAndGradientLargePlanes) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Planes spanning several spatial tiles, an even window and a beta off
+  // the square-root path.
+  this->blob_bottom_->Reshape(2, 6, 17, 19);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  const LRNParameter_NormRegion regions[2] = {
+    LRNParameter_NormRegion_ACROSS_CHANNELS,
+    LRNParameter_NormRegion_WITHIN_CHANNEL
+  };
+  for (int r = 0; r < 2; ++r) {
+    LayerParameter layer_param;
+    layer_param.mutable_lrn_param()->set_norm_region(regions[r]);
+    layer_param.mutable_lrn_param()->set_local_size(r == 0 ? 4 : 5);
+    layer_param.mutable_lrn_param()->set_alpha(2.);
+    layer_param.mutable_lrn_param()->set_beta(0.6);
+    LRNLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, &(this->blob_top_vec_));
+    layer.Forward(this->blob_bottom_vec_, &(this->blob_top_vec_));
+    Blob<Dtype> top_reference;
+    this->ReferenceLRNForward(*(this->blob_bottom_), layer_param,
+        &top_reference);
+    for (int i = 0; i < this->blob_bottom_->count(); ++i) {
+      EXPECT_NEAR(this->blob_top_->cpu_data()[i], top_reference.cpu_data()[i],
+                  this->epsilon_);
+    }
+    GradientChecker<Dtype> checker(1e-2, 1e-2);
+    checker.CheckGradientSingle(&layer, &(this->blob_bottom_vec_),
+        &(this->blob_top_vec_), 0, 0, 1000);
+  }
+}
+
 TYPED_TEST(LRNLayerTest, TestSetupWithinChannel) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter layer_param;
@@ -1,14 +1,23 @@
 #include <stdint.h>  // for uint32_t & uint64_t
 #include <time.h>
+#include <algorithm>
 #include <climits>
 #include <cmath>  // for std::fabs
 #include <cstdlib>  // for rand_r
+#include <limits>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #include "gtest/gtest.h"
 
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
+#include "caffe/util/fast_math.hpp"
+#include "caffe/util/low_rank.hpp"
 #include "caffe/util/math_functions.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
@@ -20,7 +29,10 @@ class MathFunctionsTest : public ::testing::Test {
  protected:
   MathFunctionsTest()
       : blob_bottom_(new Blob<Dtype>()),
-        blob_top_(new Blob<Dtype>()) {
+        blob_top_(new Blob<Dtype>()),
+        grain_(caffe_parallel_grain()),
+        deterministic_(caffe_deterministic_reductions()),
+        strict_math_(caffe_strict_math()) {
   }
 
   virtual void SetUp() {
@@ -37,6 +49,18 @@ class MathFunctionsTest : public ::testing::Test {
   virtual ~MathFunctionsTest() {
     delete blob_bottom_;
     delete blob_top_;
+    caffe_set_parallel_grain(grain_);
+    caffe_set_deterministic_reductions(deterministic_);
+    caffe_set_strict_math(strict_math_);
+  }
+
+  // Splits the primitives into many chunks over several threads, even on a
+  // single core machine.
+  void SetParallel(const int threads) {
+    caffe_set_parallel_grain(1000);
+#ifdef _OPENMP
+    omp_set_num_threads(threads);
+#endif
   }
 
   // http://en.wikipedia.org/wiki/Hamming_distance
@@ -62,6 +86,9 @@ class MathFunctionsTest : public ::testing::Test {
 
   Blob<Dtype>* const blob_bottom_;
   Blob<Dtype>* const blob_top_;
+  const int grain_;
+  const bool deterministic_;
+  const bool strict_math_;
 };
 
 TYPED_TEST_CASE(MathFunctionsTest, TestDtypes);
@@ -144,6 +171,473 @@ TYPED_TEST(MathFunctionsTest, TestCopyCPU) {
   }
 }
 
+TYPED_TEST(MathFunctionsTest, TestParallelElementwiseCPU) {
+  typedef TypeParam Dtype;
+#ifdef _OPENMP
+  const int threads = omp_get_max_threads();
+#endif
+  this->SetParallel(4);
+  const int n = this->blob_bottom_->count();
+  const Dtype* a = this->blob_bottom_->cpu_data();
+  const Dtype* b = this->blob_top_->cpu_data();
+  vector<Dtype> y(n);
+  caffe_add(n, a, b, &y[0]);
+  for (int i = 0; i < n; ++i) {
+    EXPECT_EQ(y[i], a[i] + b[i]);
+  }
+  caffe_mul(n, a, b, &y[0]);
+  for (int i = 0; i < n; ++i) {
+    EXPECT_EQ(y[i], a[i] * b[i]);
+  }
+  caffe_exp(n, a, &y[0]);
+  for (int i = 0; i < n; ++i) {
+    EXPECT_NEAR(y[i], std::exp(a[i]), 1e-5 * std::exp(a[i]));
+  }
+  caffe_copy(n, b, &y[0]);
+  caffe_cpu_axpby(n, Dtype(2), a, Dtype(0.5), &y[0]);
+  for (int i = 0; i < n; ++i) {
+    EXPECT_NEAR(y[i], 2 * a[i] + 0.5 * b[i], 1e-5);
+  }
+  caffe_set(n, Dtype(3), &y[0]);
+  for (int i = 0; i < n; ++i) {
+    EXPECT_EQ(y[i], 3);
+  }
+#ifdef _OPENMP
+  omp_set_num_threads(threads);
+#endif
+}
+
+TYPED_TEST(MathFunctionsTest, TestDeterministicReductionsCPU) {
+  typedef TypeParam Dtype;
+#ifdef _OPENMP
+  const int threads = omp_get_max_threads();
+#endif
+  const int n = this->blob_bottom_->count();
+  const Dtype* x = this->blob_bottom_->cpu_data();
+  const Dtype* y = this->blob_top_->cpu_data();
+  double std_dot = 0;
+  double std_asum = 0;
+  for (int i = 0; i < n; ++i) {
+    std_dot += x[i] * y[i];
+    std_asum += std::fabs(x[i]);
+  }
+  caffe_set_deterministic_reductions(true);
+  this->SetParallel(1);
+  const Dtype dot = caffe_cpu_dot(n, x, y);
+  const Dtype asum = caffe_cpu_asum(n, x);
+  EXPECT_NEAR(dot, std_dot, 1e-3 * std::fabs(std_dot) + 1e-2);
+  EXPECT_NEAR(asum, std_asum, 1e-4 * std_asum);
+  // The same chunks are summed in the same order with any thread count.
+  this->SetParallel(3);
+  EXPECT_EQ(caffe_cpu_dot(n, x, y), dot);
+  EXPECT_EQ(caffe_cpu_asum(n, x), asum);
+  // Enough chunks for several batches of partials.
+  caffe_set_parallel_grain(100);
+  const Dtype many_dot = caffe_cpu_dot(n, x, y);
+  const Dtype many_asum = caffe_cpu_asum(n, x);
+  EXPECT_NEAR(many_dot, std_dot, 1e-3 * std::fabs(std_dot) + 1e-2);
+  EXPECT_NEAR(many_asum, std_asum, 1e-4 * std_asum);
+#ifdef _OPENMP
+  omp_set_num_threads(1);
+#endif
+  EXPECT_EQ(caffe_cpu_dot(n, x, y), many_dot);
+  EXPECT_EQ(caffe_cpu_asum(n, x), many_asum);
+  caffe_set_deterministic_reductions(false);
+  EXPECT_NEAR(caffe_cpu_dot(n, x, y), std_dot,
+      1e-3 * std::fabs(std_dot) + 1e-2);
+  EXPECT_NEAR(caffe_cpu_asum(n, x), std_asum, 1e-4 * std_asum);
+#ifdef _OPENMP
+  omp_set_num_threads(threads);
+#endif
+}
+
+TYPED_TEST(MathFunctionsTest, TestAxisPrimitivesCPU) {
+  typedef TypeParam Dtype;
+#ifdef _OPENMP
+  const int threads = omp_get_max_threads();
+#endif
+  // Every split: over outer rows, inner ranges, and the contiguous rows.
+  const int kShapes[][3] = { {1, 11, 300}, {6, 5, 70}, {40, 33, 1} };
+  for (int s = 0; s < 3; ++s) {
+    for (int t = 1; t <= 4; t += 3) {
+      this->SetParallel(t);
+      const int outer = kShapes[s][0];
+      const int dim = kShapes[s][1];
+      const int inner = kShapes[s][2];
+      const Dtype* x = this->blob_bottom_->cpu_data();
+      const Dtype* v = this->blob_top_->cpu_data();
+      vector<Dtype> sum(outer * inner, 1);
+      vector<Dtype> max(outer * inner);
+      vector<Dtype> dot(outer * inner);
+      vector<Dtype> mean(outer * inner);
+      vector<Dtype> var(outer * inner);
+      caffe_cpu_axis_sum(outer, dim, inner, Dtype(2), x, Dtype(0.5), &sum[0]);
+      caffe_cpu_axis_max(outer, dim, inner, x, &max[0]);
+      caffe_cpu_axis_dot(outer, dim, inner, x, v, &dot[0]);
+      caffe_cpu_axis_mean_var(outer, dim, inner, x, &mean[0], &var[0]);
+      for (int o = 0; o < outer; ++o) {
+        for (int i = 0; i < inner; ++i) {
+          double ref_sum = 0, ref_sq = 0, ref_dot = 0;
+          Dtype ref_max = x[o * dim * inner + i];
+          for (int d = 0; d < dim; ++d) {
+            const int k = (o * dim + d) * inner + i;
+            ref_sum += x[k];
+            ref_sq += x[k] * x[k];
+            ref_dot += x[k] * v[k];
+            ref_max = std::max(ref_max, x[k]);
+          }
+          const int j = o * inner + i;
+          const double ref_mean = ref_sum / dim;
+          EXPECT_NEAR(sum[j], 2 * ref_sum + 0.5, 1e-4);
+          EXPECT_EQ(max[j], ref_max);
+          EXPECT_NEAR(dot[j], ref_dot, 1e-4);
+          EXPECT_NEAR(mean[j], ref_mean, 1e-5);
+          EXPECT_NEAR(var[j], ref_sq / dim - ref_mean * ref_mean, 1e-4);
+        }
+      }
+      // Broadcasts, checked against the reduced arrays above.
+      const int count = outer * dim * inner;
+      vector<Dtype> y(x, x + count);
+      caffe_cpu_axis_add(outer, dim, inner, Dtype(-1), &mean[0], &y[0]);
+      caffe_cpu_axis_mul(outer, dim, inner, &var[0], &y[0]);
+      vector<Dtype> z(count);
+      caffe_cpu_axis_normalize(outer, dim, inner, x, &mean[0], &var[0],
+          &z[0]);
+      for (int o = 0; o < outer; ++o) {
+        for (int d = 0; d < dim; ++d) {
+          for (int i = 0; i < inner; ++i) {
+            const int k = (o * dim + d) * inner + i;
+            const int j = o * inner + i;
+            const Dtype expected = (x[k] - mean[j]) * var[j];
+            EXPECT_NEAR(y[k], expected, 1e-5);
+            EXPECT_NEAR(z[k], expected, 1e-5);
+          }
+        }
+      }
+    }
+  }
+#ifdef _OPENMP
+  omp_set_num_threads(threads);
+#endif
+}
+
+TYPED_TEST(MathFunctionsTest, TestTranscendentalsCPU) {
+  typedef TypeParam Dtype;
+  // Inputs spanning the interesting range of each function, including the
+  // saturated tails; log gets positive inputs over many decades.
+  const int n = 20001;
+  vector<Dtype> x(n);
+  vector<Dtype> positive(n);
+  for (int i = 0; i < n; ++i) {
+    x[i] = -86 + 172. * i / (n - 1);
+    positive[i] = pow(10., -30 + 60. * i / (n - 1));
+  }
+  vector<Dtype> y(n);
+  const Dtype eps = std::numeric_limits<Dtype>::epsilon();
+  // The bounds documented in fast_math.hpp, in units of the result's ulp,
+  // which eps * |result| bounds from above.
+  caffe_exp(n, &x[0], &y[0]);
+  for (int i = 0; i < n; ++i) {
+    const double expected = exp(static_cast<double>(x[i]));
+    EXPECT_LE(fabs(y[i] - expected), 1 * eps * expected) << x[i];
+  }
+  caffe_log(n, &positive[0], &y[0]);
+  for (int i = 0; i < n; ++i) {
+    const double expected = log(static_cast<double>(positive[i]));
+    EXPECT_LE(fabs(y[i] - expected), 1 * eps * fabs(expected)) << positive[i];
+  }
+  caffe_tanh(n, &x[0], &y[0]);
+  for (int i = 0; i < n; ++i) {
+    const double expected = tanh(static_cast<double>(x[i]));
+    EXPECT_LE(fabs(y[i] - expected), 1.5 * eps * fabs(expected)) << x[i];
+  }
+  caffe_sigmoid(n, &x[0], &y[0]);
+  for (int i = 0; i < n; ++i) {
+    const double expected = 1. / (1. + exp(-static_cast<double>(x[i])));
+    EXPECT_LE(fabs(y[i] - expected), 2.5 * eps * expected) << x[i];
+  }
+  caffe_log1p_exp(n, &x[0], &y[0]);
+  for (int i = 0; i < n; ++i) {
+    const double value = x[i];
+    const double expected = value > 0 ?
+        value + log1p(exp(-value)) : log1p(exp(value));
+    EXPECT_LE(fabs(y[i] - expected), 2 * eps * expected) << x[i];
+  }
+  // Inputs near (k + 1/2) ln 2, several with x / ln 2 halfway between two
+  // integers in single precision, each run through four vector lanes and a
+  // scalar tail, which must agree; NaN must come back from both.
+  vector<Dtype> ties;
+  for (int k = -100; k <= 100; k += 3) {
+    Dtype v = (k + 0.5) * 0.693147180559945309;
+    for (int j = 0; j < 3; ++j) {
+      ties.push_back(v);
+      v = caffe_nextafter(v);
+    }
+  }
+  ties.push_back(std::numeric_limits<Dtype>::quiet_NaN());
+  vector<Dtype> in(5);
+  vector<Dtype> out(5);
+  for (int i = 0; i < ties.size(); ++i) {
+    std::fill(in.begin(), in.end(), ties[i]);
+    caffe_exp(5, &in[0], &out[0]);
+    for (int j = 0; j < 4; ++j) {
+      if (isnan(ties[i])) {
+        EXPECT_TRUE(isnan(out[j]));
+      } else {
+        EXPECT_EQ(out[4], out[j]) << ties[i];
+      }
+    }
+    EXPECT_EQ(isnan(ties[i]), isnan(out[4]));
+  }
+  // Strict math reproduces the libm expressions bit for bit.
+  caffe_set_strict_math(true);
+  caffe_sigmoid(n, &x[0], &y[0]);
+  for (int i = 0; i < n; ++i) {
+    EXPECT_EQ(Dtype(1. / (1. + exp(-x[i]))), y[i]);
+  }
+  caffe_tanh(n, &x[0], &y[0]);
+  for (int i = 0; i < n; ++i) {
+    EXPECT_EQ(tanh(x[i]), y[i]);
+  }
+  caffe_exp(n, &x[0], &y[0]);
+  for (int i = 0; i < n; ++i) {
+    EXPECT_EQ(exp(x[i]), y[i]);
+  }
+}
+
+TYPED_TEST(MathFunctionsTest, TestBernoulliBitsCPU) {
+  typedef TypeParam Dtype;
+  const int n = 100003;
+  const int words = (n + 31) / 32;
+  vector<unsigned int> bits(words);
+  // 1/4 takes 8-bit lanes and 0.3 16-bit ones.
+  const Dtype probs[] = { 0.25, 0.3 };
+  for (int j = 0; j < 2; ++j) {
+    const int lane_bits = j == 0 ? 8 : 16;
+    const unsigned int threshold = j == 0 ? 64 : 19661;
+    Caffe::set_random_seed(1701);
+    caffe_rng_bernoulli_bits(n, probs[j], &bits[0]);
+    // The lanes are the consecutive slices of the random stream.
+    Caffe::set_random_seed(1701);
+    vector<unsigned int> random(words * lane_bits);
+    caffe_rng_bits(random.size(), &random[0]);
+    const int per_word = 32 / lane_bits;
+    int ones = 0;
+    for (int i = 0; i < words * 32; ++i) {
+      const unsigned int lane = (random[i / per_word]
+          >> (i % per_word * lane_bits)) & ((1u << lane_bits) - 1);
+      const bool bit = (bits[i / 32] >> (i % 32)) & 1;
+      EXPECT_EQ(i < n && lane < threshold, bit) << i;
+      ones += bit;
+    }
+    EXPECT_NEAR(probs[j], static_cast<double>(ones) / n, 0.01);
+  }
+  caffe_rng_bernoulli_bits(n, Dtype(1), &bits[0]);
+  EXPECT_EQ(~0u, bits[0]);
+  EXPECT_EQ((1u << n % 32) - 1, bits[words - 1]);
+  caffe_rng_bernoulli_bits(n, Dtype(0), &bits[0]);
+  EXPECT_EQ(0, *std::max_element(bits.begin(), bits.end()));
+}
+
+TYPED_TEST(MathFunctionsTest, TestMaskScaleCPU) {
+  typedef TypeParam Dtype;
+#ifdef _OPENMP
+  const int threads = omp_get_max_threads();
+#endif
+  const int n = this->blob_bottom_->count();
+  vector<unsigned int> mask((n + 31) / 32);
+  caffe_rng_bernoulli_bits(n, Dtype(0.5), &mask[0]);
+  const Dtype* x = this->blob_bottom_->cpu_data();
+  Dtype* y = this->blob_top_->mutable_cpu_data();
+  this->SetParallel(3);
+  caffe_cpu_mask_scale(n, &mask[0], Dtype(2), x, y);
+  for (int i = 0; i < n; ++i) {
+    EXPECT_EQ((mask[i / 32] >> (i % 32)) & 1 ? 2 * x[i] : Dtype(0), y[i]);
+  }
+#ifdef _OPENMP
+  omp_set_num_threads(threads);
+#endif
+}
+
+TYPED_TEST(MathFunctionsTest, TestHalfConversionsCPU) {
+  const float inf = std::numeric_limits<float>::infinity();
+  const float nan = std::numeric_limits<float>::quiet_NaN();
+  const float x[] = {1, -2, 65504, 65519, 65520, inf, -inf, 5.96046448e-8f,
+      2.9e-8f, 1 + 1.f / 256, 1 + 3.f / 256, nan};
+  const uint16_t half[] = {0x3c00, 0xc000, 0x7bff, 0x7bff, 0x7c00, 0x7c00,
+      0xfc00, 0x0001, 0x0000, 0x3c04, 0x3c0c, 0x7e00};
+  const uint16_t bfloat16[] = {0x3f80, 0xc000, 0x4780, 0x4780, 0x4780, 0x7f80,
+      0xff80, 0x3380, 0x32f9, 0x3f80, 0x3f82, 0x7fc0};
+  const int n = sizeof(x) / sizeof(x[0]);
+  // The SSE2 kernels take the first eight and the scalar tail the rest.
+  uint16_t y[n];
+  fast_float_to_half(n, x, y);
+  for (int i = 0; i < n; ++i) {
+    EXPECT_EQ(half[i], y[i]) << "x = " << x[i];
+  }
+  fast_float_to_bfloat16(n, x, y);
+  for (int i = 0; i < n; ++i) {
+    EXPECT_EQ(bfloat16[i], y[i]) << "x = " << x[i];
+  }
+  // Widening every 16-bit value and narrowing it back is exact, and the
+  // kernels agree with the scalar tails.
+  vector<uint16_t> all(65536);
+  for (int i = 0; i < all.size(); ++i) {
+    all[i] = static_cast<uint16_t>(i);
+  }
+  vector<float> wide(all.size());
+  vector<uint16_t> narrow(all.size());
+  for (int type = 0; type < 2; ++type) {
+    if (type == 0) {
+      fast_half_to_float(all.size(), &all[0], &wide[0]);
+      fast_float_to_half(all.size(), &wide[0], &narrow[0]);
+    } else {
+      fast_bfloat16_to_float(all.size(), &all[0], &wide[0]);
+      fast_float_to_bfloat16(all.size(), &wide[0], &narrow[0]);
+    }
+    for (int i = 0; i < all.size(); ++i) {
+      float scalar;
+      uint16_t scalar_narrow;
+      if (type == 0) {
+        fast_half_to_float(1, &all[i], &scalar);
+        fast_float_to_half(1, &wide[i], &scalar_narrow);
+      } else {
+        fast_bfloat16_to_float(1, &all[i], &scalar);
+        fast_float_to_bfloat16(1, &wide[i], &scalar_narrow);
+      }
+      EXPECT_EQ(0, memcmp(&scalar, &wide[i], sizeof(scalar)))
+          << "type " << type << " value " << i;
+      EXPECT_EQ(scalar_narrow, narrow[i]);
+      if (wide[i] != wide[i]) {
+        // NaNs come back quiet; half precision drops the payload.
+        EXPECT_EQ(type == 0 ? (all[i] & 0x8000) | 0x7e00 : all[i] | 0x0040,
+            narrow[i]);
+      } else {
+        EXPECT_EQ(all[i], narrow[i]) << "type " << type << " value " << i;
+      }
+    }
+  }
+  // Random floats narrow to the nearest value.
+  const int count = this->blob_bottom_->count();
+  vector<float> random(this->blob_bottom_->cpu_data(),
+      this->blob_bottom_->cpu_data() + count);
+  narrow.resize(count);
+  fast_float_to_half(count, &random[0], &narrow[0]);
+  for (int i = 0; i < count; ++i) {
+    uint16_t neighbors[3] = {narrow[i], uint16_t(narrow[i] - 1),
+        uint16_t(narrow[i] + 1)};
+    float values[3];
+    fast_half_to_float(3, neighbors, values);
+    EXPECT_LE(std::fabs(values[0] - random[i]),
+        std::fabs(values[1] - random[i]));
+    EXPECT_LE(std::fabs(values[0] - random[i]),
+        std::fabs(values[2] - random[i]));
+  }
+}
+
+TYPED_TEST(MathFunctionsTest, TestQuantizeU8CPU) {
+  const TypeParam nan = std::numeric_limits<TypeParam>::quiet_NaN();
+  // Ties go to even, the ends saturate and NaN gives 0; the first sixteen
+  // take the SSE2 kernel and the rest the scalar tail.
+  const TypeParam x[] = {0, 0.5, 1.5, 2.5, -0.5, -3, 127.4, 127.6, 300, -300,
+      1e10, -1e10, nan, 64.5, 0.49, 200.5, 0.5, 2.5, nan, 1e10};
+  const uint8_t expected[] = {128, 128, 130, 130, 128, 125, 255, 255, 255, 0,
+      255, 0, 0, 192, 128, 255, 128, 130, 0, 255};
+  const int n = sizeof(x) / sizeof(x[0]);
+  uint8_t q[n];
+  caffe_cpu_quantize_u8<TypeParam>(n, x, 1, 128, q);
+  for (int i = 0; i < n; ++i) {
+    EXPECT_EQ(expected[i], q[i]) << "x = " << x[i];
+  }
+  caffe_cpu_quantize_u8<TypeParam>(n, x, 0.5, 0, q);
+  for (int i = 0; i < n; ++i) {
+    uint8_t scalar;
+    fast_quantize_u8(1, x + i, TypeParam(2), 0, &scalar);
+    EXPECT_EQ(scalar, q[i]) << "x = " << x[i];
+  }
+  EXPECT_EQ(0, q[0]);
+  EXPECT_EQ(1, q[1]);
+  EXPECT_EQ(3, q[2]);
+  EXPECT_EQ(5, q[3]);
+}
+
+TYPED_TEST(MathFunctionsTest, TestGemmU8S8S32CPU) {
+  // Sizes that leave tails in both K and N; the second product has fewer
+  // rows than threads and is split by columns.
+  const int sizes[][3] = {{7, 11, 37}, {3, 70, 300}};
+  for (int s = 0; s < 2; ++s) {
+    const int M = sizes[s][0], N = sizes[s][1], K = sizes[s][2];
+    vector<uint8_t> a(M * K);
+    vector<int8_t> b(N * K);
+    for (int i = 0; i < a.size(); ++i) {
+      a[i] = static_cast<uint8_t>(i % 5 == 0 ? 255 : (i * 37 + 11) % 256);
+    }
+    for (int i = 0; i < b.size(); ++i) {
+      b[i] = static_cast<int8_t>(i % 7 == 0 ? -128 : (i * 53 + 3) % 256 - 128);
+    }
+    vector<int32_t> c(M * N);
+    if (s == 1) {
+      this->SetParallel(4);
+      caffe_set_parallel_grain(16);
+    }
+    caffe_cpu_gemm_u8s8s32(M, N, K, &a[0], &b[0], &c[0]);
+    for (int m = 0; m < M; ++m) {
+      for (int n = 0; n < N; ++n) {
+        int32_t expected = 0;
+        for (int k = 0; k < K; ++k) {
+          expected += static_cast<int32_t>(a[m * K + k]) * b[n * K + k];
+        }
+        EXPECT_EQ(expected, c[m * N + n]) << "m = " << m << ", n = " << n;
+      }
+    }
+  }
+}
+
+TYPED_TEST(MathFunctionsTest, TestLowRankCPU) {
+  Caffe::set_random_seed(1701);
+  const int M = 30, N = 50;
+  // A matrix of rank 4 is recovered exactly.
+  vector<TypeParam> a(M * N, 0);
+  for (int m = 0; m < M; ++m) {
+    for (int n = 0; n < N; ++n) {
+      for (int k = 0; k < 4; ++k) {
+        a[m * N + n] += std::sin(m * (k + 1) + 0.5 * k) * std::cos(n * k + 1.);
+      }
+    }
+  }
+  vector<TypeParam> u(M * 4), v(4 * N);
+  caffe_cpu_low_rank(M, N, &a[0], 4, &u[0], &v[0]);
+  for (int m = 0; m < M; ++m) {
+    for (int n = 0; n < N; ++n) {
+      TypeParam product = 0;
+      for (int k = 0; k < 4; ++k) {
+        product += u[m * 4 + k] * v[k * N + n];
+      }
+      EXPECT_NEAR(a[m * N + n], product, 1e-4);
+    }
+  }
+  // Singular values 5, 3, 2 and 1 on unit vectors: rank 2 keeps the first
+  // two terms.
+  const TypeParam sigma[] = {2, 5, 1, 3};
+  caffe_set(M * N, TypeParam(0), &a[0]);
+  for (int k = 0; k < 4; ++k) {
+    a[(3 * k + 1) * N + 5 * k + 2] = sigma[k];
+  }
+  vector<TypeParam> singular_values;
+  caffe_cpu_low_rank(M, N, &a[0], 2, &u[0], &v[0], &singular_values);
+  ASSERT_EQ(2, singular_values.size());
+  EXPECT_NEAR(5, singular_values[0], 1e-4);
+  EXPECT_NEAR(3, singular_values[1], 1e-4);
+  for (int m = 0; m < M; ++m) {
+    for (int n = 0; n < N; ++n) {
+      const TypeParam product = u[m * 2] * v[n] + u[m * 2 + 1] * v[N + n];
+      const TypeParam expected =
+          (m == 4 && n == 7) ? 5 : (m == 10 && n == 17) ? 3 : 0;
+      EXPECT_NEAR(expected, product, 1e-4);
+    }
+  }
+}
+
 #ifndef CPU_ONLY
 
 // TODO: Fix caffe_gpu_hamming_distance and re-enable this test.
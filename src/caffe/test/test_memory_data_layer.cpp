@@ -111,6 +111,62 @@ TYPED_TEST(MemoryDataLayerTest, TestForward) {
   }
 }
 
+TYPED_TEST(MemoryDataLayerTest, TestForwardSparse) {
+  typedef typename TypeParam::Dtype Dtype;
+
+  LayerParameter layer_param;
+  MemoryDataParameter* md_param = layer_param.mutable_memory_data_param();
+  md_param->set_batch_size(this->batch_size_);
+  md_param->set_channels(this->channels_);
+  md_param->set_height(this->height_);
+  md_param->set_width(this->width_);
+  Blob<Dtype> indices_blob, row_ptr_blob;
+  vector<Blob<Dtype>*> top_vec;
+  top_vec.push_back(this->data_blob_);
+  top_vec.push_back(&indices_blob);
+  top_vec.push_back(&row_ptr_blob);
+  top_vec.push_back(this->label_blob_);
+  shared_ptr<MemoryDataLayer<Dtype> > layer(
+      new MemoryDataLayer<Dtype>(layer_param));
+  layer->SetUp(this->blob_bottom_vec_, &top_vec);
+  EXPECT_EQ(row_ptr_blob.count(), this->batch_size_ + 1);
+  EXPECT_EQ(this->label_blob_->count(), this->batch_size_);
+  // Row r has r % 5 nonzeros, the values r + j at the features r + 7j.
+  const int rows = this->batches_ * this->batch_size_;
+  const int dim = this->channels_ * this->height_ * this->width_;
+  vector<Dtype> values;
+  vector<int> indices;
+  vector<int> indptr(1, 0);
+  for (int r = 0; r < rows; ++r) {
+    for (int j = 0; j < r % 5; ++j) {
+      values.push_back(r + j);
+      indices.push_back((r + 7 * j) % dim);
+    }
+    indptr.push_back(values.size());
+  }
+  layer->ResetSparse(&values[0], &indices[0], &indptr[0],
+      this->labels_->mutable_cpu_data(), rows);
+  for (int i = 0; i < this->batches_ * 2; ++i) {
+    const int batch_num = i % this->batches_;
+    layer->Forward(this->blob_bottom_vec_, &top_vec);
+    const int first = this->batch_size_ * batch_num;
+    const int begin = indptr[first];
+    for (int n = 0; n <= this->batch_size_; ++n) {
+      EXPECT_EQ(row_ptr_blob.cpu_data()[n], indptr[first + n] - begin);
+    }
+    const int nonzeros = indptr[first + this->batch_size_] - begin;
+    ASSERT_GE(this->data_blob_->count(), nonzeros);
+    for (int j = 0; j < nonzeros; ++j) {
+      EXPECT_EQ(this->data_blob_->cpu_data()[j], values[begin + j]);
+      EXPECT_EQ(indices_blob.cpu_data()[j], indices[begin + j]);
+    }
+    for (int j = 0; j < this->batch_size_; ++j) {
+      EXPECT_EQ(this->label_blob_->cpu_data()[j],
+          this->labels_->cpu_data()[first + j]);
+    }
+  }
+}
+
 TYPED_TEST(MemoryDataLayerTest, AddDatumVectorDefaultTransform) {
   typedef typename TypeParam::Dtype Dtype;
 
@@ -1,3 +1,7 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <limits>
 #include <string>
 #include <utility>
 #include <vector>
@@ -8,6 +12,8 @@
 
 #include "caffe/common.hpp"
 #include "caffe/net.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/mapped_weights.hpp"
 #include "caffe/util/math_functions.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
@@ -1005,6 +1011,58 @@ TYPED_TEST(NetTest, TestSharedWeightsUpdate) {
   }
 }
 
+TYPED_TEST(NetTest, TestPruneLayer) {
+  typedef typename TypeParam::Dtype Dtype;
+  Caffe::set_random_seed(this->seed_);
+  this->InitDiffDataUnsharedWeightsNet();
+  EXPECT_EQ(this->net_->layer_names()[1], "innerproduct1");
+  Blob<Dtype>* weights = this->net_->layers()[1]->blobs()[0].get();
+  int param_id = 0;
+  while (this->net_->params()[param_id].get() != weights) { ++param_id; }
+  EXPECT_TRUE(this->net_->param_mask(param_id) == NULL);
+  Blob<Dtype> original;
+  original.CopyFrom(*weights, false, true);
+  const int count = weights->count();
+  const float sparsity = 0.6;
+  this->net_->PruneLayer("innerproduct1", sparsity);
+  ASSERT_TRUE(this->net_->param_mask(param_id) != NULL);
+  // Exactly the smallest weights are gone.
+  int pruned = 0;
+  Dtype max_pruned = 0;
+  Dtype min_kept = std::numeric_limits<Dtype>::max();
+  for (int i = 0; i < count; ++i) {
+    const Dtype magnitude = std::fabs(original.cpu_data()[i]);
+    if (weights->cpu_data()[i] == 0) {
+      ++pruned;
+      max_pruned = std::max(max_pruned, magnitude);
+      EXPECT_EQ(0, this->net_->param_mask(param_id)->cpu_data()[i]);
+    } else {
+      min_kept = std::min(min_kept, magnitude);
+      EXPECT_EQ(original.cpu_data()[i], weights->cpu_data()[i]);
+      EXPECT_EQ(1, this->net_->param_mask(param_id)->cpu_data()[i]);
+    }
+  }
+  EXPECT_EQ(static_cast<int>(sparsity * count), pruned);
+  EXPECT_LE(max_pruned, min_kept);
+  // The update leaves the pruned weights at zero and moves the others.
+  vector<Blob<Dtype>*> bottom;
+  this->net_->Forward(bottom);
+  this->net_->Backward();
+  Blob<Dtype> expected;
+  expected.CopyFrom(*weights, false, true);
+  expected.CopyFrom(*weights, true, true);
+  this->net_->Update();
+  for (int i = 0; i < count; ++i) {
+    if (this->net_->param_mask(param_id)->cpu_data()[i] == 0) {
+      EXPECT_NE(0, expected.cpu_diff()[i]);
+      EXPECT_EQ(0, weights->cpu_data()[i]);
+    } else {
+      EXPECT_EQ(expected.cpu_data()[i] - expected.cpu_diff()[i],
+          weights->cpu_data()[i]);
+    }
+  }
+}
+
 TYPED_TEST(NetTest, TestParamPropagateDown) {
   typedef typename TypeParam::Dtype Dtype;
   vector<Blob<Dtype>*> bottom;
@@ -1121,6 +1179,123 @@ TYPED_TEST(NetTest, TestFromTo) {
   }
 }
 
+TYPED_TEST(NetTest, TestInitFromTrained) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->InitTinyNet();
+  NetParameter trained;
+  this->net_->ToProto(&trained);
+  // The net to load has no blobs, and a weight filler that would fail if it
+  // ran.
+  NetParameter param(trained);
+  for (int i = 0; i < param.layers_size(); ++i) {
+    param.mutable_layers(i)->clear_blobs();
+  }
+  param.mutable_layers(1)->mutable_inner_product_param()->
+      mutable_weight_filler()->set_type("not_a_filler");
+  Net<Dtype> net(param, trained);
+  EXPECT_FALSE(Caffe::skip_fill());
+  ASSERT_EQ(this->net_->params().size(), net.params().size());
+  for (int i = 0; i < net.params().size(); ++i) {
+    const Blob<Dtype>& expected = *this->net_->params()[i];
+    const Blob<Dtype>& loaded = *net.params()[i];
+    ASSERT_EQ(expected.count(), loaded.count());
+    // BlobProto stores floats.
+    for (int j = 0; j < expected.count(); ++j) {
+      EXPECT_EQ(static_cast<float>(expected.cpu_data()[j]),
+          loaded.cpu_data()[j]);
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestMappedWeightsRoundTrip) {
+  this->InitTinyNet();
+  NetParameter trained;
+  this->net_->ToProto(&trained);
+  string filename;
+  MakeTempFilename(&filename);
+  this->net_->ToMappedWeights(filename);
+  EXPECT_TRUE(MappedWeights::IsMappedWeightsFile(filename));
+  NetParameter converted;
+  {
+    MappedWeights weights(filename);
+    ASSERT_EQ(2, weights.entries().size());
+    for (int i = 0; i < weights.entries().size(); ++i) {
+      EXPECT_EQ(0, reinterpret_cast<size_t>(weights.entries()[i].data) %
+          MappedWeights::kAlignment);
+    }
+    weights.ToProto(&converted);
+  }
+  // Back to a NetParameter and through the proto writer again.
+  WriteMappedWeights(converted, filename);
+  MappedWeights weights(filename);
+  weights.ToProto(&converted);
+  ASSERT_EQ(1, converted.layers_size());
+  const LayerParameter& expected = trained.layers(1);
+  EXPECT_EQ(expected.name(), converted.layers(0).name());
+  ASSERT_EQ(expected.blobs_size(), converted.layers(0).blobs_size());
+  for (int i = 0; i < expected.blobs_size(); ++i) {
+    const BlobProto& blob = converted.layers(0).blobs(i);
+    EXPECT_EQ(expected.blobs(i).num(), blob.num());
+    EXPECT_EQ(expected.blobs(i).channels(), blob.channels());
+    EXPECT_EQ(expected.blobs(i).height(), blob.height());
+    EXPECT_EQ(expected.blobs(i).width(), blob.width());
+    ASSERT_EQ(expected.blobs(i).data_size(), blob.data_size());
+    for (int j = 0; j < blob.data_size(); ++j) {
+      EXPECT_EQ(expected.blobs(i).data(j), blob.data(j));
+    }
+  }
+  remove(filename.c_str());
+}
+
+TYPED_TEST(NetTest, TestInitFromMappedWeights) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->InitTinyNet();
+  NetParameter param;
+  this->net_->ToProto(&param);
+  for (int i = 0; i < param.layers_size(); ++i) {
+    param.mutable_layers(i)->clear_blobs();
+  }
+  param.mutable_layers(1)->mutable_inner_product_param()->
+      mutable_weight_filler()->set_type("not_a_filler");
+  string param_file, weights_file;
+  MakeTempFilename(&param_file);
+  MakeTempFilename(&weights_file);
+  WriteProtoToTextFile(param, param_file);
+  this->net_->ToMappedWeights(weights_file);
+  {
+    Net<Dtype> net(param_file, weights_file);
+    ASSERT_EQ(this->net_->params().size(), net.params().size());
+    for (int i = 0; i < net.params().size(); ++i) {
+      const Blob<Dtype>& expected = *this->net_->params()[i];
+      const Blob<Dtype>& loaded = *net.params()[i];
+      ASSERT_EQ(expected.count(), loaded.count());
+      for (int j = 0; j < expected.count(); ++j) {
+        EXPECT_EQ(static_cast<float>(expected.cpu_data()[j]),
+            loaded.cpu_data()[j]);
+      }
+    }
+    // Writes to shared pages stay private to the process.
+    net.params()[0]->mutable_cpu_data()[0] = 7;
+    Net<Dtype> copy(param_file, weights_file);
+    EXPECT_EQ(static_cast<float>(this->net_->params()[0]->cpu_data()[0]),
+        copy.params()[0]->cpu_data()[0]);
+  }
+  // CopyTrainedLayersFrom reads the format too.
+  param.mutable_layers(1)->mutable_inner_product_param()->
+      mutable_weight_filler()->set_type("gaussian");
+  Net<Dtype> net(param);
+  net.CopyTrainedLayersFrom(weights_file);
+  for (int i = 0; i < net.params().size(); ++i) {
+    const Blob<Dtype>& expected = *this->net_->params()[i];
+    for (int j = 0; j < expected.count(); ++j) {
+      EXPECT_EQ(static_cast<float>(expected.cpu_data()[j]),
+          net.params()[i]->cpu_data()[j]);
+    }
+  }
+  remove(param_file.c_str());
+  remove(weights_file.c_str());
+}
+
 class FilterNetTest : public ::testing::Test {
  protected:
   void RunFilterNetTest(
@@ -6,6 +6,7 @@
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
+#include "caffe/util/math_functions.hpp"
 #include "caffe/vision_layers.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
@@ -192,6 +193,25 @@ TYPED_TEST(NeuronLayerTest, TestTanH) {
   }
 }
 
+TYPED_TEST(NeuronLayerTest, TestTanHStrictMath) {
+  typedef typename TypeParam::Dtype Dtype;
+  if (Caffe::mode() != Caffe::CPU) { return; }
+  LayerParameter layer_param;
+  TanHLayer<Dtype> layer(layer_param);
+  const bool strict_math = caffe_strict_math();
+  caffe_set_strict_math(true);
+  layer.SetUp(this->blob_bottom_vec_, &(this->blob_top_vec_));
+  layer.Forward(this->blob_bottom_vec_, &(this->blob_top_vec_));
+  caffe_set_strict_math(strict_math);
+  // Strict math reproduces the original formula bit for bit.
+  const Dtype* bottom_data = this->blob_bottom_->cpu_data();
+  const Dtype* top_data = this->blob_top_->cpu_data();
+  for (int i = 0; i < this->blob_bottom_->count(); ++i) {
+    const Dtype exp2x = exp(2 * bottom_data[i]);
+    EXPECT_EQ((exp2x - Dtype(1)) / (exp2x + Dtype(1)), top_data[i]);
+  }
+}
+
 TYPED_TEST(NeuronLayerTest, TestTanHGradient) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter layer_param;
@@ -263,6 +283,27 @@ TYPED_TEST(NeuronLayerTest, TestBNLL) {
   }
 }
 
+TYPED_TEST(NeuronLayerTest, TestBNLLStrictMath) {
+  typedef typename TypeParam::Dtype Dtype;
+  if (Caffe::mode() != Caffe::CPU) { return; }
+  LayerParameter layer_param;
+  BNLLLayer<Dtype> layer(layer_param);
+  const bool strict_math = caffe_strict_math();
+  caffe_set_strict_math(true);
+  layer.SetUp(this->blob_bottom_vec_, &(this->blob_top_vec_));
+  layer.Forward(this->blob_bottom_vec_, &(this->blob_top_vec_));
+  caffe_set_strict_math(strict_math);
+  // Strict math reproduces the original formula bit for bit.
+  const Dtype* bottom_data = this->blob_bottom_->cpu_data();
+  const Dtype* top_data = this->blob_top_->cpu_data();
+  for (int i = 0; i < this->blob_bottom_->count(); ++i) {
+    const Dtype expected = bottom_data[i] > 0 ?
+        bottom_data[i] + log(1. + exp(-bottom_data[i])) :
+        log(1. + exp(bottom_data[i]));
+    EXPECT_EQ(expected, top_data[i]);
+  }
+}
+
 TYPED_TEST(NeuronLayerTest, TestBNLLGradient) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter layer_param;
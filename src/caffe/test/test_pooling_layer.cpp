@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cstring>
 #include <vector>
 
@@ -6,6 +7,7 @@
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
+#include "caffe/util/math_functions.hpp"
 #include "caffe/vision_layers.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
@@ -592,6 +594,99 @@ TYPED_TEST(PoolingLayerTest, TestGradientAvePadded) {
   }
 }
 
+TYPED_TEST(PoolingLayerTest, TestMaxMaskMatchesTopMask) {
+  typedef typename TypeParam::Dtype Dtype;
+  // The internal mask (a byte offset up to 256-element windows, a full
+  // index beyond) must route gradients exactly as the top mask does.
+  this->blob_bottom_->Reshape(2, 3, 18, 17);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  const int kernels[3] = {2, 3, 17};
+  const int strides[3] = {2, 2, 1};
+  for (int k = 0; k < 3; ++k) {
+    LayerParameter layer_param;
+    PoolingParameter* pooling_param = layer_param.mutable_pooling_param();
+    pooling_param->set_kernel_size(kernels[k]);
+    pooling_param->set_stride(strides[k]);
+    pooling_param->set_pool(PoolingParameter_PoolMethod_MAX);
+    PoolingLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, &(this->blob_top_vec_));
+    layer.Forward(this->blob_bottom_vec_, &(this->blob_top_vec_));
+    Blob<Dtype> top;
+    vector<Blob<Dtype>*> masked_top_vec;
+    masked_top_vec.push_back(&top);
+    masked_top_vec.push_back(this->blob_top_mask_);
+    PoolingLayer<Dtype> masked_layer(layer_param);
+    masked_layer.SetUp(this->blob_bottom_vec_, &masked_top_vec);
+    masked_layer.Forward(this->blob_bottom_vec_, &masked_top_vec);
+    const int bottom_size = this->blob_bottom_->height()
+        * this->blob_bottom_->width();
+    const int top_size = top.height() * top.width();
+    for (int i = 0; i < top.count(); ++i) {
+      EXPECT_EQ(this->blob_top_->cpu_data()[i], top.cpu_data()[i]);
+      const int index = static_cast<int>(this->blob_top_mask_->cpu_data()[i]);
+      EXPECT_EQ(top.cpu_data()[i],
+          this->blob_bottom_->cpu_data()[(i / top_size) * bottom_size + index]);
+    }
+    filler.Fill(this->blob_top_);
+    caffe_copy(top.count(), this->blob_top_->cpu_data(),
+        this->blob_top_->mutable_cpu_diff());
+    caffe_copy(top.count(), this->blob_top_->cpu_data(),
+        top.mutable_cpu_diff());
+    vector<bool> propagate_down(1, true);
+    layer.Backward(this->blob_top_vec_, propagate_down,
+        &(this->blob_bottom_vec_));
+    vector<Dtype> diff(this->blob_bottom_->cpu_diff(),
+        this->blob_bottom_->cpu_diff() + this->blob_bottom_->count());
+    masked_layer.Backward(masked_top_vec, propagate_down,
+        &(this->blob_bottom_vec_));
+    for (int i = 0; i < this->blob_bottom_->count(); ++i) {
+      EXPECT_EQ(diff[i], this->blob_bottom_->cpu_diff()[i]);
+    }
+  }
+}
+
+TYPED_TEST(PoolingLayerTest, TestInputSmallerThanKernel) {
+  typedef typename TypeParam::Dtype Dtype;
+  // The one clipped window of each plane covers the whole plane, and the
+  // fixed-size 2x2 and 3x3 stride 2 kernels must not be used for it.
+  // Each shape is height, width and a kernel larger than one of them.
+  const int shapes[4][3] = {{2, 2, 3}, {3, 2, 3}, {1, 1, 2}, {1, 2, 2}};
+  for (int s = 0; s < 4; ++s) {
+    const int height = shapes[s][0];
+    const int width = shapes[s][1];
+    const int kernel = shapes[s][2];
+    this->blob_bottom_->Reshape(2, 3, height, width);
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_);
+    for (int method = 0; method < 2; ++method) {
+      LayerParameter layer_param;
+      PoolingParameter* pooling_param = layer_param.mutable_pooling_param();
+      pooling_param->set_kernel_size(kernel);
+      pooling_param->set_stride(2);
+      pooling_param->set_pool(method == 0 ? PoolingParameter_PoolMethod_MAX
+          : PoolingParameter_PoolMethod_AVE);
+      PoolingLayer<Dtype> layer(layer_param);
+      layer.SetUp(this->blob_bottom_vec_, &(this->blob_top_vec_));
+      EXPECT_EQ(this->blob_top_->height(), 1);
+      EXPECT_EQ(this->blob_top_->width(), 1);
+      layer.Forward(this->blob_bottom_vec_, &(this->blob_top_vec_));
+      const int plane = height * width;
+      for (int p = 0; p < this->blob_top_->count(); ++p) {
+        const Dtype* x = this->blob_bottom_->cpu_data() + p * plane;
+        Dtype expected = method == 0 ? x[0] : 0;
+        for (int i = 0; i < plane; ++i) {
+          expected = method == 0 ? std::max(expected, x[i])
+              : expected + x[i] / plane;
+        }
+        EXPECT_NEAR(this->blob_top_->cpu_data()[p], expected, 1e-5);
+      }
+    }
+  }
+}
+
 #ifdef USE_CUDNN
 template <typename Dtype>
 class CuDNNPoolingLayerTest : public ::testing::Test {
@@ -1,11 +1,17 @@
 #include <cmath>
 #include <cstring>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #include "gtest/gtest.h"
 
 #include "caffe/common.hpp"
 #include "caffe/syncedmem.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/philox.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 
@@ -396,6 +402,58 @@ TYPED_TEST(RandomNumberGeneratorTest, TestRngBernoulliTimesBernoulli) {
   EXPECT_NEAR(true_mean, sample_p, bound);
 }
 
+TYPED_TEST(RandomNumberGeneratorTest, TestPhilox) {
+  // Block 0 of key 0 is the first known answer of the Random123 reference.
+  const uint32_t zero_key[2] = { 0, 0 };
+  uint32_t block[4];
+  philox4x32(0, 1, zero_key, block);
+  EXPECT_EQ(0x6627e8d5u, block[0]);
+  EXPECT_EQ(0xe169c58du, block[1]);
+  EXPECT_EQ(0xbc57ac4cu, block[2]);
+  EXPECT_EQ(0x9b00dbd8u, block[3]);
+  // The four-block kernel agrees with single blocks, across the carry into
+  // the counter's high word.
+  const uint32_t key[2] = { 1701, 42 };
+  const uint64_t first = 0xfffffffdull;
+  uint32_t blocks[4 * 7];
+  philox4x32(first, 7, key, blocks);
+  for (int b = 0; b < 7; ++b) {
+    philox4x32(first + b, 1, key, block);
+    for (int j = 0; j < 4; ++j) {
+      EXPECT_EQ(block[j], blocks[4 * b + j]);
+    }
+  }
+}
+
+TYPED_TEST(RandomNumberGeneratorTest, TestRngThreadIndependent) {
+  // The same seed gives the same values whatever the split across threads.
+  const int n = this->sample_size_ + 3;
+  vector<TypeParam> serial(2 * n);
+  caffe_rng_uniform(n, TypeParam(-1), TypeParam(2), &serial[0]);
+  caffe_rng_gaussian(n, TypeParam(1), TypeParam(3), &serial[n]);
+  const int grain = caffe_parallel_grain();
+  caffe_set_parallel_grain(1000);
+#ifdef _OPENMP
+  const int threads = omp_get_max_threads();
+  omp_set_num_threads(3);
+#endif
+  Caffe::set_random_seed(this->seed_);
+  vector<TypeParam> parallel(2 * n);
+  caffe_rng_uniform(n, TypeParam(-1), TypeParam(2), &parallel[0]);
+  caffe_rng_gaussian(n, TypeParam(1), TypeParam(3), &parallel[n]);
+  caffe_set_parallel_grain(grain);
+#ifdef _OPENMP
+  omp_set_num_threads(threads);
+#endif
+  for (int i = 0; i < 2 * n; ++i) {
+    EXPECT_EQ(serial[i], parallel[i]);
+  }
+  // Successive calls continue the stream rather than repeat it.
+  EXPECT_NE(serial[0], serial[n]);
+  caffe_rng_uniform(n, TypeParam(-1), TypeParam(2), &parallel[0]);
+  EXPECT_NE(serial[0], parallel[0]);
+}
+
 #ifndef CPU_ONLY
 
 TYPED_TEST(RandomNumberGeneratorTest, TestRngGaussianGPU) {
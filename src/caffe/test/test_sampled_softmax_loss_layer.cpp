@@ -0,0 +1,200 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>  // NOLINT(readability/streams)
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/vision_layers.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+#include "caffe/test/test_gradient_check_util.hpp"
+
+namespace caffe {
+
+template <typename TypeParam>
+class SampledSoftmaxLossLayerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  SampledSoftmaxLossLayerTest()
+      : num_output_(20),
+        blob_bottom_data_(new Blob<Dtype>(8, 3, 2, 1)),
+        blob_bottom_label_(new Blob<Dtype>(8, 1, 1, 1)),
+        blob_top_loss_(new Blob<Dtype>()),
+        blob_top_prob_(new Blob<Dtype>()) {
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_data_);
+    blob_bottom_vec_.push_back(blob_bottom_data_);
+    for (int i = 0; i < blob_bottom_label_->count(); ++i) {
+      blob_bottom_label_->mutable_cpu_data()[i] =
+          caffe_rng_rand() % num_output_;
+    }
+    blob_bottom_vec_.push_back(blob_bottom_label_);
+    blob_top_vec_.push_back(blob_top_loss_);
+    Caffe::set_phase(Caffe::TRAIN);
+  }
+  virtual ~SampledSoftmaxLossLayerTest() {
+    delete blob_bottom_data_;
+    delete blob_bottom_label_;
+    delete blob_top_loss_;
+    delete blob_top_prob_;
+    Caffe::set_phase(Caffe::TRAIN);
+  }
+
+  LayerParameter MakeParam() {
+    LayerParameter layer_param;
+    SampledSoftmaxParameter* param =
+        layer_param.mutable_sampled_softmax_param();
+    param->set_num_output(num_output_);
+    param->set_num_sampled(6);
+    param->mutable_weight_filler()->set_type("gaussian");
+    param->mutable_bias_filler()->set_type("gaussian");
+    return layer_param;
+  }
+
+  const int num_output_;
+  Blob<Dtype>* const blob_bottom_data_;
+  Blob<Dtype>* const blob_bottom_label_;
+  Blob<Dtype>* const blob_top_loss_;
+  Blob<Dtype>* const blob_top_prob_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(SampledSoftmaxLossLayerTest, TestDtypesAndDevices);
+
+TYPED_TEST(SampledSoftmaxLossLayerTest, TestForwardTestPhase) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->blob_top_vec_.push_back(this->blob_top_prob_);
+  SampledSoftmaxLossLayer<Dtype> layer(this->MakeParam());
+  layer.SetUp(this->blob_bottom_vec_, &(this->blob_top_vec_));
+  Caffe::set_phase(Caffe::TEST);
+  layer.Forward(this->blob_bottom_vec_, &(this->blob_top_vec_));
+  // The exact softmax over every class.
+  const int num = this->blob_bottom_data_->num();
+  const int dim = this->blob_bottom_data_->count() / num;
+  const Dtype* data = this->blob_bottom_data_->cpu_data();
+  const Dtype* weight = layer.blobs()[0]->cpu_data();
+  const Dtype* bias = layer.blobs()[1]->cpu_data();
+  double loss = 0;
+  for (int n = 0; n < num; ++n) {
+    vector<double> score(this->num_output_);
+    double sum = 0;
+    for (int k = 0; k < this->num_output_; ++k) {
+      score[k] = bias[k];
+      for (int d = 0; d < dim; ++d) {
+        score[k] += data[n * dim + d] * weight[k * dim + d];
+      }
+      sum += exp(score[k]);
+    }
+    for (int k = 0; k < this->num_output_; ++k) {
+      EXPECT_NEAR(exp(score[k]) / sum,
+          this->blob_top_prob_->data_at(n, k, 0, 0), 1e-5);
+    }
+    const int label =
+        static_cast<int>(this->blob_bottom_label_->cpu_data()[n]);
+    loss += log(sum) - score[label];
+  }
+  EXPECT_NEAR(loss / num, this->blob_top_loss_->cpu_data()[0], 1e-4);
+}
+
+TYPED_TEST(SampledSoftmaxLossLayerTest, TestGradient) {
+  typedef typename TypeParam::Dtype Dtype;
+  SampledSoftmaxLossLayer<Dtype> layer(this->MakeParam());
+  // The checker reseeds before every Forward, so each pass draws the same
+  // samples and the sampled loss is a fixed function to differentiate.
+  GradientChecker<Dtype> checker(1e-2, 1e-2, 1701);
+  checker.CheckGradientExhaustive(&layer, &(this->blob_bottom_vec_),
+      &(this->blob_top_vec_), 0);
+}
+
+TYPED_TEST(SampledSoftmaxLossLayerTest, TestSparseRows) {
+  typedef typename TypeParam::Dtype Dtype;
+  SampledSoftmaxLossLayer<Dtype> layer(this->MakeParam());
+  layer.SetUp(this->blob_bottom_vec_, &(this->blob_top_vec_));
+  layer.Forward(this->blob_bottom_vec_, &(this->blob_top_vec_));
+  EXPECT_TRUE(layer.sparse_param_rows(0) == NULL);
+  // Mark the diffs, which the rows Backward skips keep.
+  caffe_set(layer.blobs()[0]->count(), Dtype(7),
+      layer.blobs()[0]->mutable_cpu_diff());
+  vector<bool> propagate_down(2, false);
+  propagate_down[0] = true;
+  layer.Backward(this->blob_top_vec_, propagate_down,
+      &(this->blob_bottom_vec_));
+  const vector<int>* rows = layer.sparse_param_rows(0);
+  ASSERT_TRUE(rows != NULL);
+  ASSERT_TRUE(layer.sparse_param_rows(1) != NULL);
+  // Every label is a row, and the rows are sorted and distinct.
+  for (int n = 0; n < this->blob_bottom_label_->count(); ++n) {
+    const int label =
+        static_cast<int>(this->blob_bottom_label_->cpu_data()[n]);
+    EXPECT_TRUE(std::binary_search(rows->begin(), rows->end(), label));
+  }
+  for (int i = 1; i < rows->size(); ++i) {
+    EXPECT_LT((*rows)[i - 1], (*rows)[i]);
+  }
+  const int dim = layer.blobs()[0]->count() / this->num_output_;
+  layer.DensifyParamDiff(0);
+  EXPECT_TRUE(layer.sparse_param_rows(0) == NULL);
+  for (int k = 0; k < this->num_output_; ++k) {
+    const bool listed = std::binary_search(rows->begin(), rows->end(), k);
+    for (int d = 0; d < dim; ++d) {
+      const Dtype diff = layer.blobs()[0]->cpu_diff()[k * dim + d];
+      if (!listed) {
+        EXPECT_EQ(0, diff);
+      } else {
+        EXPECT_NE(7, diff);
+      }
+    }
+  }
+}
+
+TYPED_TEST(SampledSoftmaxLossLayerTest, TestProposals) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param = this->MakeParam();
+  SampledSoftmaxParameter* param =
+      layer_param.mutable_sampled_softmax_param();
+  {
+    SampledSoftmaxLossLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, &(this->blob_top_vec_));
+    double sum = 0;
+    for (int k = 0; k < this->num_output_; ++k) {
+      // The sampler inverts the CDF.
+      EXPECT_EQ(k,
+          layer.ProposalClass(sum + layer.ProposalProbability(k) / 2));
+      sum += layer.ProposalProbability(k);
+    }
+    EXPECT_NEAR(1, sum, 1e-9);
+    EXPECT_GT(layer.ProposalProbability(0), layer.ProposalProbability(1));
+  }
+  string filename;
+  MakeTempFilename(&filename);
+  std::ofstream outfile(filename.c_str());
+  for (int k = 0; k < this->num_output_; ++k) {
+    outfile << (k % 2) * 4 << std::endl;
+  }
+  outfile.close();
+  param->set_proposal(SampledSoftmaxParameter_Proposal_UNIGRAM);
+  param->set_proposal_file(filename);
+  param->set_distortion(0.5);
+  SampledSoftmaxLossLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, &(this->blob_top_vec_));
+  for (int k = 0; k < this->num_output_; ++k) {
+    EXPECT_NEAR((k % 2) * 2. / this->num_output_,
+        layer.ProposalProbability(k), 1e-9);
+  }
+  EXPECT_EQ(1, layer.ProposalClass(0));
+  EXPECT_EQ(3, layer.ProposalClass(0.15));
+  remove(filename.c_str());
+}
+
+}  // namespace caffe
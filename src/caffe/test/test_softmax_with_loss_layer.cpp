@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <cfloat>
 #include <cmath>
 #include <cstdlib>
 #include <cstring>
@@ -51,6 +53,54 @@ class SoftmaxWithLossLayerTest : public MultiDeviceTest<TypeParam> {
 TYPED_TEST_CASE(SoftmaxWithLossLayerTest, TestDtypesAndDevices);
 
 
+TYPED_TEST(SoftmaxWithLossLayerTest, TestForwardAndProb) {
+  typedef typename TypeParam::Dtype Dtype;
+  Blob<Dtype> prob;
+  this->blob_top_vec_.push_back(&prob);
+  // Spatial positions, and one logit vector per image.
+  for (int shape = 0; shape < 2; ++shape) {
+    if (shape == 1) {
+      this->blob_bottom_data_->Reshape(10, 5, 1, 1);
+      this->blob_bottom_label_->Reshape(10, 1, 1, 1);
+      FillerParameter filler_param;
+      filler_param.set_std(10);
+      GaussianFiller<Dtype> filler(filler_param);
+      filler.Fill(this->blob_bottom_data_);
+      for (int i = 0; i < this->blob_bottom_label_->count(); ++i) {
+        this->blob_bottom_label_->mutable_cpu_data()[i] = caffe_rng_rand() % 5;
+      }
+    }
+    LayerParameter layer_param;
+    layer_param.add_loss_weight(1);
+    layer_param.add_loss_weight(0);
+    SoftmaxWithLossLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, &(this->blob_top_vec_));
+    layer.Forward(this->blob_bottom_vec_, &(this->blob_top_vec_));
+    const Blob<Dtype>& data = *this->blob_bottom_data_;
+    double loss = 0;
+    for (int n = 0; n < data.num(); ++n) {
+      for (int h = 0; h < data.height(); ++h) {
+        for (int w = 0; w < data.width(); ++w) {
+          double sum = 0;
+          for (int c = 0; c < data.channels(); ++c) {
+            sum += exp(static_cast<double>(data.data_at(n, c, h, w)));
+          }
+          for (int c = 0; c < data.channels(); ++c) {
+            EXPECT_NEAR(exp(data.data_at(n, c, h, w)) / sum,
+                prob.data_at(n, c, h, w), 1e-5);
+          }
+          const int label = static_cast<int>(
+              this->blob_bottom_label_->data_at(n, 0, h, w));
+          loss -= std::max(log(exp(data.data_at(n, label, h, w)) / sum),
+              log(static_cast<double>(FLT_MIN)));
+        }
+      }
+    }
+    loss /= data.num() * data.height() * data.width();
+    EXPECT_NEAR(loss, this->blob_top_loss_->cpu_data()[0], 1e-4 * loss);
+  }
+}
+
 TYPED_TEST(SoftmaxWithLossLayerTest, TestGradient) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter layer_param;
@@ -68,6 +68,21 @@ TEST_F(SyncedMemoryTest, TestCPUWrite) {
   }
 }
 
+TEST_F(SyncedMemoryTest, TestVersion) {
+  SyncedMemory mem(10);
+  const unsigned int initial = mem.version();
+  mem.cpu_data();
+  EXPECT_EQ(initial, mem.version());
+  mem.mutable_cpu_data();
+  EXPECT_NE(initial, mem.version());
+  const unsigned int written = mem.version();
+  mem.cpu_data();
+  EXPECT_EQ(written, mem.version());
+  char data[10];
+  mem.set_cpu_data(data);
+  EXPECT_NE(written, mem.version());
+}
+
 #ifndef CPU_ONLY  // GPU test
 
 TEST_F(SyncedMemoryTest, TestGPURead) {
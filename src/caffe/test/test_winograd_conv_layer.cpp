@@ -0,0 +1,245 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/vision_layers.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+#include "caffe/test/test_gradient_check_util.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class WinogradConvolutionLayerTest : public ::testing::Test {
+ protected:
+  WinogradConvolutionLayerTest()
+      : blob_bottom_(new Blob<Dtype>(2, 4, 9, 7)),
+        blob_top_(new Blob<Dtype>()),
+        blob_top_ref_(new Blob<Dtype>()) {}
+  virtual void SetUp() {
+    Caffe::set_mode(Caffe::CPU);
+    Caffe::set_random_seed(1701);
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_);
+    blob_bottom_vec_.push_back(blob_bottom_);
+    blob_top_vec_.push_back(blob_top_);
+    blob_top_ref_vec_.push_back(blob_top_ref_);
+  }
+  virtual ~WinogradConvolutionLayerTest() {
+    delete blob_bottom_;
+    delete blob_top_;
+    delete blob_top_ref_;
+  }
+
+  // Runs the WINOGRAD engine and the im2col ConvolutionLayer with the same
+  // weights and expects the same output.
+  void CheckAgainstIm2col(const LayerParameter& layer_param) {
+    WinogradConvolutionLayer<Dtype> layer(layer_param);
+    layer.SetUp(blob_bottom_vec_, &blob_top_vec_);
+    ConvolutionLayer<Dtype> ref_layer(layer_param);
+    ref_layer.blobs().resize(layer.blobs().size());
+    for (int i = 0; i < layer.blobs().size(); ++i) {
+      ref_layer.blobs()[i].reset(new Blob<Dtype>());
+      ref_layer.blobs()[i]->CopyFrom(*layer.blobs()[i], false, true);
+    }
+    ref_layer.SetUp(blob_bottom_vec_, &blob_top_ref_vec_);
+    layer.Forward(blob_bottom_vec_, &blob_top_vec_);
+    ref_layer.Forward(blob_bottom_vec_, &blob_top_ref_vec_);
+    CheckTopsEqual();
+  }
+
+  // The error is relative to the larger of |expected| and scale.
+  void CheckTopsEqual(const Dtype tolerance = 1e-4, const Dtype scale = 1) {
+    ASSERT_EQ(blob_top_->count(), blob_top_ref_->count());
+    for (int i = 0; i < blob_top_->count(); ++i) {
+      const Dtype expected = blob_top_ref_->cpu_data()[i];
+      EXPECT_NEAR(blob_top_->cpu_data()[i], expected,
+          tolerance * std::max(scale, std::fabs(expected)));
+    }
+  }
+
+  Blob<Dtype>* const blob_bottom_;
+  Blob<Dtype>* const blob_top_;
+  Blob<Dtype>* const blob_top_ref_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+  vector<Blob<Dtype>*> blob_top_ref_vec_;
+};
+
+TYPED_TEST_CASE(WinogradConvolutionLayerTest, TestDtypes);
+
+TYPED_TEST(WinogradConvolutionLayerTest, TestForwardF2x2) {
+  for (int pad = 0; pad <= 1; ++pad) {
+    LayerParameter layer_param;
+    ConvolutionParameter* convolution_param =
+        layer_param.mutable_convolution_param();
+    convolution_param->set_kernel_size(3);
+    convolution_param->set_pad(pad);
+    convolution_param->set_num_output(5);
+    convolution_param->set_winograd_tile(2);
+    convolution_param->mutable_weight_filler()->set_type("gaussian");
+    convolution_param->mutable_bias_filler()->set_type("gaussian");
+    this->CheckAgainstIm2col(layer_param);
+  }
+}
+
+TYPED_TEST(WinogradConvolutionLayerTest, TestForwardF4x4) {
+  for (int pad = 0; pad <= 1; ++pad) {
+    LayerParameter layer_param;
+    ConvolutionParameter* convolution_param =
+        layer_param.mutable_convolution_param();
+    convolution_param->set_kernel_size(3);
+    convolution_param->set_pad(pad);
+    convolution_param->set_num_output(5);
+    convolution_param->set_winograd_tile(4);
+    convolution_param->mutable_weight_filler()->set_type("gaussian");
+    convolution_param->mutable_bias_filler()->set_type("gaussian");
+    this->CheckAgainstIm2col(layer_param);
+  }
+}
+
+TYPED_TEST(WinogradConvolutionLayerTest, TestForwardGroup) {
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->set_kernel_size(3);
+  convolution_param->set_pad(1);
+  convolution_param->set_num_output(6);
+  convolution_param->set_group(2);
+  convolution_param->set_bias_term(false);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  this->CheckAgainstIm2col(layer_param);
+}
+
+TYPED_TEST(WinogradConvolutionLayerTest, TestFallback) {
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->set_kernel_size(3);
+  convolution_param->set_stride(2);
+  convolution_param->set_num_output(5);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  this->CheckAgainstIm2col(layer_param);
+}
+
+TYPED_TEST(WinogradConvolutionLayerTest, TestWeightUpdate) {
+  // Changing the weights between passes must refresh the cached transform.
+  typedef TypeParam Dtype;
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->set_kernel_size(3);
+  convolution_param->set_pad(1);
+  convolution_param->set_num_output(5);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  WinogradConvolutionLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, &(this->blob_top_vec_));
+  layer.Forward(this->blob_bottom_vec_, &(this->blob_top_vec_));
+  caffe_scal(layer.blobs()[0]->count(), Dtype(-2),
+      layer.blobs()[0]->mutable_cpu_data());
+  layer.Forward(this->blob_bottom_vec_, &(this->blob_top_vec_));
+  ConvolutionLayer<Dtype> ref_layer(layer_param);
+  ref_layer.blobs() = layer.blobs();
+  ref_layer.SetUp(this->blob_bottom_vec_, &(this->blob_top_ref_vec_));
+  ref_layer.Forward(this->blob_bottom_vec_, &(this->blob_top_ref_vec_));
+  this->CheckTopsEqual();
+}
+
+TYPED_TEST(WinogradConvolutionLayerTest, TestFactory) {
+  typedef TypeParam Dtype;
+  LayerParameter layer_param;
+  layer_param.set_type(LayerParameter_LayerType_CONVOLUTION);
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->set_kernel_size(3);
+  convolution_param->set_num_output(5);
+  convolution_param->set_engine(ConvolutionParameter_Engine_WINOGRAD);
+  shared_ptr<Layer<Dtype> > layer(GetLayer<Dtype>(layer_param));
+  EXPECT_TRUE(dynamic_cast<WinogradConvolutionLayer<Dtype>*>(layer.get()));
+}
+
+TYPED_TEST(WinogradConvolutionLayerTest, TestGradient) {
+  typedef TypeParam Dtype;
+  this->blob_bottom_->Reshape(2, 3, 6, 4);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->set_kernel_size(3);
+  convolution_param->set_pad(1);
+  convolution_param->set_num_output(2);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  WinogradConvolutionLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, &(this->blob_bottom_vec_),
+      &(this->blob_top_vec_));
+}
+
+TYPED_TEST(WinogradConvolutionLayerTest, TestSpeedVsIm2col) {
+  typedef TypeParam Dtype;
+  // (channels, size, num_output) of representative 3x3 pad 1 layers.
+  const int kShapes[][3] = {
+    {64, 56, 64}, {128, 28, 128}, {256, 14, 256}, {512, 7, 512}
+  };
+  const int kNumShapes = sizeof(kShapes) / sizeof(kShapes[0]);
+  const int kIters = 2;
+  for (int s = 0; s < kNumShapes; ++s) {
+    const int* shape = kShapes[s];
+    Blob<Dtype> bottom(1, shape[0], shape[1], shape[1]);
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(&bottom);
+    vector<Blob<Dtype>*> bottom_vec(1, &bottom);
+    LayerParameter layer_param;
+    ConvolutionParameter* convolution_param =
+        layer_param.mutable_convolution_param();
+    convolution_param->set_kernel_size(3);
+    convolution_param->set_pad(1);
+    convolution_param->set_num_output(shape[2]);
+    convolution_param->mutable_weight_filler()->set_type("gaussian");
+    convolution_param->mutable_bias_filler()->set_type("gaussian");
+    ConvolutionLayer<Dtype> im2col_layer(layer_param);
+    im2col_layer.SetUp(bottom_vec, &(this->blob_top_ref_vec_));
+    WinogradConvolutionLayer<Dtype> layer(layer_param);
+    layer.blobs() = im2col_layer.blobs();
+    layer.SetUp(bottom_vec, &(this->blob_top_vec_));
+    // Warm up, which also transforms the weights once.
+    layer.Forward(bottom_vec, &(this->blob_top_vec_));
+    Timer timer;
+    timer.Start();
+    for (int i = 0; i < kIters; ++i) {
+      im2col_layer.Forward(bottom_vec, &(this->blob_top_ref_vec_));
+    }
+    const float im2col_ms = timer.MilliSeconds() / kIters;
+    timer.Start();
+    for (int i = 0; i < kIters; ++i) {
+      layer.Forward(bottom_vec, &(this->blob_top_vec_));
+    }
+    const float winograd_ms = timer.MilliSeconds() / kIters;
+    LOG(INFO) << "3x3 conv C=" << shape[0] << " HW=" << shape[1]
+        << " K=" << shape[2] << ": im2col " << im2col_ms << " ms, winograd "
+        << winograd_ms << " ms";
+    // F(4x4,3x3) loses about three digits over these long reductions in
+    // single precision. The rounding error follows the size of the summed
+    // terms, which the RMS output measures, so small outputs are compared
+    // on that scale.
+    const Blob<Dtype>& ref = *this->blob_top_ref_;
+    const Dtype rms = std::sqrt(caffe_cpu_dot(ref.count(), ref.cpu_data(),
+        ref.cpu_data()) / ref.count());
+    this->CheckTopsEqual(1e-3, rms);
+  }
+}
+
+}  // namespace caffe
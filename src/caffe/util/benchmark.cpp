@@ -71,7 +71,9 @@ float Timer::MilliSeconds() {
       NO_GPU;
 #endif
   } else {
-    elapsed_milliseconds_ = (stop_cpu_ - start_cpu_).total_milliseconds();
+    // Microsecond resolution; sub-millisecond layers would all read 0.
+    elapsed_milliseconds_ =
+        (stop_cpu_ - start_cpu_).total_microseconds() / 1000.f;
   }
   return elapsed_milliseconds_;
 }
@@ -0,0 +1,469 @@
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/blas.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+using boost::posix_time::microsec_clock;
+using boost::posix_time::ptime;
+
+// The CBLAS library mkl_alternate.hpp includes.
+#if defined(USE_MKL)
+static const char kCblasLibrary[] = "mkl";
+#elif defined(USE_ATLAS)
+static const char kCblasLibrary[] = "atlas";
+#else
+static const char kCblasLibrary[] = "openblas";
+#endif
+
+// Cache blocking of the builtin GEMM: a kGemmBlockK x kGemmBlockN block of B
+// is packed once and shared by all threads, which each pack kGemmBlockM rows
+// of A at a time. kGemmTile x kGemmTile is the register block.
+const int kGemmBlockM = 64;
+const int kGemmBlockN = 256;
+const int kGemmBlockK = 256;
+const int kGemmTile = 4;
+// The builtin GEMM goes parallel above this many multiply-adds.
+const int64_t kParallelGemmVolume = 1 << 18;
+
+static BlasBackend& current_blas_backend() {
+  static BlasBackend backend = getenv("CAFFE_BLAS") ?
+      caffe_blas_backend_from_name(getenv("CAFFE_BLAS")) : BLAS_CBLAS;
+  return backend;
+}
+
+static bool blas_profiling_ = false;
+static BlasStats blas_stats_[BLAS_NUM_ROUTINES];
+
+void caffe_set_blas_backend(const BlasBackend backend) {
+  current_blas_backend() = backend;
+}
+
+BlasBackend caffe_blas_backend() {
+  return current_blas_backend();
+}
+
+BlasBackend caffe_blas_backend_from_name(const std::string& name) {
+  if (name == "builtin") {
+    return BLAS_BUILTIN;
+  }
+  CHECK(name == "cblas" || name == kCblasLibrary) << "Unknown BLAS backend '"
+      << name << "'; this build has cblas (" << kCblasLibrary
+      << ") and builtin.";
+  return BLAS_CBLAS;
+}
+
+const char* caffe_blas_backend_name(const BlasBackend backend) {
+  return backend == BLAS_BUILTIN ? "builtin" : kCblasLibrary;
+}
+
+void caffe_blas_set_profiling(const bool profiling) {
+  blas_profiling_ = profiling;
+}
+
+bool caffe_blas_profiling() {
+  return blas_profiling_;
+}
+
+BlasStats caffe_blas_stats(const BlasRoutine routine) {
+  CHECK_LT(routine, BLAS_NUM_ROUTINES);
+  return blas_stats_[routine];
+}
+
+void caffe_blas_reset_stats() {
+  for (int i = 0; i < BLAS_NUM_ROUTINES; ++i) {
+    blas_stats_[i].calls = 0;
+    blas_stats_[i].flops = 0;
+    blas_stats_[i].seconds = 0;
+  }
+}
+
+void caffe_blas_log_stats() {
+  static const char* const names[BLAS_NUM_ROUTINES] = {
+    "gemm", "gemm as gemv", "small gemm", "gemv"
+  };
+  LOG(INFO) << "BLAS backend: "
+      << caffe_blas_backend_name(caffe_blas_backend());
+  for (int i = 0; i < BLAS_NUM_ROUTINES; ++i) {
+    const BlasStats& stats = blas_stats_[i];
+    LOG(INFO) << names[i] << ": " << stats.calls << " calls, "
+        << stats.seconds * 1000 << " ms, "
+        << (stats.seconds > 0 ? stats.flops / stats.seconds / 1e9 : 0)
+        << " GFlop/s";
+  }
+}
+
+static void record_blas_call(const BlasRoutine routine, const double flops,
+    const ptime& start) {
+  const double seconds =
+      (microsec_clock::local_time() - start).total_microseconds() / 1e6;
+#pragma omp critical(caffe_blas_stats)
+  {
+    blas_stats_[routine].calls++;
+    blas_stats_[routine].flops += flops;
+    blas_stats_[routine].seconds += seconds;
+  }
+}
+
+// Stores one row segment c = alpha * acc + beta * c. With beta 0, c is
+// overwritten whatever it held, as BLAS specifies.
+template <typename Dtype>
+static inline void gemm_store(const int n, const Dtype* acc,
+    const Dtype alpha, const Dtype beta, Dtype* c) {
+  if (beta == Dtype(0)) {
+    for (int j = 0; j < n; ++j) {
+      c[j] = alpha * acc[j];
+    }
+  } else {
+    for (int j = 0; j < n; ++j) {
+      c[j] = alpha * acc[j] + beta * c[j];
+    }
+  }
+}
+
+template <typename Dtype>
+void caffe_cpu_gemm_small(const CBLAS_TRANSPOSE TransA,
+    const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
+    const Dtype alpha, const Dtype* A, const Dtype* B, const Dtype beta,
+    Dtype* C) {
+  // Element strides of op(A) (M x K) and op(B) (K x N).
+  const int a_rs = TransA == CblasNoTrans ? K : 1;
+  const int a_ks = TransA == CblasNoTrans ? 1 : M;
+  const int b_ks = TransB == CblasNoTrans ? N : 1;
+  const int b_cs = TransB == CblasNoTrans ? 1 : K;
+  for (int i0 = 0; i0 < M; i0 += kGemmTile) {
+    const int rows = std::min(kGemmTile, M - i0);
+    for (int j0 = 0; j0 < N; j0 += kGemmTile) {
+      const int cols = std::min(kGemmTile, N - j0);
+      Dtype acc[kGemmTile * kGemmTile] = { 0 };
+      if (rows == kGemmTile && cols == kGemmTile && b_cs == 1) {
+        // Full tile over contiguous rows of B: the inner loop vectorizes.
+        for (int k = 0; k < K; ++k) {
+          const Dtype* a = A + i0 * a_rs + k * a_ks;
+          const Dtype* b = B + k * b_ks + j0;
+          for (int r = 0; r < kGemmTile; ++r) {
+            const Dtype a_r = a[r * a_rs];
+            for (int c = 0; c < kGemmTile; ++c) {
+              acc[r * kGemmTile + c] += a_r * b[c];
+            }
+          }
+        }
+      } else if (rows == kGemmTile && cols == kGemmTile) {
+        for (int k = 0; k < K; ++k) {
+          const Dtype* a = A + i0 * a_rs + k * a_ks;
+          const Dtype* b = B + k * b_ks + j0 * b_cs;
+          for (int r = 0; r < kGemmTile; ++r) {
+            const Dtype a_r = a[r * a_rs];
+            for (int c = 0; c < kGemmTile; ++c) {
+              acc[r * kGemmTile + c] += a_r * b[c * b_cs];
+            }
+          }
+        }
+      } else {
+        for (int k = 0; k < K; ++k) {
+          const Dtype* a = A + i0 * a_rs + k * a_ks;
+          const Dtype* b = B + k * b_ks + j0 * b_cs;
+          for (int r = 0; r < rows; ++r) {
+            const Dtype a_r = a[r * a_rs];
+            for (int c = 0; c < cols; ++c) {
+              acc[r * kGemmTile + c] += a_r * b[c * b_cs];
+            }
+          }
+        }
+      }
+      for (int r = 0; r < rows; ++r) {
+        gemm_store(cols, acc + r * kGemmTile, alpha, beta,
+            C + (i0 + r) * N + j0);
+      }
+    }
+  }
+}
+
+template void caffe_cpu_gemm_small<float>(const CBLAS_TRANSPOSE TransA,
+    const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
+    const float alpha, const float* A, const float* B, const float beta,
+    float* C);
+template void caffe_cpu_gemm_small<double>(const CBLAS_TRANSPOSE TransA,
+    const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
+    const double alpha, const double* A, const double* B, const double beta,
+    double* C);
+
+// Packs rows [i0, i0 + m) x columns [k0, k0 + kc) of op(A) as kGemmTile-row
+// panels stored k-major, zero-padding the last panel.
+template <typename Dtype>
+static void gemm_pack_a(const Dtype* A, const int a_rs, const int a_ks,
+    const int i0, const int m, const int k0, const int kc, Dtype* packed) {
+  for (int p = 0; p < m; p += kGemmTile) {
+    for (int k = 0; k < kc; ++k) {
+      for (int r = 0; r < kGemmTile; ++r) {
+        *packed++ = p + r < m ?
+            A[(i0 + p + r) * a_rs + (k0 + k) * a_ks] : Dtype(0);
+      }
+    }
+  }
+}
+
+// Packs rows [k0, k0 + kc) x columns [j0, j0 + n) of op(B) as
+// kGemmTile-column panels stored k-major, zero-padding the last panel.
+template <typename Dtype>
+static void gemm_pack_b(const Dtype* B, const int b_ks, const int b_cs,
+    const int k0, const int kc, const int j0, const int n, Dtype* packed) {
+  for (int q = 0; q < n; q += kGemmTile) {
+    for (int k = 0; k < kc; ++k) {
+      for (int c = 0; c < kGemmTile; ++c) {
+        *packed++ = q + c < n ?
+            B[(k0 + k) * b_ks + (j0 + q + c) * b_cs] : Dtype(0);
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+static inline void gemm_micro_kernel(const int kc, const Dtype* a,
+    const Dtype* b, Dtype* acc) {
+  for (int k = 0; k < kc; ++k) {
+    for (int r = 0; r < kGemmTile; ++r) {
+      for (int c = 0; c < kGemmTile; ++c) {
+        acc[r * kGemmTile + c] += a[r] * b[c];
+      }
+    }
+    a += kGemmTile;
+    b += kGemmTile;
+  }
+}
+
+template <typename Dtype>
+void caffe_cpu_gemm_builtin(const CBLAS_TRANSPOSE TransA,
+    const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
+    const Dtype alpha, const Dtype* A, const Dtype* B, const Dtype beta,
+    Dtype* C) {
+  if (K == 0) {
+    for (int i = 0; i < M * N; ++i) {
+      C[i] = beta == Dtype(0) ? Dtype(0) : beta * C[i];
+    }
+    return;
+  }
+  const int a_rs = TransA == CblasNoTrans ? K : 1;
+  const int a_ks = TransA == CblasNoTrans ? 1 : M;
+  const int b_ks = TransB == CblasNoTrans ? N : 1;
+  const int b_cs = TransB == CblasNoTrans ? 1 : K;
+  const bool parallel =
+      static_cast<int64_t>(M) * N * K >= kParallelGemmVolume;
+  const int n_padded = (std::min(N, kGemmBlockN) + kGemmTile - 1)
+      / kGemmTile * kGemmTile;
+  vector<Dtype> packed_b(std::min(K, kGemmBlockK) * n_padded);
+  for (int j0 = 0; j0 < N; j0 += kGemmBlockN) {
+    const int n = std::min(kGemmBlockN, N - j0);
+    for (int k0 = 0; k0 < K; k0 += kGemmBlockK) {
+      const int kc = std::min(kGemmBlockK, K - k0);
+      // The first K block applies beta; later ones accumulate onto it.
+      const Dtype block_beta = k0 == 0 ? beta : Dtype(1);
+      gemm_pack_b(B, b_ks, b_cs, k0, kc, j0, n, &packed_b[0]);
+#pragma omp parallel if (parallel)
+      {
+        vector<Dtype> packed_a(kGemmBlockM * kc);
+#pragma omp for schedule(static)
+        for (int i0 = 0; i0 < M; i0 += kGemmBlockM) {
+          const int m = std::min(kGemmBlockM, M - i0);
+          gemm_pack_a(A, a_rs, a_ks, i0, m, k0, kc, &packed_a[0]);
+          for (int p = 0; p < m; p += kGemmTile) {
+            const int rows = std::min(kGemmTile, m - p);
+            for (int q = 0; q < n; q += kGemmTile) {
+              Dtype acc[kGemmTile * kGemmTile] = { 0 };
+              gemm_micro_kernel(kc, &packed_a[p * kc], &packed_b[q * kc],
+                  acc);
+              for (int r = 0; r < rows; ++r) {
+                gemm_store(std::min(kGemmTile, n - q), acc + r * kGemmTile,
+                    alpha, block_beta, C + (i0 + p + r) * N + j0 + q);
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+template void caffe_cpu_gemm_builtin<float>(const CBLAS_TRANSPOSE TransA,
+    const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
+    const float alpha, const float* A, const float* B, const float beta,
+    float* C);
+template void caffe_cpu_gemm_builtin<double>(const CBLAS_TRANSPOSE TransA,
+    const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
+    const double alpha, const double* A, const double* B, const double beta,
+    double* C);
+
+template <typename Dtype>
+void caffe_cpu_gemv_builtin(const CBLAS_TRANSPOSE TransA, const int M,
+    const int N, const Dtype alpha, const Dtype* A, const Dtype* x,
+    const Dtype beta, Dtype* y) {
+  if (TransA == CblasNoTrans) {
+#pragma omp parallel for schedule(static) if (M * N >= 16384)
+    for (int i = 0; i < M; ++i) {
+      const Dtype* row = A + i * N;
+      Dtype sum = 0;
+      for (int j = 0; j < N; ++j) {
+        sum += row[j] * x[j];
+      }
+      gemm_store(1, &sum, alpha, beta, y + i);
+    }
+    return;
+  }
+  // y = alpha * A^T x + beta * y accumulates scaled rows of A; threads own
+  // disjoint column blocks of y.
+  const int kColumnBlock = 256;
+#pragma omp parallel for schedule(static) if (M * N >= 16384)
+  for (int j0 = 0; j0 < N; j0 += kColumnBlock) {
+    const int n = std::min(kColumnBlock, N - j0);
+    Dtype sum[kColumnBlock] = { 0 };
+    for (int i = 0; i < M; ++i) {
+      const Dtype x_i = x[i];
+      const Dtype* row = A + i * N + j0;
+      for (int j = 0; j < n; ++j) {
+        sum[j] += x_i * row[j];
+      }
+    }
+    gemm_store(n, sum, alpha, beta, y + j0);
+  }
+}
+
+template void caffe_cpu_gemv_builtin<float>(const CBLAS_TRANSPOSE TransA,
+    const int M, const int N, const float alpha, const float* A,
+    const float* x, const float beta, float* y);
+template void caffe_cpu_gemv_builtin<double>(const CBLAS_TRANSPOSE TransA,
+    const int M, const int N, const double alpha, const double* A,
+    const double* x, const double beta, double* y);
+
+// The selected backend's GEMM and GEMV, with the caffe_cpu_* interfaces.
+static void backend_gemm(const CBLAS_TRANSPOSE TransA,
+    const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
+    const float alpha, const float* A, const float* B, const float beta,
+    float* C) {
+  if (caffe_blas_backend() == BLAS_BUILTIN) {
+    caffe_cpu_gemm_builtin(TransA, TransB, M, N, K, alpha, A, B, beta, C);
+    return;
+  }
+  int lda = (TransA == CblasNoTrans) ? K : M;
+  int ldb = (TransB == CblasNoTrans) ? N : K;
+  cblas_sgemm(CblasRowMajor, TransA, TransB, M, N, K, alpha, A, lda, B,
+      ldb, beta, C, N);
+}
+
+static void backend_gemm(const CBLAS_TRANSPOSE TransA,
+    const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
+    const double alpha, const double* A, const double* B, const double beta,
+    double* C) {
+  if (caffe_blas_backend() == BLAS_BUILTIN) {
+    caffe_cpu_gemm_builtin(TransA, TransB, M, N, K, alpha, A, B, beta, C);
+    return;
+  }
+  int lda = (TransA == CblasNoTrans) ? K : M;
+  int ldb = (TransB == CblasNoTrans) ? N : K;
+  cblas_dgemm(CblasRowMajor, TransA, TransB, M, N, K, alpha, A, lda, B,
+      ldb, beta, C, N);
+}
+
+static void backend_gemv(const CBLAS_TRANSPOSE TransA, const int M,
+    const int N, const float alpha, const float* A, const float* x,
+    const float beta, float* y) {
+  if (caffe_blas_backend() == BLAS_BUILTIN) {
+    caffe_cpu_gemv_builtin(TransA, M, N, alpha, A, x, beta, y);
+    return;
+  }
+  cblas_sgemv(CblasRowMajor, TransA, M, N, alpha, A, N, x, 1, beta, y, 1);
+}
+
+static void backend_gemv(const CBLAS_TRANSPOSE TransA, const int M,
+    const int N, const double alpha, const double* A, const double* x,
+    const double beta, double* y) {
+  if (caffe_blas_backend() == BLAS_BUILTIN) {
+    caffe_cpu_gemv_builtin(TransA, M, N, alpha, A, x, beta, y);
+    return;
+  }
+  cblas_dgemv(CblasRowMajor, TransA, M, N, alpha, A, N, x, 1, beta, y, 1);
+}
+
+// Routes a GEMM by shape and returns the counter it belongs to.
+template <typename Dtype>
+static BlasRoutine gemm_dispatch(const CBLAS_TRANSPOSE TransA,
+    const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
+    const Dtype alpha, const Dtype* A, const Dtype* B, const Dtype beta,
+    Dtype* C) {
+  if (N == 1) {
+    // C is a column: op(A) times the vector B.
+    if (TransA == CblasNoTrans) {
+      backend_gemv(CblasNoTrans, M, K, alpha, A, B, beta, C);
+    } else {
+      backend_gemv(CblasTrans, K, M, alpha, A, B, beta, C);
+    }
+    return BLAS_GEMM_AS_GEMV;
+  }
+  if (M == 1) {
+    // C is a row: C^T = op(B)^T times the vector A.
+    if (TransB == CblasNoTrans) {
+      backend_gemv(CblasTrans, K, N, alpha, B, A, beta, C);
+    } else {
+      backend_gemv(CblasNoTrans, N, K, alpha, B, A, beta, C);
+    }
+    return BLAS_GEMM_AS_GEMV;
+  }
+  if (static_cast<int64_t>(M) * N * K <= kSmallGemmVolume) {
+    caffe_cpu_gemm_small(TransA, TransB, M, N, K, alpha, A, B, beta, C);
+    return BLAS_GEMM_SMALL;
+  }
+  backend_gemm(TransA, TransB, M, N, K, alpha, A, B, beta, C);
+  return BLAS_GEMM;
+}
+
+template <typename Dtype>
+void caffe_cpu_gemm(const CBLAS_TRANSPOSE TransA,
+    const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
+    const Dtype alpha, const Dtype* A, const Dtype* B, const Dtype beta,
+    Dtype* C) {
+  if (!blas_profiling_) {
+    gemm_dispatch(TransA, TransB, M, N, K, alpha, A, B, beta, C);
+    return;
+  }
+  const ptime start = microsec_clock::local_time();
+  const BlasRoutine routine =
+      gemm_dispatch(TransA, TransB, M, N, K, alpha, A, B, beta, C);
+  record_blas_call(routine, 2. * M * N * K, start);
+}
+
+template void caffe_cpu_gemm<float>(const CBLAS_TRANSPOSE TransA,
+    const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
+    const float alpha, const float* A, const float* B, const float beta,
+    float* C);
+template void caffe_cpu_gemm<double>(const CBLAS_TRANSPOSE TransA,
+    const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
+    const double alpha, const double* A, const double* B, const double beta,
+    double* C);
+
+template <typename Dtype>
+void caffe_cpu_gemv(const CBLAS_TRANSPOSE TransA, const int M, const int N,
+    const Dtype alpha, const Dtype* A, const Dtype* x, const Dtype beta,
+    Dtype* y) {
+  if (!blas_profiling_) {
+    backend_gemv(TransA, M, N, alpha, A, x, beta, y);
+    return;
+  }
+  const ptime start = microsec_clock::local_time();
+  backend_gemv(TransA, M, N, alpha, A, x, beta, y);
+  record_blas_call(BLAS_GEMV, 2. * M * N, start);
+}
+
+template void caffe_cpu_gemv<float>(const CBLAS_TRANSPOSE TransA,
+    const int M, const int N, const float alpha, const float* A,
+    const float* x, const float beta, float* y);
+template void caffe_cpu_gemv<double>(const CBLAS_TRANSPOSE TransA,
+    const int M, const int N, const double alpha, const double* A,
+    const double* x, const double beta, double* y);
+
+}  // namespace caffe
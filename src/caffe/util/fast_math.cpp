@@ -0,0 +1,757 @@
+#include <stdint.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+// SSE2 is part of every x86-64 target, and of 32-bit MSVC builds with
+// /arch:SSE2.
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CAFFE_FAST_MATH_SSE2
+#endif
+
+#include "glog/logging.h"
+
+#include "caffe/util/fast_math.hpp"
+
+namespace caffe {
+
+// The polynomials and range reductions are those of the Cephes single
+// precision library. Each function has a scalar form, for tails and non-x86
+// builds, and an SSE2 form four lanes wide with the same steps; compilers do
+// not vectorize the scalar selects on their own under strict IEEE
+// semantics.
+
+static inline int32_t float_bits(const float x) {
+  int32_t bits;
+  memcpy(&bits, &x, sizeof(bits));
+  return bits;
+}
+
+static inline float bits_float(const int32_t bits) {
+  float x;
+  memcpy(&x, &bits, sizeof(x));
+  return x;
+}
+
+// exp(x) = 2^k exp(r) with k the nearest integer to x / ln 2, ties to even
+// as _mm_cvtps_epi32 rounds them, and |r| <= ln 2 / 2. 2^k is applied in two
+// halves, so past the ends of the clamped range the product itself overflows
+// to +inf or underflows through the denormals to 0, and NaN propagates,
+// without a select on the result.
+static inline float exp_element(const float x) {
+  const float clamped = x > 89.f ? 89.f : (x < -104.f ? -104.f : x);
+  const float t = clamped * 1.44269504088896341f;
+  // NaN fails both compares of the clamp; it takes k = 0 rather than an
+  // undefined conversion, and r carries it to the result.
+  double rounded = t == t ? floor(t + 0.5) : 0.;
+  if (rounded - t == 0.5 && fmod(rounded, 2.) != 0) {
+    rounded -= 1;
+  }
+  const int32_t k = static_cast<int32_t>(rounded);
+  const float n = static_cast<float>(k);
+  const float r = clamped - n * 0.693359375f + n * 2.12194440e-4f;
+  float p = 1.9875691500e-4f;
+  p = p * r + 1.3981999507e-3f;
+  p = p * r + 8.3334519073e-3f;
+  p = p * r + 4.1665795894e-2f;
+  p = p * r + 1.6666665459e-1f;
+  p = p * r + 5.0000001201e-1f;
+  const float e = p * r * r + r + 1.f;
+  const int32_t half = k >> 1;
+  return e * bits_float((half + 127) << 23)
+      * bits_float((k - half + 127) << 23);
+}
+
+// log(x) = e ln 2 + log(m) with m in [sqrt(1/2), sqrt(2)); denormals are
+// scaled up first.
+static inline float log_element(const float x) {
+  const bool tiny = x < std::numeric_limits<float>::min();
+  const float scaled = x * (tiny ? 33554432.f : 1.f);
+  const int32_t bits = float_bits(scaled);
+  int32_t exponent = ((bits >> 23) & 0xff) - 126 - (tiny ? 25 : 0);
+  float m = bits_float((bits & 0x807fffff) | 0x3f000000);
+  const bool low = m < 0.707106781186547524f;
+  exponent -= low ? 1 : 0;
+  m = (low ? m + m : m) - 1.f;
+  const float e = static_cast<float>(exponent);
+  const float z = m * m;
+  float p = 7.0376836292e-2f;
+  p = p * m - 1.1514610310e-1f;
+  p = p * m + 1.1676998740e-1f;
+  p = p * m - 1.2420140846e-1f;
+  p = p * m + 1.4249322787e-1f;
+  p = p * m - 1.6668057665e-1f;
+  p = p * m + 2.0000714765e-1f;
+  p = p * m - 2.4999993993e-1f;
+  p = p * m + 3.3333331174e-1f;
+  float y = p * m * z - 2.12194440e-4f * e - 0.5f * z;
+  y = m + y + 0.693359375f * e;
+  const float inf = std::numeric_limits<float>::infinity();
+  const float result = x == inf ? inf : (x == 0 ? -inf : y);
+  return x >= 0 ? result : std::numeric_limits<float>::quiet_NaN();
+}
+
+// Small |x| use tanh's odd polynomial, the rest 1 - 2 / (exp(2|x|) + 1).
+static inline float tanh_element(const float x) {
+  const float a = x < 0 ? -x : x;
+  const float z = x * x;
+  float p = -5.70498872745e-3f;
+  p = p * z + 2.06390887954e-2f;
+  p = p * z - 5.37397155531e-2f;
+  p = p * z + 1.33314422036e-1f;
+  p = p * z - 3.33332819422e-1f;
+  const float small = p * z * x + x;
+  const float large = 1.f - 2.f / (exp_element(a + a) + 1.f);
+  return a < 0.625f ? small : (x < 0 ? -large : large);
+}
+
+static inline float sigmoid_element(const float x) {
+  return 1.f / (1.f + exp_element(-x));
+}
+
+// log(1 + exp(x)) = max(x, 0) + log1p(exp(-|x|)), with log1p(u) as
+// log(w) - ((w - 1) - u) / w for w = 1 + u, which recovers the bits of u
+// that rounding w dropped.
+static inline float log1p_exp_element(const float x) {
+  const float u = exp_element(x < 0 ? x : -x);
+  const float w = 1.f + u;
+  const float log1p_u = log_element(w) - ((w - 1.f) - u) / w;
+  return (x > 0 ? x : 0.f) + log1p_u;
+}
+
+#ifdef CAFFE_FAST_MATH_SSE2
+
+static inline __m128 select_ps(const __m128 mask, const __m128 a,
+    const __m128 b) {
+  return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+// min and max return their second operand when either is NaN, so NaN
+// inputs pass through the clamp.
+static inline __m128 exp_ps(const __m128 x) {
+  const __m128 clamped = _mm_max_ps(_mm_set1_ps(-104.f),
+      _mm_min_ps(_mm_set1_ps(89.f), x));
+  const __m128i k = _mm_cvtps_epi32(
+      _mm_mul_ps(clamped, _mm_set1_ps(1.44269504088896341f)));
+  const __m128 n = _mm_cvtepi32_ps(k);
+  const __m128 r = _mm_add_ps(
+      _mm_sub_ps(clamped, _mm_mul_ps(n, _mm_set1_ps(0.693359375f))),
+      _mm_mul_ps(n, _mm_set1_ps(2.12194440e-4f)));
+  __m128 p = _mm_set1_ps(1.9875691500e-4f);
+  p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(1.3981999507e-3f));
+  p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(8.3334519073e-3f));
+  p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(4.1665795894e-2f));
+  p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(1.6666665459e-1f));
+  p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(5.0000001201e-1f));
+  const __m128 e = _mm_add_ps(_mm_add_ps(
+      _mm_mul_ps(_mm_mul_ps(p, r), r), r), _mm_set1_ps(1.f));
+  const __m128i bias = _mm_set1_epi32(127);
+  const __m128i half = _mm_srai_epi32(k, 1);
+  const __m128 scale_a = _mm_castsi128_ps(
+      _mm_slli_epi32(_mm_add_epi32(half, bias), 23));
+  const __m128 scale_b = _mm_castsi128_ps(
+      _mm_slli_epi32(_mm_add_epi32(_mm_sub_epi32(k, half), bias), 23));
+  return _mm_mul_ps(_mm_mul_ps(e, scale_a), scale_b);
+}
+
+static inline __m128 log_ps(const __m128 x) {
+  const __m128 one = _mm_set1_ps(1.f);
+  const __m128 tiny = _mm_cmplt_ps(x,
+      _mm_set1_ps(std::numeric_limits<float>::min()));
+  const __m128 scaled = _mm_mul_ps(x,
+      select_ps(tiny, _mm_set1_ps(33554432.f), one));
+  const __m128i bits = _mm_castps_si128(scaled);
+  __m128i exponent = _mm_sub_epi32(_mm_and_si128(_mm_srli_epi32(bits, 23),
+      _mm_set1_epi32(0xff)), _mm_set1_epi32(126));
+  exponent = _mm_sub_epi32(exponent,
+      _mm_and_si128(_mm_castps_si128(tiny), _mm_set1_epi32(25)));
+  __m128 m = _mm_castsi128_ps(_mm_or_si128(
+      _mm_and_si128(bits, _mm_set1_epi32(0x807fffff)),
+      _mm_set1_epi32(0x3f000000)));
+  const __m128 low = _mm_cmplt_ps(m, _mm_set1_ps(0.707106781186547524f));
+  exponent = _mm_sub_epi32(exponent,
+      _mm_and_si128(_mm_castps_si128(low), _mm_set1_epi32(1)));
+  m = _mm_sub_ps(_mm_add_ps(m, _mm_and_ps(low, m)), one);
+  const __m128 e = _mm_cvtepi32_ps(exponent);
+  const __m128 z = _mm_mul_ps(m, m);
+  __m128 p = _mm_set1_ps(7.0376836292e-2f);
+  p = _mm_sub_ps(_mm_mul_ps(p, m), _mm_set1_ps(1.1514610310e-1f));
+  p = _mm_add_ps(_mm_mul_ps(p, m), _mm_set1_ps(1.1676998740e-1f));
+  p = _mm_sub_ps(_mm_mul_ps(p, m), _mm_set1_ps(1.2420140846e-1f));
+  p = _mm_add_ps(_mm_mul_ps(p, m), _mm_set1_ps(1.4249322787e-1f));
+  p = _mm_sub_ps(_mm_mul_ps(p, m), _mm_set1_ps(1.6668057665e-1f));
+  p = _mm_add_ps(_mm_mul_ps(p, m), _mm_set1_ps(2.0000714765e-1f));
+  p = _mm_sub_ps(_mm_mul_ps(p, m), _mm_set1_ps(2.4999993993e-1f));
+  p = _mm_add_ps(_mm_mul_ps(p, m), _mm_set1_ps(3.3333331174e-1f));
+  __m128 y = _mm_sub_ps(_mm_sub_ps(_mm_mul_ps(_mm_mul_ps(p, m), z),
+      _mm_mul_ps(e, _mm_set1_ps(2.12194440e-4f))),
+      _mm_mul_ps(z, _mm_set1_ps(0.5f)));
+  y = _mm_add_ps(_mm_add_ps(m, y), _mm_mul_ps(e, _mm_set1_ps(0.693359375f)));
+  const __m128 inf = _mm_set1_ps(std::numeric_limits<float>::infinity());
+  y = select_ps(_mm_cmpeq_ps(x, inf), inf, y);
+  y = select_ps(_mm_cmpeq_ps(x, _mm_setzero_ps()),
+      _mm_sub_ps(_mm_setzero_ps(), inf), y);
+  return select_ps(_mm_cmpge_ps(x, _mm_setzero_ps()), y,
+      _mm_set1_ps(std::numeric_limits<float>::quiet_NaN()));
+}
+
+static inline __m128 tanh_ps(const __m128 x) {
+  const __m128 sign = _mm_set1_ps(-0.f);
+  const __m128 a = _mm_andnot_ps(sign, x);
+  const __m128 z = _mm_mul_ps(x, x);
+  __m128 p = _mm_set1_ps(-5.70498872745e-3f);
+  p = _mm_add_ps(_mm_mul_ps(p, z), _mm_set1_ps(2.06390887954e-2f));
+  p = _mm_sub_ps(_mm_mul_ps(p, z), _mm_set1_ps(5.37397155531e-2f));
+  p = _mm_add_ps(_mm_mul_ps(p, z), _mm_set1_ps(1.33314422036e-1f));
+  p = _mm_sub_ps(_mm_mul_ps(p, z), _mm_set1_ps(3.33332819422e-1f));
+  const __m128 small = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(p, z), x), x);
+  const __m128 one = _mm_set1_ps(1.f);
+  const __m128 large = _mm_sub_ps(one, _mm_div_ps(_mm_set1_ps(2.f),
+      _mm_add_ps(exp_ps(_mm_add_ps(a, a)), one)));
+  return select_ps(_mm_cmplt_ps(a, _mm_set1_ps(0.625f)), small,
+      _mm_or_ps(large, _mm_and_ps(sign, x)));
+}
+
+static inline __m128 sigmoid_ps(const __m128 x) {
+  const __m128 one = _mm_set1_ps(1.f);
+  return _mm_div_ps(one, _mm_add_ps(one,
+      exp_ps(_mm_xor_ps(x, _mm_set1_ps(-0.f)))));
+}
+
+static inline __m128 log1p_exp_ps(const __m128 x) {
+  const __m128 one = _mm_set1_ps(1.f);
+  const __m128 u = exp_ps(_mm_or_ps(x, _mm_set1_ps(-0.f)));
+  const __m128 w = _mm_add_ps(one, u);
+  const __m128 log1p_u = _mm_sub_ps(log_ps(w),
+      _mm_div_ps(_mm_sub_ps(_mm_sub_ps(w, one), u), w));
+  return _mm_add_ps(_mm_max_ps(_mm_setzero_ps(), x), log1p_u);
+}
+
+#define FAST_MATH_KERNEL(name) \
+void fast_##name(const int n, const float* a, float* y) { \
+  int i = 0; \
+  for (; i + 4 <= n; i += 4) { \
+    _mm_storeu_ps(y + i, name##_ps(_mm_loadu_ps(a + i))); \
+  } \
+  for (; i < n; ++i) { \
+    y[i] = name##_element(a[i]); \
+  } \
+}
+
+#else
+
+#define FAST_MATH_KERNEL(name) \
+void fast_##name(const int n, const float* a, float* y) { \
+  for (int i = 0; i < n; ++i) { \
+    y[i] = name##_element(a[i]); \
+  } \
+}
+
+#endif  // CAFFE_FAST_MATH_SSE2
+
+FAST_MATH_KERNEL(exp)
+FAST_MATH_KERNEL(log)
+FAST_MATH_KERNEL(tanh)
+FAST_MATH_KERNEL(sigmoid)
+FAST_MATH_KERNEL(log1p_exp)
+
+static inline unsigned int threshold_word(const int lanes,
+    const unsigned int* words, const int lane_bits,
+    const unsigned int threshold) {
+  const unsigned int lane_mask = (1u << lane_bits) - 1;
+  const int per_word = 32 / lane_bits;
+  unsigned int bits = 0;
+  for (int i = 0; i < lanes; ++i) {
+    const unsigned int lane =
+        (words[i / per_word] >> (i % per_word * lane_bits)) & lane_mask;
+    bits |= static_cast<unsigned int>(lane < threshold) << i;
+  }
+  return bits;
+}
+
+template <typename Dtype>
+static inline void mask_scale_word(const int lanes, const unsigned int bits,
+    const Dtype scale, const Dtype* x, Dtype* y) {
+  for (int i = 0; i < lanes; ++i) {
+    y[i] = (bits >> i) & 1 ? x[i] * scale : Dtype(0);
+  }
+}
+
+#ifdef CAFFE_FAST_MATH_SSE2
+
+// Unsigned lanes compare as signed ones once their top bits are flipped.
+// _mm_movemask_epi8 collects the byte compares, sixteen lanes at a time,
+// after _mm_packs_epi16 narrows the 16-bit ones.
+void fast_threshold_bits(const int n, const unsigned int* words,
+    const int lane_bits, const unsigned int threshold, unsigned int* bits) {
+  CHECK(lane_bits == 8 || lane_bits == 16) << "lane_bits must be 8 or 16";
+  const int full = n / 32;
+  if (lane_bits == 8) {
+    const __m128i flip = _mm_set1_epi8(static_cast<char>(0x80));
+    const __m128i t = _mm_set1_epi8(static_cast<char>(threshold ^ 0x80));
+    for (int w = 0; w < full; ++w) {
+      const __m128i* src = reinterpret_cast<const __m128i*>(words + w * 8);
+      const int low = _mm_movemask_epi8(_mm_cmplt_epi8(
+          _mm_xor_si128(_mm_loadu_si128(src), flip), t));
+      const int high = _mm_movemask_epi8(_mm_cmplt_epi8(
+          _mm_xor_si128(_mm_loadu_si128(src + 1), flip), t));
+      bits[w] = static_cast<unsigned int>(low | (high << 16));
+    }
+  } else {
+    const __m128i flip = _mm_set1_epi16(static_cast<short>(0x8000));
+    const __m128i t = _mm_set1_epi16(static_cast<short>(threshold ^ 0x8000));
+    for (int w = 0; w < full; ++w) {
+      const __m128i* src = reinterpret_cast<const __m128i*>(words + w * 16);
+      int half[2];
+      for (int h = 0; h < 2; ++h) {
+        const __m128i a = _mm_cmplt_epi16(
+            _mm_xor_si128(_mm_loadu_si128(src + 2 * h), flip), t);
+        const __m128i b = _mm_cmplt_epi16(
+            _mm_xor_si128(_mm_loadu_si128(src + 2 * h + 1), flip), t);
+        half[h] = _mm_movemask_epi8(_mm_packs_epi16(a, b));
+      }
+      bits[w] = static_cast<unsigned int>(half[0] | (half[1] << 16));
+    }
+  }
+  if (n % 32) {
+    bits[full] = threshold_word(n % 32, words + full * lane_bits, lane_bits,
+        threshold);
+  }
+}
+
+// Lane k of a group keeps its element when bit k of the shifted mask word
+// is set; a double takes two 32-bit lanes.
+void fast_mask_scale(const int n, const unsigned int* bits, const float scale,
+    const float* x, float* y) {
+  const __m128i select = _mm_set_epi32(8, 4, 2, 1);
+  const __m128 s = _mm_set1_ps(scale);
+  int i = 0;
+  for (; i + 32 <= n; i += 32) {
+    const unsigned int word = bits[i / 32];
+    for (int k = 0; k < 32; k += 4) {
+      const __m128i keep = _mm_cmpeq_epi32(_mm_and_si128(
+          _mm_set1_epi32(static_cast<int>(word >> k)), select), select);
+      _mm_storeu_ps(y + i + k, _mm_and_ps(_mm_castsi128_ps(keep),
+          _mm_mul_ps(_mm_loadu_ps(x + i + k), s)));
+    }
+  }
+  if (i < n) {
+    mask_scale_word(n - i, bits[i / 32], scale, x + i, y + i);
+  }
+}
+
+void fast_mask_scale(const int n, const unsigned int* bits,
+    const double scale, const double* x, double* y) {
+  const __m128i select = _mm_set_epi32(2, 2, 1, 1);
+  const __m128d s = _mm_set1_pd(scale);
+  int i = 0;
+  for (; i + 32 <= n; i += 32) {
+    const unsigned int word = bits[i / 32];
+    for (int k = 0; k < 32; k += 2) {
+      const __m128i keep = _mm_cmpeq_epi32(_mm_and_si128(
+          _mm_set1_epi32(static_cast<int>(word >> k)), select), select);
+      _mm_storeu_pd(y + i + k, _mm_and_pd(_mm_castsi128_pd(keep),
+          _mm_mul_pd(_mm_loadu_pd(x + i + k), s)));
+    }
+  }
+  if (i < n) {
+    mask_scale_word(n - i, bits[i / 32], scale, x + i, y + i);
+  }
+}
+
+#else
+
+void fast_threshold_bits(const int n, const unsigned int* words,
+    const int lane_bits, const unsigned int threshold, unsigned int* bits) {
+  CHECK(lane_bits == 8 || lane_bits == 16) << "lane_bits must be 8 or 16";
+  for (int w = 0; w * 32 < n; ++w) {
+    bits[w] = threshold_word(std::min(32, n - w * 32), words + w * lane_bits,
+        lane_bits, threshold);
+  }
+}
+
+void fast_mask_scale(const int n, const unsigned int* bits, const float scale,
+    const float* x, float* y) {
+  for (int i = 0; i < n; i += 32) {
+    mask_scale_word(std::min(32, n - i), bits[i / 32], scale, x + i, y + i);
+  }
+}
+
+void fast_mask_scale(const int n, const unsigned int* bits,
+    const double scale, const double* x, double* y) {
+  for (int i = 0; i < n; i += 32) {
+    mask_scale_word(std::min(32, n - i), bits[i / 32], scale, x + i, y + i);
+  }
+}
+
+#endif  // CAFFE_FAST_MATH_SSE2
+
+// Half precision follows the round-to-nearest-even conversions of F. Giesen
+// ("float->half variants", 2016), which need only integer and float adds;
+// bfloat16 is the top half of the float, rounded the same way. Both kernels
+// give the scalar results bit for bit.
+
+static inline uint16_t float_to_half_element(const float x) {
+  const uint32_t bits = static_cast<uint32_t>(float_bits(x));
+  const uint32_t sign = bits & 0x80000000u;
+  uint32_t abs_bits = bits ^ sign;
+  uint32_t half;
+  if (abs_bits >= (127u + 16) << 23) {
+    // Past the half range: inf, or a quiet NaN.
+    half = abs_bits > 255u << 23 ? 0x7e00 : 0x7c00;
+  } else if (abs_bits < (127u - 14) << 23) {
+    // Subnormal or zero: the float add rounds the mantissa into place.
+    const uint32_t magic = ((127u - 15) + (23 - 10) + 1) << 23;
+    half = static_cast<uint32_t>(float_bits(bits_float(abs_bits) +
+        bits_float(magic))) - magic;
+  } else {
+    const uint32_t odd = (abs_bits >> 13) & 1;
+    abs_bits += ((15u - 127) << 23) + 0xfff + odd;
+    half = abs_bits >> 13;
+  }
+  return static_cast<uint16_t>(half | (sign >> 16));
+}
+
+static inline float half_to_float_element(const uint16_t x) {
+  const uint32_t shifted_exp = 0x7c00u << 13;
+  uint32_t bits = (x & 0x7fffu) << 13;
+  const uint32_t exp = bits & shifted_exp;
+  bits += (127u - 15) << 23;
+  if (exp == shifted_exp) {
+    bits += (128u - 16) << 23;
+  } else if (exp == 0) {
+    bits = float_bits(bits_float(bits + (1 << 23)) - bits_float(113 << 23));
+  }
+  return bits_float(bits | (static_cast<uint32_t>(x & 0x8000u) << 16));
+}
+
+static inline uint16_t float_to_bfloat16_element(const float x) {
+  const uint32_t bits = static_cast<uint32_t>(float_bits(x));
+  if ((bits & 0x7fffffffu) > 0x7f800000u) {
+    return static_cast<uint16_t>((bits >> 16) | 0x40);
+  }
+  return static_cast<uint16_t>((bits + 0x7fff + ((bits >> 16) & 1)) >> 16);
+}
+
+static inline float bfloat16_to_float_element(const uint16_t x) {
+  return bits_float(static_cast<uint32_t>(x) << 16);
+}
+
+#ifdef CAFFE_FAST_MATH_SSE2
+
+// Four floats to four halves in the low 16 bits of sign-extended lanes,
+// ready for _mm_packs_epi32.
+static inline __m128i float_to_half_ps(const __m128 x) {
+  const __m128i sign_mask = _mm_set1_epi32(static_cast<int>(0x80000000u));
+  const __m128i half_max = _mm_set1_epi32((127 + 16) << 23);
+  const __m128i min_normal = _mm_set1_epi32((127 - 14) << 23);
+  const __m128i subnormal_magic =
+      _mm_set1_epi32(((127 - 15) + (23 - 10) + 1) << 23);
+  const __m128i normal_bias = _mm_set1_epi32(0xfff - ((127 - 15) << 23));
+  const __m128 sign = _mm_and_ps(_mm_castsi128_ps(sign_mask), x);
+  const __m128 abs_x = _mm_xor_ps(x, sign);
+  const __m128i abs_bits = _mm_castps_si128(abs_x);
+  const __m128i nan_bit = _mm_and_si128(
+      _mm_castps_si128(_mm_cmpunord_ps(abs_x, abs_x)), _mm_set1_epi32(0x200));
+  const __m128i special = _mm_or_si128(nan_bit, _mm_set1_epi32(0x7c00));
+  const __m128i regular = _mm_cmpgt_epi32(half_max, abs_bits);
+  const __m128i subnormal = _mm_cmpgt_epi32(min_normal, abs_bits);
+  const __m128i sub_result = _mm_sub_epi32(_mm_castps_si128(
+      _mm_add_ps(abs_x, _mm_castsi128_ps(subnormal_magic))), subnormal_magic);
+  const __m128i odd = _mm_srai_epi32(_mm_slli_epi32(abs_bits, 31 - 13), 31);
+  const __m128i normal_result = _mm_srli_epi32(_mm_sub_epi32(
+      _mm_add_epi32(abs_bits, normal_bias), odd), 13);
+  const __m128i finite = _mm_or_si128(_mm_and_si128(subnormal, sub_result),
+      _mm_andnot_si128(subnormal, normal_result));
+  const __m128i joined = _mm_or_si128(_mm_and_si128(regular, finite),
+      _mm_andnot_si128(regular, special));
+  return _mm_or_si128(joined,
+      _mm_srai_epi32(_mm_castps_si128(sign), 16));
+}
+
+// Four halves in the low 16 bits of the lanes to four floats; the multiply
+// rescales the exponent and normalizes subnormals.
+static inline __m128 half_to_float_ps(const __m128i x) {
+  const __m128i exp_mant = _mm_and_si128(x, _mm_set1_epi32(0x7fff));
+  const __m128 scaled = _mm_mul_ps(
+      _mm_castsi128_ps(_mm_slli_epi32(exp_mant, 13)),
+      _mm_castsi128_ps(_mm_set1_epi32((254 - 15) << 23)));
+  const __m128i inf_nan = _mm_cmpgt_epi32(exp_mant, _mm_set1_epi32(0x7bff));
+  const __m128i sign = _mm_slli_epi32(_mm_xor_si128(x, exp_mant), 16);
+  const __m128i exp_inf_nan =
+      _mm_and_si128(inf_nan, _mm_set1_epi32(255 << 23));
+  return _mm_or_ps(scaled,
+      _mm_castsi128_ps(_mm_or_si128(sign, exp_inf_nan)));
+}
+
+static inline __m128i float_to_bfloat16_ps(const __m128 x) {
+  const __m128i bits = _mm_castps_si128(x);
+  const __m128i odd = _mm_and_si128(_mm_srli_epi32(bits, 16),
+      _mm_set1_epi32(1));
+  const __m128i rounded = _mm_srli_epi32(_mm_add_epi32(
+      _mm_add_epi32(bits, _mm_set1_epi32(0x7fff)), odd), 16);
+  const __m128i quiet = _mm_or_si128(_mm_srli_epi32(bits, 16),
+      _mm_set1_epi32(0x40));
+  const __m128i nan = _mm_castps_si128(_mm_cmpunord_ps(x, x));
+  const __m128i result = _mm_or_si128(_mm_and_si128(nan, quiet),
+      _mm_andnot_si128(nan, rounded));
+  // Sign-extend from 16 bits so that _mm_packs_epi32 keeps the low halves.
+  return _mm_srai_epi32(_mm_slli_epi32(result, 16), 16);
+}
+
+void fast_float_to_half(const int n, const float* x, uint16_t* y) {
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(y + i), _mm_packs_epi32(
+        float_to_half_ps(_mm_loadu_ps(x + i)),
+        float_to_half_ps(_mm_loadu_ps(x + i + 4))));
+  }
+  for (; i < n; ++i) {
+    y[i] = float_to_half_element(x[i]);
+  }
+}
+
+void fast_half_to_float(const int n, const uint16_t* x, float* y) {
+  const __m128i zero = _mm_setzero_si128();
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m128i h =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(x + i));
+    _mm_storeu_ps(y + i, half_to_float_ps(_mm_unpacklo_epi16(h, zero)));
+    _mm_storeu_ps(y + i + 4, half_to_float_ps(_mm_unpackhi_epi16(h, zero)));
+  }
+  for (; i < n; ++i) {
+    y[i] = half_to_float_element(x[i]);
+  }
+}
+
+void fast_float_to_bfloat16(const int n, const float* x, uint16_t* y) {
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(y + i), _mm_packs_epi32(
+        float_to_bfloat16_ps(_mm_loadu_ps(x + i)),
+        float_to_bfloat16_ps(_mm_loadu_ps(x + i + 4))));
+  }
+  for (; i < n; ++i) {
+    y[i] = float_to_bfloat16_element(x[i]);
+  }
+}
+
+void fast_bfloat16_to_float(const int n, const uint16_t* x, float* y) {
+  const __m128i zero = _mm_setzero_si128();
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m128i h =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(x + i));
+    _mm_storeu_ps(y + i, _mm_castsi128_ps(_mm_unpacklo_epi16(zero, h)));
+    _mm_storeu_ps(y + i + 4, _mm_castsi128_ps(_mm_unpackhi_epi16(zero, h)));
+  }
+  for (; i < n; ++i) {
+    y[i] = bfloat16_to_float_element(x[i]);
+  }
+}
+
+#else
+
+void fast_float_to_half(const int n, const float* x, uint16_t* y) {
+  for (int i = 0; i < n; ++i) {
+    y[i] = float_to_half_element(x[i]);
+  }
+}
+
+void fast_half_to_float(const int n, const uint16_t* x, float* y) {
+  for (int i = 0; i < n; ++i) {
+    y[i] = half_to_float_element(x[i]);
+  }
+}
+
+void fast_float_to_bfloat16(const int n, const float* x, uint16_t* y) {
+  for (int i = 0; i < n; ++i) {
+    y[i] = float_to_bfloat16_element(x[i]);
+  }
+}
+
+void fast_bfloat16_to_float(const int n, const uint16_t* x, float* y) {
+  for (int i = 0; i < n; ++i) {
+    y[i] = bfloat16_to_float_element(x[i]);
+  }
+}
+
+#endif  // CAFFE_FAST_MATH_SSE2
+
+// The quantized kernels widen both operands to 16 bits for _mm_madd_epi16,
+// as SSE2 has no unsigned by signed byte multiply; each step takes 16 bytes
+// of K. The scalar forms round ties to even like _mm_cvtps_epi32, so the
+// vector body and the tails agree.
+
+static inline uint8_t quantize_u8_element(double v, const int zero_point) {
+  // Clamped first so that the conversion cannot overflow; NaN fails both
+  // compares and ends up at 0.
+  v = v > 512 ? 512 : (v > -512 ? v : -512);
+  double rounded = floor(v + 0.5);
+  if (rounded - v == 0.5 && fmod(rounded, 2.) != 0) {
+    rounded -= 1;
+  }
+  const int q = static_cast<int>(rounded) + zero_point;
+  return static_cast<uint8_t>(q < 0 ? 0 : (q > 255 ? 255 : q));
+}
+
+static inline int32_t dot_u8s8(const int K, const uint8_t* a,
+    const int8_t* b) {
+  int32_t sum = 0;
+  for (int k = 0; k < K; ++k) {
+    sum += static_cast<int32_t>(a[k]) * b[k];
+  }
+  return sum;
+}
+
+void fast_quantize_u8(const int n, const double* x, const double inv_scale,
+    const int zero_point, uint8_t* q) {
+  for (int i = 0; i < n; ++i) {
+    q[i] = quantize_u8_element(x[i] * inv_scale, zero_point);
+  }
+}
+
+#ifdef CAFFE_FAST_MATH_SSE2
+
+void fast_quantize_u8(const int n, const float* x, const float inv_scale,
+    const int zero_point, uint8_t* q) {
+  const __m128 scale = _mm_set1_ps(inv_scale);
+  const __m128 lo = _mm_set1_ps(-512.f);
+  const __m128 hi = _mm_set1_ps(512.f);
+  const __m128i zp = _mm_set1_epi32(zero_point);
+  int i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m128i v[4];
+    for (int j = 0; j < 4; ++j) {
+      // _mm_max_ps returns its second operand for NaN.
+      const __m128 y = _mm_min_ps(
+          _mm_max_ps(_mm_mul_ps(_mm_loadu_ps(x + i + 4 * j), scale), lo), hi);
+      v[j] = _mm_add_epi32(_mm_cvtps_epi32(y), zp);
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(q + i), _mm_packus_epi16(
+        _mm_packs_epi32(v[0], v[1]), _mm_packs_epi32(v[2], v[3])));
+  }
+  for (; i < n; ++i) {
+    q[i] = quantize_u8_element(x[i] * inv_scale, zero_point);
+  }
+}
+
+// Adds the products of the 16 bytes of a, widened to alo and ahi, with the
+// 16 words at b to the four lanes of acc.
+static inline __m128i madd_u8s16(const __m128i acc, const __m128i alo,
+    const __m128i ahi, const int16_t* b) {
+  const __m128i* bv = reinterpret_cast<const __m128i*>(b);
+  return _mm_add_epi32(acc, _mm_add_epi32(
+      _mm_madd_epi16(alo, _mm_loadu_si128(bv)),
+      _mm_madd_epi16(ahi, _mm_loadu_si128(bv + 1))));
+}
+
+// The four horizontal sums of acc[0..3], side by side.
+static inline __m128i hsum4_epi32(const __m128i* acc) {
+  const __m128i t0 = _mm_unpacklo_epi32(acc[0], acc[1]);
+  const __m128i t1 = _mm_unpackhi_epi32(acc[0], acc[1]);
+  const __m128i t2 = _mm_unpacklo_epi32(acc[2], acc[3]);
+  const __m128i t3 = _mm_unpackhi_epi32(acc[2], acc[3]);
+  return _mm_add_epi32(
+      _mm_add_epi32(_mm_unpacklo_epi64(t0, t2), _mm_unpackhi_epi64(t0, t2)),
+      _mm_add_epi32(_mm_unpacklo_epi64(t1, t3), _mm_unpackhi_epi64(t1, t3)));
+}
+
+// Stores the sums of the first cols of the four columns in sums, adding
+// the tail of K past body that the vector loop left out.
+static inline void store_row_u8s8(const __m128i sums, const int cols,
+    const int K, const int body, const uint8_t* a, const int8_t* b,
+    int32_t* c) {
+  int32_t out[4];
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(out), sums);
+  for (int j = 0; j < cols; ++j) {
+    c[j] = out[j] + dot_u8s8(K - body, a + body, b + j * K + body);
+  }
+}
+
+// Four rows of B at a time are sign-extended to 16 bits once and then
+// multiplied with every row of A, two rows per step.
+void fast_gemm_u8s8s32(const int M, const int N, const int K,
+    const uint8_t* A, const int8_t* B, int32_t* C, const int ldc) {
+  const __m128i zero = _mm_setzero_si128();
+  const int body = K & ~15;
+  std::vector<int16_t> wide(4 * body + 1);
+  for (int n = 0; n < N; n += 4) {
+    const int cols = std::min(4, N - n);
+    const int8_t* b = B + n * K;
+    for (int j = 0; j < 4; ++j) {
+      for (int k = 0; k < body; ++k) {
+        wide[j * body + k] = j < cols ? b[j * K + k] : 0;
+      }
+    }
+    const int16_t* w = &wide[0];
+    int m = 0;
+    for (; m + 2 <= M; m += 2) {
+      const uint8_t* a0 = A + m * K;
+      const uint8_t* a1 = a0 + K;
+      __m128i acc0[4] = { zero, zero, zero, zero };
+      __m128i acc1[4] = { zero, zero, zero, zero };
+      for (int k = 0; k < body; k += 16) {
+        const __m128i v0 =
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(a0 + k));
+        const __m128i v1 =
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(a1 + k));
+        const __m128i lo0 = _mm_unpacklo_epi8(v0, zero);
+        const __m128i hi0 = _mm_unpackhi_epi8(v0, zero);
+        const __m128i lo1 = _mm_unpacklo_epi8(v1, zero);
+        const __m128i hi1 = _mm_unpackhi_epi8(v1, zero);
+        for (int j = 0; j < 4; ++j) {
+          acc0[j] = madd_u8s16(acc0[j], lo0, hi0, w + j * body + k);
+          acc1[j] = madd_u8s16(acc1[j], lo1, hi1, w + j * body + k);
+        }
+      }
+      store_row_u8s8(hsum4_epi32(acc0), cols, K, body, a0, b,
+          C + m * ldc + n);
+      store_row_u8s8(hsum4_epi32(acc1), cols, K, body, a1, b,
+          C + (m + 1) * ldc + n);
+    }
+    if (m < M) {
+      const uint8_t* a0 = A + m * K;
+      __m128i acc0[4] = { zero, zero, zero, zero };
+      for (int k = 0; k < body; k += 16) {
+        const __m128i v0 =
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(a0 + k));
+        const __m128i lo0 = _mm_unpacklo_epi8(v0, zero);
+        const __m128i hi0 = _mm_unpackhi_epi8(v0, zero);
+        for (int j = 0; j < 4; ++j) {
+          acc0[j] = madd_u8s16(acc0[j], lo0, hi0, w + j * body + k);
+        }
+      }
+      store_row_u8s8(hsum4_epi32(acc0), cols, K, body, a0, b,
+          C + m * ldc + n);
+    }
+  }
+}
+
+#else
+
+void fast_quantize_u8(const int n, const float* x, const float inv_scale,
+    const int zero_point, uint8_t* q) {
+  for (int i = 0; i < n; ++i) {
+    q[i] = quantize_u8_element(x[i] * inv_scale, zero_point);
+  }
+}
+
+void fast_gemm_u8s8s32(const int M, const int N, const int K,
+    const uint8_t* A, const int8_t* B, int32_t* C, const int ldc) {
+  for (int n = 0; n < N; ++n) {
+    for (int m = 0; m < M; ++m) {
+      C[m * ldc + n] = dot_u8s8(K, A + m * K, B + n * K);
+    }
+  }
+}
+
+#endif  // CAFFE_FAST_MATH_SSE2
+
+}  // namespace caffe
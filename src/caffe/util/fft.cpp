@@ -0,0 +1,74 @@
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/fft.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+FFTPlan<Dtype>::FFTPlan(const int n)
+    : n_(n), bit_reverse_(n), twiddles_(n / 2) {
+  CHECK_GT(n, 0);
+  CHECK_EQ(n & (n - 1), 0) << "FFT size must be a power of two.";
+  int log_n = 0;
+  while ((1 << log_n) < n) {
+    ++log_n;
+  }
+  for (int i = 0; i < n; ++i) {
+    int r = 0;
+    for (int b = 0; b < log_n; ++b) {
+      r |= ((i >> b) & 1) << (log_n - 1 - b);
+    }
+    bit_reverse_[i] = r;
+  }
+  // Computed in double so that the float plan is correctly rounded.
+  const double pi = std::acos(-1.);
+  for (int i = 0; i < n / 2; ++i) {
+    const double angle = -2. * pi * i / n;
+    twiddles_[i] = std::complex<Dtype>(std::cos(angle), std::sin(angle));
+  }
+}
+
+template <typename Dtype>
+void FFTPlan<Dtype>::Transform(std::complex<Dtype>* x, const int stride,
+    const bool inverse) const {
+  for (int i = 0; i < n_; ++i) {
+    const int r = bit_reverse_[i];
+    if (i < r) {
+      std::swap(x[i * stride], x[r * stride]);
+    }
+  }
+  for (int len = 2; len <= n_; len <<= 1) {
+    const int half = len / 2;
+    const int step = n_ / len;
+    for (int start = 0; start < n_; start += len) {
+      for (int j = 0; j < half; ++j) {
+        const std::complex<Dtype> w = inverse ?
+            std::conj(twiddles_[j * step]) : twiddles_[j * step];
+        std::complex<Dtype>& a = x[(start + j) * stride];
+        std::complex<Dtype>& b = x[(start + j + half) * stride];
+        const std::complex<Dtype> t = w * b;
+        b = a - t;
+        a += t;
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void FFTPlan<Dtype>::Transform2D(std::complex<Dtype>* x,
+    const bool inverse) const {
+  for (int i = 0; i < n_; ++i) {
+    Transform(x + i * n_, 1, inverse);
+  }
+  for (int j = 0; j < n_; ++j) {
+    Transform(x + j, n_, inverse);
+  }
+}
+
+INSTANTIATE_CLASS(FFTPlan);
+
+}  // namespace caffe
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cmath>
 #include <cstdlib>
 #include <cstring>
@@ -7,31 +8,151 @@
 
 namespace caffe {
 
+// Below this many column entries the OpenMP fork/join costs more than it
+// saves, so the loops run on the calling thread.
+const int kIm2colParallelThreshold = 16384;
+
+// Compile-time kernel geometry. A zero template argument means "not fixed",
+// in which case the runtime value is used; otherwise the constant is folded
+// into the inner loops so the compiler can unroll and vectorize them.
+template <int KH, int KW, int SH, int SW>
+struct Im2colShape {
+  static inline int kernel_h(const int v) { return KH ? KH : v; }
+  static inline int kernel_w(const int v) { return KW ? KW : v; }
+  static inline int stride_h(const int v) { return SH ? SH : v; }
+  static inline int stride_w(const int v) { return SW ? SW : v; }
+};
+
+template <typename Dtype, typename Shape>
+void im2col_cpu_kernel(const Dtype* data_im, const int channels,
+    const int height, const int width, const int kernel_h_in,
+    const int kernel_w_in, const int pad_h, const int pad_w,
+    const int stride_h_in, const int stride_w_in, Dtype* data_col,
+    const int col_ld) {
+  const int kernel_h = Shape::kernel_h(kernel_h_in);
+  const int kernel_w = Shape::kernel_w(kernel_w_in);
+  const int stride_h = Shape::stride_h(stride_h_in);
+  const int stride_w = Shape::stride_w(stride_w_in);
+  const int height_col = (height + 2 * pad_h - kernel_h) / stride_h + 1;
+  const int width_col = (width + 2 * pad_w - kernel_w) / stride_w + 1;
+  const int channels_col = channels * kernel_h * kernel_w;
+  // Each (c_im, h_offset, w_offset) row of the column buffer is independent.
+  // Consecutive rows read the same input plane, so a static schedule keeps
+  // each thread working on a cache-resident slice of the image.
+#pragma omp parallel for schedule(static) \
+    if (channels_col * height_col * width_col >= kIm2colParallelThreshold)
+  for (int c = 0; c < channels_col; ++c) {
+    const int w_offset = c % kernel_w;
+    const int h_offset = (c / kernel_w) % kernel_h;
+    const int c_im = c / kernel_h / kernel_w;
+    const Dtype* im = data_im + c_im * height * width;
+    Dtype* col = data_col + c * col_ld;
+    int w_begin, w_end;
+    im2col_valid_range(width, width_col, pad_w, stride_w, w_offset,
+        &w_begin, &w_end);
+    for (int h = 0; h < height_col; ++h, col += width_col) {
+      const int h_pad = h * stride_h - pad_h + h_offset;
+      if (h_pad < 0 || h_pad >= height) {
+        memset(col, 0, sizeof(Dtype) * width_col);  // NOLINT(caffe/alt_fn)
+        continue;
+      }
+      const Dtype* im_row = im + h_pad * width - pad_w + w_offset;
+      for (int w = 0; w < w_begin; ++w) {
+        col[w] = 0;
+      }
+      for (int w = w_begin; w < w_end; ++w) {
+        col[w] = im_row[w * stride_w];
+      }
+      for (int w = w_end; w < width_col; ++w) {
+        col[w] = 0;
+      }
+    }
+  }
+}
+
+template <typename Dtype, typename Shape>
+void col2im_cpu_kernel(const Dtype* data_col, const int col_ld,
+    const int channels,
+    const int height, const int width, const int patch_h_in,
+    const int patch_w_in, const int pad_h, const int pad_w,
+    const int stride_h_in, const int stride_w_in, Dtype* data_im) {
+  const int patch_h = Shape::kernel_h(patch_h_in);
+  const int patch_w = Shape::kernel_w(patch_w_in);
+  const int stride_h = Shape::stride_h(stride_h_in);
+  const int stride_w = Shape::stride_w(stride_w_in);
+  const int height_col = (height + 2 * pad_h - patch_h) / stride_h + 1;
+  const int width_col = (width + 2 * pad_w - patch_w) / stride_w + 1;
+  const int col_plane = height_col * width_col;
+  // Rows of different input channels scatter into disjoint image planes, so
+  // the channels can be accumulated in parallel without synchronization.
+#pragma omp parallel for schedule(static) \
+    if (channels * patch_h * patch_w * col_plane >= kIm2colParallelThreshold)
+  for (int c_im = 0; c_im < channels; ++c_im) {
+    Dtype* im = data_im + c_im * height * width;
+    memset(im, 0, sizeof(Dtype) * height * width);  // NOLINT(caffe/alt_fn)
+    const Dtype* col = data_col + c_im * patch_h * patch_w * col_ld;
+    for (int h_offset = 0; h_offset < patch_h; ++h_offset) {
+      for (int w_offset = 0; w_offset < patch_w; ++w_offset, col += col_ld) {
+        int w_begin, w_end;
+        im2col_valid_range(width, width_col, pad_w, stride_w, w_offset,
+            &w_begin, &w_end);
+        const Dtype* col_row = col;
+        for (int h = 0; h < height_col; ++h, col_row += width_col) {
+          const int h_pad = h * stride_h - pad_h + h_offset;
+          if (h_pad < 0 || h_pad >= height) {
+            continue;
+          }
+          Dtype* im_row = im + h_pad * width - pad_w + w_offset;
+          for (int w = w_begin; w < w_end; ++w) {
+            im_row[w * stride_w] += col_row[w];
+          }
+        }
+      }
+    }
+  }
+}
+
+// Picks a specialized kernel for the common AlexNet/VGG/GoogLeNet filter
+// geometries and falls back to the fully runtime-parameterized one. Strided
+// 1x1 kernels reduce to a plain subsample of each input plane.
+#define IM2COL_DISPATCH(kernel_fn, kh, kw, sh, sw, args) \
+  do { \
+    if (kh == 1 && kw == 1) { \
+      kernel_fn<Dtype, Im2colShape<1, 1, 0, 0> > args; \
+    } else if (kh == 3 && kw == 3 && sh == 1 && sw == 1) { \
+      kernel_fn<Dtype, Im2colShape<3, 3, 1, 1> > args; \
+    } else if (kh == 5 && kw == 5 && sh == 1 && sw == 1) { \
+      kernel_fn<Dtype, Im2colShape<5, 5, 1, 1> > args; \
+    } else if (kh == 7 && kw == 7 && sh == 2 && sw == 2) { \
+      kernel_fn<Dtype, Im2colShape<7, 7, 2, 2> > args; \
+    } else if (kh == 11 && kw == 11 && sh == 4 && sw == 4) { \
+      kernel_fn<Dtype, Im2colShape<11, 11, 4, 4> > args; \
+    } else { \
+      kernel_fn<Dtype, Im2colShape<0, 0, 0, 0> > args; \
+    } \
+  } while (0)
+
 template <typename Dtype>
 void im2col_cpu(const Dtype* data_im, const int channels,
     const int height, const int width, const int kernel_h, const int kernel_w,
     const int pad_h, const int pad_w,
     const int stride_h, const int stride_w,
     Dtype* data_col) {
-  int height_col = (height + 2 * pad_h - kernel_h) / stride_h + 1;
-  int width_col = (width + 2 * pad_w - kernel_w) / stride_w + 1;
-  int channels_col = channels * kernel_h * kernel_w;
-  for (int c = 0; c < channels_col; ++c) {
-    int w_offset = c % kernel_w;
-    int h_offset = (c / kernel_w) % kernel_h;
-    int c_im = c / kernel_h / kernel_w;
-    for (int h = 0; h < height_col; ++h) {
-      for (int w = 0; w < width_col; ++w) {
-        int h_pad = h * stride_h - pad_h + h_offset;
-        int w_pad = w * stride_w - pad_w + w_offset;
-        if (h_pad >= 0 && h_pad < height && w_pad >= 0 && w_pad < width)
-          data_col[(c * height_col + h) * width_col + w] =
-            data_im[(c_im * height + h_pad) * width + w_pad];
-        else
-          data_col[(c * height_col + h) * width_col + w] = 0;
-      }
-    }
-  }
+  const int height_col = (height + 2 * pad_h - kernel_h) / stride_h + 1;
+  const int width_col = (width + 2 * pad_w - kernel_w) / stride_w + 1;
+  im2col_cpu_ld(data_im, channels, height, width, kernel_h, kernel_w,
+      pad_h, pad_w, stride_h, stride_w, data_col, height_col * width_col);
+}
+
+template <typename Dtype>
+void im2col_cpu_ld(const Dtype* data_im, const int channels,
+    const int height, const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w,
+    Dtype* data_col, const int col_ld) {
+  IM2COL_DISPATCH(im2col_cpu_kernel, kernel_h, kernel_w, stride_h, stride_w,
+      (data_im, channels, height, width, kernel_h, kernel_w, pad_h, pad_w,
+       stride_h, stride_w, data_col, col_ld));
 }
 
 // Explicit instantiation
@@ -43,6 +164,57 @@ template void im2col_cpu<double>(const double* data_im, const int channels,
     const int height, const int width, const int kernel_h, const int kernel_w,
     const int pad_h, const int pad_w, const int stride_h,
     const int stride_w, double* data_col);
+template void im2col_cpu_ld<float>(const float* data_im, const int channels,
+    const int height, const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h,
+    const int stride_w, float* data_col, const int col_ld);
+template void im2col_cpu_ld<double>(const double* data_im, const int channels,
+    const int height, const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h,
+    const int stride_w, double* data_col, const int col_ld);
+
+// One output position per row. The rows of an output line are filled one
+// kernel row of one channel at a time, so that reads stay on a single image
+// line and the writes on the few kilobytes of that output line.
+void im2row_cpu(const uint8_t* data_im, const int channels,
+    const int height, const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h,
+    const int stride_w, const uint8_t pad_value, uint8_t* data_row) {
+  const int height_col = (height + 2 * pad_h - kernel_h) / stride_h + 1;
+  const int width_col = (width + 2 * pad_w - kernel_w) / stride_w + 1;
+  const int row_size = channels * kernel_h * kernel_w;
+#pragma omp parallel for schedule(static) \
+    if (row_size * height_col * width_col >= kIm2colParallelThreshold)
+  for (int h = 0; h < height_col; ++h) {
+    uint8_t* line = data_row + h * width_col * row_size;
+    for (int c = 0; c < channels; ++c) {
+      for (int i = 0; i < kernel_h; ++i) {
+        uint8_t* row = line + (c * kernel_h + i) * kernel_w;
+        const int h_pad = h * stride_h - pad_h + i;
+        if (h_pad < 0 || h_pad >= height) {
+          for (int w = 0; w < width_col; ++w, row += row_size) {
+            memset(row, pad_value, kernel_w);  // NOLINT(caffe/alt_fn)
+          }
+          continue;
+        }
+        const uint8_t* im = data_im + (c * height + h_pad) * width;
+        for (int w = 0; w < width_col; ++w, row += row_size) {
+          const int w_pad = w * stride_w - pad_w;
+          if (w_pad >= 0 && w_pad + kernel_w <= width) {
+            for (int j = 0; j < kernel_w; ++j) {
+              row[j] = im[w_pad + j];
+            }
+          } else {
+            for (int j = 0; j < kernel_w; ++j) {
+              row[j] = w_pad + j >= 0 && w_pad + j < width ?
+                  im[w_pad + j] : pad_value;
+            }
+          }
+        }
+      }
+    }
+  }
+}
 
 template <typename Dtype>
 void col2im_cpu(const Dtype* data_col, const int channels,
@@ -50,26 +222,25 @@ void col2im_cpu(const Dtype* data_col, const int channels,
     const int pad_h, const int pad_w,
     const int stride_h, const int stride_w,
     Dtype* data_im) {
-  caffe_set(height * width * channels, Dtype(0), data_im);
-  int height_col = (height + 2 * pad_h - patch_h) / stride_h + 1;
-  int width_col = (width + 2 * pad_w - patch_w) / stride_w + 1;
-  int channels_col = channels * patch_h * patch_w;
-  for (int c = 0; c < channels_col; ++c) {
-    int w_offset = c % patch_w;
-    int h_offset = (c / patch_w) % patch_h;
-    int c_im = c / patch_h / patch_w;
-    for (int h = 0; h < height_col; ++h) {
-      for (int w = 0; w < width_col; ++w) {
-        int h_pad = h * stride_h - pad_h + h_offset;
-        int w_pad = w * stride_w - pad_w + w_offset;
-        if (h_pad >= 0 && h_pad < height && w_pad >= 0 && w_pad < width)
-          data_im[(c_im * height + h_pad) * width + w_pad] +=
-              data_col[(c * height_col + h) * width_col + w];
-      }
-    }
-  }
+  const int height_col = (height + 2 * pad_h - patch_h) / stride_h + 1;
+  const int width_col = (width + 2 * pad_w - patch_w) / stride_w + 1;
+  col2im_cpu_ld(data_col, height_col * width_col, channels, height, width,
+      patch_h, patch_w, pad_h, pad_w, stride_h, stride_w, data_im);
+}
+
+template <typename Dtype>
+void col2im_cpu_ld(const Dtype* data_col, const int col_ld,
+    const int channels, const int height, const int width, const int patch_h,
+    const int patch_w, const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w,
+    Dtype* data_im) {
+  IM2COL_DISPATCH(col2im_cpu_kernel, patch_h, patch_w, stride_h, stride_w,
+      (data_col, col_ld, channels, height, width, patch_h, patch_w, pad_h,
+       pad_w, stride_h, stride_w, data_im));
 }
 
+#undef IM2COL_DISPATCH
+
 // Explicit instantiation
 template void col2im_cpu<float>(const float* data_col, const int channels,
     const int height, const int width, const int patch_h, const int patch_w,
@@ -79,5 +250,13 @@ template void col2im_cpu<double>(const double* data_col, const int channels,
     const int height, const int width, const int patch_h, const int patch_w,
     const int pad_h, const int pad_w, const int stride_h,
     const int stride_w, double* data_im);
+template void col2im_cpu_ld<float>(const float* data_col, const int col_ld,
+    const int channels, const int height, const int width, const int patch_h,
+    const int patch_w, const int pad_h, const int pad_w, const int stride_h,
+    const int stride_w, float* data_im);
+template void col2im_cpu_ld<double>(const double* data_col, const int col_ld,
+    const int channels, const int height, const int width, const int patch_h,
+    const int patch_w, const int pad_h, const int pad_w, const int stride_h,
+    const int stride_w, double* data_im);
 
 }  // namespace caffe
@@ -0,0 +1,177 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/low_rank.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+// Orthonormalizes the rows of the rows x n matrix Q in place by modified
+// Gram-Schmidt, projecting twice so that float keeps them orthogonal. Rows
+// that lie in the span of the previous ones are zeroed.
+template <typename Dtype>
+static void orthonormalize_rows(const int rows, const int n, Dtype* Q) {
+  for (int i = 0; i < rows; ++i) {
+    Dtype* q = Q + i * n;
+    const Dtype initial = std::sqrt(caffe_cpu_dot(n, q, q));
+    for (int pass = 0; pass < 2; ++pass) {
+      for (int j = 0; j < i; ++j) {
+        const Dtype* p = Q + j * n;
+        caffe_axpy(n, -caffe_cpu_dot(n, p, q), p, q);
+      }
+    }
+    const Dtype norm = std::sqrt(caffe_cpu_dot(n, q, q));
+    if (norm > 16 * std::numeric_limits<Dtype>::epsilon() * initial) {
+      caffe_scal(n, 1 / norm, q);
+    } else {
+      caffe_set(n, Dtype(0), q);
+    }
+  }
+}
+
+// Cyclic Jacobi eigendecomposition of the symmetric n x n matrix G, which is
+// rotated in place to the diagonal of eigenvalues; the columns of W receive
+// the eigenvectors.
+static void symmetric_eigen(const int n, double* G, double* W) {
+  for (int i = 0; i < n * n; ++i) {
+    W[i] = i / n == i % n;
+  }
+  double total = 0;
+  for (int i = 0; i < n * n; ++i) {
+    total += G[i] * G[i];
+  }
+  const int kMaxSweeps = 50;
+  for (int sweep = 0; sweep < kMaxSweeps; ++sweep) {
+    double off = 0;
+    for (int p = 0; p < n; ++p) {
+      for (int q = p + 1; q < n; ++q) {
+        off += G[p * n + q] * G[p * n + q];
+      }
+    }
+    if (off <= 1e-28 * total) {
+      return;
+    }
+    for (int p = 0; p < n; ++p) {
+      for (int q = p + 1; q < n; ++q) {
+        const double apq = G[p * n + q];
+        if (apq == 0) {
+          continue;
+        }
+        const double theta = (G[q * n + q] - G[p * n + p]) / (2 * apq);
+        const double t = (theta >= 0 ? 1 : -1) /
+            (std::fabs(theta) + std::sqrt(theta * theta + 1));
+        const double c = 1 / std::sqrt(t * t + 1);
+        const double s = t * c;
+        for (int k = 0; k < n; ++k) {
+          const double gkp = G[k * n + p];
+          const double gkq = G[k * n + q];
+          G[k * n + p] = c * gkp - s * gkq;
+          G[k * n + q] = s * gkp + c * gkq;
+        }
+        for (int k = 0; k < n; ++k) {
+          const double gpk = G[p * n + k];
+          const double gqk = G[q * n + k];
+          G[p * n + k] = c * gpk - s * gqk;
+          G[q * n + k] = s * gpk + c * gqk;
+        }
+        for (int k = 0; k < n; ++k) {
+          const double wkp = W[k * n + p];
+          const double wkq = W[k * n + q];
+          W[k * n + p] = c * wkp - s * wkq;
+          W[k * n + q] = s * wkp + c * wkq;
+        }
+      }
+    }
+  }
+  LOG(WARNING) << "Jacobi eigendecomposition did not converge in "
+      << kMaxSweeps << " sweeps.";
+}
+
+template <typename Dtype>
+void caffe_cpu_low_rank(const int M, const int N, const Dtype* A,
+    const int rank, Dtype* U, Dtype* V, std::vector<Dtype>* singular_values) {
+  CHECK_GT(rank, 0) << "The rank must be positive.";
+  CHECK_LE(rank, std::min(M, N)) << "The rank cannot exceed min(M, N).";
+  const int kOversampling = 10;
+  const int kPowerIterations = 2;
+  const int l = std::min(std::min(M, N), rank + kOversampling);
+
+  // The rows of Q span the leading left singular subspace of A, refined by
+  // alternating with the rows of Z for the right one.
+  vector<Dtype> Q(l * M);
+  vector<Dtype> Z(l * N);
+  caffe_rng_gaussian<Dtype>(l * N, Dtype(0), Dtype(1), &Z[0]);
+  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, l, M, N, Dtype(1), &Z[0],
+      A, Dtype(0), &Q[0]);
+  orthonormalize_rows(l, M, &Q[0]);
+  for (int i = 0; i < kPowerIterations; ++i) {
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, l, N, M, Dtype(1),
+        &Q[0], A, Dtype(0), &Z[0]);
+    orthonormalize_rows(l, N, &Z[0]);
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, l, M, N, Dtype(1),
+        &Z[0], A, Dtype(0), &Q[0]);
+    orthonormalize_rows(l, M, &Q[0]);
+  }
+  // A ~= Q' B with B = Q A; the SVD of A follows from the eigenvectors of
+  // B B', taken in double.
+  vector<Dtype>& B = Z;
+  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, l, N, M, Dtype(1),
+      &Q[0], A, Dtype(0), &B[0]);
+  vector<double> G(l * l);
+  for (int i = 0; i < l; ++i) {
+    for (int j = 0; j <= i; ++j) {
+      double sum = 0;
+      for (int n = 0; n < N; ++n) {
+        sum += static_cast<double>(B[i * N + n]) * B[j * N + n];
+      }
+      G[i * l + j] = G[j * l + i] = sum;
+    }
+  }
+  vector<double> W(l * l);
+  symmetric_eigen(l, &G[0], &W[0]);
+  vector<pair<double, int> > order(l);
+  for (int i = 0; i < l; ++i) {
+    order[i] = make_pair(-G[i * l + i], i);
+  }
+  std::sort(order.begin(), order.end());
+
+  // U = Q' W_r S^1/2 and V = S^-1/2 W_r' B.
+  vector<Dtype> W_r(l * rank);
+  vector<Dtype> scales(rank);
+  if (singular_values) {
+    singular_values->resize(rank);
+  }
+  for (int k = 0; k < rank; ++k) {
+    const double sigma = std::sqrt(std::max(0.0, -order[k].first));
+    for (int i = 0; i < l; ++i) {
+      W_r[i * rank + k] = W[i * l + order[k].second];
+    }
+    scales[k] = std::sqrt(sigma);
+    if (singular_values) {
+      (*singular_values)[k] = sigma;
+    }
+  }
+  caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, M, rank, l, Dtype(1),
+      &Q[0], &W_r[0], Dtype(0), U);
+  caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, rank, N, l, Dtype(1),
+      &W_r[0], &B[0], Dtype(0), V);
+  for (int k = 0; k < rank; ++k) {
+    for (int m = 0; m < M; ++m) {
+      U[m * rank + k] *= scales[k];
+    }
+    caffe_scal(N, scales[k] > 0 ? 1 / scales[k] : Dtype(0), V + k * N);
+  }
+}
+
+template void caffe_cpu_low_rank<float>(const int M, const int N,
+    const float* A, const int rank, float* U, float* V,
+    std::vector<float>* singular_values);
+template void caffe_cpu_low_rank<double>(const int M, const int N,
+    const double* A, const int rank, double* U, double* V,
+    std::vector<double>* singular_values);
+
+}  // namespace caffe
@@ -0,0 +1,316 @@
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include <stdint.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>  // NOLINT(readability/streams)
+#include <map>
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/mapped_weights.hpp"
+
+namespace caffe {
+
+namespace {
+
+const char kMagic[8] = {'C', 'A', 'F', 'F', 'E', 'M', 'A', 'P'};
+const uint32_t kVersion = 1;
+const size_t kHeaderSize = sizeof(kMagic) + 2 * sizeof(uint32_t);
+
+struct IndexEntry {
+  string layer;
+  uint32_t blob_id;
+  int32_t shape[4];
+  uint64_t count() const {
+    return uint64_t(shape[0]) * shape[1] * shape[2] * shape[3];
+  }
+};
+
+template <typename T>
+T ReadIndex(const char* base, const size_t size, size_t* pos) {
+  CHECK_LE(*pos + sizeof(T), size) << "Truncated mapped weights index";
+  T value;
+  memcpy(&value, base + *pos, sizeof(T));
+  *pos += sizeof(T);
+  return value;
+}
+
+template <typename T>
+void WriteValue(std::ofstream* out, const T value, uint64_t* pos) {
+  out->write(reinterpret_cast<const char*>(&value), sizeof(T));
+  *pos += sizeof(T);
+}
+
+uint64_t Align(const uint64_t offset) {
+  const uint64_t alignment = MappedWeights::kAlignment;
+  return (offset + alignment - 1) / alignment * alignment;
+}
+
+// Writes the header and the index, and returns in offsets where the data of
+// each entry goes.
+void WriteIndex(const vector<IndexEntry>& index, std::ofstream* out,
+    vector<uint64_t>* offsets, uint64_t* pos) {
+  uint64_t offset = kHeaderSize;
+  for (int i = 0; i < index.size(); ++i) {
+    offset += sizeof(uint32_t) + index[i].layer.size() + sizeof(uint32_t) +
+        sizeof(index[i].shape) + sizeof(uint64_t);
+  }
+  offsets->clear();
+  for (int i = 0; i < index.size(); ++i) {
+    offset = Align(offset);
+    offsets->push_back(offset);
+    offset += index[i].count() * sizeof(float);
+  }
+  out->write(kMagic, sizeof(kMagic));
+  *pos += sizeof(kMagic);
+  WriteValue(out, kVersion, pos);
+  WriteValue(out, static_cast<uint32_t>(index.size()), pos);
+  for (int i = 0; i < index.size(); ++i) {
+    WriteValue(out, static_cast<uint32_t>(index[i].layer.size()), pos);
+    out->write(index[i].layer.data(), index[i].layer.size());
+    *pos += index[i].layer.size();
+    WriteValue(out, index[i].blob_id, pos);
+    for (int j = 0; j < 4; ++j) {
+      WriteValue(out, index[i].shape[j], pos);
+    }
+    WriteValue(out, (*offsets)[i], pos);
+  }
+}
+
+void WritePadding(const uint64_t offset, std::ofstream* out, uint64_t* pos) {
+  CHECK_LE(*pos, offset);
+  const char zeros[MappedWeights::kAlignment] = {0};
+  out->write(zeros, offset - *pos);
+  *pos = offset;
+}
+
+void WriteData(const float* data, const uint64_t count, std::ofstream* out,
+    uint64_t* pos) {
+  out->write(reinterpret_cast<const char*>(data), count * sizeof(float));
+  *pos += count * sizeof(float);
+}
+
+void WriteData(const double* data, const uint64_t count, std::ofstream* out,
+    uint64_t* pos) {
+  const uint64_t kChunk = 4096;
+  vector<float> buffer(std::min(count, kChunk));
+  for (uint64_t i = 0; i < count; i += kChunk) {
+    const uint64_t n = std::min(count - i, kChunk);
+    std::copy(data + i, data + i + n, buffer.begin());
+    WriteData(&buffer[0], n, out, pos);
+  }
+}
+
+}  // namespace
+
+MappedWeights::MappedWeights(const string& filename)
+    : addr_(NULL), size_(0) {
+#ifdef _WIN32
+  file_ = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+      OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  CHECK(file_ != INVALID_HANDLE_VALUE) << "File not found: " << filename;
+  LARGE_INTEGER file_size;
+  CHECK(GetFileSizeEx(file_, &file_size)) << "Failed to stat " << filename;
+  size_ = static_cast<size_t>(file_size.QuadPart);
+  CHECK_GE(size_, kHeaderSize) << "Not a mapped weights file: " << filename;
+  mapping_ = CreateFileMappingA(file_, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+  CHECK(mapping_) << "Failed to map " << filename;
+  addr_ = MapViewOfFile(mapping_, FILE_MAP_COPY, 0, 0, 0);
+  CHECK(addr_) << "Failed to map " << filename;
+#else
+  const int fd = open(filename.c_str(), O_RDONLY);
+  CHECK_NE(fd, -1) << "File not found: " << filename;
+  struct stat file_stat;
+  CHECK_EQ(fstat(fd, &file_stat), 0) << "Failed to stat " << filename;
+  size_ = file_stat.st_size;
+  CHECK_GE(size_, kHeaderSize) << "Not a mapped weights file: " << filename;
+  // Private and writable: writes through set_cpu_data pointers copy the page
+  // instead of faulting or reaching the file.
+  addr_ = mmap(NULL, size_, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  CHECK(addr_ != MAP_FAILED) << "Failed to map " << filename;
+#endif
+  const char* base = static_cast<const char*>(addr_);
+  CHECK_EQ(memcmp(base, kMagic, sizeof(kMagic)), 0)
+      << "Not a mapped weights file: " << filename;
+  size_t pos = sizeof(kMagic);
+  const uint32_t version = ReadIndex<uint32_t>(base, size_, &pos);
+  CHECK_EQ(version, kVersion) << "Unsupported mapped weights version in "
+      << filename;
+  const uint32_t num_entries = ReadIndex<uint32_t>(base, size_, &pos);
+  entries_.resize(num_entries);
+  for (int i = 0; i < num_entries; ++i) {
+    Entry& entry = entries_[i];
+    const uint32_t name_size = ReadIndex<uint32_t>(base, size_, &pos);
+    CHECK_LE(pos + name_size, size_) << "Truncated mapped weights index";
+    entry.layer.assign(base + pos, name_size);
+    pos += name_size;
+    entry.blob_id = ReadIndex<uint32_t>(base, size_, &pos);
+    entry.num = ReadIndex<int32_t>(base, size_, &pos);
+    entry.channels = ReadIndex<int32_t>(base, size_, &pos);
+    entry.height = ReadIndex<int32_t>(base, size_, &pos);
+    entry.width = ReadIndex<int32_t>(base, size_, &pos);
+    CHECK(entry.num >= 0 && entry.channels >= 0 && entry.height >= 0 &&
+        entry.width >= 0) << "Bad shape for " << entry.layer;
+    const uint64_t offset = ReadIndex<uint64_t>(base, size_, &pos);
+    CHECK_EQ(offset % kAlignment, 0) << "Misaligned data for " << entry.layer;
+    CHECK_LE(offset + uint64_t(entry.count()) * sizeof(float), size_)
+        << "Truncated data for " << entry.layer;
+    entry.data = reinterpret_cast<const float*>(base + offset);
+  }
+}
+
+MappedWeights::~MappedWeights() {
+#ifdef _WIN32
+  UnmapViewOfFile(addr_);
+  CloseHandle(mapping_);
+  CloseHandle(file_);
+#else
+  munmap(addr_, size_);
+#endif
+}
+
+bool MappedWeights::IsMappedWeightsFile(const string& filename) {
+  std::ifstream in(filename.c_str(), std::ios::in | std::ios::binary);
+  char magic[sizeof(kMagic)];
+  return in.read(magic, sizeof(magic)) &&
+      memcmp(magic, kMagic, sizeof(kMagic)) == 0;
+}
+
+vector<const MappedWeights::Entry*> MappedWeights::layer_entries(
+    const string& layer) const {
+  vector<const Entry*> result;
+  for (int i = 0; i < entries_.size(); ++i) {
+    if (entries_[i].layer != layer) { continue; }
+    if (result.size() <= entries_[i].blob_id) {
+      result.resize(entries_[i].blob_id + 1, NULL);
+    }
+    CHECK(!result[entries_[i].blob_id]) << "Duplicate blob "
+        << entries_[i].blob_id << " of layer " << layer;
+    result[entries_[i].blob_id] = &entries_[i];
+  }
+  for (int i = 0; i < result.size(); ++i) {
+    CHECK(result[i]) << "Missing blob " << i << " of layer " << layer;
+  }
+  return result;
+}
+
+void MappedWeights::ToProto(NetParameter* param) const {
+  param->Clear();
+  map<string, LayerParameter*> layers;
+  for (int i = 0; i < entries_.size(); ++i) {
+    if (layers.count(entries_[i].layer)) { continue; }
+    LayerParameter* layer_param = param->add_layers();
+    layer_param->set_name(entries_[i].layer);
+    layers[entries_[i].layer] = layer_param;
+    const vector<const Entry*> blobs = layer_entries(entries_[i].layer);
+    for (int j = 0; j < blobs.size(); ++j) {
+      BlobProto* blob_proto = layer_param->add_blobs();
+      blob_proto->set_num(blobs[j]->num);
+      blob_proto->set_channels(blobs[j]->channels);
+      blob_proto->set_height(blobs[j]->height);
+      blob_proto->set_width(blobs[j]->width);
+      blob_proto->mutable_data()->Reserve(blobs[j]->count());
+      for (int k = 0; k < blobs[j]->count(); ++k) {
+        blob_proto->add_data(blobs[j]->data[k]);
+      }
+    }
+  }
+}
+
+void WriteMappedWeights(const NetParameter& param, const string& filename) {
+  vector<IndexEntry> index;
+  vector<const BlobProto*> blobs;
+  for (int i = 0; i < param.layers_size(); ++i) {
+    const LayerParameter& layer_param = param.layers(i);
+    for (int j = 0; j < layer_param.blobs_size(); ++j) {
+      const BlobProto& blob_proto = layer_param.blobs(j);
+      IndexEntry entry;
+      entry.layer = layer_param.name();
+      entry.blob_id = j;
+      entry.shape[0] = blob_proto.num();
+      entry.shape[1] = blob_proto.channels();
+      entry.shape[2] = blob_proto.height();
+      entry.shape[3] = blob_proto.width();
+      if (blob_proto.data_type() == BlobProto_DataType_FP32) {
+        CHECK_EQ(entry.count(), blob_proto.data_size())
+            << "Blob " << j << " of layer " << entry.layer
+            << " does not match its shape";
+      }
+      index.push_back(entry);
+      blobs.push_back(&blob_proto);
+    }
+  }
+  std::ofstream out(filename.c_str(),
+      std::ios::out | std::ios::trunc | std::ios::binary);
+  CHECK(out) << "Failed to open " << filename;
+  vector<uint64_t> offsets;
+  uint64_t pos = 0;
+  WriteIndex(index, &out, &offsets, &pos);
+  for (int i = 0; i < blobs.size(); ++i) {
+    WritePadding(offsets[i], &out, &pos);
+    if (index[i].count() &&
+        blobs[i]->data_type() != BlobProto_DataType_FP32) {
+      // Widened one blob at a time.
+      Blob<float> blob;
+      blob.FromProto(*blobs[i]);
+      WriteData(blob.cpu_data(), blob.count(), &out, &pos);
+    } else if (blobs[i]->data_size()) {
+      WriteData(blobs[i]->data().data(), blobs[i]->data_size(), &out, &pos);
+    }
+  }
+  CHECK(out) << "Failed to write " << filename;
+}
+
+template <typename Dtype>
+void WriteMappedWeights(const vector<string>& layer_names,
+    const vector<vector<Blob<Dtype>*> >& blobs, const string& filename) {
+  CHECK_EQ(layer_names.size(), blobs.size());
+  vector<IndexEntry> index;
+  for (int i = 0; i < blobs.size(); ++i) {
+    for (int j = 0; j < blobs[i].size(); ++j) {
+      IndexEntry entry;
+      entry.layer = layer_names[i];
+      entry.blob_id = j;
+      entry.shape[0] = blobs[i][j]->num();
+      entry.shape[1] = blobs[i][j]->channels();
+      entry.shape[2] = blobs[i][j]->height();
+      entry.shape[3] = blobs[i][j]->width();
+      index.push_back(entry);
+    }
+  }
+  std::ofstream out(filename.c_str(),
+      std::ios::out | std::ios::trunc | std::ios::binary);
+  CHECK(out) << "Failed to open " << filename;
+  vector<uint64_t> offsets;
+  uint64_t pos = 0;
+  WriteIndex(index, &out, &offsets, &pos);
+  int entry_id = 0;
+  for (int i = 0; i < blobs.size(); ++i) {
+    for (int j = 0; j < blobs[i].size(); ++j, ++entry_id) {
+      WritePadding(offsets[entry_id], &out, &pos);
+      if (blobs[i][j]->count()) {
+        WriteData(blobs[i][j]->cpu_data(), blobs[i][j]->count(), &out, &pos);
+      }
+    }
+  }
+  CHECK(out) << "Failed to write " << filename;
+}
+
+template void WriteMappedWeights<float>(const vector<string>& layer_names,
+    const vector<vector<Blob<float>*> >& blobs, const string& filename);
+template void WriteMappedWeights<double>(const vector<string>& layer_names,
+    const vector<vector<Blob<double>*> >& blobs, const string& filename);
+
+}  // namespace caffe
@@ -1,66 +1,151 @@
+#include <boost/math/special_functions/log1p.hpp>
 #include <boost/math/special_functions/next.hpp>
-#include <boost/random.hpp>
 
+#include <algorithm>
 #include <limits>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #include "caffe/common.hpp"
+#include "caffe/util/fast_math.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/philox.hpp"
 #include "caffe/util/rng.hpp"
 
 namespace caffe {
 
-template<>
-void caffe_cpu_gemm<float>(const CBLAS_TRANSPOSE TransA,
-    const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
-    const float alpha, const float* A, const float* B, const float beta,
-    float* C) {
-  int lda = (TransA == CblasNoTrans) ? K : M;
-  int ldb = (TransB == CblasNoTrans) ? N : K;
-  cblas_sgemm(CblasRowMajor, TransA, TransB, M, N, K, alpha, A, lda, B,
-      ldb, beta, C, N);
+static int parallel_grain_ = kDefaultParallelGrain;
+static bool deterministic_reductions_ = false;
+static bool strict_math_ = false;
+
+void caffe_set_parallel_grain(const int grain) {
+  CHECK_GT(grain, 0) << "The parallel grain must be positive.";
+  parallel_grain_ = grain;
 }
 
-template<>
-void caffe_cpu_gemm<double>(const CBLAS_TRANSPOSE TransA,
-    const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
-    const double alpha, const double* A, const double* B, const double beta,
-    double* C) {
-  int lda = (TransA == CblasNoTrans) ? K : M;
-  int ldb = (TransB == CblasNoTrans) ? N : K;
-  cblas_dgemm(CblasRowMajor, TransA, TransB, M, N, K, alpha, A, lda, B,
-      ldb, beta, C, N);
+int caffe_parallel_grain() {
+  return parallel_grain_;
 }
 
-template <>
-void caffe_cpu_gemv<float>(const CBLAS_TRANSPOSE TransA, const int M,
-    const int N, const float alpha, const float* A, const float* x,
-    const float beta, float* y) {
-  cblas_sgemv(CblasRowMajor, TransA, M, N, alpha, A, N, x, 1, beta, y, 1);
+void caffe_set_deterministic_reductions(const bool deterministic) {
+  deterministic_reductions_ = deterministic;
 }
 
-template <>
-void caffe_cpu_gemv<double>(const CBLAS_TRANSPOSE TransA, const int M,
-    const int N, const double alpha, const double* A, const double* x,
-    const double beta, double* y) {
-  cblas_dgemv(CblasRowMajor, TransA, M, N, alpha, A, N, x, 1, beta, y, 1);
+bool caffe_deterministic_reductions() {
+  return deterministic_reductions_;
+}
+
+void caffe_set_strict_math(const bool strict) {
+  strict_math_ = strict;
+}
+
+bool caffe_strict_math() {
+  return strict_math_;
+}
+
+// The primitives split their range into contiguous chunks of at least
+// parallel_grain_ elements, one per OpenMP thread. Inside a parallel region
+// (e.g. a layer that already splits over images) they stay serial.
+static int parallel_chunks(const int n) {
+#ifdef _OPENMP
+  if (omp_in_parallel()) {
+    return 1;
+  }
+  return std::max(1, std::min(omp_get_max_threads(), n / parallel_grain_));
+#else
+  return 1;
+#endif
+}
+
+// Deterministic reductions fix the partition to ceil(n / grain) chunks, so
+// the order of the additions does not depend on the thread count.
+static int reduction_chunks(const int n) {
+  if (deterministic_reductions_) {
+    return std::max(1, static_cast<int>(
+        (static_cast<int64_t>(n) + parallel_grain_ - 1) / parallel_grain_));
+  }
+  return parallel_chunks(n);
+}
+
+static inline int chunk_begin(const int n, const int chunks, const int c) {
+  return static_cast<int>(static_cast<int64_t>(n) * c / chunks);
+}
+
+// Runs a VML style kernel over the chunks of its range.
+template <typename Dtype>
+static void parallel_unary(void (*kernel)(const int, const Dtype*, Dtype*),
+    const int n, const Dtype* a, Dtype* y) {
+  const int chunks = parallel_chunks(n);
+  if (chunks == 1) {
+    kernel(n, a, y);
+    return;
+  }
+#pragma omp parallel for schedule(static)
+  for (int c = 0; c < chunks; ++c) {
+    const int begin = chunk_begin(n, chunks, c);
+    kernel(chunk_begin(n, chunks, c + 1) - begin, a + begin, y + begin);
+  }
+}
+
+template <typename Dtype>
+static void parallel_binary(
+    void (*kernel)(const int, const Dtype*, const Dtype*, Dtype*),
+    const int n, const Dtype* a, const Dtype* b, Dtype* y) {
+  const int chunks = parallel_chunks(n);
+  if (chunks == 1) {
+    kernel(n, a, b, y);
+    return;
+  }
+#pragma omp parallel for schedule(static)
+  for (int c = 0; c < chunks; ++c) {
+    const int begin = chunk_begin(n, chunks, c);
+    kernel(chunk_begin(n, chunks, c + 1) - begin, a + begin, b + begin,
+        y + begin);
+  }
 }
 
 template <>
 void caffe_axpy<float>(const int N, const float alpha, const float* X,
-    float* Y) { cblas_saxpy(N, alpha, X, 1, Y, 1); }
+    float* Y) {
+  const int chunks = parallel_chunks(N);
+#pragma omp parallel for schedule(static) if (chunks > 1)
+  for (int c = 0; c < chunks; ++c) {
+    const int begin = chunk_begin(N, chunks, c);
+    cblas_saxpy(chunk_begin(N, chunks, c + 1) - begin, alpha, X + begin, 1,
+        Y + begin, 1);
+  }
+}
 
 template <>
 void caffe_axpy<double>(const int N, const double alpha, const double* X,
-    double* Y) { cblas_daxpy(N, alpha, X, 1, Y, 1); }
+    double* Y) {
+  const int chunks = parallel_chunks(N);
+#pragma omp parallel for schedule(static) if (chunks > 1)
+  for (int c = 0; c < chunks; ++c) {
+    const int begin = chunk_begin(N, chunks, c);
+    cblas_daxpy(chunk_begin(N, chunks, c + 1) - begin, alpha, X + begin, 1,
+        Y + begin, 1);
+  }
+}
 
 template <typename Dtype>
 void caffe_set(const int N, const Dtype alpha, Dtype* Y) {
-  if (alpha == 0) {
-    memset(Y, 0, sizeof(Dtype) * N);  // NOLINT(caffe/alt_fn)
-    return;
-  }
-  for (int i = 0; i < N; ++i) {
-    Y[i] = alpha;
+  const int chunks = parallel_chunks(N);
+#pragma omp parallel for schedule(static) if (chunks > 1)
+  for (int c = 0; c < chunks; ++c) {
+    const int begin = chunk_begin(N, chunks, c);
+    const int end = chunk_begin(N, chunks, c + 1);
+    if (alpha == 0) {
+      // NOLINT_NEXT_LINE(caffe/alt_fn)
+      memset(Y + begin, 0, sizeof(Dtype) * (end - begin));
+    } else {
+      for (int i = begin; i < end; ++i) {
+        Y[i] = alpha;
+      }
+    }
   }
 }
 
@@ -68,19 +153,22 @@ template void caffe_set<int>(const int N, const int alpha, int* Y);
 template void caffe_set<float>(const int N, const float alpha, float* Y);
 template void caffe_set<double>(const int N, const double alpha, double* Y);
 
-template <>
-void caffe_add_scalar(const int N, const float alpha, float* Y) {
-  for (int i = 0; i < N; ++i) {
-    Y[i] += alpha;
+template <typename Dtype>
+void caffe_add_scalar(const int N, const Dtype alpha, Dtype* Y) {
+  const int chunks = parallel_chunks(N);
+#pragma omp parallel for schedule(static) if (chunks > 1)
+  for (int c = 0; c < chunks; ++c) {
+    const int end = chunk_begin(N, chunks, c + 1);
+    for (int i = chunk_begin(N, chunks, c); i < end; ++i) {
+      Y[i] += alpha;
+    }
   }
 }
 
-template <>
-void caffe_add_scalar(const int N, const double alpha, double* Y) {
-  for (int i = 0; i < N; ++i) {
-    Y[i] += alpha;
-  }
-}
+template void caffe_add_scalar<float>(const int N, const float alpha,
+    float* Y);
+template void caffe_add_scalar<double>(const int N, const double alpha,
+    double* Y);
 
 template <typename Dtype>
 void caffe_copy(const int N, const Dtype* X, Dtype* Y) {
@@ -106,114 +194,219 @@ template void caffe_copy<double>(const int N, const double* X, double* Y);
 
 template <>
 void caffe_scal<float>(const int N, const float alpha, float *X) {
-  cblas_sscal(N, alpha, X, 1);
+  const int chunks = parallel_chunks(N);
+#pragma omp parallel for schedule(static) if (chunks > 1)
+  for (int c = 0; c < chunks; ++c) {
+    const int begin = chunk_begin(N, chunks, c);
+    cblas_sscal(chunk_begin(N, chunks, c + 1) - begin, alpha, X + begin, 1);
+  }
 }
 
 template <>
 void caffe_scal<double>(const int N, const double alpha, double *X) {
-  cblas_dscal(N, alpha, X, 1);
+  const int chunks = parallel_chunks(N);
+#pragma omp parallel for schedule(static) if (chunks > 1)
+  for (int c = 0; c < chunks; ++c) {
+    const int begin = chunk_begin(N, chunks, c);
+    cblas_dscal(chunk_begin(N, chunks, c + 1) - begin, alpha, X + begin, 1);
+  }
 }
 
-template <>
-void caffe_cpu_axpby<float>(const int N, const float alpha, const float* X,
-                            const float beta, float* Y) {
-  cblas_saxpby(N, alpha, X, 1, beta, Y, 1);
+// One pass over X and Y, rather than the scal and axpy that cblas_?axpby
+// falls back to without MKL. beta == 0 overwrites Y, as BLAS does.
+template <typename Dtype>
+void caffe_cpu_axpby(const int N, const Dtype alpha, const Dtype* X,
+    const Dtype beta, Dtype* Y) {
+  const int chunks = parallel_chunks(N);
+#pragma omp parallel for schedule(static) if (chunks > 1)
+  for (int c = 0; c < chunks; ++c) {
+    const int end = chunk_begin(N, chunks, c + 1);
+    if (beta == 0) {
+      for (int i = chunk_begin(N, chunks, c); i < end; ++i) {
+        Y[i] = alpha * X[i];
+      }
+    } else {
+      for (int i = chunk_begin(N, chunks, c); i < end; ++i) {
+        Y[i] = alpha * X[i] + beta * Y[i];
+      }
+    }
+  }
 }
 
-template <>
-void caffe_cpu_axpby<double>(const int N, const double alpha, const double* X,
-                             const double beta, double* Y) {
-  cblas_daxpby(N, alpha, X, 1, beta, Y, 1);
-}
+template void caffe_cpu_axpby<float>(const int N, const float alpha,
+    const float* X, const float beta, float* Y);
+template void caffe_cpu_axpby<double>(const int N, const double alpha,
+    const double* X, const double beta, double* Y);
 
 template <>
 void caffe_add<float>(const int n, const float* a, const float* b,
     float* y) {
-  vsAdd(n, a, b, y);
+  parallel_binary(vsAdd, n, a, b, y);
 }
 
 template <>
 void caffe_add<double>(const int n, const double* a, const double* b,
     double* y) {
-  vdAdd(n, a, b, y);
+  parallel_binary(vdAdd, n, a, b, y);
 }
 
 template <>
 void caffe_sub<float>(const int n, const float* a, const float* b,
     float* y) {
-  vsSub(n, a, b, y);
+  parallel_binary(vsSub, n, a, b, y);
 }
 
 template <>
 void caffe_sub<double>(const int n, const double* a, const double* b,
     double* y) {
-  vdSub(n, a, b, y);
+  parallel_binary(vdSub, n, a, b, y);
 }
 
 template <>
 void caffe_mul<float>(const int n, const float* a, const float* b,
     float* y) {
-  vsMul(n, a, b, y);
+  parallel_binary(vsMul, n, a, b, y);
 }
 
 template <>
 void caffe_mul<double>(const int n, const double* a, const double* b,
     double* y) {
-  vdMul(n, a, b, y);
+  parallel_binary(vdMul, n, a, b, y);
 }
 
 template <>
 void caffe_div<float>(const int n, const float* a, const float* b,
     float* y) {
-  vsDiv(n, a, b, y);
+  parallel_binary(vsDiv, n, a, b, y);
 }
 
 template <>
 void caffe_div<double>(const int n, const double* a, const double* b,
     double* y) {
-  vdDiv(n, a, b, y);
+  parallel_binary(vdDiv, n, a, b, y);
 }
 
 template <>
 void caffe_powx<float>(const int n, const float* a, const float b,
     float* y) {
-  vsPowx(n, a, b, y);
+  const int chunks = parallel_chunks(n);
+#pragma omp parallel for schedule(static) if (chunks > 1)
+  for (int c = 0; c < chunks; ++c) {
+    const int begin = chunk_begin(n, chunks, c);
+    vsPowx(chunk_begin(n, chunks, c + 1) - begin, a + begin, b, y + begin);
+  }
 }
 
 template <>
 void caffe_powx<double>(const int n, const double* a, const double b,
     double* y) {
-  vdPowx(n, a, b, y);
+  const int chunks = parallel_chunks(n);
+#pragma omp parallel for schedule(static) if (chunks > 1)
+  for (int c = 0; c < chunks; ++c) {
+    const int begin = chunk_begin(n, chunks, c);
+    vdPowx(chunk_begin(n, chunks, c + 1) - begin, a + begin, b, y + begin);
+  }
 }
 
 template <>
 void caffe_sqr<float>(const int n, const float* a, float* y) {
-  vsSqr(n, a, y);
+  parallel_unary(vsSqr, n, a, y);
 }
 
 template <>
 void caffe_sqr<double>(const int n, const double* a, double* y) {
-  vdSqr(n, a, y);
+  parallel_unary(vdSqr, n, a, y);
 }
 
 template <>
 void caffe_exp<float>(const int n, const float* a, float* y) {
-  vsExp(n, a, y);
+  parallel_unary(strict_math_ ? vsExp : fast_exp, n, a, y);
 }
 
 template <>
 void caffe_exp<double>(const int n, const double* a, double* y) {
-  vdExp(n, a, y);
+  parallel_unary(vdExp, n, a, y);
+}
+
+// The libm kernels of strict math, and of double.
+template <typename Dtype>
+static void libm_log(const int n, const Dtype* a, Dtype* y) {
+  for (int i = 0; i < n; ++i) {
+    y[i] = log(a[i]);
+  }
+}
+
+template <typename Dtype>
+static void libm_tanh(const int n, const Dtype* a, Dtype* y) {
+  for (int i = 0; i < n; ++i) {
+    y[i] = tanh(a[i]);
+  }
+}
+
+template <typename Dtype>
+static void libm_sigmoid(const int n, const Dtype* a, Dtype* y) {
+  for (int i = 0; i < n; ++i) {
+    y[i] = 1. / (1. + exp(-a[i]));
+  }
+}
+
+template <typename Dtype>
+static void libm_log1p_exp(const int n, const Dtype* a, Dtype* y) {
+  for (int i = 0; i < n; ++i) {
+    y[i] = a[i] > 0 ? a[i] + boost::math::log1p(exp(-a[i])) :
+        boost::math::log1p(exp(a[i]));
+  }
+}
+
+template <>
+void caffe_log<float>(const int n, const float* a, float* y) {
+  parallel_unary(strict_math_ ? libm_log<float> : fast_log, n, a, y);
+}
+
+template <>
+void caffe_log<double>(const int n, const double* a, double* y) {
+  parallel_unary(libm_log<double>, n, a, y);
+}
+
+template <>
+void caffe_tanh<float>(const int n, const float* a, float* y) {
+  parallel_unary(strict_math_ ? libm_tanh<float> : fast_tanh, n, a, y);
+}
+
+template <>
+void caffe_tanh<double>(const int n, const double* a, double* y) {
+  parallel_unary(libm_tanh<double>, n, a, y);
+}
+
+template <>
+void caffe_sigmoid<float>(const int n, const float* a, float* y) {
+  parallel_unary(strict_math_ ? libm_sigmoid<float> : fast_sigmoid, n, a, y);
+}
+
+template <>
+void caffe_sigmoid<double>(const int n, const double* a, double* y) {
+  parallel_unary(libm_sigmoid<double>, n, a, y);
+}
+
+template <>
+void caffe_log1p_exp<float>(const int n, const float* a, float* y) {
+  parallel_unary(strict_math_ ? libm_log1p_exp<float> : fast_log1p_exp, n, a,
+      y);
+}
+
+template <>
+void caffe_log1p_exp<double>(const int n, const double* a, double* y) {
+  parallel_unary(libm_log1p_exp<double>, n, a, y);
 }
 
 template <>
 void caffe_abs<float>(const int n, const float* a, float* y) {
-    vsAbs(n, a, y);
+  parallel_unary(vsAbs, n, a, y);
 }
 
 template <>
 void caffe_abs<double>(const int n, const double* a, double* y) {
-    vdAbs(n, a, y);
+  parallel_unary(vdAbs, n, a, y);
 }
 
 unsigned int caffe_rng_rand() {
@@ -232,17 +425,105 @@ float caffe_nextafter(const float b);
 template
 double caffe_nextafter(const double b);
 
+// The bulk fills draw from the counter-based stream of Caffe::RNG. Each
+// call reserves the blocks it needs up front and every chunk generates its
+// own blocks, so for a fixed seed the values do not depend on the number of
+// threads. The transforms turn a buffer of random words into count values,
+// kPerBlock from each four-word block.
+static const int kRngBufferBlocks = 256;
+static const double kRngWordScale = 1. / 4294967296.;
+
+template <typename Dtype, typename Transform>
+static void rng_fill(const int n, const Transform& transform, Dtype* r) {
+  const int per_block = Transform::kPerBlock;
+  const int blocks = (n + per_block - 1) / per_block;
+  uint32_t key[2];
+  const uint64_t first = Caffe::rng_stream().ReserveBlocks(blocks, key);
+  const int chunks = parallel_chunks(n);
+#pragma omp parallel for schedule(static) if (chunks > 1)
+  for (int c = 0; c < chunks; ++c) {
+    uint32_t words[4 * kRngBufferBlocks];
+    const int end = chunk_begin(blocks, chunks, c + 1);
+    for (int b = chunk_begin(blocks, chunks, c); b < end;
+         b += kRngBufferBlocks) {
+      const int m = std::min(kRngBufferBlocks, end - b);
+      philox4x32(first + b, m, key, words);
+      transform(words, std::min(n - b * per_block, m * per_block),
+          r + b * per_block);
+    }
+  }
+}
+
+struct WordTransform {
+  static const int kPerBlock = 4;
+  void operator()(const uint32_t* words, const int count,
+      unsigned int* r) const {
+    for (int i = 0; i < count; ++i) {
+      r[i] = words[i];
+    }
+  }
+};
+
+// a + (b - a) u with u a multiple of 2^-32 in [0, 1).
+template <typename Dtype>
+struct UniformTransform {
+  static const int kPerBlock = 4;
+  UniformTransform(const Dtype a, const Dtype b) : a_(a), range_(b - a) {}
+  void operator()(const uint32_t* words, const int count, Dtype* r) const {
+    for (int i = 0; i < count; ++i) {
+      r[i] = static_cast<Dtype>(a_ + range_ * (words[i] * kRngWordScale));
+    }
+  }
+  const double a_;
+  const double range_;
+};
+
+// Box-Muller: two words give the two normals of one radius and angle; the
+// radius word is shifted into (0, 1] to keep the log finite.
+template <typename Dtype>
+struct GaussianTransform {
+  static const int kPerBlock = 4;
+  GaussianTransform(const Dtype mu, const Dtype sigma)
+      : mu_(mu), sigma_(sigma) {}
+  void operator()(const uint32_t* words, const int count, Dtype* r) const {
+    for (int i = 0; i < count; i += 2) {
+      const double radius = sigma_ * sqrt(-2. * log((words[i] + 1.) *
+          kRngWordScale));
+      const double theta = 6.283185307179586 * (words[i + 1] * kRngWordScale);
+      r[i] = static_cast<Dtype>(mu_ + radius * cos(theta));
+      if (i + 1 < count) {
+        r[i + 1] = static_cast<Dtype>(mu_ + radius * sin(theta));
+      }
+    }
+  }
+  const double mu_;
+  const double sigma_;
+};
+
+template <typename Itype>
+struct BernoulliTransform {
+  static const int kPerBlock = 4;
+  explicit BernoulliTransform(const double p) : threshold_(p * 4294967296.) {}
+  void operator()(const uint32_t* words, const int count, Itype* r) const {
+    for (int i = 0; i < count; ++i) {
+      r[i] = words[i] < threshold_;
+    }
+  }
+  const double threshold_;
+};
+
+void caffe_rng_bits(const int n, unsigned int* r) {
+  CHECK_GE(n, 0);
+  CHECK(r);
+  rng_fill(n, WordTransform(), r);
+}
+
 template <typename Dtype>
 void caffe_rng_uniform(const int n, const Dtype a, const Dtype b, Dtype* r) {
   CHECK_GE(n, 0);
   CHECK(r);
   CHECK_LE(a, b);
-  boost::uniform_real<Dtype> random_distribution(a, caffe_nextafter<Dtype>(b));
-  boost::variate_generator<caffe::rng_t*, boost::uniform_real<Dtype> >
-      variate_generator(caffe_rng(), random_distribution);
-  for (int i = 0; i < n; ++i) {
-    r[i] = variate_generator();
-  }
+  rng_fill(n, UniformTransform<Dtype>(a, b), r);
 }
 
 template
@@ -259,12 +540,7 @@ void caffe_rng_gaussian(const int n, const Dtype a,
   CHECK_GE(n, 0);
   CHECK(r);
   CHECK_GT(sigma, 0);
-  boost::normal_distribution<Dtype> random_distribution(a, sigma);
-  boost::variate_generator<caffe::rng_t*, boost::normal_distribution<Dtype> >
-      variate_generator(caffe_rng(), random_distribution);
-  for (int i = 0; i < n; ++i) {
-    r[i] = variate_generator();
-  }
+  rng_fill(n, GaussianTransform<Dtype>(a, sigma), r);
 }
 
 template
@@ -281,12 +557,7 @@ void caffe_rng_bernoulli(const int n, const Dtype p, int* r) {
   CHECK(r);
   CHECK_GE(p, 0);
   CHECK_LE(p, 1);
-  boost::bernoulli_distribution<Dtype> random_distribution(p);
-  boost::variate_generator<caffe::rng_t*, boost::bernoulli_distribution<Dtype> >
-      variate_generator(caffe_rng(), random_distribution);
-  for (int i = 0; i < n; ++i) {
-    r[i] = variate_generator();
-  }
+  rng_fill(n, BernoulliTransform<int>(p), r);
 }
 
 template
@@ -301,12 +572,7 @@ void caffe_rng_bernoulli(const int n, const Dtype p, unsigned int* r) {
   CHECK(r);
   CHECK_GE(p, 0);
   CHECK_LE(p, 1);
-  boost::bernoulli_distribution<Dtype> random_distribution(p);
-  boost::variate_generator<caffe::rng_t*, boost::bernoulli_distribution<Dtype> >
-      variate_generator(caffe_rng(), random_distribution);
-  for (int i = 0; i < n; ++i) {
-    r[i] = static_cast<unsigned int>(variate_generator());
-  }
+  rng_fill(n, BernoulliTransform<unsigned int>(p), r);
 }
 
 template
@@ -315,18 +581,275 @@ void caffe_rng_bernoulli<double>(const int n, const double p, unsigned int* r);
 template
 void caffe_rng_bernoulli<float>(const int n, const float p, unsigned int* r);
 
-template <>
-float caffe_cpu_strided_dot<float>(const int n, const float* x, const int incx,
+// A mask word takes lane_bits random words, lane_bits / 4 blocks; the
+// chunks split the mask at word boundaries, and buffer a block of mask
+// words' random words at a time.
+static const int kBernoulliBlockWords = 64;
+
+template <typename Dtype>
+void caffe_rng_bernoulli_bits(const int n, const Dtype p, unsigned int* r) {
+  CHECK_GE(n, 0);
+  CHECK(r);
+  CHECK_GE(p, 0);
+  CHECK_LE(p, 1);
+  const int words = (n + 31) / 32;
+  const double fine = floor(p * 65536. + 0.5);
+  if (fine == 0 || fine == 65536) {
+    std::fill(r, r + words, fine == 0 ? 0u : ~0u);
+    if (n % 32) {
+      r[words - 1] &= (1u << n % 32) - 1;
+    }
+    return;
+  }
+  const int lane_bits = p * 256. == floor(p * 256.) ? 8 : 16;
+  const unsigned int threshold = static_cast<unsigned int>(
+      lane_bits == 8 ? p * 256. : fine);
+  const int word_blocks = lane_bits / 4;
+  uint32_t key[2];
+  const uint64_t first =
+      Caffe::rng_stream().ReserveBlocks(words * word_blocks, key);
+  const int chunks = parallel_chunks(n);
+#pragma omp parallel for schedule(static) if (chunks > 1)
+  for (int c = 0; c < chunks; ++c) {
+    uint32_t random[kBernoulliBlockWords * 16];
+    const int end = chunk_begin(words, chunks, c + 1);
+    for (int w = chunk_begin(words, chunks, c); w < end;
+         w += kBernoulliBlockWords) {
+      const int block = std::min(kBernoulliBlockWords, end - w);
+      philox4x32(first + w * word_blocks, block * word_blocks, key, random);
+      fast_threshold_bits(std::min(n - w * 32, block * 32), random,
+          lane_bits, threshold, r + w);
+    }
+  }
+}
+
+template
+void caffe_rng_bernoulli_bits<float>(const int n, const float p,
+    unsigned int* r);
+
+template
+void caffe_rng_bernoulli_bits<double>(const int n, const double p,
+    unsigned int* r);
+
+// The chunks split the mask at word boundaries.
+template <typename Dtype>
+void caffe_cpu_mask_scale(const int n, const unsigned int* mask,
+    const Dtype alpha, const Dtype* x, Dtype* y) {
+  const int words = (n + 31) / 32;
+  const int chunks = parallel_chunks(n);
+#pragma omp parallel for schedule(static) if (chunks > 1)
+  for (int c = 0; c < chunks; ++c) {
+    const int begin = chunk_begin(words, chunks, c);
+    const int end = std::min(n, 32 * chunk_begin(words, chunks, c + 1));
+    fast_mask_scale(end - 32 * begin, mask + begin, alpha, x + 32 * begin,
+        y + 32 * begin);
+  }
+}
+
+template
+void caffe_cpu_mask_scale<float>(const int n, const unsigned int* mask,
+    const float alpha, const float* x, float* y);
+
+template
+void caffe_cpu_mask_scale<double>(const int n, const unsigned int* mask,
+    const double alpha, const double* x, double* y);
+
+// The chunks split the rows of C, or its columns when there are fewer rows
+// than threads; each 16 bytes of K count as one element of work.
+void caffe_cpu_gemm_u8s8s32(const int M, const int N, const int K,
+    const uint8_t* A, const int8_t* B, int32_t* C) {
+  const int64_t work = static_cast<int64_t>(M) * N * ((K + 15) / 16);
+  const int chunks = parallel_chunks(static_cast<int>(
+      std::min<int64_t>(work, std::numeric_limits<int>::max())));
+  if (chunks == 1) {
+    fast_gemm_u8s8s32(M, N, K, A, B, C, N);
+    return;
+  }
+  const bool split_rows = M >= chunks;
+#pragma omp parallel for schedule(static)
+  for (int c = 0; c < chunks; ++c) {
+    if (split_rows) {
+      const int begin = chunk_begin(M, chunks, c);
+      fast_gemm_u8s8s32(chunk_begin(M, chunks, c + 1) - begin, N, K,
+          A + begin * K, B, C + begin * N, N);
+    } else {
+      const int begin = chunk_begin(N, chunks, c);
+      fast_gemm_u8s8s32(M, chunk_begin(N, chunks, c + 1) - begin, K, A,
+          B + begin * K, C + begin, N);
+    }
+  }
+}
+
+template <typename Dtype>
+void caffe_cpu_quantize_u8(const int n, const Dtype* x, const Dtype scale,
+    const int zero_point, uint8_t* q) {
+  const Dtype inv_scale = 1 / scale;
+  const int chunks = parallel_chunks(n);
+#pragma omp parallel for schedule(static) if (chunks > 1)
+  for (int c = 0; c < chunks; ++c) {
+    const int begin = chunk_begin(n, chunks, c);
+    fast_quantize_u8(chunk_begin(n, chunks, c + 1) - begin, x + begin,
+        inv_scale, zero_point, q + begin);
+  }
+}
+
+template
+void caffe_cpu_quantize_u8<float>(const int n, const float* x,
+    const float scale, const int zero_point, uint8_t* q);
+
+template
+void caffe_cpu_quantize_u8<double>(const int n, const double* x,
+    const double scale, const int zero_point, uint8_t* q);
+
+// Four rows of A at a time share each load of a nonzero of B. The blocks of
+// A are the outer loop so that they stay in cache while the rows of B stream
+// through; the threads split the rows of B.
+template <typename Dtype>
+void caffe_cpu_csr_gemm(const int M, const int N, const int K,
+    const Dtype* A, const int* row_ptr, const int* col_index,
+    const Dtype* values, Dtype* C) {
+  const int chunks = parallel_chunks(static_cast<int>(std::min<int64_t>(
+      static_cast<int64_t>(M) * row_ptr[N],
+      std::numeric_limits<int>::max())));
+#pragma omp parallel for schedule(static) if (chunks > 1)
+  for (int c = 0; c < chunks; ++c) {
+    const int n_begin = chunk_begin(N, chunks, c);
+    const int n_end = chunk_begin(N, chunks, c + 1);
+    int m = 0;
+    for (; m + 4 <= M; m += 4) {
+      const Dtype* a0 = A + m * K;
+      const Dtype* a1 = a0 + K;
+      const Dtype* a2 = a1 + K;
+      const Dtype* a3 = a2 + K;
+      for (int n = n_begin; n < n_end; ++n) {
+        Dtype s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+        for (int i = row_ptr[n]; i < row_ptr[n + 1]; ++i) {
+          const int k = col_index[i];
+          const Dtype v = values[i];
+          s0 += v * a0[k];
+          s1 += v * a1[k];
+          s2 += v * a2[k];
+          s3 += v * a3[k];
+        }
+        C[m * N + n] = s0;
+        C[(m + 1) * N + n] = s1;
+        C[(m + 2) * N + n] = s2;
+        C[(m + 3) * N + n] = s3;
+      }
+    }
+    for (; m < M; ++m) {
+      const Dtype* a = A + m * K;
+      for (int n = n_begin; n < n_end; ++n) {
+        Dtype s = 0;
+        for (int i = row_ptr[n]; i < row_ptr[n + 1]; ++i) {
+          s += values[i] * a[col_index[i]];
+        }
+        C[m * N + n] = s;
+      }
+    }
+  }
+}
+
+template
+void caffe_cpu_csr_gemm<float>(const int M, const int N, const int K,
+    const float* A, const int* row_ptr, const int* col_index,
+    const float* values, float* C);
+
+template
+void caffe_cpu_csr_gemm<double>(const int M, const int N, const int K,
+    const double* A, const int* row_ptr, const int* col_index,
+    const double* values, double* C);
+
+// Fixed-order partial sums for the deterministic reductions; the library
+// kernels may reassociate depending on the CPU and their own threading.
+template <typename Dtype>
+static Dtype serial_strided_dot(const int n, const Dtype* x, const int incx,
+    const Dtype* y, const int incy) {
+  Dtype sum[4] = { 0, 0, 0, 0 };
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    for (int k = 0; k < 4; ++k) {
+      sum[k] += x[(i + k) * incx] * y[(i + k) * incy];
+    }
+  }
+  for (; i < n; ++i) {
+    sum[0] += x[i * incx] * y[i * incy];
+  }
+  return (sum[0] + sum[1]) + (sum[2] + sum[3]);
+}
+
+template <typename Dtype>
+static Dtype serial_asum(const int n, const Dtype* x) {
+  Dtype sum[4] = { 0, 0, 0, 0 };
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    for (int k = 0; k < 4; ++k) {
+      sum[k] += std::fabs(x[i + k]);
+    }
+  }
+  for (; i < n; ++i) {
+    sum[0] += std::fabs(x[i]);
+  }
+  return (sum[0] + sum[1]) + (sum[2] + sum[3]);
+}
+
+static float blas_strided_dot(const int n, const float* x, const int incx,
     const float* y, const int incy) {
   return cblas_sdot(n, x, incx, y, incy);
 }
 
-template <>
-double caffe_cpu_strided_dot<double>(const int n, const double* x,
-    const int incx, const double* y, const int incy) {
+static double blas_strided_dot(const int n, const double* x, const int incx,
+    const double* y, const int incy) {
   return cblas_ddot(n, x, incx, y, incy);
 }
 
+static float blas_asum(const int n, const float* x) {
+  return cblas_sasum(n, x, 1);
+}
+
+static double blas_asum(const int n, const double* x) {
+  return cblas_dasum(n, x, 1);
+}
+
+// Chunk partials live on the stack; a reduction with more chunks than this
+// runs them in batches of this many.
+const int kReductionBatch = 256;
+
+// The chunk partials are added in chunk order.
+template <typename Dtype>
+Dtype caffe_cpu_strided_dot(const int n, const Dtype* x, const int incx,
+    const Dtype* y, const int incy) {
+  if (incx <= 0 || incy <= 0) {
+    return blas_strided_dot(n, x, incx, y, incy);
+  }
+  const bool deterministic = deterministic_reductions_;
+  const int chunks = reduction_chunks(n);
+  Dtype sum = 0;
+  for (int first = 0; first < chunks; first += kReductionBatch) {
+    const int batch = std::min(kReductionBatch, chunks - first);
+    Dtype partial[kReductionBatch];
+#pragma omp parallel for schedule(static) if (batch > 1)
+    for (int b = 0; b < batch; ++b) {
+      const int begin = chunk_begin(n, chunks, first + b);
+      const int count = chunk_begin(n, chunks, first + b + 1) - begin;
+      const Dtype* x_chunk = x + static_cast<int64_t>(begin) * incx;
+      const Dtype* y_chunk = y + static_cast<int64_t>(begin) * incy;
+      partial[b] = deterministic ?
+          serial_strided_dot(count, x_chunk, incx, y_chunk, incy) :
+          blas_strided_dot(count, x_chunk, incx, y_chunk, incy);
+    }
+    for (int b = 0; b < batch; ++b) {
+      sum += partial[b];
+    }
+  }
+  return sum;
+}
+
+template float caffe_cpu_strided_dot<float>(const int n, const float* x,
+    const int incx, const float* y, const int incy);
+template double caffe_cpu_strided_dot<double>(const int n, const double* x,
+    const int incx, const double* y, const int incy);
+
 template <typename Dtype>
 Dtype caffe_cpu_dot(const int n, const Dtype* x, const Dtype* y) {
   return caffe_cpu_strided_dot(n, x, 1, y, 1);
@@ -360,31 +883,438 @@ int caffe_cpu_hamming_distance<double>(const int n, const double* x,
   return dist;
 }
 */
-template <>
-float caffe_cpu_asum<float>(const int n, const float* x) {
-  return cblas_sasum(n, x, 1);
+template <typename Dtype>
+Dtype caffe_cpu_asum(const int n, const Dtype* x) {
+  const bool deterministic = deterministic_reductions_;
+  const int chunks = reduction_chunks(n);
+  Dtype sum = 0;
+  for (int first = 0; first < chunks; first += kReductionBatch) {
+    const int batch = std::min(kReductionBatch, chunks - first);
+    Dtype partial[kReductionBatch];
+#pragma omp parallel for schedule(static) if (batch > 1)
+    for (int b = 0; b < batch; ++b) {
+      const int begin = chunk_begin(n, chunks, first + b);
+      const int count = chunk_begin(n, chunks, first + b + 1) - begin;
+      partial[b] = deterministic ? serial_asum(count, x + begin) :
+          blas_asum(count, x + begin);
+    }
+    for (int b = 0; b < batch; ++b) {
+      sum += partial[b];
+    }
+  }
+  return sum;
 }
 
-template <>
-double caffe_cpu_asum<double>(const int n, const double* x) {
-  return cblas_dasum(n, x, 1);
-}
+template float caffe_cpu_asum<float>(const int n, const float* x);
+template double caffe_cpu_asum<double>(const int n, const double* x);
 
 INSTANTIATE_CAFFE_CPU_UNARY_FUNC(sign);
 //INSTANTIATE_CAFFE_CPU_UNARY_FUNC(sgnbit);
 
-template <>
-void caffe_cpu_scale<float>(const int n, const float alpha, const float *x,
-                            float* y) {
-  cblas_scopy(n, x, 1, y, 1);
-  cblas_sscal(n, alpha, y, 1);
+template <typename Dtype>
+void caffe_cpu_scale(const int n, const Dtype alpha, const Dtype *x,
+    Dtype* y) {
+  const int chunks = parallel_chunks(n);
+#pragma omp parallel for schedule(static) if (chunks > 1)
+  for (int c = 0; c < chunks; ++c) {
+    const int end = chunk_begin(n, chunks, c + 1);
+    for (int i = chunk_begin(n, chunks, c); i < end; ++i) {
+      y[i] = alpha * x[i];
+    }
+  }
 }
 
-template <>
-void caffe_cpu_scale<double>(const int n, const double alpha, const double *x,
-                             double* y) {
-  cblas_dcopy(n, x, 1, y, 1);
-  cblas_dscal(n, alpha, y, 1);
+template void caffe_cpu_scale<float>(const int n, const float alpha,
+    const float *x, float* y);
+template void caffe_cpu_scale<double>(const int n, const double alpha,
+    const double *x, double* y);
+
+// The axis primitives work on blocks of this many inner indices, with the
+// accumulators on the stack.
+const int kAxisBlock = 256;
+
+// Sums of contiguous rows with independent accumulators; a single running
+// sum would serialize on the add latency and cannot be vectorized.
+template <typename Dtype>
+static Dtype row_sum(const int n, const Dtype* x) {
+  Dtype acc[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    for (int k = 0; k < 8; ++k) {
+      acc[k] += x[i + k];
+    }
+  }
+  for (; i < n; ++i) {
+    acc[0] += x[i];
+  }
+  return ((acc[0] + acc[1]) + (acc[2] + acc[3]))
+      + ((acc[4] + acc[5]) + (acc[6] + acc[7]));
 }
 
+template <typename Dtype>
+static Dtype row_dot(const int n, const Dtype* a, const Dtype* b) {
+  Dtype acc[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    for (int k = 0; k < 8; ++k) {
+      acc[k] += a[i + k] * b[i + k];
+    }
+  }
+  for (; i < n; ++i) {
+    acc[0] += a[i] * b[i];
+  }
+  return ((acc[0] + acc[1]) + (acc[2] + acc[3]))
+      + ((acc[4] + acc[5]) + (acc[6] + acc[7]));
+}
+
+// The sum and the sum of squares of x - shift.
+template <typename Dtype>
+static void row_shifted_sums(const int n, const Dtype* x, const Dtype shift,
+    Dtype* sum, Dtype* sum_sq) {
+  Dtype acc[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+  Dtype acc_sq[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    for (int k = 0; k < 8; ++k) {
+      const Dtype delta = x[i + k] - shift;
+      acc[k] += delta;
+      acc_sq[k] += delta * delta;
+    }
+  }
+  for (; i < n; ++i) {
+    const Dtype delta = x[i] - shift;
+    acc[0] += delta;
+    acc_sq[0] += delta * delta;
+  }
+  *sum = ((acc[0] + acc[1]) + (acc[2] + acc[3]))
+      + ((acc[4] + acc[5]) + (acc[6] + acc[7]));
+  *sum_sq = ((acc_sq[0] + acc_sq[1]) + (acc_sq[2] + acc_sq[3]))
+      + ((acc_sq[4] + acc_sq[5]) + (acc_sq[6] + acc_sq[7]));
+}
+
+// Splits an outer x dim x inner array into tasks of one outer index and a
+// contiguous range of inner indices, enough of them to feed the threads.
+class AxisPartition {
+ public:
+  AxisPartition(const int outer, const int dim, const int inner)
+      : inner_(inner) {
+    const int chunks = parallel_chunks(outer * dim * inner);
+    parallel_ = chunks > 1;
+    inner_chunks_ = outer >= chunks ? 1 :
+        std::max(1, std::min(inner, (chunks + outer - 1) / outer));
+    tasks_ = outer * inner_chunks_;
+  }
+  bool parallel() const { return parallel_; }
+  int tasks() const { return tasks_; }
+  void Range(const int task, int* o, int* begin, int* end) const {
+    *o = task / inner_chunks_;
+    const int c = task % inner_chunks_;
+    *begin = chunk_begin(inner_, inner_chunks_, c);
+    *end = chunk_begin(inner_, inner_chunks_, c + 1);
+  }
+
+ private:
+  int inner_;
+  int inner_chunks_;
+  int tasks_;
+  bool parallel_;
+};
+
+template <typename Dtype>
+void caffe_cpu_axis_sum(const int outer, const int dim, const int inner,
+    const Dtype alpha, const Dtype* x, const Dtype beta, Dtype* y) {
+  const AxisPartition part(outer, dim, inner);
+#pragma omp parallel for schedule(static) if (part.parallel())
+  for (int t = 0; t < part.tasks(); ++t) {
+    int o, begin, end;
+    part.Range(t, &o, &begin, &end);
+    const Dtype* x_o = x + o * dim * inner;
+    for (int b = begin; b < end; b += kAxisBlock) {
+      const int n = std::min(kAxisBlock, end - b);
+      Dtype acc[kAxisBlock];
+      if (inner == 1) {
+        acc[0] = row_sum(dim, x_o);
+      } else {
+        for (int i = 0; i < n; ++i) {
+          acc[i] = 0;
+        }
+        for (int d = 0; d < dim; ++d) {
+          const Dtype* row = x_o + d * inner + b;
+          for (int i = 0; i < n; ++i) {
+            acc[i] += row[i];
+          }
+        }
+      }
+      Dtype* y_o = y + o * inner + b;
+      if (beta == 0) {
+        for (int i = 0; i < n; ++i) {
+          y_o[i] = alpha * acc[i];
+        }
+      } else {
+        for (int i = 0; i < n; ++i) {
+          y_o[i] = alpha * acc[i] + beta * y_o[i];
+        }
+      }
+    }
+  }
+}
+
+template void caffe_cpu_axis_sum<float>(const int outer, const int dim,
+    const int inner, const float alpha, const float* x, const float beta,
+    float* y);
+template void caffe_cpu_axis_sum<double>(const int outer, const int dim,
+    const int inner, const double alpha, const double* x, const double beta,
+    double* y);
+
+template <typename Dtype>
+void caffe_cpu_axis_max(const int outer, const int dim, const int inner,
+    const Dtype* x, Dtype* y) {
+  CHECK_GT(dim, 0);
+  const AxisPartition part(outer, dim, inner);
+#pragma omp parallel for schedule(static) if (part.parallel())
+  for (int t = 0; t < part.tasks(); ++t) {
+    int o, begin, end;
+    part.Range(t, &o, &begin, &end);
+    const Dtype* x_o = x + o * dim * inner;
+    Dtype* y_o = y + o * inner;
+    for (int i = begin; i < end; ++i) {
+      y_o[i] = x_o[i];
+    }
+    for (int d = 1; d < dim; ++d) {
+      const Dtype* row = x_o + d * inner;
+      for (int i = begin; i < end; ++i) {
+        y_o[i] = std::max(y_o[i], row[i]);
+      }
+    }
+  }
+}
+
+template void caffe_cpu_axis_max<float>(const int outer, const int dim,
+    const int inner, const float* x, float* y);
+template void caffe_cpu_axis_max<double>(const int outer, const int dim,
+    const int inner, const double* x, double* y);
+
+template <typename Dtype>
+void caffe_cpu_axis_dot(const int outer, const int dim, const int inner,
+    const Dtype* a, const Dtype* b, Dtype* y) {
+  const AxisPartition part(outer, dim, inner);
+#pragma omp parallel for schedule(static) if (part.parallel())
+  for (int t = 0; t < part.tasks(); ++t) {
+    int o, begin, end;
+    part.Range(t, &o, &begin, &end);
+    const Dtype* a_o = a + o * dim * inner;
+    const Dtype* b_o = b + o * dim * inner;
+    if (inner == 1) {
+      y[o] = row_dot(dim, a_o, b_o);
+      continue;
+    }
+    for (int k = begin; k < end; k += kAxisBlock) {
+      const int n = std::min(kAxisBlock, end - k);
+      Dtype acc[kAxisBlock];
+      for (int i = 0; i < n; ++i) {
+        acc[i] = 0;
+      }
+      for (int d = 0; d < dim; ++d) {
+        const Dtype* a_row = a_o + d * inner + k;
+        const Dtype* b_row = b_o + d * inner + k;
+        for (int i = 0; i < n; ++i) {
+          acc[i] += a_row[i] * b_row[i];
+        }
+      }
+      Dtype* y_o = y + o * inner + k;
+      for (int i = 0; i < n; ++i) {
+        y_o[i] = acc[i];
+      }
+    }
+  }
+}
+
+template void caffe_cpu_axis_dot<float>(const int outer, const int dim,
+    const int inner, const float* a, const float* b, float* y);
+template void caffe_cpu_axis_dot<double>(const int outer, const int dim,
+    const int inner, const double* a, const double* b, double* y);
+
+// Sums are taken around the first value along d, which keeps the squares
+// well conditioned when the mean is large next to the deviation.
+template <typename Dtype>
+void caffe_cpu_axis_mean_var(const int outer, const int dim, const int inner,
+    const Dtype* x, Dtype* mean, Dtype* variance) {
+  CHECK_GT(dim, 0);
+  const AxisPartition part(outer, dim, inner);
+#pragma omp parallel for schedule(static) if (part.parallel())
+  for (int t = 0; t < part.tasks(); ++t) {
+    int o, begin, end;
+    part.Range(t, &o, &begin, &end);
+    const Dtype* x_o = x + o * dim * inner;
+    for (int k = begin; k < end; k += kAxisBlock) {
+      const int n = std::min(kAxisBlock, end - k);
+      Dtype sum[kAxisBlock];
+      Dtype sum_sq[kAxisBlock];
+      const Dtype* shift = x_o + k;
+      if (inner == 1) {
+        row_shifted_sums(dim, x_o, shift[0], &sum[0], &sum_sq[0]);
+      } else {
+        for (int i = 0; i < n; ++i) {
+          sum[i] = 0;
+          sum_sq[i] = 0;
+        }
+        for (int d = 0; d < dim; ++d) {
+          const Dtype* row = x_o + d * inner + k;
+          for (int i = 0; i < n; ++i) {
+            const Dtype delta = row[i] - shift[i];
+            sum[i] += delta;
+            sum_sq[i] += delta * delta;
+          }
+        }
+      }
+      for (int i = 0; i < n; ++i) {
+        const Dtype m = sum[i] / dim;
+        mean[o * inner + k + i] = shift[i] + m;
+        variance[o * inner + k + i] =
+            std::max(Dtype(0), sum_sq[i] / dim - m * m);
+      }
+    }
+  }
+}
+
+template void caffe_cpu_axis_mean_var<float>(const int outer, const int dim,
+    const int inner, const float* x, float* mean, float* variance);
+template void caffe_cpu_axis_mean_var<double>(const int outer, const int dim,
+    const int inner, const double* x, double* mean, double* variance);
+
+template <typename Dtype>
+void caffe_cpu_axis_add(const int outer, const int dim, const int inner,
+    const Dtype alpha, const Dtype* v, Dtype* x) {
+  const AxisPartition part(outer, dim, inner);
+#pragma omp parallel for schedule(static) if (part.parallel())
+  for (int t = 0; t < part.tasks(); ++t) {
+    int o, begin, end;
+    part.Range(t, &o, &begin, &end);
+    Dtype* x_o = x + o * dim * inner;
+    const Dtype* v_o = v + o * inner;
+    if (inner == 1) {
+      const Dtype value = alpha * v_o[0];
+      for (int d = 0; d < dim; ++d) {
+        x_o[d] += value;
+      }
+      continue;
+    }
+    for (int d = 0; d < dim; ++d) {
+      Dtype* row = x_o + d * inner;
+      for (int i = begin; i < end; ++i) {
+        row[i] += alpha * v_o[i];
+      }
+    }
+  }
+}
+
+template void caffe_cpu_axis_add<float>(const int outer, const int dim,
+    const int inner, const float alpha, const float* v, float* x);
+template void caffe_cpu_axis_add<double>(const int outer, const int dim,
+    const int inner, const double alpha, const double* v, double* x);
+
+template <typename Dtype>
+void caffe_cpu_axis_mul(const int outer, const int dim, const int inner,
+    const Dtype* v, Dtype* x) {
+  const AxisPartition part(outer, dim, inner);
+#pragma omp parallel for schedule(static) if (part.parallel())
+  for (int t = 0; t < part.tasks(); ++t) {
+    int o, begin, end;
+    part.Range(t, &o, &begin, &end);
+    Dtype* x_o = x + o * dim * inner;
+    const Dtype* v_o = v + o * inner;
+    if (inner == 1) {
+      const Dtype value = v_o[0];
+      for (int d = 0; d < dim; ++d) {
+        x_o[d] *= value;
+      }
+      continue;
+    }
+    for (int d = 0; d < dim; ++d) {
+      Dtype* row = x_o + d * inner;
+      for (int i = begin; i < end; ++i) {
+        row[i] *= v_o[i];
+      }
+    }
+  }
+}
+
+template void caffe_cpu_axis_mul<float>(const int outer, const int dim,
+    const int inner, const float* v, float* x);
+template void caffe_cpu_axis_mul<double>(const int outer, const int dim,
+    const int inner, const double* v, double* x);
+
+template <typename Dtype>
+void caffe_cpu_axis_normalize(const int outer, const int dim,
+    const int inner, const Dtype* x, const Dtype* mean, const Dtype* scale,
+    Dtype* y) {
+  const AxisPartition part(outer, dim, inner);
+#pragma omp parallel for schedule(static) if (part.parallel())
+  for (int t = 0; t < part.tasks(); ++t) {
+    int o, begin, end;
+    part.Range(t, &o, &begin, &end);
+    const Dtype* x_o = x + o * dim * inner;
+    Dtype* y_o = y + o * dim * inner;
+    const Dtype* mean_o = mean + o * inner;
+    const Dtype* scale_o = scale ? scale + o * inner : NULL;
+    for (int d = 0; d < dim; ++d) {
+      const Dtype* x_row = x_o + d * inner;
+      Dtype* y_row = y_o + d * inner;
+      if (scale_o) {
+        for (int i = begin; i < end; ++i) {
+          y_row[i] = (x_row[i] - mean_o[i]) * scale_o[i];
+        }
+      } else {
+        for (int i = begin; i < end; ++i) {
+          y_row[i] = x_row[i] - mean_o[i];
+        }
+      }
+    }
+  }
+}
+
+template void caffe_cpu_axis_normalize<float>(const int outer, const int dim,
+    const int inner, const float* x, const float* mean, const float* scale,
+    float* y);
+template void caffe_cpu_axis_normalize<double>(const int outer,
+    const int dim, const int inner, const double* x, const double* mean,
+    const double* scale, double* y);
+
+template <typename Dtype>
+void caffe_cpu_zero_other_rows(const int num, const int dim,
+    const vector<int>& rows, Dtype* x) {
+  int begin = 0;
+  for (int i = 0; i <= rows.size(); ++i) {
+    const int end = i < rows.size() ? rows[i] : num;
+    caffe_set((end - begin) * dim, Dtype(0), x + begin * dim);
+    begin = end + 1;
+  }
+}
+
+template void caffe_cpu_zero_other_rows<float>(const int num, const int dim,
+    const vector<int>& rows, float* x);
+template void caffe_cpu_zero_other_rows<double>(const int num,
+    const int dim, const vector<int>& rows, double* x);
+
+template <typename Dtype>
+Dtype caffe_cpu_softmax(const int n, Dtype* x) {
+  Dtype max_value = x[0];
+  for (int i = 1; i < n; ++i) {
+    max_value = std::max(max_value, x[i]);
+  }
+  for (int i = 0; i < n; ++i) {
+    x[i] -= max_value;
+  }
+  caffe_exp(n, x, x);
+  Dtype sum = 0;
+  for (int i = 0; i < n; ++i) {
+    sum += x[i];
+  }
+  caffe_scal(n, Dtype(1) / sum, x);
+  return max_value + log(sum);
+}
+
+template float caffe_cpu_softmax<float>(const int n, float* x);
+template double caffe_cpu_softmax<double>(const int n, double* x);
+
 }  // namespace caffe
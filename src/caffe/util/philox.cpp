@@ -0,0 +1,124 @@
+#include <stdint.h>
+
+// SSE2 is part of every x86-64 target, and of 32-bit MSVC builds with
+// /arch:SSE2.
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CAFFE_PHILOX_SSE2
+#endif
+
+#include "caffe/util/philox.hpp"
+
+namespace caffe {
+
+static const uint32_t kPhiloxM0 = 0xD2511F53;
+static const uint32_t kPhiloxM1 = 0xCD9E8D57;
+static const uint32_t kPhiloxW0 = 0x9E3779B9;
+static const uint32_t kPhiloxW1 = 0xBB67AE85;
+static const int kPhiloxRounds = 10;
+
+static inline void philox_block(const uint64_t counter, const uint32_t key[2],
+    uint32_t* out) {
+  uint32_t c0 = static_cast<uint32_t>(counter);
+  uint32_t c1 = static_cast<uint32_t>(counter >> 32);
+  uint32_t c2 = 0;
+  uint32_t c3 = 0;
+  uint32_t k0 = key[0];
+  uint32_t k1 = key[1];
+  for (int round = 0; round < kPhiloxRounds; ++round) {
+    const uint64_t p0 = static_cast<uint64_t>(kPhiloxM0) * c0;
+    const uint64_t p1 = static_cast<uint64_t>(kPhiloxM1) * c2;
+    c0 = static_cast<uint32_t>(p1 >> 32) ^ c1 ^ k0;
+    c1 = static_cast<uint32_t>(p1);
+    c2 = static_cast<uint32_t>(p0 >> 32) ^ c3 ^ k1;
+    c3 = static_cast<uint32_t>(p0);
+    k0 += kPhiloxW0;
+    k1 += kPhiloxW1;
+  }
+  out[0] = c0;
+  out[1] = c1;
+  out[2] = c2;
+  out[3] = c3;
+}
+
+#ifdef CAFFE_PHILOX_SSE2
+
+// The high and low halves of the products of four lanes with m.
+// _mm_mul_epu32 multiplies the even lanes, so the odd ones are shifted down
+// for a second product.
+static inline void mulhilo_epu32(const __m128i a, const __m128i m,
+    __m128i* hi, __m128i* lo) {
+  const __m128i even = _mm_mul_epu32(a, m);
+  const __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), m);
+  *lo = _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+      _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+  *hi = _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 3, 1)),
+      _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 3, 1)));
+}
+
+// Four consecutive blocks, one per lane, transposed back to block order.
+static inline void philox_block4(const uint64_t counter,
+    const uint32_t key[2], uint32_t* out) {
+  uint32_t low[4];
+  uint32_t high[4];
+  for (int j = 0; j < 4; ++j) {
+    low[j] = static_cast<uint32_t>(counter + j);
+    high[j] = static_cast<uint32_t>((counter + j) >> 32);
+  }
+  __m128i c0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(low));
+  __m128i c1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(high));
+  __m128i c2 = _mm_setzero_si128();
+  __m128i c3 = _mm_setzero_si128();
+  const __m128i m0 = _mm_set1_epi32(static_cast<int>(kPhiloxM0));
+  const __m128i m1 = _mm_set1_epi32(static_cast<int>(kPhiloxM1));
+  uint32_t k0 = key[0];
+  uint32_t k1 = key[1];
+  for (int round = 0; round < kPhiloxRounds; ++round) {
+    __m128i hi0, lo0, hi1, lo1;
+    mulhilo_epu32(c0, m0, &hi0, &lo0);
+    mulhilo_epu32(c2, m1, &hi1, &lo1);
+    c0 = _mm_xor_si128(_mm_xor_si128(hi1, c1),
+        _mm_set1_epi32(static_cast<int>(k0)));
+    c1 = lo1;
+    c2 = _mm_xor_si128(_mm_xor_si128(hi0, c3),
+        _mm_set1_epi32(static_cast<int>(k1)));
+    c3 = lo0;
+    k0 += kPhiloxW0;
+    k1 += kPhiloxW1;
+  }
+  // Transpose the 4x4 words so that each block's words are contiguous.
+  const __m128i t0 = _mm_unpacklo_epi32(c0, c1);
+  const __m128i t1 = _mm_unpacklo_epi32(c2, c3);
+  const __m128i t2 = _mm_unpackhi_epi32(c0, c1);
+  const __m128i t3 = _mm_unpackhi_epi32(c2, c3);
+  __m128i* dst = reinterpret_cast<__m128i*>(out);
+  _mm_storeu_si128(dst, _mm_unpacklo_epi64(t0, t1));
+  _mm_storeu_si128(dst + 1, _mm_unpackhi_epi64(t0, t1));
+  _mm_storeu_si128(dst + 2, _mm_unpacklo_epi64(t2, t3));
+  _mm_storeu_si128(dst + 3, _mm_unpackhi_epi64(t2, t3));
+}
+
+void philox4x32(const uint64_t first, const int blocks, const uint32_t key[2],
+    uint32_t* out) {
+  int b = 0;
+  for (; b + 4 <= blocks; b += 4) {
+    philox_block4(first + b, key, out + 4 * b);
+  }
+  for (; b < blocks; ++b) {
+    philox_block(first + b, key, out + 4 * b);
+  }
+}
+
+#else
+
+void philox4x32(const uint64_t first, const int blocks, const uint32_t key[2],
+    uint32_t* out) {
+  for (int b = 0; b < blocks; ++b) {
+    philox_block(first + b, key, out + 4 * b);
+  }
+}
+
+#endif  // CAFFE_PHILOX_SSE2
+
+}  // namespace caffe
@@ -0,0 +1,150 @@
+#include <stdint.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/quantization.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+Int8Engine<Dtype>::Int8Engine(const QuantizationParameter& param)
+    : param_(param), num_output_(0), dim_(0) {
+  CHECK_GE(param_.input_scale(), 0) << "input_scale must be non-negative.";
+  CHECK_LE(param_.input_zero_point(), 255)
+      << "input_zero_point must be in [0, 255].";
+}
+
+template <typename Dtype>
+void Int8Engine<Dtype>::SetWeights(const int num_output, const int dim,
+    const Dtype* weights) {
+  num_output_ = num_output;
+  dim_ = dim;
+  weights_.resize(num_output * dim);
+  weight_scales_.resize(num_output);
+  weight_sums_.resize(num_output);
+  for (int o = 0; o < num_output; ++o) {
+    const Dtype* w = weights + o * dim;
+    Dtype max_abs = 0;
+    for (int k = 0; k < dim; ++k) {
+      max_abs = std::max(max_abs, static_cast<Dtype>(std::fabs(w[k])));
+    }
+    const Dtype scale = max_abs > 0 ? max_abs / 127 : Dtype(1);
+    int8_t* q = &weights_[o * dim];
+    int32_t sum = 0;
+    for (int k = 0; k < dim; ++k) {
+      const int v = static_cast<int>(std::floor(w[k] / scale + Dtype(0.5)));
+      q[k] = static_cast<int8_t>(std::max(-127, std::min(127, v)));
+      sum += q[k];
+    }
+    weight_scales_[o] = scale;
+    weight_sums_[o] = sum;
+  }
+}
+
+template <typename Dtype>
+void Int8Engine<Dtype>::InputQuantization(const int n, const Dtype* x,
+    Dtype* scale, int* zero_point) const {
+  *scale = param_.input_scale();
+  *zero_point = param_.input_zero_point();
+  if (*scale > 0) {
+    return;
+  }
+  // Uncalibrated: signed inputs are centered on 128, others use the full
+  // range.
+  Dtype min_x = 0;
+  Dtype max_x = 0;
+  for (int i = 0; i < n; ++i) {
+    min_x = std::min(min_x, x[i]);
+    max_x = std::max(max_x, x[i]);
+  }
+  *zero_point = min_x < 0 ? 128 : 0;
+  *scale = min_x < 0 ? std::max(-min_x, max_x) / 127 : max_x / 255;
+  if (!(*scale > 0)) {
+    *scale = 1;
+  }
+}
+
+template <typename Dtype>
+void Int8Engine<Dtype>::Forward(const int rows, const uint8_t* q,
+    const Dtype scale, const int zero_point, const Dtype* bias,
+    const bool y_trans, Dtype* y) {
+  CHECK(has_weights()) << "SetWeights must come before Forward.";
+  sums_.resize(rows * num_output_);
+  caffe_cpu_gemm_u8s8s32(rows, num_output_, dim_, q, &weights_[0],
+      &sums_[0]);
+
+  // y = scale * weight_scale * sum((q - zero_point) * w) + bias, with
+  // sum(zero_point * w) taken out of the int32 sums before the conversion.
+  const int outputs = num_output_;
+  vector<Dtype> multipliers(outputs);
+  vector<int32_t> offsets(outputs);
+  vector<Dtype> biases(outputs, Dtype(0));
+  for (int o = 0; o < outputs; ++o) {
+    multipliers[o] = scale * weight_scales_[o];
+    offsets[o] = zero_point * weight_sums_[o];
+    if (bias) {
+      biases[o] = bias[o];
+    }
+  }
+  // The fused ReLU is a lower bound, so that the store does not branch on
+  // the sign of every output.
+  const Dtype lower = param_.fuse_relu() ? Dtype(0) :
+      -std::numeric_limits<Dtype>::max();
+  const int32_t* sums = &sums_[0];
+  const Dtype* m = &multipliers[0];
+  const int32_t* c = &offsets[0];
+  const Dtype* b = &biases[0];
+  // The sums are read in blocks of rows that stay in L1 while the transposed
+  // output is written one contiguous run per output.
+  const int kBlock = 64;
+#pragma omp parallel for schedule(static) \
+    if (rows * outputs > caffe_parallel_grain())
+  for (int r0 = 0; r0 < rows; r0 += kBlock) {
+    const int r1 = std::min(rows, r0 + kBlock);
+    if (y_trans) {
+      for (int o = 0; o < outputs; ++o) {
+        for (int r = r0; r < r1; ++r) {
+          const Dtype v = m[o] * static_cast<Dtype>(
+              sums[r * outputs + o] - c[o]) + b[o];
+          y[o * rows + r] = std::max(v, lower);
+        }
+      }
+    } else {
+      for (int r = r0; r < r1; ++r) {
+        for (int o = 0; o < outputs; ++o) {
+          const Dtype v = m[o] * static_cast<Dtype>(
+              sums[r * outputs + o] - c[o]) + b[o];
+          y[r * outputs + o] = std::max(v, lower);
+        }
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void Int8Engine<Dtype>::Forward(const int rows, const Dtype* x,
+    const Dtype* bias, Dtype* y) {
+  const int count = rows * dim_;
+  Dtype scale;
+  int zero_point;
+  InputQuantization(count, x, &scale, &zero_point);
+  input_.resize(count);
+  caffe_cpu_quantize_u8(count, x, scale, zero_point, &input_[0]);
+  Forward(rows, &input_[0], scale, zero_point, bias, false, y);
+}
+
+template <typename Dtype>
+uint64_t Int8Engine<Dtype>::workspace_bytes() const {
+  return weights_.size() + input_.size()
+      + sizeof(Dtype) * weight_scales_.size()
+      + sizeof(int32_t) * (weight_sums_.size() + sums_.size());
+}
+
+INSTANTIATE_CLASS(Int8Engine);
+
+}  // namespace caffe
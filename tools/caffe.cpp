@@ -1,5 +1,7 @@
 #include <glog/logging.h>
 
+#include <algorithm>
+#include <cmath>
 #include <cstring>
 #include <map>
 #include <string>
@@ -7,6 +9,7 @@
 #include <fstream>
 
 #include "caffe/caffe.hpp"
+#include "caffe/util/upgrade_proto.hpp"
 
 using caffe::Blob;
 using caffe::Caffe;
@@ -30,6 +33,8 @@ DEFINE_string(weights, "",
     "Cannot be set simultaneously with snapshot.");
 DEFINE_string(outfile, "",
     "The file to output the class probability.");
+DEFINE_string(quantized_model, "",
+    "The model definition with INT8 engines that calibrate writes.");
 DEFINE_string(phase, "",
 	"The phase of caffe model (used in predict).");
 DEFINE_int32(iterations, 50,
@@ -40,6 +45,19 @@ DEFINE_int32(score_index, 0,
     "The index of score to output.");
 DEFINE_int32(random_seed, 0,
     "The random seed used to generate random transformed images.");
+DEFINE_string(blas, "",
+    "Optional; the CPU BLAS backend, cblas or builtin. Overrides CAFFE_BLAS.");
+DEFINE_bool(blas_profile, false,
+    "Log per-routine BLAS call counts and timings when the command ends.");
+DEFINE_int32(parallel_grain, 0,
+    "Optional; the minimum number of elements per thread for the parallel "
+    "math primitives.");
+DEFINE_bool(deterministic_reductions, false,
+    "Sum dot products and norms over fixed chunks, so that results do not "
+    "depend on the thread count.");
+DEFINE_bool(strict_math, false,
+    "Compute exp, log, tanh and sigmoid with libm instead of the faster "
+    "polynomial kernels, for bit-exact comparisons.");
 
 // A simple registry for caffe commands.
 typedef int (*BrewFunction)();
@@ -97,6 +115,10 @@ int train() {
 
   caffe::SolverParameter solver_param;
   caffe::ReadProtoFromTextFileOrDie(FLAGS_solver, &solver_param);
+  if (FLAGS_weights.size()) {
+    LOG(INFO) << "Finetuning from " << FLAGS_weights;
+    solver_param.set_weights(FLAGS_weights);
+  }
 
   // If the gpu flag is not provided, allow the mode and device to be set
   // in the solver prototxt.
@@ -122,10 +144,6 @@ int train() {
   if (FLAGS_snapshot.size()) {
     LOG(INFO) << "Resuming from " << FLAGS_snapshot;
     solver->Solve(FLAGS_snapshot);
-  } else if (FLAGS_weights.size()) {
-    LOG(INFO) << "Finetuning from " << FLAGS_weights;
-    solver->net()->CopyTrainedLayersFrom(FLAGS_weights);
-    solver->Solve();
   } else {
     solver->Solve();
   }
@@ -151,8 +169,7 @@ int test() {
   }
   // Instantiate the caffe net.
   Caffe::set_phase(Caffe::TEST);
-  Net<float> caffe_net(FLAGS_model);
-  caffe_net.CopyTrainedLayersFrom(FLAGS_weights);
+  Net<float> caffe_net(FLAGS_model, FLAGS_weights);
   LOG(INFO) << "Running for " << FLAGS_iterations << " iterations.";
 
   vector<Blob<float>* > bottom_vec;
@@ -201,6 +218,124 @@ int test() {
 }
 RegisterBrewFunction(test);
 
+// Calibrate: pick the input scales of INT8 inference from the range of the
+// inputs of every InnerProduct and Convolution layer over FLAGS_iterations
+// TEST batches, write the model with those layers on the INT8 engine, and
+// compare it with the float model on the same batches.
+int calibrate() {
+  CHECK_GT(FLAGS_model.size(), 0) << "Need a model definition to calibrate.";
+  CHECK_GT(FLAGS_weights.size(), 0) << "Need model weights to calibrate.";
+  CHECK_GT(FLAGS_quantized_model.size(), 0)
+      << "Need a file to write the quantized model definition to.";
+  CHECK_LT(FLAGS_gpu, 0) << "INT8 inference runs on CPU only.";
+  Caffe::set_mode(Caffe::CPU);
+  Caffe::set_phase(Caffe::TEST);
+  LOG(INFO) << "Calibrating over " << FLAGS_iterations << " iterations.";
+
+  // Only one net is alive at a time: they all open the same data source,
+  // which LevelDB lets only one handle per process open.
+  std::map<caffe::string, std::pair<float, float> > ranges;
+  {
+    Caffe::set_random_seed(FLAGS_random_seed);
+    Net<float> caffe_net(FLAGS_model, FLAGS_weights);
+    // Layer by layer, so that the inputs are seen before any in-place layer
+    // after them changes them.
+    const vector<shared_ptr<Layer<float> > >& layers = caffe_net.layers();
+    for (int i = 0; i < FLAGS_iterations; ++i) {
+      for (int j = 0; j < layers.size(); ++j) {
+        const caffe::LayerParameter_LayerType type =
+            layers[j]->layer_param().type();
+        if (type == caffe::LayerParameter_LayerType_INNER_PRODUCT ||
+            type == caffe::LayerParameter_LayerType_CONVOLUTION) {
+          std::pair<float, float>& range =
+              ranges[caffe_net.layer_names()[j]];
+          const vector<Blob<float>*>& bottom = caffe_net.bottom_vecs()[j];
+          for (int b = 0; b < bottom.size(); ++b) {
+            const float* data = bottom[b]->cpu_data();
+            for (int k = 0; k < bottom[b]->count(); ++k) {
+              range.first = std::min(range.first, data[k]);
+              range.second = std::max(range.second, data[k]);
+            }
+          }
+        }
+        caffe_net.ForwardFromTo(j, j);
+      }
+    }
+  }
+
+  caffe::NetParameter param;
+  caffe::ReadNetParamsFromTextFileOrDie(FLAGS_model, &param);
+  caffe::NetParameter quantized(param);
+  quantized.clear_layers();
+  for (int i = 0; i < param.layers_size(); ++i) {
+    caffe::LayerParameter* layer = quantized.add_layers();
+    layer->CopyFrom(param.layers(i));
+    if (!ranges.count(layer->name())) {
+      continue;
+    }
+    // Non-negative inputs use all of [0, 255], signed ones are centered on
+    // 128.
+    const std::pair<float, float>& range = ranges[layer->name()];
+    const bool is_signed = range.first < 0;
+    float scale = is_signed ?
+        std::max(-range.first, range.second) / 127 : range.second / 255;
+    if (!(scale > 0)) {
+      scale = 1;
+    }
+    caffe::QuantizationParameter* quantization_param =
+        layer->mutable_quantization_param();
+    quantization_param->set_input_scale(scale);
+    quantization_param->set_input_zero_point(is_signed ? 128 : 0);
+    if (layer->type() == caffe::LayerParameter_LayerType_CONVOLUTION) {
+      layer->mutable_convolution_param()->set_engine(
+          caffe::ConvolutionParameter_Engine_INT8);
+    } else {
+      layer->mutable_inner_product_param()->set_engine(
+          caffe::InnerProductParameter_Engine_INT8);
+    }
+    // An in-place ReLU right after the layer is folded into it.
+    if (i + 1 < param.layers_size() && layer->top_size() == 1) {
+      const caffe::LayerParameter& next = param.layers(i + 1);
+      if (next.type() == caffe::LayerParameter_LayerType_RELU &&
+          next.relu_param().negative_slope() == 0 &&
+          next.bottom_size() == 1 && next.top_size() == 1 &&
+          next.bottom(0) == layer->top(0) && next.top(0) == layer->top(0)) {
+        quantization_param->set_fuse_relu(true);
+        ++i;
+      }
+    }
+    LOG(INFO) << layer->name() << ": input range [" << range.first << ", "
+        << range.second << "], scale " << scale
+        << (quantization_param->fuse_relu() ? ", fused ReLU" : "");
+  }
+  caffe::WriteProtoToTextFile(quantized, FLAGS_quantized_model);
+  LOG(INFO) << "Wrote the quantized model to " << FLAGS_quantized_model;
+
+  // Both nets see the same batches.
+  vector<caffe::string> names;
+  vector<double> float_means, int8_means;
+  double float_ms, int8_ms;
+  {
+    Caffe::set_random_seed(FLAGS_random_seed);
+    Net<float> float_net(FLAGS_model, FLAGS_weights);
+    float_ms = float_net.MeanOutputs(FLAGS_iterations, &names, &float_means);
+  }
+  {
+    Caffe::set_random_seed(FLAGS_random_seed);
+    Net<float> int8_net(FLAGS_quantized_model, FLAGS_weights);
+    int8_ms = int8_net.MeanOutputs(FLAGS_iterations, &names, &int8_means);
+  }
+  for (int k = 0; k < float_means.size(); ++k) {
+    LOG(INFO) << names[k] << ": float " << float_means[k] << ", INT8 "
+        << int8_means[k] << " (delta "
+        << std::fabs(int8_means[k] - float_means[k]) << ")";
+  }
+  LOG(INFO) << "Forward time: float " << float_ms << " ms, INT8 " << int8_ms
+      << " ms per iteration (" << float_ms / int8_ms << "x).";
+  return 0;
+}
+RegisterBrewFunction(calibrate);
+
 // Predict: get the predicted score (eg. class probability).
 int predict() {
   CHECK_GT(FLAGS_model.size(), 0) << "Need a model definition to make prediction.";
@@ -223,8 +358,7 @@ int predict() {
   else
 	  Caffe::set_phase(Caffe::TEST);
   Caffe::set_random_seed(FLAGS_random_seed);
-  Net<float> caffe_net(FLAGS_model);
-  caffe_net.CopyTrainedLayersFrom(FLAGS_weights);
+  Net<float> caffe_net(FLAGS_model, FLAGS_weights);
   std::ofstream outfile(FLAGS_outfile);
   LOG(INFO) << "Running for " << FLAGS_iterations << " iterations.";
 
@@ -337,13 +471,29 @@ int main(int argc, char** argv) {
       "commands:\n"
       "  train           train or finetune a model\n"
       "  test            score a model\n"
+      "  calibrate       write an INT8 model and compare it with the float "
+      "one\n"
 	  "  predict         make prediction using a model\n"
       "  device_query    show GPU diagnostic information\n"
       "  time            benchmark model execution time");
   // Run tool or show usage.
   caffe::GlobalInit(&argc, &argv);
   if (argc == 2) {
-    return GetBrewFunction(caffe::string(argv[1]))();
+    if (FLAGS_blas.size()) {
+      caffe::caffe_set_blas_backend(
+          caffe::caffe_blas_backend_from_name(FLAGS_blas));
+    }
+    caffe::caffe_blas_set_profiling(FLAGS_blas_profile);
+    if (FLAGS_parallel_grain > 0) {
+      caffe::caffe_set_parallel_grain(FLAGS_parallel_grain);
+    }
+    caffe::caffe_set_deterministic_reductions(FLAGS_deterministic_reductions);
+    caffe::caffe_set_strict_math(FLAGS_strict_math);
+    const int result = GetBrewFunction(caffe::string(argv[1]))();
+    if (FLAGS_blas_profile) {
+      caffe::caffe_blas_log_stats();
+    }
+    return result;
   } else {
     gflags::ShowUsageWithFlagsRestrict(argv[0], "tools/caffe");
   }
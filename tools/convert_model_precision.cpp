@@ -0,0 +1,94 @@
+// This program stores the weights of a trained net at 16-bit precision
+// (FP16 or BF16) and reports what that costs: the net, whose data layers
+// should read a validation DB, runs the given number of iterations with the
+// original and then with the converted weights, and the mean of every output
+// (accuracy, loss, ...) is compared, as are the weights themselves.
+// Usage:
+//    convert_model_precision net_proto weights_in weights_out FP16|BF16
+//        iterations [CPU/GPU] [Device ID]
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "caffe/caffe.hpp"
+#include "caffe/util/io.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  if (argc < 6 || argc > 8) {
+    LOG(ERROR) << "Usage: convert_model_precision net_proto weights_in "
+        << "weights_out FP16|BF16 iterations [CPU/GPU] [Device ID]";
+    return 1;
+  }
+  BlobProto_DataType data_type;
+  if (!BlobProto_DataType_Parse(argv[4], &data_type)) {
+    LOG(ERROR) << "Unknown data type " << argv[4];
+    return 1;
+  }
+  const int iterations = atoi(argv[5]);
+
+  Caffe::set_phase(Caffe::TEST);
+  if (argc >= 7 && strcmp(argv[6], "GPU") == 0) {
+    Caffe::set_mode(Caffe::GPU);
+    const int device_id = argc == 8 ? atoi(argv[7]) : 0;
+    Caffe::SetDevice(device_id);
+    LOG(ERROR) << "Using GPU #" << device_id;
+  } else {
+    LOG(ERROR) << "Using CPU";
+    Caffe::set_mode(Caffe::CPU);
+  }
+
+  // Both runs draw the same random crops and mirrors. Only one net is alive
+  // at a time: both open the same data source, which LevelDB lets only one
+  // handle per process open.
+  const int kSeed = 1701;
+  vector<string> names;
+  vector<double> original_means, converted_means;
+  vector<shared_ptr<Blob<float> > > original_params;
+  {
+    Caffe::set_random_seed(kSeed);
+    Net<float> original(argv[1], argv[2]);
+    original.MeanOutputs(iterations, &names, &original_means);
+    for (int i = 0; i < original.params().size(); ++i) {
+      original_params.push_back(shared_ptr<Blob<float> >(new Blob<float>()));
+      original_params.back()->CopyFrom(*original.params()[i], false, true);
+    }
+
+    NetParameter net_param;
+    original.ToProto(&net_param, false, data_type);
+    WriteProtoToBinaryFile(net_param, argv[3]);
+    LOG(ERROR) << "Wrote " << argv[4] << " weights to " << argv[3];
+  }
+
+  double max_weight_delta = 0;
+  {
+    Caffe::set_random_seed(kSeed);
+    Net<float> converted(argv[1], argv[3]);
+    converted.MeanOutputs(iterations, &names, &converted_means);
+    for (int i = 0; i < original_params.size(); ++i) {
+      const Blob<float>& expected = *original_params[i];
+      const Blob<float>& actual = *converted.params()[i];
+      for (int j = 0; j < expected.count(); ++j) {
+        max_weight_delta = std::max(max_weight_delta,
+            std::fabs(double(expected.cpu_data()[j]) - actual.cpu_data()[j]));
+      }
+    }
+  }
+  double max_output_delta = 0;
+  for (int k = 0; k < original_means.size(); ++k) {
+    const double delta = std::fabs(converted_means[k] - original_means[k]);
+    LOG(ERROR) << names[k] << ": " << original_means[k] << " -> "
+        << converted_means[k] << " (delta " << delta << ")";
+    max_output_delta = std::max(max_output_delta, delta);
+  }
+  LOG(ERROR) << "Max weight delta: " << max_weight_delta;
+  LOG(ERROR) << "Max output delta over " << iterations << " iterations: "
+      << max_output_delta;
+  return 0;
+}
@@ -0,0 +1,35 @@
+// This program converts trained weights between a binary NetParameter
+// (.caffemodel) and the memory-mapped weights format (.caffemap). The
+// direction follows the input: a mapped weights file becomes a NetParameter
+// holding the layer names and blobs, anything else is parsed as a
+// NetParameter and written in the mapped format.
+// Usage:
+//    convert_weights weights_in weights_out
+
+#include "caffe/caffe.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/mapped_weights.hpp"
+#include "caffe/util/upgrade_proto.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  if (argc != 3) {
+    LOG(ERROR) << "Usage: convert_weights weights_in weights_out";
+    return 1;
+  }
+
+  NetParameter net_param;
+  if (MappedWeights::IsMappedWeightsFile(argv[1])) {
+    MappedWeights weights(argv[1]);
+    weights.ToProto(&net_param);
+    WriteProtoToBinaryFile(net_param, argv[2]);
+    LOG(ERROR) << "Wrote NetParameter binary proto to " << argv[2];
+  } else {
+    ReadNetParamsFromBinaryFileOrDie(argv[1], &net_param);
+    WriteMappedWeights(net_param, argv[2]);
+    LOG(ERROR) << "Wrote mapped weights to " << argv[2];
+  }
+  return 0;
+}
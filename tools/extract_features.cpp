@@ -88,8 +88,7 @@ int feature_extraction_pipeline(int argc, char** argv) {
    */
   string feature_extraction_proto(argv[++arg_pos]);
   boost::shared_ptr<Net<Dtype> > feature_extraction_net(
-      new Net<Dtype>(feature_extraction_proto));
-  feature_extraction_net->CopyTrainedLayersFrom(pretrained_binary_proto);
+      new Net<Dtype>(feature_extraction_proto, pretrained_binary_proto));
 
   string extract_feature_blob_name(argv[++arg_pos]);
   CHECK(feature_extraction_net->has_blob(extract_feature_blob_name))
@@ -0,0 +1,357 @@
+// This program replaces chosen layers of a trained net by two cheaper layers
+// of the existing types, computed from the trained weights:
+//   an INNER_PRODUCT layer by a rank r INNER_PRODUCT and an INNER_PRODUCT on
+//     top of it (SVD of the weights),
+//   a CONVOLUTION layer by r filters of the same size and a 1x1 convolution
+//     (channel low-rank), or with :spatial by a k_h x 1 convolution with r
+//     outputs and a 1 x k_w one (spatially separable).
+// The second layer of each pair keeps the name and top of the original, the
+// first is named <name>_low_rank. It writes the rewritten net and its weights,
+// which `caffe train --weights` can fine-tune, and reports the multiply-adds
+// per image and the relative error of each factorization. The net, whose data
+// layers should read a validation DB, then runs the given number of
+// iterations before and after, and the mean of every output (accuracy, loss,
+// ...) is compared.
+// Usage:
+//    factorize_model net_proto weights_in net_out weights_out
+//        layer:rank[:spatial][,layer:rank[:spatial]...] iterations
+//        [CPU/GPU] [Device ID]
+
+#include <boost/algorithm/string.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "caffe/caffe.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/low_rank.hpp"
+#include "caffe/util/upgrade_proto.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+struct Factorization {
+  int rank;
+  bool spatial;
+};
+
+// The multiply-adds per image of the convolution and inner product layers of
+// net, by layer name.
+static map<string, double> LayerMacs(Net<float>* net) {
+  map<string, double> macs;
+  for (int i = 0; i < net->layers().size(); ++i) {
+    const LayerParameter_LayerType type = net->layers()[i]->type();
+    if (type != LayerParameter_LayerType_CONVOLUTION &&
+        type != LayerParameter_LayerType_INNER_PRODUCT) {
+      continue;
+    }
+    const Blob<float>& top = *net->top_vecs()[i][0];
+    const Blob<float>& weights = *net->layers()[i]->blobs()[0];
+    macs[net->layer_names()[i]] = double(top.count()) / top.num() *
+        weights.count() / top.channels();
+  }
+  return macs;
+}
+
+// Sets the kernel, pad and stride of param as height, width pairs.
+static void SetGeometry(ConvolutionParameter* param, const int kernel_h,
+    const int kernel_w, const int pad_h, const int pad_w, const int stride_h,
+    const int stride_w) {
+  param->clear_kernel_size();
+  param->clear_pad();
+  param->clear_stride();
+  param->set_kernel_h(kernel_h);
+  param->set_kernel_w(kernel_w);
+  param->set_pad_h(pad_h);
+  param->set_pad_w(pad_w);
+  param->set_stride_h(stride_h);
+  param->set_stride_w(stride_w);
+  // The Winograd layers only take 3x3 kernels.
+  if (param->engine() == ConvolutionParameter_Engine_WINOGRAD) {
+    param->clear_engine();
+  }
+}
+
+// Fills first and second, the two layers replacing layer, and their weights
+// from the trained blobs of layer. Returns the relative Frobenius error of
+// the factorization.
+static double Factorize(const LayerParameter& layer,
+    const vector<shared_ptr<Blob<float> > >& blobs, const Factorization& f,
+    LayerParameter* first, LayerParameter* second) {
+  CHECK_EQ(layer.param_size(), 0)
+      << "Layer " << layer.name() << " shares its parameters.";
+  const string first_name = layer.name() + "_low_rank";
+  *first = layer;
+  first->set_name(first_name);
+  first->clear_top();
+  first->add_top(first_name);
+  first->clear_blobs();
+  // The first layer has only weights.
+  if (layer.blobs_lr_size() > 1) {
+    first->clear_blobs_lr();
+    first->add_blobs_lr(layer.blobs_lr(0));
+  }
+  if (layer.weight_decay_size() > 1) {
+    first->clear_weight_decay();
+    first->add_weight_decay(layer.weight_decay(0));
+  }
+  *second = layer;
+  second->clear_bottom();
+  second->add_bottom(first_name);
+  second->clear_blobs();
+
+  const Blob<float>& weights = *blobs[0];
+  const int r = f.rank;
+  int rows, cols;
+  vector<float> matrix;
+  Blob<float> first_weights, second_weights;
+  if (layer.type() == LayerParameter_LayerType_INNER_PRODUCT) {
+    CHECK(!f.spatial) << "Only convolutions have a spatial factorization.";
+    CHECK_EQ(layer.bottom_size(), 1) << "Layer " << layer.name()
+        << " has a sparse input, whose weights are transposed.";
+    rows = layer.inner_product_param().num_output();
+    cols = weights.count() / rows;
+    matrix.assign(weights.cpu_data(), weights.cpu_data() + weights.count());
+    first->mutable_inner_product_param()->set_num_output(r);
+    first->mutable_inner_product_param()->set_bias_term(false);
+    first->mutable_inner_product_param()->clear_bias_filler();
+    first_weights.Reshape(1, 1, r, cols);
+    second_weights.Reshape(1, 1, rows, r);
+  } else {
+    CHECK_EQ(layer.type(), LayerParameter_LayerType_CONVOLUTION)
+        << "Layer " << layer.name() << " is neither a convolution nor an "
+        << "inner product.";
+    const ConvolutionParameter& conv = layer.convolution_param();
+    CHECK_EQ(conv.group(), 1) << "Grouped convolutions are not supported.";
+    const int M = weights.num();
+    const int C = weights.channels();
+    const int kh = weights.height();
+    const int kw = weights.width();
+    const int pad_h = conv.has_pad_h() ? conv.pad_h() : conv.pad();
+    const int pad_w = conv.has_pad_w() ? conv.pad_w() : conv.pad();
+    const int stride_h = conv.has_stride_h() ? conv.stride_h() : conv.stride();
+    const int stride_w = conv.has_stride_w() ? conv.stride_w() : conv.stride();
+    ConvolutionParameter* first_conv = first->mutable_convolution_param();
+    ConvolutionParameter* second_conv = second->mutable_convolution_param();
+    first_conv->set_num_output(r);
+    first_conv->set_bias_term(false);
+    first_conv->clear_bias_filler();
+    if (f.spatial) {
+      // W[m][c][i][j] as the (C * kh) x (M * kw) matrix of rows (c, i) and
+      // columns (m, j): its factors are the vertical filters over (c, i)
+      // and the horizontal ones over (m, j).
+      rows = C * kh;
+      cols = M * kw;
+      matrix.resize(rows * cols);
+      const float* w = weights.cpu_data();
+      for (int m = 0; m < M; ++m) {
+        for (int c = 0; c < C; ++c) {
+          for (int i = 0; i < kh; ++i) {
+            for (int j = 0; j < kw; ++j) {
+              matrix[(c * kh + i) * cols + m * kw + j] =
+                  w[((m * C + c) * kh + i) * kw + j];
+            }
+          }
+        }
+      }
+      SetGeometry(first_conv, kh, 1, pad_h, 0, stride_h, 1);
+      SetGeometry(second_conv, 1, kw, 0, pad_w, 1, stride_w);
+      first_weights.Reshape(r, C, kh, 1);
+      second_weights.Reshape(M, r, 1, kw);
+    } else {
+      rows = M;
+      cols = C * kh * kw;
+      matrix.assign(weights.cpu_data(), weights.cpu_data() + weights.count());
+      SetGeometry(second_conv, 1, 1, 0, 0, 1, 1);
+      first_weights.Reshape(r, C, kh, kw);
+      second_weights.Reshape(M, r, 1, 1);
+    }
+  }
+  CHECK_LE(r, std::min(rows, cols)) << "Layer " << layer.name()
+      << " has rank at most " << std::min(rows, cols) << ".";
+
+  vector<float> u(rows * r), v(r * cols);
+  caffe_cpu_low_rank(rows, cols, &matrix[0], r, &u[0], &v[0]);
+  double error = 0, norm = 0;
+  for (int i = 0; i < rows; ++i) {
+    for (int j = 0; j < cols; ++j) {
+      double product = 0;
+      for (int k = 0; k < r; ++k) {
+        product += double(u[i * r + k]) * v[k * cols + j];
+      }
+      const double a = matrix[i * cols + j];
+      error += (a - product) * (a - product);
+      norm += a * a;
+    }
+  }
+
+  float* first_data = first_weights.mutable_cpu_data();
+  float* second_data = second_weights.mutable_cpu_data();
+  if (f.spatial) {
+    // u is (c, i) x k and v is k x (m, j).
+    const int M = second_weights.num();
+    const int kw = second_weights.width();
+    for (int row = 0; row < rows; ++row) {
+      for (int k = 0; k < r; ++k) {
+        first_data[k * rows + row] = u[row * r + k];
+      }
+    }
+    for (int k = 0; k < r; ++k) {
+      for (int m = 0; m < M; ++m) {
+        for (int j = 0; j < kw; ++j) {
+          second_data[(m * r + k) * kw + j] = v[k * cols + m * kw + j];
+        }
+      }
+    }
+  } else {
+    // W ~= u v: the first layer computes v x, the second u (v x).
+    caffe_copy(r * cols, &v[0], first_data);
+    caffe_copy(rows * r, &u[0], second_data);
+  }
+  first_weights.ToProto(first->add_blobs());
+  second_weights.ToProto(second->add_blobs());
+  for (int i = 1; i < blobs.size(); ++i) {
+    blobs[i]->ToProto(second->add_blobs());
+  }
+  return norm > 0 ? std::sqrt(error / norm) : 0;
+}
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  if (argc < 7 || argc > 9) {
+    LOG(ERROR) << "Usage: factorize_model net_proto weights_in net_out "
+        << "weights_out layer:rank[:spatial][,...] iterations [CPU/GPU] "
+        << "[Device ID]";
+    return 1;
+  }
+  map<string, Factorization> factorizations;
+  vector<string> specs;
+  boost::split(specs, argv[5], boost::is_any_of(","));
+  for (int i = 0; i < specs.size(); ++i) {
+    vector<string> fields;
+    boost::split(fields, specs[i], boost::is_any_of(":"));
+    CHECK(fields.size() == 2 || (fields.size() == 3 && fields[2] == "spatial"))
+        << "Expected layer:rank[:spatial], not " << specs[i];
+    Factorization f;
+    f.rank = atoi(fields[1].c_str());
+    f.spatial = fields.size() == 3;
+    CHECK_GT(f.rank, 0) << "Bad rank in " << specs[i];
+    factorizations[fields[0]] = f;
+  }
+  const int iterations = atoi(argv[6]);
+
+  Caffe::set_phase(Caffe::TEST);
+  if (argc >= 8 && strcmp(argv[7], "GPU") == 0) {
+    Caffe::set_mode(Caffe::GPU);
+    const int device_id = argc == 9 ? atoi(argv[8]) : 0;
+    Caffe::SetDevice(device_id);
+    LOG(ERROR) << "Using GPU #" << device_id;
+  } else {
+    LOG(ERROR) << "Using CPU";
+    Caffe::set_mode(Caffe::CPU);
+  }
+
+  // Only one net is alive at a time: both open the same data source, which
+  // LevelDB lets only one handle per process open. Each scoring net is
+  // seeded right before it is built, so that both draw the same random crops
+  // and mirrors whatever the factorizations drew from the RNG in between.
+  const int kSeed = 1701;
+  NetParameter net_param;
+  ReadNetParamsFromTextFileOrDie(argv[1], &net_param);
+  NetParameter factorized_param(net_param);
+  factorized_param.clear_layers();
+  NetParameter factorized_weights;
+  map<string, double> errors;
+  map<string, double> original_macs;
+  vector<string> names;
+  vector<double> original_means, factorized_means;
+  double original_ms, factorized_ms;
+  {
+    Caffe::set_random_seed(kSeed);
+    Net<float> original(net_param);
+    original.CopyTrainedLayersFrom(string(argv[2]));
+    original_ms = original.MeanOutputs(iterations, &names, &original_means);
+    original_macs = LayerMacs(&original);
+
+    NetParameter weights_param;
+    original.ToProto(&weights_param, false);
+    factorized_weights.set_name(weights_param.name());
+    for (int i = 0; i < weights_param.layers_size(); ++i) {
+      if (!factorizations.count(weights_param.layers(i).name())) {
+        *factorized_weights.add_layers() = weights_param.layers(i);
+      }
+    }
+    for (int i = 0; i < net_param.layers_size(); ++i) {
+      const LayerParameter& layer = net_param.layers(i);
+      map<string, Factorization>::const_iterator it =
+          factorizations.find(layer.name());
+      if (it == factorizations.end()) {
+        *factorized_param.add_layers() = layer;
+        continue;
+      }
+      CHECK(original.has_layer(layer.name()))
+          << "Layer " << layer.name() << " is not in the TEST net.";
+      LayerParameter first, second;
+      errors[layer.name()] = Factorize(layer,
+          original.layer_by_name(layer.name())->blobs(), it->second, &first,
+          &second);
+      *factorized_weights.add_layers() = first;
+      *factorized_weights.add_layers() = second;
+      first.clear_blobs();
+      second.clear_blobs();
+      *factorized_param.add_layers() = first;
+      *factorized_param.add_layers() = second;
+    }
+    CHECK_EQ(errors.size(), factorizations.size())
+        << "Not all of the layers to factorize are in " << argv[1];
+  }
+
+  map<string, double> factorized_macs;
+  {
+    Caffe::set_random_seed(kSeed);
+    Net<float> factorized(factorized_param, factorized_weights);
+    WriteProtoToTextFile(factorized_param, argv[3]);
+    NetParameter trained;
+    factorized.ToProto(&trained, false);
+    WriteProtoToBinaryFile(trained, argv[4]);
+    LOG(ERROR) << "Wrote " << argv[3] << " and " << argv[4];
+    factorized_macs = LayerMacs(&factorized);
+    factorized_ms =
+        factorized.MeanOutputs(iterations, &names, &factorized_means);
+  }
+
+  double total_before = 0, total_after = 0;
+  for (map<string, double>::const_iterator it = original_macs.begin();
+      it != original_macs.end(); ++it) {
+    total_before += it->second;
+  }
+  for (map<string, double>::const_iterator it = factorized_macs.begin();
+      it != factorized_macs.end(); ++it) {
+    total_after += it->second;
+  }
+  for (map<string, double>::const_iterator it = errors.begin();
+      it != errors.end(); ++it) {
+    const double before = original_macs.find(it->first)->second;
+    const double after = factorized_macs.find(it->first)->second +
+        factorized_macs.find(it->first + "_low_rank")->second;
+    LOG(ERROR) << it->first << " rank " << factorizations[it->first].rank
+        << (factorizations[it->first].spatial ? " (spatial)" : "")
+        << ": " << before << " -> " << after << " multiply-adds per image ("
+        << before / after << "x), relative error " << it->second;
+  }
+  LOG(ERROR) << "Net: " << total_before << " -> " << total_after
+      << " multiply-adds per image (" << total_before / total_after << "x)";
+
+  for (int k = 0; k < original_means.size(); ++k) {
+    LOG(ERROR) << names[k] << ": " << original_means[k] << " -> "
+        << factorized_means[k] << " (delta "
+        << std::fabs(factorized_means[k] - original_means[k]) << ")";
+  }
+  LOG(ERROR) << "Forward: " << original_ms << " -> " << factorized_ms
+      << " ms per iteration over " << iterations << " iterations";
+  return 0;
+}
@@ -22,10 +22,10 @@ int main(int argc, char** argv) {
   SolverParameter solver_param;
   ReadProtoFromTextFileOrDie(argv[1], &solver_param);
 
+  LOG(INFO) << "Loading from " << argv[2];
+  solver_param.set_weights(argv[2]);
   LOG(INFO) << "Starting Optimization";
   SGDSolver<float> solver(solver_param);
-  LOG(INFO) << "Loading from " << argv[2];
-  solver.net()->CopyTrainedLayersFrom(string(argv[2]));
   solver.Solve();
   LOG(INFO) << "Optimization Done.";
 
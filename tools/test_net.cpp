@@ -38,8 +38,7 @@ int main(int argc, char** argv) {
     Caffe::set_mode(Caffe::CPU);
   }
 
-  Net<float> caffe_test_net(argv[1]);
-  caffe_test_net.CopyTrainedLayersFrom(argv[2]);
+  Net<float> caffe_test_net(argv[1], argv[2]);
 
   int total_iter = atoi(argv[3]);
   LOG(ERROR) << "Running " << total_iter << " iterations.";